@@ -0,0 +1,111 @@
+// bench_culling - frustum culling throughput (objects per second)
+#include "culling.h"
+#include "jobs.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <thread>
+#include <vector>
+
+namespace {
+
+// Column-major perspective * look-along -Z view, Vulkan clip space (z in [0,1], y down).
+void makeViewProjection(float fovyRadians, float aspect, float zNear, float zFar, float out[16]) {
+  const float f = 1.0f / std::tan(fovyRadians * 0.5f);
+  for (int i = 0; i < 16; ++i) out[i] = 0.0f;
+  out[0] = f / aspect;
+  out[5] = -f;
+  out[10] = zFar / (zNear - zFar);
+  out[11] = -1.0f;
+  out[14] = (zNear * zFar) / (zNear - zFar);
+}
+
+template <typename Fn>
+double medianMs(int iterations, Fn&& fn) {
+  std::vector<double> samples;
+  samples.reserve(iterations);
+  for (int i = 0; i < iterations; ++i) {
+    auto t0 = std::chrono::steady_clock::now();
+    fn();
+    auto t1 = std::chrono::steady_clock::now();
+    samples.push_back(std::chrono::duration<double, std::milli>(t1 - t0).count());
+  }
+  std::sort(samples.begin(), samples.end());
+  return samples[samples.size() / 2];
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  size_t objectCount = 1000000;
+  int iterations = 50;
+  if (argc > 1) objectCount = static_cast<size_t>(std::strtoull(argv[1], nullptr, 10));
+  if (argc > 2) iterations = std::max(1, std::atoi(argv[2]));
+
+  std::mt19937 rng(1234);
+  std::uniform_real_distribution<float> pos(-500.0f, 500.0f);
+  std::uniform_real_distribution<float> rad(0.5f, 4.0f);
+  vklite::SphereBounds spheres;
+  vklite::AabbBounds boxes;
+  spheres.reserve(objectCount);
+  boxes.reserve(objectCount);
+  for (size_t i = 0; i < objectCount; ++i) {
+    float x = pos(rng), y = pos(rng), z = pos(rng), r = rad(rng);
+    spheres.add(x, y, z, r);
+    float mn[3] = { x - r, y - r, z - r };
+    float mx[3] = { x + r, y + r, z + r };
+    boxes.add(mn, mx);
+  }
+
+  float viewProj[16];
+  makeViewProjection(1.0f, 16.0f / 9.0f, 0.1f, 400.0f, viewProj);
+  const vklite::Frustum frustum = vklite::Frustum::fromViewProjection(viewProj);
+
+  const uint32_t hw = std::max(1u, std::thread::hardware_concurrency());
+  std::vector<uint32_t> threadCounts = { 1 };
+  for (uint32_t t = 2; t < hw; t *= 2) threadCounts.push_back(t);
+  if (hw > 1) threadCounts.push_back(hw);
+
+  // One pool for every run; a run with N threads splits into N chunks, so
+  // N - 1 workers join the calling thread
+  vklite::JobSettings jobSettings;
+  jobSettings.workerCount = std::max(1u, hw - 1);
+  vklite::JobSystem jobs(jobSettings);
+
+  std::cout << "bench_culling: " << objectCount << " objects, " << iterations << " iterations, "
+            << "auto kernel = " << vklite::cullKernelName(vklite::resolveCullKernel(vklite::CullKernel::Auto)) << "\n";
+
+  std::vector<uint32_t> visible;
+  size_t referenceSpheres = 0, referenceBoxes = 0;
+  const vklite::CullKernel kernels[] = { vklite::CullKernel::Scalar, vklite::CullKernel::SSE, vklite::CullKernel::AVX2 };
+  for (vklite::CullKernel requested : kernels) {
+    vklite::CullKernel kernel = vklite::resolveCullKernel(requested);
+    if (kernel != requested) continue; // not supported on this CPU / build
+    for (uint32_t threads : threadCounts) {
+      vklite::CullOptions opts;
+      opts.kernel = kernel;
+      opts.jobs = threads > 1 ? &jobs : nullptr;
+      opts.threadCount = threads;
+
+      size_t n = 0;
+      double sphereMs = medianMs(iterations, [&]() { n = vklite::cullSpheres(frustum, spheres, visible, opts); });
+      if (referenceSpheres == 0) referenceSpheres = n;
+      bool sphereOk = n == referenceSpheres;
+
+      double boxMs = medianMs(iterations, [&]() { n = vklite::cullAabbs(frustum, boxes, visible, opts); });
+      if (referenceBoxes == 0) referenceBoxes = n;
+      bool boxOk = n == referenceBoxes;
+
+      std::cout << "  " << vklite::cullKernelName(kernel) << " x" << threads
+                << "  spheres: " << sphereMs << " ms (" << (objectCount / sphereMs) / 1000.0 << " Mobj/s, visible " << referenceSpheres << (sphereOk ? "" : " MISMATCH") << ")"
+                << "  aabbs: " << boxMs << " ms (" << (objectCount / boxMs) / 1000.0 << " Mobj/s, visible " << referenceBoxes << (boxOk ? "" : " MISMATCH") << ")\n";
+    }
+  }
+  const vklite::JobSystem::Stats stats = jobs.stats();
+  std::cout << "  jobs: " << stats.workers << " workers, " << stats.executed << " executed, " << stats.stolen << " stolen, "
+            << stats.helped << " run by the calling thread\n";
+  return 0;
+}
@@ -0,0 +1,121 @@
+// bench_windows - main loop cost with many windows, most of them in the background
+#include "vklite.h"
+#include <GLFW/glfw3.h>
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace {
+
+// Cap for the background windows of the unfocused run
+constexpr double kUnfocusedMaxFps = 10.0;
+
+enum class Background {
+  None,       // every window visible and rendering
+  Hidden,     // all but `foreground` windows hidden or iconified
+  Unfocused,  // all visible; only the focused one renders at full rate
+};
+
+struct Result {
+  double seconds = 0.0;
+  uint64_t iterations = 0;
+  uint64_t foregroundFrames = 0;
+  uint64_t backgroundFrames = 0;
+  uint64_t skipped = 0;
+};
+
+const char* backgroundName(Background b) {
+  switch (b) {
+    case Background::None: return "all visible";
+    case Background::Hidden: return "hidden/iconified";
+    case Background::Unfocused: return "unfocused";
+  }
+  return "?";
+}
+
+bool run(vklite::Context& ctx, int windowCount, int foreground, Background background, double seconds, Result& result) {
+  std::vector<vklite::Window*> windows;
+  for (int i = 0; i < windowCount; ++i) {
+    vklite::Window* w = ctx.createWindow(240, 160, "bench_windows " + std::to_string(i));
+    if (!w) {
+      std::cerr << "bench_windows: failed to create window " << i << "\n";
+      for (vklite::Window* c : windows) glfwSetWindowShouldClose(static_cast<GLFWwindow*>(c->handle), GLFW_TRUE);
+      ctx.runMainLoop();
+      return false;
+    }
+    windows.push_back(w);
+  }
+  // Only the unfocused run caps background windows; focus follows the
+  // desktop, so it is forced to keep the runs reproducible
+  const double unfocusedMaxFps = ctx.unfocusedMaxFps;
+  ctx.unfocusedMaxFps = background == Background::Unfocused ? kUnfocusedMaxFps : 0.0;
+  for (int i = 0; i < windowCount; ++i) windows[i]->focused = background != Background::Unfocused || i < foreground;
+  for (int i = foreground; i < windowCount; ++i) {
+    vklite::Window* w = windows[i];
+    if (background == Background::Hidden) {
+      // Half hidden, half minimized: the two ways a console hides a view
+      if (i % 2) {
+        ctx.setWindowVisible(w, false);
+      } else {
+        glfwIconifyWindow(static_cast<GLFWwindow*>(w->handle));
+      }
+    }
+  }
+
+  result = Result{};
+  const double start = glfwGetTime();
+  ctx.updateCallback = [&] {
+    if (result.seconds > 0.0) return;  // closing
+    ++result.iterations;
+    if (glfwGetTime() - start < seconds) return;
+    result.seconds = glfwGetTime() - start;
+    for (int i = 0; i < windowCount; ++i) {
+      vklite::Window* w = windows[i];
+      (i < foreground ? result.foregroundFrames : result.backgroundFrames) += w->framesRendered;
+      result.skipped += w->framesSkipped;
+      glfwSetWindowShouldClose(static_cast<GLFWwindow*>(w->handle), GLFW_TRUE);
+    }
+  };
+  ctx.runMainLoop();
+  ctx.updateCallback = nullptr;
+  ctx.unfocusedMaxFps = unfocusedMaxFps;
+  return result.seconds > 0.0;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  int windowCount = 24;
+  int foreground = 2;
+  double seconds = 3.0;
+  if (argc > 1) windowCount = std::max(1, std::atoi(argv[1]));
+  if (argc > 2) foreground = std::clamp(std::atoi(argv[2]), 1, windowCount);
+  if (argc > 3) seconds = std::max(0.5, std::atof(argv[3]));
+
+  vklite::Context ctx;
+  ctx.validation_enabled = false;
+  if (!ctx.initialize("bench_windows")) {
+    std::cerr << "bench_windows: failed to initialize vklite\n";
+    return 1;
+  }
+  // Uncapped and continuous, so the numbers show what the loop can sustain
+  ctx.renderMode = vklite::RenderMode::Continuous;
+
+  std::cout << "bench_windows: " << windowCount << " windows, " << foreground << " in the foreground, " << seconds << " s per run\n";
+  const Background runs[] = { Background::None, Background::Hidden, Background::Unfocused };
+  for (Background background : runs) {
+    Result r;
+    if (!run(ctx, windowCount, foreground, background, seconds, r)) {
+      ctx.shutdown();
+      return 1;
+    }
+    std::cout << "  " << backgroundName(background) << ": " << r.iterations / r.seconds << " loop iterations/s, "
+              << r.foregroundFrames / r.seconds / foreground << " fps per foreground window, "
+              << (windowCount > foreground ? r.backgroundFrames / r.seconds / (windowCount - foreground) : 0.0)
+              << " fps per background window, " << r.skipped << " frames skipped\n";
+  }
+  ctx.shutdown();
+  return 0;
+}
@@ -0,0 +1,7 @@
+#version 450
+// Full-screen triangle vertex shader (no vertex buffers)
+void main() {
+  // Positions that form a full-screen triangle that covers the viewport
+  vec2 positions[3] = vec2[](vec2(-1.0, -1.0), vec2(3.0, -1.0), vec2(-1.0, 3.0));
+  gl_Position = vec4(positions[gl_VertexIndex], 0.0, 1.0);
+}
@@ -1,7 +1,10 @@
 #include "vklite.h"
+#include "triangle.vert.spv.h"
+#include "triangle.frag.spv.h"
 #include <iostream>
+#include <string>
 
-int main() {
+int main(int argc, char** argv) {
   vklite::Context ctx;
   if (!ctx.initialize("sandbox")) {
     std::cerr << "Failed to initialize vklite\n";
@@ -17,26 +20,31 @@ int main() {
     return 1;
   }
 
-  // Create a pipeline from GLSL source strings at runtime (triangle only)
-  // Full-screen triangle vertex shader (no vertex buffers)
-  const std::string triVert = R"GLSL(#version 450
-void main() {
-  // Positions that form a full-screen triangle that covers the viewport
-  vec2 positions[3] = vec2[](vec2(-1.0, -1.0), vec2(3.0, -1.0), vec2(-1.0, 3.0));
-  gl_Position = vec4(positions[gl_VertexIndex], 0.0, 1.0);
-})GLSL";
-  const std::string triFrag = R"GLSL(#version 450
-layout(location = 0) out vec4 outColor;
-void main() { outColor = vec4(1.0, 0.0, 0.0, 1.0); }
-)GLSL";
+  // Create a pipeline from SPIR-V compiled at build time (triangle only,
+  // see shaders/triangle.vert and shaders/triangle.frag), or from their GLSL
+  // when no compiler was found then
   // Create pipeline using the swapchain's color format
   VkFormat colorFmt = (win1 && win1->swapchainFormat != VK_FORMAT_UNDEFINED) ? win1->swapchainFormat : VK_FORMAT_B8G8R8A8_SRGB;
-  auto* triPipeline = ctx.createPipelineFromGlsl(triVert, triFrag, 3, colorFmt);
+#if defined(VKLITE_EMBEDDED_GLSL)
+  auto* triPipeline = ctx.createPipelineFromGlsl(shaders::triangle_vert_glsl, shaders::triangle_frag_glsl, 3, colorFmt);
+#else
+  auto* triPipeline = ctx.createPipelineFromSpirv(shaders::triangle_vert, shaders::triangle_frag, 3, colorFmt);
+#endif
   if (triPipeline) {
     win1->pipeline = triPipeline;
     std::cout << "Triangle pipeline created successfully.\n";
   } else {
-    std::cout << "Failed to create triangle pipeline. Check shader compiler output above.\n";
+    std::cout << "Failed to create triangle pipeline.\n";
+  }
+
+  // Static content: only redraw on input, resize or expose
+  ctx.renderMode = vklite::RenderMode::OnDemand;
+  // --render-thread: keep GLFW events on this thread and render on another
+  // --check-allocations: abort on a steady-state frame that allocates
+  // (needs a VKLITE_COUNT_ALLOCATIONS build)
+  for (int i = 1; i < argc; ++i) {
+    if (std::string(argv[i]) == "--render-thread") ctx.threadingMode = vklite::ThreadingMode::RenderThread;
+    if (std::string(argv[i]) == "--check-allocations") ctx.failOnFrameAllocations = true;
   }
 
   std::cout << " ctx.windows=" << ctx.getWindows().size() << "\n";
@@ -0,0 +1,87 @@
+# vklite_add_shaders(<target> [NAMESPACE <ns>] [RUNTIME_FALLBACK] SOURCES <files...>)
+#
+# Compiles GLSL files to SPIR-V at build time (the stage comes from the file
+# extension: .vert, .frag, .comp, ...) and embeds each result as a constexpr
+# array in a generated header, so no shader compiler is needed at runtime.
+# The SPIR-V targets Vulkan 1.2, the oldest device version vklite accepts.
+# For triangle.vert this generates triangle.vert.spv.h containing
+#
+#   namespace <ns> { inline constexpr uint32_t triangle_vert[] = { ... }; }
+#
+# The header directory is added to the target's include path; pass the arrays
+# to Context::createPipelineFromSpirv. NAMESPACE defaults to "shaders".
+#
+# Without glslangValidator or glslc this is a configure error, unless
+# RUNTIME_FALLBACK is given: then the header holds the GLSL source instead
+# (`<ns>::triangle_vert_glsl`), VKLITE_EMBEDDED_GLSL is defined for the
+# target and the target compiles the source at runtime
+# (Context::compileGlslToSpirv).
+
+find_program(VKLITE_GLSLANG_VALIDATOR NAMES glslangValidator
+    HINTS "$ENV{VULKAN_SDK}/bin" "$ENV{VULKAN_SDK}/Bin")
+find_program(VKLITE_GLSLC NAMES glslc
+    HINTS "$ENV{VULKAN_SDK}/bin" "$ENV{VULKAN_SDK}/Bin")
+# Called from other directories, so remember where the embed script lives
+set(VKLITE_EMBED_SPIRV_SCRIPT "${CMAKE_CURRENT_LIST_DIR}/embed_spirv.cmake" CACHE INTERNAL "")
+set(VKLITE_EMBED_GLSL_SCRIPT "${CMAKE_CURRENT_LIST_DIR}/embed_glsl.cmake" CACHE INTERNAL "")
+
+function(vklite_add_shaders target)
+    cmake_parse_arguments(ARG "RUNTIME_FALLBACK" "NAMESPACE" "SOURCES" ${ARGN})
+    if(NOT ARG_NAMESPACE)
+        set(ARG_NAMESPACE shaders)
+    endif()
+    set(_embed_glsl OFF)
+    if(NOT VKLITE_GLSLANG_VALIDATOR AND NOT VKLITE_GLSLC)
+        if(NOT ARG_RUNTIME_FALLBACK)
+            message(FATAL_ERROR "vklite_add_shaders: neither glslangValidator nor glslc was found; install the Vulkan SDK or shaderc.")
+        endif()
+        message(WARNING "vklite_add_shaders(${target}): neither glslangValidator nor glslc was found; "
+                        "embedding GLSL to compile at runtime instead. Install the Vulkan SDK or shaderc to embed SPIR-V.")
+        set(_embed_glsl ON)
+    endif()
+
+    set(_out_dir "${CMAKE_CURRENT_BINARY_DIR}/shaders")
+    set(_headers)
+    foreach(_src IN LISTS ARG_SOURCES)
+        get_filename_component(_abs "${_src}" ABSOLUTE)
+        get_filename_component(_name "${_src}" NAME)
+        string(MAKE_C_IDENTIFIER "${_name}" _ident)
+        set(_spv "${_out_dir}/${_name}.spv")
+        set(_header "${_out_dir}/${_name}.spv.h")
+        if(_embed_glsl)
+            add_custom_command(
+                OUTPUT "${_header}"
+                COMMAND ${CMAKE_COMMAND} -E make_directory "${_out_dir}"
+                COMMAND ${CMAKE_COMMAND} -DGLSL=${_abs} -DHEADER=${_header} -DNAME=${_ident}
+                        -DNAMESPACE=${ARG_NAMESPACE} -DSOURCE=${_name} -P "${VKLITE_EMBED_GLSL_SCRIPT}"
+                DEPENDS "${_abs}" "${VKLITE_EMBED_GLSL_SCRIPT}"
+                COMMENT "Embedding shader source ${_name}"
+                VERBATIM
+            )
+            list(APPEND _headers "${_header}")
+            continue()
+        endif()
+        if(VKLITE_GLSLANG_VALIDATOR)
+            set(_compile "${VKLITE_GLSLANG_VALIDATOR}" -V --target-env vulkan1.2 "${_abs}" -o "${_spv}")
+        else()
+            set(_compile "${VKLITE_GLSLC}" --target-env=vulkan1.2 "${_abs}" -o "${_spv}")
+        endif()
+        add_custom_command(
+            OUTPUT "${_header}"
+            COMMAND ${CMAKE_COMMAND} -E make_directory "${_out_dir}"
+            COMMAND ${_compile}
+            COMMAND ${CMAKE_COMMAND} -DSPV=${_spv} -DHEADER=${_header} -DNAME=${_ident}
+                    -DNAMESPACE=${ARG_NAMESPACE} -DSOURCE=${_name} -P "${VKLITE_EMBED_SPIRV_SCRIPT}"
+            DEPENDS "${_abs}" "${VKLITE_EMBED_SPIRV_SCRIPT}"
+            COMMENT "Compiling shader ${_name}"
+            VERBATIM
+        )
+        list(APPEND _headers "${_header}")
+    endforeach()
+
+    target_sources(${target} PRIVATE ${_headers})
+    target_include_directories(${target} PRIVATE "${_out_dir}")
+    if(_embed_glsl)
+        target_compile_definitions(${target} PRIVATE VKLITE_EMBEDDED_GLSL=1)
+    endif()
+endfunction()
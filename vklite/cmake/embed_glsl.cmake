@@ -0,0 +1,19 @@
+# Writes a GLSL source as a constexpr string for compilation at runtime, when
+# no compiler was found at build time (see VkliteShaders.cmake).
+# Usage: cmake -DGLSL=<in.comp> -DHEADER=<out.h> -DNAME=<ident> -DNAMESPACE=<ns> -DSOURCE=<file> -P embed_glsl.cmake
+
+file(READ "${GLSL}" _source)
+if(_source MATCHES "\\)vklite_glsl\"")
+    message(FATAL_ERROR "embed_glsl: ${GLSL} contains the raw string delimiter )vklite_glsl\"")
+endif()
+
+file(WRITE "${HEADER}"
+"// Generated by vklite_add_shaders from ${SOURCE}; do not edit.
+// No GLSL compiler was found at build time: the source is embedded and
+// compiled at runtime (VKLITE_EMBEDDED_GLSL).
+#pragma once
+
+namespace ${NAMESPACE} {
+inline constexpr char ${NAME}_glsl[] = R\"vklite_glsl(${_source})vklite_glsl\";
+} // namespace ${NAMESPACE}
+")
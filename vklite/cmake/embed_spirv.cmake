@@ -0,0 +1,29 @@
+# Writes a SPIR-V binary as a constexpr uint32_t array (see VkliteShaders.cmake).
+# Usage: cmake -DSPV=<in.spv> -DHEADER=<out.h> -DNAME=<ident> -DNAMESPACE=<ns> -DSOURCE=<file> -P embed_spirv.cmake
+
+file(READ "${SPV}" _hex HEX)
+string(LENGTH "${_hex}" _len)
+math(EXPR _rem "${_len} % 8")
+if(_len EQUAL 0 OR NOT _rem EQUAL 0)
+    message(FATAL_ERROR "embed_spirv: ${SPV} is not a SPIR-V binary")
+endif()
+
+# SPIR-V is a stream of little-endian 32-bit words; eight per line
+string(REGEX REPLACE "(..)(..)(..)(..)" "0x\\4\\3\\2\\1u, " _words "${_hex}")
+# (CMake regexes have no {n} repetition)
+set(_word "0x[0-9a-f]+u, ")
+string(REGEX REPLACE "(${_word}${_word}${_word}${_word}${_word}${_word}${_word}${_word})" "\\1\n  " _words "${_words}")
+string(REPLACE ", \n" ",\n" _words "${_words}")
+string(REGEX REPLACE "[ \n]+$" "" _words "${_words}")
+
+file(WRITE "${HEADER}"
+"// Generated by vklite_add_shaders from ${SOURCE}; do not edit.
+#pragma once
+#include <cstdint>
+
+namespace ${NAMESPACE} {
+inline constexpr uint32_t ${NAME}[] = {
+  ${_words}
+};
+} // namespace ${NAMESPACE}
+")
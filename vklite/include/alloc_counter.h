@@ -0,0 +1,17 @@
+#pragma once
+
+#include <cstdint>
+
+namespace vklite {
+
+// Heap allocation counting, for checking that steady-state frames do not
+// allocate (see Window::frameAllocations and
+// Context::failOnFrameAllocations). Configuring with
+// VKLITE_COUNT_ALLOCATIONS=ON replaces the global operator new to count
+// every allocation, per thread. Otherwise the counts stay at zero.
+bool allocationCountingEnabled();
+
+// Number of allocations made so far by the calling thread.
+uint64_t threadAllocationCount();
+
+} // namespace vklite
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+namespace vklite {
+
+class JobSystem;
+
+// View frustum as six normalized planes (nx, ny, nz, d). A point p is inside a
+// plane when dot(n, p) + d >= 0.
+struct Frustum {
+  float planes[6][4] = {};
+
+  // Extract planes from a column-major view-projection matrix (glm layout)
+  // using Vulkan clip space conventions (0 <= z <= w).
+  static Frustum fromViewProjection(const float* m);
+};
+
+// Bounding spheres stored as structure-of-arrays so the SIMD kernels can load
+// 4 (SSE) or 8 (AVX2) objects per register.
+struct SphereBounds {
+  std::vector<float> centerX;
+  std::vector<float> centerY;
+  std::vector<float> centerZ;
+  std::vector<float> radius;
+
+  uint32_t add(float x, float y, float z, float r);
+  void set(uint32_t index, float x, float y, float z, float r);
+  void reserve(size_t count);
+  void clear();
+  size_t size() const { return radius.size(); }
+};
+
+// Axis-aligned boxes stored as centre / half-extent arrays; add() takes the
+// usual min/max corners and converts once so the kernels do not have to.
+struct AabbBounds {
+  std::vector<float> centerX;
+  std::vector<float> centerY;
+  std::vector<float> centerZ;
+  std::vector<float> extentX;
+  std::vector<float> extentY;
+  std::vector<float> extentZ;
+
+  uint32_t add(const float minCorner[3], const float maxCorner[3]);
+  void set(uint32_t index, const float minCorner[3], const float maxCorner[3]);
+  void reserve(size_t count);
+  void clear();
+  size_t size() const { return extentX.size(); }
+};
+
+enum class CullKernel {
+  Auto,   // best kernel supported by the running CPU
+  Scalar,
+  SSE,
+  AVX2,
+};
+
+struct CullOptions {
+  CullKernel kernel = CullKernel::Auto;
+  // Pool the chunks are spread over (e.g. Context::jobs), with the calling
+  // thread taking part. Without one everything runs on the calling thread.
+  JobSystem* jobs = nullptr;
+  // Most chunks to split into; 0 = one per worker plus the calling thread
+  uint32_t threadCount = 0;
+  // Below this many objects per thread the work is not split further.
+  uint32_t minObjectsPerThread = 16384;
+};
+
+// Returns the kernel Auto resolves to on this CPU.
+CullKernel resolveCullKernel(CullKernel requested);
+const char* cullKernelName(CullKernel kernel);
+
+// Test every volume against the frustum and write the indices of the visible
+// ones, in ascending order, to `visible`. The vector is resized to the
+// visible count; its capacity is reused across calls so steady-state culling
+// does not allocate. Returns the number of visible objects.
+size_t cullSpheres(const Frustum& frustum, const SphereBounds& spheres, std::vector<uint32_t>& visible, const CullOptions& options = {});
+size_t cullAabbs(const Frustum& frustum, const AabbBounds& boxes, std::vector<uint32_t>& visible, const CullOptions& options = {});
+
+} // namespace vklite
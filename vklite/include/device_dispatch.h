@@ -0,0 +1,168 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+namespace vklite {
+
+// Device-level Vulkan entry points resolved with vkGetDeviceProcAddr, in the
+// style of volk's device table. The functions exported by the loader are
+// trampolines that look up the device's dispatch table on every call; the
+// pointers in the table go straight to the driver (or the first enabled
+// layer).
+
+// Vulkan 1.0 and VK_KHR_swapchain: present on every device vklite creates.
+#define VKLITE_DEVICE_FUNCTIONS(X) \
+  X(vkDestroyDevice) \
+  X(vkGetDeviceQueue) \
+  X(vkQueueSubmit) \
+  X(vkQueueWaitIdle) \
+  X(vkDeviceWaitIdle) \
+  X(vkAllocateMemory) \
+  X(vkFreeMemory) \
+  X(vkMapMemory) \
+  X(vkUnmapMemory) \
+  X(vkFlushMappedMemoryRanges) \
+  X(vkInvalidateMappedMemoryRanges) \
+  X(vkGetDeviceMemoryCommitment) \
+  X(vkBindBufferMemory) \
+  X(vkBindImageMemory) \
+  X(vkGetBufferMemoryRequirements) \
+  X(vkGetImageMemoryRequirements) \
+  X(vkGetImageSparseMemoryRequirements) \
+  X(vkQueueBindSparse) \
+  X(vkCreateFence) \
+  X(vkDestroyFence) \
+  X(vkResetFences) \
+  X(vkGetFenceStatus) \
+  X(vkWaitForFences) \
+  X(vkCreateSemaphore) \
+  X(vkDestroySemaphore) \
+  X(vkCreateEvent) \
+  X(vkDestroyEvent) \
+  X(vkGetEventStatus) \
+  X(vkSetEvent) \
+  X(vkResetEvent) \
+  X(vkCreateQueryPool) \
+  X(vkDestroyQueryPool) \
+  X(vkGetQueryPoolResults) \
+  X(vkCreateBuffer) \
+  X(vkDestroyBuffer) \
+  X(vkCreateBufferView) \
+  X(vkDestroyBufferView) \
+  X(vkCreateImage) \
+  X(vkDestroyImage) \
+  X(vkGetImageSubresourceLayout) \
+  X(vkCreateImageView) \
+  X(vkDestroyImageView) \
+  X(vkCreateShaderModule) \
+  X(vkDestroyShaderModule) \
+  X(vkCreatePipelineCache) \
+  X(vkDestroyPipelineCache) \
+  X(vkGetPipelineCacheData) \
+  X(vkMergePipelineCaches) \
+  X(vkCreateGraphicsPipelines) \
+  X(vkCreateComputePipelines) \
+  X(vkDestroyPipeline) \
+  X(vkCreatePipelineLayout) \
+  X(vkDestroyPipelineLayout) \
+  X(vkCreateSampler) \
+  X(vkDestroySampler) \
+  X(vkCreateDescriptorSetLayout) \
+  X(vkDestroyDescriptorSetLayout) \
+  X(vkCreateDescriptorPool) \
+  X(vkDestroyDescriptorPool) \
+  X(vkResetDescriptorPool) \
+  X(vkAllocateDescriptorSets) \
+  X(vkFreeDescriptorSets) \
+  X(vkUpdateDescriptorSets) \
+  X(vkCreateFramebuffer) \
+  X(vkDestroyFramebuffer) \
+  X(vkCreateRenderPass) \
+  X(vkDestroyRenderPass) \
+  X(vkGetRenderAreaGranularity) \
+  X(vkCreateCommandPool) \
+  X(vkDestroyCommandPool) \
+  X(vkResetCommandPool) \
+  X(vkAllocateCommandBuffers) \
+  X(vkFreeCommandBuffers) \
+  X(vkBeginCommandBuffer) \
+  X(vkEndCommandBuffer) \
+  X(vkResetCommandBuffer) \
+  X(vkCmdBindPipeline) \
+  X(vkCmdSetViewport) \
+  X(vkCmdSetScissor) \
+  X(vkCmdSetLineWidth) \
+  X(vkCmdSetDepthBias) \
+  X(vkCmdSetBlendConstants) \
+  X(vkCmdSetDepthBounds) \
+  X(vkCmdSetStencilCompareMask) \
+  X(vkCmdSetStencilWriteMask) \
+  X(vkCmdSetStencilReference) \
+  X(vkCmdBindDescriptorSets) \
+  X(vkCmdBindIndexBuffer) \
+  X(vkCmdBindVertexBuffers) \
+  X(vkCmdDraw) \
+  X(vkCmdDrawIndexed) \
+  X(vkCmdDrawIndirect) \
+  X(vkCmdDrawIndexedIndirect) \
+  X(vkCmdDispatch) \
+  X(vkCmdDispatchIndirect) \
+  X(vkCmdCopyBuffer) \
+  X(vkCmdCopyImage) \
+  X(vkCmdBlitImage) \
+  X(vkCmdCopyBufferToImage) \
+  X(vkCmdCopyImageToBuffer) \
+  X(vkCmdUpdateBuffer) \
+  X(vkCmdFillBuffer) \
+  X(vkCmdClearColorImage) \
+  X(vkCmdClearDepthStencilImage) \
+  X(vkCmdClearAttachments) \
+  X(vkCmdResolveImage) \
+  X(vkCmdSetEvent) \
+  X(vkCmdResetEvent) \
+  X(vkCmdWaitEvents) \
+  X(vkCmdPipelineBarrier) \
+  X(vkCmdBeginQuery) \
+  X(vkCmdEndQuery) \
+  X(vkCmdResetQueryPool) \
+  X(vkCmdWriteTimestamp) \
+  X(vkCmdCopyQueryPoolResults) \
+  X(vkCmdPushConstants) \
+  X(vkCmdBeginRenderPass) \
+  X(vkCmdNextSubpass) \
+  X(vkCmdEndRenderPass) \
+  X(vkCmdExecuteCommands) \
+  X(vkCreateSwapchainKHR) \
+  X(vkDestroySwapchainKHR) \
+  X(vkGetSwapchainImagesKHR) \
+  X(vkAcquireNextImageKHR) \
+  X(vkQueuePresentKHR)
+
+// Newer core versions and optional extensions; null when the device (or
+// its API version) does not provide them.
+#define VKLITE_OPTIONAL_DEVICE_FUNCTIONS(X) \
+  X(vkCmdDrawIndirectCount) \
+  X(vkCmdDrawIndexedIndirectCount) \
+  X(vkResetQueryPool) \
+  X(vkGetSemaphoreCounterValue) \
+  X(vkWaitSemaphores) \
+  X(vkSignalSemaphore) \
+  X(vkCmdPipelineBarrier2) \
+  X(vkCmdWriteTimestamp2) \
+  X(vkQueueSubmit2) \
+  X(vkCmdBeginRenderingKHR) \
+  X(vkCmdEndRenderingKHR) \
+  X(vkWaitForPresentKHR)
+
+struct DeviceDispatch {
+#define VKLITE_DISPATCH_MEMBER(name) PFN_##name name = nullptr;
+  VKLITE_DEVICE_FUNCTIONS(VKLITE_DISPATCH_MEMBER)
+  VKLITE_OPTIONAL_DEVICE_FUNCTIONS(VKLITE_DISPATCH_MEMBER)
+#undef VKLITE_DISPATCH_MEMBER
+
+  // Resolve every entry for `device`. Returns false if a required function
+  // is missing; `missing` (optional) receives the first one's name.
+  bool load(VkDevice device, const char** missing = nullptr);
+};
+
+} // namespace vklite
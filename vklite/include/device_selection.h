@@ -0,0 +1,51 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <cstdint>
+#include <string>
+
+namespace vklite {
+
+// A physical device as initialize saw it while choosing one. Devices older
+// than Vulkan 1.2, or without a graphics queue that can present,
+// VK_KHR_swapchain or dynamic rendering are unusable; the others are ranked
+// by score.
+struct PhysicalDeviceInfo {
+  VkPhysicalDevice device = VK_NULL_HANDLE;
+  std::string name;
+  uint8_t uuid[VK_UUID_SIZE] = {};
+  VkPhysicalDeviceType type = VK_PHYSICAL_DEVICE_TYPE_OTHER;
+  uint32_t apiVersion = 0;
+  VkDeviceSize deviceLocalBytes = 0;  // sum of the DEVICE_LOCAL heaps
+  bool swapchain = false;
+  bool presentSupport = false;  // some graphics family can present (GLFW)
+  bool dynamicRendering = false;    // required: renderWindow draws with it
+  bool timelineSemaphores = false;  // optional, see below
+  bool descriptorIndexing = false;  // partially bound, runtime-sized, non-uniform sampled arrays
+  // Optional features first (each outweighs any type/VRAM difference), then
+  // device type (discrete > integrated > virtual > other > CPU), then VRAM in
+  // MiB. -1 when unusable; only usable devices are ranked.
+  int64_t score = -1;
+  const char* unusable = nullptr;  // why, when score is -1
+};
+
+// Queue families of the chosen device. Compute and transfer fall back to the
+// graphics family when there is no dedicated one; Context creates one queue
+// per distinct family (computeQueue, transferQueue).
+struct QueueTopology {
+  uint32_t graphicsFamily = UINT32_MAX;  // graphics + compute, can present
+  uint32_t computeFamily = UINT32_MAX;   // compute without graphics if available (async compute)
+  uint32_t transferFamily = UINT32_MAX;  // transfer only if available (copy/DMA engine)
+  bool dedicatedCompute = false;
+  bool dedicatedTransfer = false;
+  // Copy granularity of the transfer family; dedicated DMA queues may not
+  // allow arbitrary image offsets
+  VkExtent3D transferGranularity = {1, 1, 1};
+};
+
+// "discrete GPU", "integrated GPU", ...
+const char* physicalDeviceTypeName(VkPhysicalDeviceType type);
+// Lower-case hex with the usual 8-4-4-4-12 dashes
+std::string formatDeviceUuid(const uint8_t uuid[VK_UUID_SIZE]);
+
+} // namespace vklite
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace vklite {
+
+// Watches a set of files and reports changes from a background thread.
+// On Linux this uses inotify on the files' directories (so editors that save
+// by writing a temp file and renaming it are caught); elsewhere it polls
+// modification times. Bursts of events for the same file are coalesced.
+class FileWatcher {
+public:
+  using Callback = std::function<void(const std::string& path)>;
+
+  // `onChange` runs on the watcher thread
+  explicit FileWatcher(Callback onChange);
+  ~FileWatcher();
+  FileWatcher(const FileWatcher&) = delete;
+  FileWatcher& operator=(const FileWatcher&) = delete;
+
+  bool watch(const std::string& path);
+  void unwatch(const std::string& path);
+  void stop();
+
+  bool usingInotify() const { return inotifyFd_ >= 0; }
+
+private:
+  struct Entry {
+    std::string path;       // as passed to watch()
+    std::string directory;
+    std::string name;
+    int wd = -1;            // inotify watch on the directory
+    long long mtime = 0;    // polling fallback
+    double pendingSince = -1.0;
+  };
+
+  void run();
+  void pollInotify(int timeoutMs);
+  void pollTimestamps();
+  void flushPending(double now);
+
+  Callback onChange_;
+  std::mutex mutex_;
+  std::vector<Entry> entries_;
+  std::thread thread_;
+  std::atomic<bool> running_{false};
+  int inotifyFd_ = -1;
+};
+
+} // namespace vklite
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+namespace vklite {
+
+// Linear allocator for data that lives for one frame. allocate() bumps a
+// pointer; reset() releases everything at once. When a frame overflows the
+// current block another is chained on, and the next reset() folds them into
+// one block big enough for the whole frame, so after a few frames the arena
+// stops touching the heap.
+//
+// Nothing is destroyed on reset(): only trivially destructible data belongs
+// here, unless the owner runs the destructors itself (see RenderGraph).
+class FrameArena {
+public:
+  explicit FrameArena(size_t initialBytes = 16 * 1024);
+  ~FrameArena();
+  FrameArena(const FrameArena&) = delete;
+  FrameArena& operator=(const FrameArena&) = delete;
+
+  void* allocate(size_t bytes, size_t alignment = alignof(std::max_align_t));
+
+  // Uninitialized storage for `count` objects of T
+  template <typename T>
+  T* allocateArray(size_t count) {
+    static_assert(std::is_trivially_destructible<T>::value, "FrameArena does not run destructors");
+    return static_cast<T*>(allocate(sizeof(T) * count, alignof(T)));
+  }
+
+  // `count` value-initialized (zeroed) objects of T
+  template <typename T>
+  T* allocateZeroed(size_t count) {
+    T* p = allocateArray<T>(count);
+    for (size_t i = 0; i < count; ++i) new (p + i) T();
+    return p;
+  }
+
+  void reset();
+
+  size_t used() const { return used_; }
+  size_t capacity() const;
+  // Most bytes used in one frame since construction
+  size_t highWater() const { return highWater_; }
+
+private:
+  struct Block {
+    uint8_t* data = nullptr;
+    size_t size = 0;
+  };
+  std::vector<Block> blocks_;  // the last one is being filled
+  size_t offset_ = 0;          // into blocks_.back()
+  size_t used_ = 0;
+  size_t highWater_ = 0;
+  size_t initialBytes_;
+};
+
+} // namespace vklite
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace vklite {
+
+// Output container for captured frames.
+// - Raw: tightly packed RGBA8 frames back to back, no header.
+// - Y4M: YUV4MPEG2 with 4:4:4 planar BT.601 (limited range) frames; plays in
+//   ffmpeg/mpv and compresses with any encoder.
+// - Png: one RGB PNG per frame.
+enum class CaptureFormat {
+  Raw,
+  Y4M,
+  Png,
+};
+
+struct CaptureSettings {
+  CaptureFormat format = CaptureFormat::Y4M;
+  // Raw / Y4M: the output file. Png: a prefix; frames are written to
+  // <path>_000000.png, <path>_000001.png, ...
+  std::string path;
+  uint32_t every = 1;      // capture every Nth rendered frame
+  uint32_t maxFrames = 0;  // stop capturing after this many (0 = no limit)
+  uint32_t fps = 60;       // frame rate recorded in the Y4M header
+};
+
+// Encodes captured frames and writes them on a worker thread. Raw and Y4M
+// frames have a fixed size and go into a memory-mapped file that is grown in
+// chunks (plain buffered writes where mmap is unavailable); PNG frames go to
+// separate files.
+class FrameWriter {
+public:
+  FrameWriter(const CaptureSettings& settings, uint32_t width, uint32_t height);
+  ~FrameWriter();
+  FrameWriter(const FrameWriter&) = delete;
+  FrameWriter& operator=(const FrameWriter&) = delete;
+
+  // Create the output and start the worker. Returns false (and logs) if the
+  // output cannot be created.
+  bool open();
+
+  // Queue one frame of width*height 8-bit pixels (BGRA order when `bgra`,
+  // otherwise RGBA). The pixels are read on the worker thread and must stay
+  // valid until `done` runs there.
+  void push(const uint8_t* pixels, bool bgra, std::function<void()> done);
+
+  // Encode everything queued, then close the output and stop the worker.
+  void finish();
+
+  uint64_t framesWritten() const { return written_.load(); }
+  bool failed() const { return failed_.load(); }
+
+private:
+  struct Job {
+    const uint8_t* pixels = nullptr;
+    bool bgra = false;
+    std::function<void()> done;
+  };
+
+  void run();
+  void encode(const Job& job);
+  bool reserve(uint64_t bytes);
+  void closeOutput();
+
+  CaptureSettings settings_;
+  uint32_t width_ = 0;
+  uint32_t height_ = 0;
+  uint64_t frameBytes_ = 0;   // Raw / Y4M bytes per frame
+  std::vector<uint8_t> scratch_;
+
+  // Output file (Raw / Y4M)
+  int fd_ = -1;
+  std::FILE* stream_ = nullptr;  // where mmap is unavailable
+  uint8_t* mapped_ = nullptr;
+  uint64_t mappedSize_ = 0;
+  uint64_t fileSize_ = 0;     // bytes written so far
+  uint64_t nextIndex_ = 0;    // PNG sequence number
+
+  std::thread worker_;
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  std::deque<Job> queue_;
+  bool stopping_ = false;
+  std::atomic<uint64_t> written_{0};
+  std::atomic<bool> failed_{false};
+};
+
+} // namespace vklite
@@ -0,0 +1,155 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <initializer_list>
+#include <memory>
+#include <mutex>
+#include <type_traits>
+#include <vector>
+
+namespace vklite {
+
+struct JobSettings {
+  // Worker threads; 0 = one per hardware thread, minus one for the thread
+  // that owns the Context (it helps while it waits). At least one.
+  uint32_t workerCount = 0;
+  // CPUs to pin the workers to, worker i on affinity[i % size]. Empty leaves
+  // placement to the OS. Ignored where the platform has no thread affinity.
+  std::vector<uint32_t> affinity;
+};
+
+class JobSystem;
+
+// Reference to a submitted job: wait on it or pass it as a dependency. Must
+// not outlive its JobSystem.
+class JobHandle {
+public:
+  JobHandle() = default;
+  JobHandle(const JobHandle& other);
+  JobHandle(JobHandle&& other) noexcept;
+  JobHandle& operator=(const JobHandle& other);
+  JobHandle& operator=(JobHandle&& other) noexcept;
+  ~JobHandle();
+
+  bool valid() const { return job_ != nullptr; }
+  // True once the job has run (also for an empty handle)
+  bool done() const;
+
+private:
+  friend class JobSystem;
+  struct Job;
+  JobHandle(JobSystem* system, Job* job) : system_(system), job_(job) {}
+  JobSystem* system_ = nullptr;
+  Job* job_ = nullptr;
+};
+
+// Thread pool with one work-stealing deque per worker. Jobs submitted from a
+// worker go to its own deque (run newest first, stolen oldest first by idle
+// workers); jobs submitted from other threads go to a shared queue. A job
+// with dependencies is queued once they have all run.
+//
+// wait() runs queued jobs on the calling thread until the job is done, so
+// waiting from inside a job cannot deadlock the pool. Job nodes are
+// recycled: once the pool is warm, parallelFor and jobs whose callable fits
+// std::function's small buffer do not allocate.
+//
+// Every parallel feature of a Context shares its pool (Context::jobs)
+// instead of starting threads of its own.
+class JobSystem {
+public:
+  explicit JobSystem(const JobSettings& settings = {});
+  // Runs every job still queued, then joins the workers. No job may be
+  // submitted from another thread meanwhile.
+  ~JobSystem();
+  JobSystem(const JobSystem&) = delete;
+  JobSystem& operator=(const JobSystem&) = delete;
+
+  uint32_t workerCount() const { return static_cast<uint32_t>(workers_.size()); }
+
+  // Queue `fn`; it runs after every valid job in `dependencies` has run.
+  // Safe to call from any thread.
+  JobHandle submit(std::function<void()> fn);
+  JobHandle submit(std::function<void()> fn, std::initializer_list<JobHandle> dependencies);
+  JobHandle submit(std::function<void()> fn, const JobHandle* dependencies, size_t dependencyCount);
+
+  // Block until `job` has run, executing other jobs meanwhile.
+  void wait(const JobHandle& job);
+
+  // Call fn(i) for every i in [0, count) across the pool and the calling
+  // thread; returns once all calls have returned. Indices are handed out
+  // one at a time, so uneven work balances itself; make each index a chunk
+  // worth at least a few microseconds. The calling thread runs only these
+  // indices, never unrelated queued jobs, and does not wait for helpers
+  // still queued behind other work once the indices have run out.
+  template <typename F>
+  void parallelFor(uint32_t count, F&& fn) {
+    using Fn = typename std::remove_reference<F>::type;
+    parallelFor(count, [](void* f, uint32_t i) { (*static_cast<Fn*>(f))(i); }, const_cast<void*>(static_cast<const void*>(&fn)));
+  }
+  void parallelFor(uint32_t count, void (*fn)(void* data, uint32_t index), void* data);
+
+  struct Stats {
+    uint32_t workers = 0;
+    uint64_t submitted = 0;
+    uint64_t executed = 0;
+    uint64_t stolen = 0;        // taken from another worker's deque
+    uint64_t helped = 0;        // run by a thread inside wait()
+    uint64_t failedSteals = 0;  // searches that found no deque to steal from
+    uint64_t sleeps = 0;        // times a worker blocked for lack of work
+    uint64_t parallelFors = 0;
+  };
+  Stats stats() const;
+  void resetStats();
+
+private:
+  friend class JobHandle;
+  using Job = JobHandle::Job;
+  struct Worker;
+  struct Counters;
+  struct Batch;
+
+  Job* allocateJob();
+  Batch* allocateBatch();
+  void releaseBatch(Batch* batch);
+  void retain(Job* job);
+  void release(Job* job);
+  void push(Job* job);
+  Job* findWork(Counters& counters);
+  void execute(Job* job, Counters& counters, bool helping);
+  void finish(Job* job);
+  Counters& countersForThisThread();
+  void helpUntil(bool (*done)(const void* data), const void* data);
+  void workerMain(uint32_t index);
+
+  std::vector<std::unique_ptr<Worker>> workers_;
+  std::unique_ptr<Counters> external_;  // threads that are not workers
+
+  std::mutex injectMutex_;
+  std::deque<Job*> injected_;  // submissions from non-worker threads
+
+  std::mutex freeMutex_;
+  std::vector<Job*> freeJobs_;
+  std::vector<std::unique_ptr<Job>> allJobs_;
+  std::vector<Batch*> freeBatches_;
+  std::vector<std::unique_ptr<Batch>> allBatches_;
+
+  // Idle workers (sleepCv_) and blocked waiters (waitCv_); see workerMain
+  // and helpUntil
+  std::mutex sleepMutex_;
+  std::condition_variable sleepCv_;
+  std::condition_variable waitCv_;
+  std::atomic<int64_t> queuedJobs_{0};    // ready and not yet taken
+  std::atomic<int64_t> injectedJobs_{0};  // of those, in injected_
+  std::atomic<uint32_t> sleepers_{0};
+  std::atomic<uint32_t> waiters_{0};
+  std::atomic<bool> stopping_{false};
+  std::atomic<uint64_t> submitted_{0};
+  std::atomic<uint64_t> parallelFors_{0};
+};
+
+} // namespace vklite
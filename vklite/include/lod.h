@@ -0,0 +1,92 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace vklite {
+
+// One level of detail: a range into Mesh::indices plus the object-space
+// geometric error introduced by the simplification (0 for the full mesh).
+struct LodLevel {
+  uint32_t indexOffset = 0;
+  uint32_t indexCount = 0;
+  float error = 0.0f;
+};
+
+// Indexed triangle mesh. All LODs share the vertex array; each LOD is just a
+// different index range, so a single vertex/index buffer pair serves them all
+// and switching LOD only changes firstIndex/indexCount of the draw.
+struct Mesh {
+  std::vector<float> positions;   // xyz per vertex
+  std::vector<uint32_t> indices;  // LOD ranges, finest first
+  std::vector<LodLevel> lods;     // lods[0] is the full-resolution mesh
+  float boundsCenter[3] = { 0.0f, 0.0f, 0.0f };
+  float boundsRadius = 0.0f;
+
+  size_t vertexCount() const { return positions.size() / 3; }
+};
+
+struct LodBuildOptions {
+  uint32_t maxLods = 6;            // including lods[0]
+  float reductionTarget = 0.5f;    // each LOD aims for this fraction of the previous triangle count
+  uint32_t minTriangles = 32;      // stop simplifying below this
+};
+
+// Generate coarser LODs by vertex clustering on a progressively larger grid.
+// lods[0] must describe (or will be set to) the full index list; existing
+// coarser LODs are replaced. Bounds are recomputed.
+void buildMeshLods(Mesh& mesh, const LodBuildOptions& options = {});
+
+// Load positions/indices from a Wavefront OBJ (all shapes merged, faces
+// triangulated) and build LODs. Returns false and logs on failure.
+bool loadMeshFromObj(const std::string& path, Mesh& mesh, const LodBuildOptions& options = {});
+
+// Binary cache of a mesh with its LODs, so simplification runs once per asset.
+// readMeshCache returns false for a missing, stale, truncated or corrupt file
+// (counts that disagree with the file size, indices past the vertex array).
+bool writeMeshCache(const std::string& path, const Mesh& mesh);
+bool readMeshCache(const std::string& path, Mesh& mesh);
+
+// Camera data needed to turn object-space error into pixels.
+// projScale = viewportHeightPixels * 0.5 * |proj[1][1]| (i.e. H / (2 tan(fovy/2))).
+struct LodCamera {
+  float position[3] = { 0.0f, 0.0f, 0.0f };
+  float projScale = 1.0f;
+};
+
+// Chooses an LOD per object from projected screen-space error. The coarsest
+// LOD whose error stays below the pixel threshold wins; hysteresis keeps an
+// object on its current LOD until the error moves clearly past the threshold,
+// which avoids popping when the camera hovers around a switch distance.
+class LodSelector {
+public:
+  float pixelThreshold = 1.0f;   // acceptable error in pixels at qualityBias 1
+  float hysteresis = 0.2f;       // relative band around the threshold
+  float qualityBias = 1.0f;      // global bias; > 1 trades quality for speed
+
+  // Frame-time budget in milliseconds (0 disables). When set, reportFrameTime
+  // raises or lowers an automatic bias on top of qualityBias, clamped to
+  // [1, maxBudgetBias].
+  float frameBudgetMs = 0.0f;
+  float maxBudgetBias = 8.0f;
+
+  void resize(size_t objectCount);
+  void reset();
+
+  // Pick the LOD for `object`. `center` is the world-space bounding-sphere
+  // centre and `scale` the object's uniform world scale.
+  uint32_t select(uint32_t object, const Mesh& mesh, const float center[3], float scale, const LodCamera& camera);
+
+  void reportFrameTime(float frameMs);
+  float budgetBias() const { return budgetBias_; }
+  float effectiveThreshold() const { return pixelThreshold * qualityBias * budgetBias_; }
+
+private:
+  std::vector<uint8_t> current_;
+  float budgetBias_ = 1.0f;
+  float smoothedFrameMs_ = 0.0f;
+};
+
+} // namespace vklite
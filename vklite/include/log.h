@@ -0,0 +1,71 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+
+#if defined(__GNUC__) || defined(__clang__)
+#define VKLITE_PRINTF_FORMAT(fmt, args) __attribute__((format(printf, fmt, args)))
+#else
+#define VKLITE_PRINTF_FORMAT(fmt, args)
+#endif
+
+namespace vklite {
+
+enum class LogLevel {
+  Debug,
+  Info,
+  Warning,
+  Error,
+};
+
+// Logging never blocks the caller on I/O. Messages are formatted into a
+// fixed-size lock-free ring (truncated to kLogMessageBytes) and handed to the
+// sink by a background thread. When the ring is full the message is dropped
+// and counted. Each VKLITE_LOG call site is rate limited: past
+// kLogSiteBurst messages per second it is muted for the rest of that second
+// and the next message reports how many were suppressed.
+constexpr size_t kLogMessageBytes = 1024;
+constexpr uint32_t kLogSiteBurst = 5;
+
+// Receives messages in order on the logging thread.
+using LogSink = std::function<void(LogLevel level, const char* message)>;
+
+// Replace the sink; an empty sink restores the default (warnings and errors
+// to stderr, the rest to stdout). Messages already queued go to the new sink.
+void setLogSink(LogSink sink);
+
+// Messages below `level` are discarded at the call site, before formatting.
+void setLogLevel(LogLevel level);
+LogLevel logLevel();
+
+// Block until every message queued so far has reached the sink.
+void flushLog();
+
+// Messages lost because the ring was full.
+uint64_t droppedLogMessages();
+
+// Rate-limit state of one call site (see VKLITE_LOG)
+struct LogSite {
+  std::atomic<int64_t> windowStart{0};  // ms, start of the current second
+  std::atomic<uint32_t> count{0};       // messages in the current second
+  std::atomic<uint32_t> suppressed{0};
+};
+
+// printf-style. `site` may be null for messages that are not rate limited.
+void logMessage(LogLevel level, LogSite* site, const char* format, ...) VKLITE_PRINTF_FORMAT(3, 4);
+
+} // namespace vklite
+
+#define VKLITE_LOG(level, ...)                                         \
+  do {                                                                 \
+    if ((level) >= ::vklite::logLevel()) {                             \
+      static ::vklite::LogSite vkliteLogSite_;                         \
+      ::vklite::logMessage((level), &vkliteLogSite_, __VA_ARGS__);     \
+    }                                                                  \
+  } while (0)
+
+#define VKLITE_LOG_DEBUG(...) VKLITE_LOG(::vklite::LogLevel::Debug, __VA_ARGS__)
+#define VKLITE_LOG_INFO(...) VKLITE_LOG(::vklite::LogLevel::Info, __VA_ARGS__)
+#define VKLITE_LOG_WARN(...) VKLITE_LOG(::vklite::LogLevel::Warning, __VA_ARGS__)
+#define VKLITE_LOG_ERROR(...) VKLITE_LOG(::vklite::LogLevel::Error, __VA_ARGS__)
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <cstddef>
+#include <cstdint>
+
+namespace vklite {
+
+// What device memory allocated through Context::allocateMemory is used for.
+// Swapchain images are owned by the driver; their size is estimated from
+// each window's image count, extent and format.
+enum class MemoryCategory {
+  Swapchain,
+  Staging,   // transient host-visible upload/copy buffers
+  Buffers,
+  Images,    // depth, Hi-Z and render graph attachments
+  Readback,  // persistently mapped GPU->CPU buffers (Hi-Z, capture)
+};
+constexpr size_t kMemoryCategoryCount = 5;
+
+struct MemoryHeapBudget {
+  uint32_t heapIndex = 0;
+  bool deviceLocal = false;
+  VkDeviceSize size = 0;
+  // With VK_EXT_memory_budget: what the driver lets this process use and
+  // how much it uses (all allocations, not only vklite's). Without it the
+  // budget is the heap size and usage is what vklite allocated.
+  VkDeviceSize budget = 0;
+  VkDeviceSize usage = 0;
+  VkDeviceSize allocated = 0;  // through Context::allocateMemory
+};
+
+// Fixed-size, so the periodic budget check does not allocate
+struct MemoryStats {
+  MemoryHeapBudget heaps[VK_MAX_MEMORY_HEAPS];
+  uint32_t heapCount = 0;
+  VkDeviceSize categories[kMemoryCategoryCount] = {};  // indexed by MemoryCategory
+  bool fromDriverBudget = false;  // VK_EXT_memory_budget was used
+};
+
+} // namespace vklite
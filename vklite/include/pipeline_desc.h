@@ -0,0 +1,186 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace vklite {
+
+struct VertexBinding {
+  uint32_t binding = 0;
+  uint32_t stride = 0;
+  VkVertexInputRate inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+};
+
+struct VertexAttribute {
+  uint32_t location = 0;
+  uint32_t binding = 0;
+  VkFormat format = VK_FORMAT_UNDEFINED;
+  uint32_t offset = 0;
+};
+
+struct BlendState {
+  bool enable = false;
+  VkBlendFactor srcColor = VK_BLEND_FACTOR_SRC_ALPHA;
+  VkBlendFactor dstColor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+  VkBlendOp colorOp = VK_BLEND_OP_ADD;
+  VkBlendFactor srcAlpha = VK_BLEND_FACTOR_ONE;
+  VkBlendFactor dstAlpha = VK_BLEND_FACTOR_ZERO;
+  VkBlendOp alphaOp = VK_BLEND_OP_ADD;
+  VkColorComponentFlags writeMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+};
+
+// Non-owning view of SPIR-V words, typically an array generated by
+// vklite_add_shaders. Pipelines created from a view keep pointing at the
+// words, so they must outlive those pipelines (embedded arrays are static).
+struct SpirvView {
+  const uint32_t* code = nullptr;
+  size_t words = 0;
+
+  SpirvView() = default;
+  SpirvView(const uint32_t* code, size_t words) : code(code), words(words) {}
+  template <size_t N>
+  SpirvView(const uint32_t (&array)[N]) : code(array), words(N) {}
+  SpirvView(const std::vector<uint32_t>& v) : code(v.data()), words(v.size()) {}
+
+  bool empty() const { return words == 0; }
+  bool operator==(const SpirvView& o) const {
+    return words == o.words && (words == 0 || code == o.code || std::memcmp(code, o.code, words * sizeof(uint32_t)) == 0);
+  }
+  bool operator!=(const SpirvView& o) const { return !(*this == o); }
+};
+
+// Typed values for a shader stage's specialization constants
+// (layout(constant_id = N) const ...). One compiled module yields a separate
+// driver-optimized pipeline per set of values, without recompiling GLSL.
+// Entries are kept sorted by id so equal sets compare and hash equal.
+class SpecializationConstants {
+public:
+  // bool is stored as VkBool32, as SPIR-V expects; other types must be
+  // 32- or 64-bit arithmetic types. Setting an id again replaces its value.
+  template <typename T>
+  SpecializationConstants& set(uint32_t id, T value) {
+    static_assert(std::is_arithmetic<T>::value, "specialization constants must be scalars");
+    if constexpr (std::is_same<T, bool>::value) {
+      return store(id, static_cast<VkBool32>(value ? VK_TRUE : VK_FALSE));
+    } else {
+      static_assert(sizeof(T) == 4 || sizeof(T) == 8, "specialization constants must be 32 or 64 bit");
+      return store(id, value);
+    }
+  }
+
+  bool empty() const { return entries_.empty(); }
+  const std::vector<VkSpecializationMapEntry>& entries() const { return entries_; }
+  const std::vector<uint8_t>& data() const { return data_; }
+
+  // Points into this object; valid until the next set()
+  VkSpecializationInfo info() const {
+    VkSpecializationInfo si{};
+    si.mapEntryCount = static_cast<uint32_t>(entries_.size());
+    si.pMapEntries = entries_.data();
+    si.dataSize = data_.size();
+    si.pData = data_.data();
+    return si;
+  }
+
+  bool operator==(const SpecializationConstants& o) const {
+    if (entries_.size() != o.entries_.size() || data_ != o.data_) return false;
+    for (size_t i = 0; i < entries_.size(); ++i) {
+      if (entries_[i].constantID != o.entries_[i].constantID || entries_[i].size != o.entries_[i].size) return false;
+    }
+    return true;
+  }
+  bool operator!=(const SpecializationConstants& o) const { return !(*this == o); }
+
+private:
+  template <typename T>
+  SpecializationConstants& store(uint32_t id, T value) {
+    std::vector<uint8_t> bytes(sizeof(T));
+    std::memcpy(bytes.data(), &value, sizeof(T));
+    auto it = std::lower_bound(entries_.begin(), entries_.end(), id,
+                               [](const VkSpecializationMapEntry& e, uint32_t key) { return e.constantID < key; });
+    // Rebuild the packed data in id order; constant sets are tiny
+    std::vector<VkSpecializationMapEntry> entries;
+    std::vector<uint8_t> data;
+    auto append = [&](uint32_t cid, const uint8_t* src, size_t size) {
+      entries.push_back({ cid, static_cast<uint32_t>(data.size()), size });
+      data.insert(data.end(), src, src + size);
+    };
+    for (auto e = entries_.begin(); e != entries_.end(); ++e) {
+      if (e == it) append(id, bytes.data(), bytes.size());
+      if (e->constantID != id) append(e->constantID, data_.data() + e->offset, e->size);
+    }
+    if (it == entries_.end()) append(id, bytes.data(), bytes.size());
+    entries_.swap(entries);
+    data_.swap(data);
+    return *this;
+  }
+
+  std::vector<VkSpecializationMapEntry> entries_;
+  std::vector<uint8_t> data_;
+};
+
+// 64-bit FNV-1a over one stage's source, GLSL text or SPIR-V words. Never 0.
+uint64_t hashShaderSource(const std::string& glsl, SpirvView spirv);
+
+// Full description of a graphics pipeline variant. Two equal descriptions
+// always map to the same cached Context::Pipeline (see
+// Context::getOrCreatePipeline); shader modules and pipeline layouts are
+// shared between variants that use the same source or push-constant layout.
+struct PipelineDesc {
+  std::string vertGlsl;
+  std::string fragGlsl;
+  // Precompiled stages; when set they are used instead of the GLSL source
+  SpirvView vertSpirv;
+  SpirvView fragSpirv;
+  // hashShaderSource of each stage. Sources are compared by these hashes
+  // only, never byte by byte; 0 means "not hashed yet", and
+  // getOrCreatePipeline then hashes the source on every call. Call
+  // hashSources once after setting the sources to make repeated lookups with
+  // this description cost the same whatever the shader size.
+  uint64_t vertSourceHash = 0;
+  uint64_t fragSourceHash = 0;
+  // Files the sources were read from (Context::createPipelineFromFiles);
+  // empty for inline sources. Part of the key, so a hot-reloadable pipeline
+  // never shares an entry with one built from the same inline source.
+  std::string vertPath;
+  std::string fragPath;
+  // Per-stage specialization constants; variants differing only here share
+  // the compiled shader modules
+  SpecializationConstants vertConstants;
+  SpecializationConstants fragConstants;
+  std::vector<VertexBinding> vertexBindings;
+  std::vector<VertexAttribute> vertexAttributes;
+  VkPrimitiveTopology topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+  VkPolygonMode polygonMode = VK_POLYGON_MODE_FILL;
+  VkCullModeFlags cullMode = VK_CULL_MODE_NONE;
+  VkFrontFace frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+  BlendState blend;
+  // Depth state only applies when depthFormat is set
+  bool depthTest = true;
+  bool depthWrite = true;
+  VkCompareOp depthCompare = VK_COMPARE_OP_LESS_OR_EQUAL;
+  VkFormat colorFormat = VK_FORMAT_B8G8R8A8_SRGB;
+  VkFormat depthFormat = VK_FORMAT_UNDEFINED;
+  std::vector<VkPushConstantRange> pushConstants;
+  // Vertices drawn by Context::recordPipelineDraw
+  uint32_t vertexCount = 3;
+
+  // Fills the source hashes that are still 0
+  void hashSources();
+  uint64_t vertHash() const { return vertSourceHash ? vertSourceHash : hashShaderSource(vertGlsl, vertSpirv); }
+  uint64_t fragHash() const { return fragSourceHash ? fragSourceHash : hashShaderSource(fragGlsl, fragSpirv); }
+
+  bool operator==(const PipelineDesc& other) const;
+  bool operator!=(const PipelineDesc& other) const { return !(*this == other); }
+};
+
+// 64-bit FNV-1a over the source hashes, source paths and every fixed-state field
+uint64_t hashPipelineDesc(const PipelineDesc& desc);
+
+} // namespace vklite
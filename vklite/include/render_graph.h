@@ -0,0 +1,215 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <cstdint>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "frame_arena.h"
+
+namespace vklite {
+
+class Context;
+
+// How a pass touches a resource. Each value maps to the narrowest pipeline
+// stage, access mask and (for images) layout the graph uses for barriers.
+enum class RGAccess {
+  None,
+  ColorAttachment,      // colour attachment read/write
+  DepthAttachment,      // depth test + write
+  DepthRead,            // read-only depth attachment
+  FragmentSampled,      // sampled in a fragment shader
+  ComputeSampled,       // sampled in a compute shader
+  ComputeStorageRead,
+  ComputeStorageWrite,
+  VertexStorageRead,    // storage buffer read in a vertex shader
+  IndirectRead,         // indirect draw/dispatch arguments
+  TransferRead,
+  TransferWrite,
+  HostRead,             // read back on the CPU after the submission completes
+  Present,
+};
+
+using RGResource = uint32_t;
+constexpr RGResource kInvalidRGResource = UINT32_MAX;
+
+// Transient image owned by the graph. Usage flags are derived from the
+// declared accesses; memory is aliased with other transients whose lifetimes
+// do not overlap.
+struct RGImageDesc {
+  VkFormat format = VK_FORMAT_UNDEFINED;
+  VkExtent2D extent = {0, 0};
+  uint32_t mipLevels = 1;
+  VkImageAspectFlags aspect = VK_IMAGE_ASPECT_COLOR_BIT;
+};
+
+// Per-frame render graph. Rebuild it every frame (reset, import, add passes,
+// compile, execute); the transient images and their memory persist across
+// frames as long as the set of transients and their lifetimes is unchanged.
+//
+// compile() culls passes that do not contribute to an output or side effect,
+// computes transient lifetimes and aliasing, and execute() records the passes
+// with one batched vkCmdPipelineBarrier2 in front of each pass that needs one.
+//
+// Once the graph shape is stable a frame makes no heap allocations: pass
+// callbacks and compile scratch live in a frame arena, and the pass and
+// resource arrays keep their capacity across reset().
+class RenderGraph {
+public:
+  explicit RenderGraph(Context& context);
+  ~RenderGraph();
+  RenderGraph(const RenderGraph&) = delete;
+  RenderGraph& operator=(const RenderGraph&) = delete;
+
+  class PassBuilder {
+  public:
+    PassBuilder& read(RGResource resource, RGAccess access);
+    PassBuilder& write(RGResource resource, RGAccess access);
+    // Never cull this pass (e.g. it writes CPU-visible data itself)
+    PassBuilder& sideEffect();
+
+  private:
+    friend class RenderGraph;
+    PassBuilder(RenderGraph* graph, uint32_t pass) : graph_(graph), pass_(pass) {}
+    RenderGraph* graph_;
+    uint32_t pass_;
+  };
+
+  // Start a new frame's graph
+  void reset();
+
+  // External resources. `layout` is the image's current layout (UNDEFINED to
+  // discard its contents); lastStages/lastWrites describe the previous use so
+  // the first barrier can wait for it (e.g. the acquire semaphore's wait stage
+  // for swapchain images).
+  RGResource importImage(const char* name, VkImage image, VkImageView view, VkImageAspectFlags aspect, uint32_t mipLevels, VkImageLayout layout,
+                         VkPipelineStageFlags2 lastStages = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, VkAccessFlags2 lastWrites = VK_ACCESS_2_MEMORY_WRITE_BIT);
+  RGResource importBuffer(const char* name, VkBuffer buffer,
+                          VkPipelineStageFlags2 lastStages = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, VkAccessFlags2 lastWrites = VK_ACCESS_2_MEMORY_WRITE_BIT);
+  RGResource createImage(const char* name, const RGImageDesc& desc);
+
+  // `execute` is any callable taking the VkCommandBuffer. It is moved into
+  // the graph's frame arena and destroyed by the next reset().
+  template <typename F>
+  PassBuilder addPass(const char* name, F&& execute) {
+    using Fn = typename std::decay<F>::type;
+    Fn* fn = new (arena_.allocate(sizeof(Fn), alignof(Fn))) Fn(std::forward<F>(execute));
+    void (*destroy)(void*) = nullptr;
+    if constexpr (!std::is_trivially_destructible<Fn>::value) destroy = [](void* f) { static_cast<Fn*>(f)->~Fn(); };
+    return addPassRecord(name, fn, [](void* f, VkCommandBuffer cmd) { (*static_cast<Fn*>(f))(cmd); }, destroy);
+  }
+
+  // Keep `resource` alive past the graph and leave it in `finalAccess`
+  // (e.g. Present for the swapchain image). Passes feeding no output and
+  // having no side effect are culled.
+  void markOutput(RGResource resource, RGAccess finalAccess = RGAccess::None);
+
+  bool compile();
+  void execute(VkCommandBuffer cmd);
+
+  // Valid after compile()
+  VkImage image(RGResource resource) const;
+  VkImageView view(RGResource resource) const;
+  VkBuffer buffer(RGResource resource) const;
+
+  struct Stats {
+    uint32_t passes = 0;
+    uint32_t culledPasses = 0;
+    uint32_t barrierBatches = 0;     // vkCmdPipelineBarrier2 calls
+    uint32_t imageBarriers = 0;
+    uint32_t bufferBarriers = 0;
+    VkDeviceSize transientBytes = 0;          // memory actually allocated
+    VkDeviceSize transientBytesUnaliased = 0; // what it would take without aliasing
+  };
+  const Stats& stats() const { return stats_; }
+
+  // Scratch memory valid until the next reset(), e.g. for data captured by
+  // reference in a pass callback
+  FrameArena& arena() { return arena_; }
+
+  // Release transient images and memory once frames in flight are done with
+  // them (through Context::deferDestroy).
+  void releaseTransients();
+
+private:
+  struct UseState {
+    VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+    VkPipelineStageFlags2 writeStages = 0;
+    VkAccessFlags2 writeAccess = 0;
+    VkPipelineStageFlags2 readStages = 0;
+    VkAccessFlags2 readAccess = 0;
+  };
+  struct Resource {
+    const char* name = "";
+    bool isImage = true;
+    bool transient = false;
+    bool output = false;
+    RGAccess finalAccess = RGAccess::None;
+    VkImage image = VK_NULL_HANDLE;
+    VkImageView view = VK_NULL_HANDLE;
+    VkBuffer buffer = VK_NULL_HANDLE;
+    VkImageAspectFlags aspect = VK_IMAGE_ASPECT_COLOR_BIT;
+    uint32_t mipLevels = 1;
+    RGImageDesc desc;
+    VkImageUsageFlags usage = 0;
+    int firstPass = -1;
+    int lastPass = -1;
+    uint32_t transientIndex = UINT32_MAX;
+    UseState initial;
+    UseState state;  // tracked while recording
+    bool touched = false;
+  };
+  struct Access {
+    RGResource resource = 0;
+    RGAccess access = RGAccess::None;
+    bool write = false;
+  };
+  struct Pass {
+    const char* name = "";
+    void* callable = nullptr;  // in arena_
+    void (*invoke)(void* callable, VkCommandBuffer cmd) = nullptr;
+    void (*destroy)(void* callable) = nullptr;  // null if trivially destructible
+    std::vector<Access> accesses;  // capacity kept across frames
+    bool sideEffect = false;
+    bool culled = false;
+  };
+  // Persistent transient image backed by a range of an aliased allocation
+  struct Transient {
+    RGImageDesc desc;
+    VkImageUsageFlags usage = 0;
+    int firstPass = -1;
+    int lastPass = -1;
+    VkImage image = VK_NULL_HANDLE;
+    VkImageView view = VK_NULL_HANDLE;
+    VkMemoryRequirements requirements{};
+    uint32_t memoryType = UINT32_MAX;
+    uint32_t block = 0;
+    VkDeviceSize offset = 0;
+    // Stages/writes of every transient sharing this memory, waited on by the
+    // first use each frame (covers the previous occupant and previous frame)
+    VkPipelineStageFlags2 aliasStages = 0;
+    VkAccessFlags2 aliasWrites = 0;
+  };
+
+  PassBuilder addPassRecord(const char* name, void* callable, void (*invoke)(void*, VkCommandBuffer), void (*destroy)(void*));
+  void destroyPassCallables();
+  void addAccess(uint32_t pass, RGResource resource, RGAccess access, bool write);
+  bool allocateTransients(const Transient* wanted, size_t count);
+  void transition(Resource& r, RGAccess access, bool write);
+  void flushBarriers(VkCommandBuffer cmd);
+
+  Context& ctx_;
+  std::vector<Resource> resources_;
+  std::vector<Pass> passes_;  // the first passCount_ belong to this frame
+  uint32_t passCount_ = 0;
+  std::vector<Transient> transients_;
+  std::vector<VkDeviceMemory> transientMemory_;
+  std::vector<VkImageMemoryBarrier2> imageBarriers_;
+  std::vector<VkBufferMemoryBarrier2> bufferBarriers_;
+  FrameArena arena_;
+  bool compiled_ = false;
+  Stats stats_;
+};
+
+} // namespace vklite
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace vklite {
+
+struct Window;
+
+// Where runMainLoop builds and submits frames.
+// - MainThread: events, recording, submission and presentation all happen on
+//   the thread that called runMainLoop.
+// - RenderThread: that thread only handles GLFW events (GLFW requires it)
+//   and runs Context::updateCallback; a dedicated render thread waits on
+//   fences, acquires, records, submits and presents. A slow acquire or fence
+//   wait no longer delays input handling, and simulation overlaps rendering.
+enum class ThreadingMode {
+  MainThread,
+  RenderThread,
+};
+
+enum class InputEventType {
+  Key,
+  Char,
+  MouseButton,
+  CursorPos,
+  Scroll,
+  FramebufferResize,
+  Focus,
+  Iconify,
+};
+
+// A window-system event as received by the GLFW callbacks, delivered to
+// Context::inputCallback on the thread that renders.
+struct InputEvent {
+  InputEventType type = InputEventType::Key;
+  Window* window = nullptr;
+  double time = 0.0;  // glfwGetTime when received
+  // Key: key, scancode, action, mods. MouseButton: key = button, action,
+  // mods. Focus / Iconify: action = 1 (focused / iconified) or 0.
+  int key = 0;
+  int scancode = 0;
+  int action = 0;
+  int mods = 0;
+  uint32_t codepoint = 0;  // Char
+  // CursorPos: position; Scroll: offsets; FramebufferResize: new size
+  double x = 0.0;
+  double y = 0.0;
+};
+
+// Bounded single-producer single-consumer ring. push and pop never block or
+// allocate; push fails when the ring is full. Each side caches the other's
+// index so the shared cache lines are only touched when the cache runs out.
+template <typename T, size_t Capacity>
+class SpscQueue {
+  static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0, "capacity must be a power of two");
+
+public:
+  // Producer thread only
+  bool push(const T& value) {
+    const size_t head = head_.load(std::memory_order_relaxed);
+    if (head - tailCache_ == Capacity) {
+      tailCache_ = tail_.load(std::memory_order_acquire);
+      if (head - tailCache_ == Capacity) return false;
+    }
+    items_[head & (Capacity - 1)] = value;
+    head_.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Consumer thread only
+  bool pop(T& out) {
+    const size_t tail = tail_.load(std::memory_order_relaxed);
+    if (tail == headCache_) {
+      headCache_ = head_.load(std::memory_order_acquire);
+      if (tail == headCache_) return false;
+    }
+    out = items_[tail & (Capacity - 1)];
+    tail_.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+private:
+  alignas(64) std::atomic<size_t> head_{0};
+  size_t tailCache_ = 0;
+  alignas(64) std::atomic<size_t> tail_{0};
+  size_t headCache_ = 0;
+  T items_[Capacity];
+};
+
+// Latest-value hand-off from one producer (e.g. the simulation in
+// updateCallback) to one consumer (e.g. buildGraph on the render thread),
+// using three slots so neither side ever waits for the other. The producer
+// fills write() and publishes it; the consumer's read() returns the newest
+// published snapshot, or the one it already had when nothing new arrived.
+// Snapshots the consumer never saw are overwritten.
+template <typename T>
+class FrameSnapshot {
+public:
+  // Producer thread only
+  T& write() { return slots_[writeIndex_]; }
+  void publish() {
+    writeIndex_ = static_cast<uint8_t>(shared_.exchange(static_cast<uint8_t>(writeIndex_ | kFresh), std::memory_order_acq_rel) & kIndexMask);
+  }
+
+  // Consumer thread only
+  const T& read() {
+    if (shared_.load(std::memory_order_relaxed) & kFresh) {
+      readIndex_ = static_cast<uint8_t>(shared_.exchange(readIndex_, std::memory_order_acq_rel) & kIndexMask);
+    }
+    return slots_[readIndex_];
+  }
+  // A snapshot newer than the last read() is waiting
+  bool fresh() const { return (shared_.load(std::memory_order_acquire) & kFresh) != 0; }
+
+private:
+  static constexpr uint8_t kIndexMask = 3;
+  static constexpr uint8_t kFresh = 4;
+  T slots_[3]{};
+  // Index of the slot between producer and consumer, plus kFresh when it
+  // holds a snapshot the consumer has not taken yet
+  std::atomic<uint8_t> shared_{1};
+  uint8_t writeIndex_ = 0;
+  uint8_t readIndex_ = 2;
+};
+
+} // namespace vklite
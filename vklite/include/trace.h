@@ -0,0 +1,70 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace vklite {
+
+// CPU trace zones. While tracing is running each VKLITE_TRACE_ZONE records
+// its name, start and duration into a buffer owned by the calling thread
+// (allocated on the thread's first event with the capacity given to
+// startTrace; events past it are dropped and counted). When tracing is
+// stopped a zone costs one relaxed atomic load. Build with VKLITE_NO_TRACE
+// to compile the zones out entirely.
+//
+// Setting the VKLITE_TRACE environment variable to a file path makes
+// Context::initialize start tracing and Context::shutdown write the trace.
+
+// Discard previously recorded events and start recording.
+void startTrace(size_t eventsPerThread = 1 << 16);
+void stopTrace();
+
+// Write the events recorded so far as Chrome trace event JSON, which loads
+// in chrome://tracing and ui.perfetto.dev. Returns false if the file cannot
+// be written.
+bool writeTrace(const std::string& path);
+
+// Label the calling thread in the trace.
+void setTraceThreadName(const char* name);
+
+// Events lost because a thread's buffer was full.
+uint64_t droppedTraceEvents();
+
+namespace detail {
+extern std::atomic<bool> g_traceRunning;
+uint64_t traceNowNs();
+// `name` must outlive the trace (a string literal)
+void traceRecord(const char* name, uint64_t beginNs, uint64_t endNs);
+} // namespace detail
+
+inline bool traceRunning() {
+  return detail::g_traceRunning.load(std::memory_order_relaxed);
+}
+
+class TraceZone {
+public:
+  explicit TraceZone(const char* name) : name_(name), begin_(traceRunning() ? detail::traceNowNs() : 0) {}
+  ~TraceZone() {
+    if (begin_ != 0) detail::traceRecord(name_, begin_, detail::traceNowNs());
+  }
+  TraceZone(const TraceZone&) = delete;
+  TraceZone& operator=(const TraceZone&) = delete;
+
+private:
+  const char* name_;
+  uint64_t begin_;
+};
+
+} // namespace vklite
+
+#define VKLITE_TRACE_CONCAT_(a, b) a##b
+#define VKLITE_TRACE_CONCAT(a, b) VKLITE_TRACE_CONCAT_(a, b)
+
+#if defined(VKLITE_NO_TRACE)
+#define VKLITE_TRACE_ZONE(name) ((void)0)
+#else
+// Time the rest of the enclosing scope under `name` (a string literal)
+#define VKLITE_TRACE_ZONE(name) ::vklite::TraceZone VKLITE_TRACE_CONCAT(vkliteTraceZone_, __LINE__)(name)
+#endif
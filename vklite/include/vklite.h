@@ -7,7 +7,19 @@
 #include <vector>
 #include <functional>
 #include <memory>
+#include <mutex>
 #include "window.h"
+#include "culling.h"
+#include "pipeline_desc.h"
+#include "frame_writer.h"
+#include "memory_budget.h"
+#include "render_thread.h"
+#include "device_dispatch.h"
+#include "jobs.h"
+#include "device_selection.h"
+#include <unordered_map>
+#include <unordered_set>
+#include <deque>
 
 // Platform macros provided by the build system:
 // - VKLITE_PLAT_WINDOWS (windows)
@@ -16,6 +28,15 @@
 
 namespace vklite {
 
+// How runMainLoop schedules frames.
+// - Continuous: every window renders every iteration (subject to maxFps).
+// - OnDemand: only dirty windows render; with nothing dirty the loop blocks
+//   in glfwWaitEvents until input, resize, expose or invalidateWindow.
+enum class RenderMode {
+  Continuous,
+  OnDemand,
+};
+
 class Context {
 public:
   VkInstance instance = VK_NULL_HANDLE;
@@ -23,6 +44,20 @@ public:
   VkDevice device = VK_NULL_HANDLE;
   VkQueue graphicsQueue = VK_NULL_HANDLE;
   uint32_t graphicsQueueFamily = UINT32_MAX;
+  // Queues of queueTopology's compute and transfer families; the same
+  // handle as graphicsQueue when the family is shared
+  VkQueue computeQueue = VK_NULL_HANDLE;
+  VkQueue transferQueue = VK_NULL_HANDLE;
+  QueueTopology queueTopology;
+
+  // Device initialize should use: a case-insensitive substring of its name
+  // or its UUID (as logged by initialize; dashes optional). The VKLITE_DEVICE
+  // environment variable takes precedence. When empty, or when nothing
+  // usable matches (a warning names any unusable match), the best-scoring
+  // device is chosen; initialize does not fail over the override.
+  std::string preferredDevice;
+  // Every device initialize considered, best score first
+  std::vector<PhysicalDeviceInfo> physicalDevices;
   // Validation / debug utils
   bool validation_enabled = true;
   // User-provided callback invoked when a validation message arrives.
@@ -39,8 +74,13 @@ public:
 
   // Create/destroy per-window surface and swapchain helpers
   bool createSurfaceForWindow(Window* window);
-  bool createSwapchainForWindow(Window* window);
+  // oldSwapchain (when rebuilding) is retired by the new swapchain; the
+  // caller still destroys it.
+  bool createSwapchainForWindow(Window* window, VkSwapchainKHR oldSwapchain = VK_NULL_HANDLE);
   void destroySwapchainForWindow(Window* window);
+  // Rebuild the swapchain (and depth resources) for the current framebuffer
+  // size. Returns false while the window is minimized.
+  bool recreateSwapchainForWindow(Window* window);
 
   // Destroy a window.
   void destroyWindow(Window* window);
@@ -48,21 +88,114 @@ public:
   // Returns true if the window is still open
   bool isWindowOpen(const Window* window) const;
 
-  // Polls events for all windows
+  // Polls events for all windows. Event thread only.
   void pollEvents();
 
   // Runs the main application loop. Returns when all windows are closed.
   void runMainLoop();
 
+  RenderMode renderMode = RenderMode::Continuous;
+  // Set before runMainLoop. In RenderThread mode, while the loop runs, only
+  // the render thread (inputCallback, buildGraph) may call
+  // into the Context; the event thread may call invalidateWindow and
+  // postInputEvent. Windows are closed on the event thread while the render
+  // thread is parked between frames.
+  ThreadingMode threadingMode = ThreadingMode::MainThread;
+
+  // Worker pool shared by the library's parallel work: background pipeline
+  // optimization, shader hot reload, and culling given CullOptions::jobs.
+  // Applications can submit their own jobs too. initialize creates it from
+  // jobSettings; shutdown destroys it.
+  JobSettings jobSettings;
+  JobSystem* jobs = nullptr;
+
+  // Receives window input in arrival order on the thread that renders,
+  // before the frames of that iteration are built. Events are only queued
+  // while a callback is set.
+  std::function<void(const InputEvent&)> inputCallback;
+
+  // Called once per loop iteration on the event thread. In RenderThread mode
+  // it runs concurrently with rendering and is woken after each rendered
+  // frame; hand its results to the frame through a FrameSnapshot.
+  std::function<void()> updateCallback;
+
+  // Queue an event for inputCallback (the GLFW callbacks use this too).
+  // Event thread only. Returns false when no inputCallback is set or the
+  // queue is full; full-queue drops are counted.
+  bool postInputEvent(const InputEvent& event);
+  uint64_t droppedInputEvents() const;
+
+  // Switch the window's presentation profile (present mode, image count and
+  // frames in flight); rebuilds the swapchain.
+  bool setPresentProfile(Window* window, PresentProfile profile);
+
+  // Scale the window's render resolution to keep its GPU time within
+  // settings.targetGpuMs (see DynamicResolutionSettings and
+  // Window::renderExtent); rebuilds the swapchain when toggled. Fails without
+  // GPU timestamps, when the swapchain cannot be blitted, and on windows
+  // building a depth pyramid (the pyramid assumes full-resolution depth).
+  bool setDynamicResolution(Window* window, const DynamicResolutionSettings& settings);
+
+  // Input-sample-to-present latency for the window. Uses VK_KHR_present_wait
+  // when presentWaitSupported, otherwise input to GPU completion.
+  PresentLatencyStats getPresentLatency(const Window* window) const;
+
+  // Mark the window for redraw in OnDemand mode. Safe to call from any
+  // thread; wakes the main loop if it is blocked waiting for events.
+  void invalidateWindow(Window* window);
+
+  // Show or hide the window. Hidden (and iconified) windows are skipped by
+  // the main loop. Event thread only.
+  void setWindowVisible(Window* window, bool visible);
+
+  // Frame-rate cap for windows without input focus, on top of
+  // Window::maxFps (0 = no extra cap, the default). A low cap such as 10
+  // makes background windows of a multi-window application cost little
+  // CPU and GPU time.
+  double unfocusedMaxFps = 0.0;
+
+  // Re-record the window's cached command buffers (Window::cacheCommandBuffers)
+  // before its next frame, for changes the state hash cannot see, such as
+  // different buildGraph passes. Also marks the window dirty.
+  void invalidateCommandBuffers(Window* window);
+
+  // Run `destroy` once the GPU has finished every submission made so far,
+  // for objects that frames in flight may still use. Never waits: pending
+  // deletions are polled at each frame boundary (applyShaderReloads) and
+  // flushed by shutdown. Main thread only.
+  void deferDestroy(std::function<void()> destroy);
+
+  // Serial of the newest submission the GPU has completed.
+  uint64_t completedSubmitSerial() const;
+
   // Get all windows.
   const std::vector<std::unique_ptr<Window>>& getWindows() const { return windows; }
 
   // Shutdown cleans up Vulkan objects and internal resources.
   void shutdown();
 
-  // Device-level function pointers (optional features)
-  PFN_vkCmdBeginRenderingKHR vkCmdBeginRenderingKHR = nullptr;
-  PFN_vkCmdEndRenderingKHR vkCmdEndRenderingKHR = nullptr;
+  // Device-level entry points of `device`, loaded by initialize. Every
+  // device-level call vklite makes goes through it rather than the loader
+  // trampolines; optional entry points are null when their feature is not
+  // enabled. Applications can record through it too (ctx.vk.vkCmdDraw(...)).
+  DeviceDispatch vk;
+
+  // VK_KHR_present_id + VK_KHR_present_wait (both enabled or neither);
+  // vk.vkWaitForPresentKHR is null otherwise
+  bool presentWaitSupported = false;
+  // vkCmdPipelineBarrier2 usable; otherwise RenderGraph emits legacy barriers
+  bool synchronization2Supported = false;
+  // VK_EXT_graphics_pipeline_library: new variants are fast-linked from
+  // cached library parts and optimized in the background
+  bool graphicsPipelineLibrarySupported = false;
+  // Submissions signal a timeline semaphore with their serial; without it
+  // completion is tracked through the frame fences
+  bool timelineSemaphoreSupported = false;
+  // VK_EXT_memory_budget: getMemoryStats reports the driver's per-heap
+  // budget and process usage
+  bool memoryBudgetSupported = false;
+  // Memory types and heaps of physicalDevice, queried once by initialize
+  VkPhysicalDeviceMemoryProperties memoryProperties{};
 
   // Simple pipeline abstraction for easy drawing from the sandbox.
   struct Pipeline {
@@ -72,28 +205,310 @@ public:
     VkShaderModule frag = VK_NULL_HANDLE;
     // primitive vertex count used by draw call
     uint32_t vertexCount = 0;
+    // Incremented each time hot reload swaps in a new VkPipeline
+    uint64_t generation = 0;
+    // Variant cache bookkeeping: non-zero keys refer to shared cache entries
+    uint32_t refCount = 1;
+    uint64_t cacheKey = 0;
+    uint64_t vertKey = 0;
+    uint64_t fragKey = 0;
+    uint64_t layoutKey = 0;
+    // Graphics pipeline library parts (vertex input, pre-rasterization,
+    // fragment shader, fragment output) this pipeline was linked from
+    uint64_t libraryKeys[4] = {};
+    // False while `pipeline` is a fast link waiting for its optimized
+    // replacement; monolithic pipelines are always optimized
+    bool optimized = false;
   };
 
-  // Destroy a pipeline
+  // Return the pipeline for `desc`, creating it on first use. Equal
+  // descriptions return the same reference-counted Pipeline (a hash lookup);
+  // shader modules and pipeline layouts are shared between variants. Sources
+  // are matched by their hashes; a description whose hashSources() was called
+  // is looked up without reading its sources. With
+  // graphicsPipelineLibrarySupported a new variant is fast-linked from cached
+  // library parts and usable at once; the link-time optimized pipeline is
+  // built in the background and swapped in by applyShaderReloads.
+  // Release each reference with destroyPipeline. Main thread only.
+  Pipeline* getOrCreatePipeline(const PipelineDesc& desc);
+
+  // Release a pipeline reference; the last release destroys it.
   void destroyPipeline(Pipeline* p);
 
+  struct PipelineCacheStats {
+    size_t variants = 0;
+    size_t shaderModules = 0;
+    size_t layouts = 0;
+    size_t libraries = 0;
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+  };
+  PipelineCacheStats pipelineCacheStats() const;
+
   // Record draw commands for the provided pipeline into the given command buffer.
   // This is a convenience helper the sandbox can call inside the render callback.
   void recordPipelineDraw(Pipeline* p, Window* window, VkCommandBuffer cmdBuf);
 
-  // Create a pipeline directly from GLSL source strings at runtime. This helper
-  // will invoke an external glslangValidator binary to produce temporary SPIR-V
-  // and then create the pipeline. Returns nullptr on failure.
-  Pipeline* createPipelineFromGlsl(const std::string& vertGlsl, const std::string& fragGlsl, uint32_t vertexCount = 3, VkFormat colorFormat = VK_FORMAT_B8G8R8A8_SRGB);
+  // Create a pipeline directly from GLSL source strings at runtime. Shorthand
+  // for getOrCreatePipeline with default state, so identical requests share
+  // one pipeline. Returns nullptr on failure.
+  // Pass the window's depthFormat when drawing into a window with a depth
+  // attachment; this enables depth test/write (LESS_OR_EQUAL).
+  Pipeline* createPipelineFromGlsl(const std::string& vertGlsl, const std::string& fragGlsl, uint32_t vertexCount = 3, VkFormat colorFormat = VK_FORMAT_B8G8R8A8_SRGB, VkFormat depthFormat = VK_FORMAT_UNDEFINED);
+
+  // Same, from SPIR-V compiled at build time (vklite_add_shaders). The words
+  // are handed to the driver without copying and must outlive the pipeline.
+  // Works without a runtime shader compiler.
+  Pipeline* createPipelineFromSpirv(SpirvView vertSpirv, SpirvView fragSpirv, uint32_t vertexCount = 3, VkFormat colorFormat = VK_FORMAT_B8G8R8A8_SRGB, VkFormat depthFormat = VK_FORMAT_UNDEFINED);
+
+  // Create a pipeline from GLSL files. With hotReload the files are watched:
+  // edits are recompiled on the job pool (jobs) and the new VkPipeline
+  // replaces the old one at the next frame boundary. A failed recompile logs
+  // the compiler output and keeps the previous pipeline. The pipeline is
+  // cached per file pair, never shared with createPipelineFromGlsl callers
+  // passing the same text, so a reload only replaces file-backed pipelines.
+  Pipeline* createPipelineFromFiles(const std::string& vertPath, const std::string& fragPath, uint32_t vertexCount = 3, VkFormat colorFormat = VK_FORMAT_B8G8R8A8_SRGB, VkFormat depthFormat = VK_FORMAT_UNDEFINED, bool hotReload = true);
+
+  // Swap in pipelines rebuilt by hot reload or optimized by the
+  // pipeline library linker, and run deferred deletions (replaced pipelines,
+  // released swapchains and other resources) the GPU has finished with. runMainLoop calls this
+  // at the start of every iteration; call it between frames when driving
+  // rendering yourself.
+  void applyShaderReloads();
+
+  // Compile a GLSL source string for the given stage (vertex, fragment or
+  // compute) to SPIR-V. Returns false and logs the compiler output on failure,
+  // and always when built with VKLITE_RUNTIME_SHADER_COMPILER=OFF.
+  bool compileGlslToSpirv(const std::string& source, VkShaderStageFlagBits stage, std::vector<uint32_t>& spirv);
+
+  // Give the window a depth attachment (cleared to 1.0 each frame). With
+  // buildHiZ a depth pyramid is built after every frame for occlusion culling.
+  bool enableDepthForWindow(Window* window, bool buildHiZ = false);
+
+  // Occlusion-test candidate spheres against the window's depth pyramid from
+  // a previous frame, using the CPU readback copy of one coarse level. Objects
+  // that straddle the near plane or fall outside the readback are kept.
+  // Returns the number of visible objects written to `visible`. When no
+  // pyramid is available yet all candidates are returned.
+  size_t cullOcclusion(Window* window, const float* viewProj, const SphereBounds& spheres, const std::vector<uint32_t>& candidates, std::vector<uint32_t>& visible);
+
+  // GPU variant: records a compute dispatch that tests `objectCount` spheres
+  // (vec4 xyz = centre, w = radius in boundsBuffer) against the full pyramid
+  // of the last rendered frame and writes instanceCount = 0/1 into the
+  // matching VkDrawIndexedIndirectCommand in drawBuffer. Record into a
+  // command buffer submitted to graphicsQueue before the window's next frame.
+  struct OcclusionCullGpuParams {
+    VkBuffer boundsBuffer = VK_NULL_HANDLE;
+    VkBuffer drawBuffer = VK_NULL_HANDLE;
+    uint32_t objectCount = 0;
+    float viewProj[16] = {};
+  };
+  bool recordOcclusionCullGpu(Window* window, VkCommandBuffer cmd, const OcclusionCullGpuParams& params);
+
+  // Record the window's frames to disk (see CaptureSettings). The backbuffer
+  // is copied into a small ring of host-visible buffers; once a frame's fence
+  // has signalled, the buffer is encoded and written on a worker thread. When
+  // every buffer is still busy the frame is skipped (counted as dropped), so
+  // capturing never stalls rendering. The capture keeps the swapchain size it
+  // started with; frames of a different size are dropped. Fails if the
+  // swapchain cannot be copied from or is not 8-bit RGBA/BGRA.
+  bool startCapture(Window* window, const CaptureSettings& settings);
+
+  // Wait for frames still being captured, finish writing and close the
+  // output. destroyWindow stops an active capture.
+  void stopCapture(Window* window);
+
+  struct CaptureStats {
+    uint64_t captured = 0;  // frames copied out of the backbuffer
+    uint64_t written = 0;   // frames encoded and written
+    uint64_t dropped = 0;   // skipped: no free readback buffer or size changed
+    bool active = false;    // still taking frames
+  };
+  CaptureStats getCaptureStats(const Window* window) const;
 
   // When true perform GPU->CPU readback and print a small diagnostic per-frame.
   // Default false to avoid spamming output and slowing down runtime.
   bool debugReadback = false;
+  // With VKLITE_COUNT_ALLOCATIONS, abort when a steady-state frame makes a
+  // heap allocation instead of only logging it (Window::steadyStateAllocations)
+  bool failOnFrameAllocations = false;
+  // Heap allocations made by steady-state main-loop iterations outside
+  // renderWindow (budget checks, reload polling, event dispatch, ...)
+  uint64_t steadyStateLoopAllocations = 0;
+
+  // Pick a memory type allowed by typeBits with all `required` flags,
+  // favouring `preferred`. Returns UINT32_MAX if none matches.
+  uint32_t findMemoryType(uint32_t typeBits, VkMemoryPropertyFlags required, VkMemoryPropertyFlags preferred = 0) const;
+
+  // vkAllocateMemory / vkFreeMemory with accounting: the allocation is
+  // counted against its heap and `category` until freed. Safe from any
+  // thread, e.g. the app thread and the render thread in RenderThread mode.
+  VkResult allocateMemory(const VkMemoryAllocateInfo& info, MemoryCategory category, VkDeviceMemory* memory);
+  void freeMemory(VkDeviceMemory memory);
+
+  // Per-heap usage against budget and per-category totals.
+  MemoryStats getMemoryStats() const;
+
+  // Called when a heap's usage rises above memoryBudgetThreshold (a fraction
+  // of its budget), and again when it falls back below, so caches can shed
+  // data before the driver starts paging. Checked after each allocation and
+  // at frame boundaries (applyShaderReloads), at most a few times a second,
+  // on the thread that allocated or ran the frame boundary.
+  float memoryBudgetThreshold = 0.9f;
+  std::function<void(const MemoryHeapBudget& heap, bool overThreshold)> memoryBudgetCallback;
 
 private:
   std::vector<std::unique_ptr<Window>> windows;
+  std::string traceOutputPath;  // VKLITE_TRACE, written at shutdown
   // Render a single window (internal)
   void renderWindow(Window* window);
+  void recordFrameCommands(Window* window, VkCommandBuffer cmd, uint32_t imageIndex, uint32_t frameSlot, VkBuffer stagingBuffer,
+                           int captureSlot, bool timed, VkCommandBufferUsageFlags usage);
+  // Command buffer caching (command_cache.cpp)
+  bool commandCachingActive(const Window* window) const;
+  VkCommandBuffer cachedFrameCommands(Window* window, uint32_t imageIndex, uint32_t frameSlot);
+  // Frame scheduling shared by both threading modes (window.cpp)
+  void collectDueWindows(double now, std::vector<Window*>& due);
+  double nextFrameTimeout() const;
+  double frameInterval(const Window* window) const;
+  // Set by collectDueWindows: with several windows due, renderWindow waits
+  // only briefly for a frame slot or image and skips the window otherwise
+  bool manyWindowsDue = false;
+  void waitForFrameSlot(Window* window);
+  void recoverFailedSubmit(FrameResources& frame);
+  // Allocation check over a whole main-loop iteration; renderWindow reports
+  // its own allocations per window and adds them to renderWindowAllocations
+  struct LoopAllocationCheck {
+    uint64_t start = 0;
+    uint64_t renderStart = 0;
+    bool steady = false;
+  };
+  uint64_t renderWindowAllocations = 0;
+  bool windowsInSteadyState() const;
+  LoopAllocationCheck beginLoopAllocationCheck() const;
+  void endLoopAllocationCheck(const LoopAllocationCheck& check);
+  // Device selection and queue topology (device_selection.cpp)
+  bool selectPhysicalDevice();
+  // Dynamic resolution (dynamic_resolution.cpp)
+  uint32_t timestampValidBits = 0;  // graphics queue; 0 = no timestamps
+  float timestampPeriod = 0.0f;     // ns per tick
+  bool dynamicResolutionActive(const Window* window) const;
+  void updateDynamicResolution(Window* window, FrameResources& frame, uint32_t frameSlot);
+  void updatePresentLatency(Window* window);
+
+  VkShaderModule createShaderModule(SpirvView spirv);
+  VkPipeline createGraphicsPipeline(const PipelineDesc& desc, VkShaderModule vert, VkShaderModule frag, VkPipelineLayout layout);
+
+  // Variant cache (pipeline_cache.cpp), keyed by content hashes
+  struct CachedModule {
+    VkShaderModule module = VK_NULL_HANDLE;
+    VkShaderStageFlagBits stage = VK_SHADER_STAGE_VERTEX_BIT;
+    uint64_t sourceHash = 0;
+    uint32_t refs = 0;
+  };
+  struct CachedLayout {
+    VkPipelineLayout layout = VK_NULL_HANDLE;
+    std::vector<VkPushConstantRange> ranges;
+    uint32_t refs = 0;
+  };
+  struct CachedVariant {
+    PipelineDesc desc;  // sources cleared; their hashes are set
+    Pipeline* pipeline = nullptr;
+  };
+  std::unordered_map<uint64_t, CachedModule> shaderModuleCache;
+  std::unordered_map<uint64_t, CachedLayout> layoutCache;
+  std::unordered_map<uint64_t, CachedVariant> variantCache;
+  // Every live Pipeline, including variants no longer in variantCache (key
+  // collisions, hot-reloaded); destroyPipelineCache frees what is left
+  std::unordered_set<Pipeline*> ownedPipelines;
+  uint64_t variantHits = 0;
+  uint64_t variantMisses = 0;
+  VkShaderModule acquireShaderModule(const std::string& glsl, SpirvView spirv, uint64_t sourceHash, VkShaderStageFlagBits stage, uint64_t& key);
+  void releaseShaderModule(uint64_t key);
+  VkPipelineLayout acquirePipelineLayout(const std::vector<VkPushConstantRange>& ranges, uint64_t& key);
+  void releasePipelineLayout(uint64_t key);
+  void destroyPipelineCache();
+
+  // Hot reload (hot_reload.cpp)
+  struct HotReloader;
+  HotReloader* hotReloader = nullptr;
+  void forgetHotReload(Pipeline* p);
+  void shutdownHotReload();
+
+  // Render thread and input hand-off (render_thread.cpp)
+  struct RenderThread;
+  RenderThread* renderThread = nullptr;
+  void initThreading();
+  void shutdownThreading();
+  void runThreadedMainLoop();
+  void renderThreadMain();
+  bool waitRenderThread(double timeout);
+  void pauseRenderThread();
+  void resumeRenderThread();
+  void stopRenderThread();
+  void wakeMainLoop();
+  void dispatchInputEvents();
+  void retireNativeWindow(void* handle);
+  void destroyRetiredNativeWindows();
+
+  // Deletion queue (deletion_queue.cpp). Submissions are numbered; an entry
+  // runs once the submission current when it was queued has completed.
+  struct DeferredDeletion {
+    uint64_t serial = 0;
+    std::function<void()> destroy;
+  };
+  std::deque<DeferredDeletion> deferredDeletions;
+  uint64_t submitSerial = 0;
+  VkSemaphore submitTimeline = VK_NULL_HANDLE;  // signalled with submitSerial
+  void retirePipeline(VkPipeline handle);
+  void collectDeferredDeletions(bool all);
+
+  // Memory accounting (memory_budget.cpp); memoryMutex guards everything
+  // below up to checkMemoryBudget
+  mutable std::mutex memoryMutex;
+  struct TrackedAllocation {
+    VkDeviceSize size = 0;
+    uint32_t heap = 0;
+    MemoryCategory category = MemoryCategory::Buffers;
+  };
+  std::unordered_map<VkDeviceMemory, TrackedAllocation> trackedAllocations;
+  VkDeviceSize categoryAllocated[kMemoryCategoryCount] = {};
+  VkDeviceSize heapAllocated[VK_MAX_MEMORY_HEAPS] = {};
+  bool heapOverThreshold[VK_MAX_MEMORY_HEAPS] = {};
+  double lastMemoryBudgetCheck = 0.0;
+  MemoryStats memoryStatsLocked() const;
+  void checkMemoryBudget(bool force);
+
+  // Graphics pipeline libraries (pipeline_library.cpp)
+  struct PipelineLibraries;
+  PipelineLibraries* pipelineLibraries = nullptr;
+  VkPipeline createLinkedPipeline(const PipelineDesc& desc, Pipeline* p);
+  void releasePipelineLibraries(Pipeline* p);
+  void applyOptimizedPipelines();
+  size_t pipelineLibraryCount() const;
+  void shutdownPipelineLibraries();
+
+  // Frame capture (capture.cpp)
+  int beginCaptureFrame(Window* window);
+  void recordCaptureCopy(Window* window, RenderGraph& graph, RGResource backbuffer, uint32_t imageIndex, int slot);
+  void completeCaptureFrame(Window* window, FrameResources& frame);
+  void cancelCaptureFrame(Window* window, int slot);
+  void flushCaptureFrames(Window* window);
+
+  bool createDepthResources(Window* window);
+  void destroyDepthResources(Window* window);
+  bool createHiZPipelines();
+  void destroyHiZPipelines();
+  void recordHiZBuild(Window* window, VkCommandBuffer cmd);
+
+  // Shared compute pipelines for pyramid build and GPU occlusion culling
+  VkDescriptorSetLayout hizBuildSetLayout = VK_NULL_HANDLE;
+  VkPipelineLayout hizBuildLayout = VK_NULL_HANDLE;
+  VkPipeline hizBuildPipeline = VK_NULL_HANDLE;
+  VkDescriptorSetLayout hizCullSetLayout = VK_NULL_HANDLE;
+  VkPipelineLayout hizCullLayout = VK_NULL_HANDLE;
+  VkPipeline hizCullPipeline = VK_NULL_HANDLE;
+  VkSampler hizSampler = VK_NULL_HANDLE;
 };
 
 } // namespace vklite
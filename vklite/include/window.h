@@ -2,27 +2,207 @@
 
 #include <string>
 #include <memory>
+#include <vector>
+#include <atomic>
+#include <functional>
+#include "render_graph.h"
 
 // Forward declare GLFWwindow to keep header light; implementation will include GLFW.
 struct GLFWwindow;
 
 namespace vklite {
 
+class Context;
+struct FrameCapture;  // capture.cpp
+
+// Presentation profile chosen per window (see Context::setPresentProfile).
+// - LowLatency: MAILBOX, else IMMEDIATE (may tear), else FIFO; fewest images,
+//   one frame in flight; the main loop waits for the GPU and display before
+//   sampling input.
+// - Vsync: FIFO, tear-free and display-paced.
+// - Throughput (default): MAILBOX, else FIFO, so it never tears; extra image
+//   and two frames in flight.
+enum class PresentProfile {
+  LowLatency,
+  Vsync,
+  Throughput,
+};
+
+// Render below the swapchain resolution when the GPU falls behind (see
+// Context::setDynamicResolution).
+struct DynamicResolutionSettings {
+  bool enabled = false;
+  // GPU time budget per frame; 0 derives it from maxFps, or 60 Hz uncapped
+  double targetGpuMs = 0.0;
+  // Bounds of the per-axis render scale
+  float minScale = 0.5f;
+  float maxScale = 1.0f;
+  // Upscale filter; NEAREST when the format cannot be blitted linearly
+  VkFilter filter = VK_FILTER_LINEAR;
+};
+
+constexpr uint32_t kMaxFramesInFlight = 2;
+// One readback slot per frame in flight plus the one the CPU is reading
+constexpr int kHiZReadbackSlots = kMaxFramesInFlight + 1;
+
+// Per frame-in-flight command buffer and synchronization
+struct FrameResources {
+  VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+  VkSemaphore imageAvailable = VK_NULL_HANDLE;
+  VkFence inFlight = VK_NULL_HANDLE;
+  int hizSlot = -1;        // Hi-Z readback slot written by this frame
+  double inputTime = 0.0;  // when input for this frame was sampled
+  bool pendingLatency = false;
+  uint64_t submitSerial = 0;  // Context submission number of the last submit
+  int captureSlot = -1;       // frame capture readback slot written by this frame
+  bool timestampsWritten = false;  // GPU timing queries pending for this frame
+};
+
+// Input-to-present latency. With VK_KHR_present_wait the end point is the
+// image actually being presented; otherwise it is GPU completion of the frame
+// (a lower bound that ignores display queueing).
+struct PresentLatencyStats {
+  double lastMs = 0.0;
+  double averageMs = 0.0;  // exponential moving average
+  double maxMs = 0.0;
+  uint64_t samples = 0;
+  bool measuredAtPresent = false;
+};
+
 struct Window {
   void* handle = nullptr; // Will be GLFWwindow*
+  Context* context = nullptr;  // owner, for the GLFW event callbacks
+  // Framebuffer size in pixels, kept current by the event thread so the
+  // render thread never queries GLFW
+  std::atomic<int> framebufferWidth{0};
+  std::atomic<int> framebufferHeight{0};
+  // Window-system state, also kept by the event thread. Iconified and hidden
+  // windows are not rendered; unfocused ones are held to
+  // Context::unfocusedMaxFps.
+  std::atomic<bool> iconified{false};
+  std::atomic<bool> visible{true};
+  std::atomic<bool> focused{true};
   VkSurfaceKHR surface = VK_NULL_HANDLE;
   VkSwapchainKHR swapchain = VK_NULL_HANDLE;
   std::vector<VkImage> swapchainImages;
   std::vector<VkImageView> swapchainImageViews;
   // Format of swapchain images (set when swapchain created)
   VkFormat swapchainFormat = VK_FORMAT_UNDEFINED;
+  VkExtent2D swapchainExtent = {0, 0};
+  // Swapchain images can be copied from (frame capture, debug readback)
+  bool swapchainTransferSrc = false;
+  // Swapchain images can be blitted to (dynamic resolution upscale)
+  bool swapchainTransferDst = false;
   // dynamic rendering: no render pass/framebuffers are required
   // Per-window frame resources
   VkCommandPool commandPool = VK_NULL_HANDLE;
-  VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
-  VkSemaphore imageAvailableSemaphore = VK_NULL_HANDLE;
-  VkSemaphore renderFinishedSemaphore = VK_NULL_HANDLE;
-  VkFence inFlightFence = VK_NULL_HANDLE;
+  std::vector<FrameResources> frames;            // framesInFlight entries
+  uint32_t frameIndex = 0;
+  std::vector<VkSemaphore> renderFinishedSemaphores; // one per swapchain image
+  // Presentation settings derived from presentProfile when the swapchain is built
+  PresentProfile presentProfile = PresentProfile::Throughput;
+  VkPresentModeKHR presentMode = VK_PRESENT_MODE_FIFO_KHR;
+  uint32_t framesInFlight = 1;
+  // Latency tracking (VK_KHR_present_id values are per swapchain)
+  double inputSampleTime = 0.0;
+  uint64_t presentIdCounter = 0;
+  struct PendingPresent {
+    uint64_t presentId = 0;
+    double inputTime = 0.0;
+  };
+  std::vector<PendingPresent> pendingPresents;
+  PresentLatencyStats latency;
+  // Optional depth attachment (see Context::enableDepthForWindow). Recreated
+  // together with the swapchain.
+  bool depthEnabled = false;
+  VkFormat depthFormat = VK_FORMAT_UNDEFINED;
+  VkImage depthImage = VK_NULL_HANDLE;
+  VkDeviceMemory depthMemory = VK_NULL_HANDLE;
+  VkImageView depthView = VK_NULL_HANDLE;
+  // Hierarchical-Z depth pyramid built from the depth attachment after each
+  // frame. Level 0 is half the depth resolution; each level holds the max
+  // (farthest) depth of the texels it covers.
+  bool hizEnabled = false;
+  VkImage hizImage = VK_NULL_HANDLE;
+  VkDeviceMemory hizMemory = VK_NULL_HANDLE;
+  VkImageView hizView = VK_NULL_HANDLE;          // all levels, for sampling
+  std::vector<VkImageView> hizLevelViews;         // one per level, for storage writes
+  VkExtent2D hizExtent = {0, 0};
+  uint32_t hizLevels = 0;
+  VkDescriptorPool hizDescriptorPool = VK_NULL_HANDLE;
+  std::vector<VkDescriptorSet> hizBuildSets;      // one per level
+  // GPU occlusion descriptor sets, cached per (bounds, draws) buffer pair
+  struct HiZCullBinding {
+    VkBuffer bounds = VK_NULL_HANDLE;
+    VkBuffer draws = VK_NULL_HANDLE;
+    VkDescriptorSet set = VK_NULL_HANDLE;
+  };
+  std::vector<HiZCullBinding> hizCullBindings;
+  // CPU copy of one coarse pyramid level, ring-buffered so the CPU reads a
+  // completed frame while frames in flight write the other slots.
+  uint32_t hizReadbackLevel = 0;
+  VkExtent2D hizReadbackExtent = {0, 0};
+  VkBuffer hizReadbackBuffers[kHiZReadbackSlots] = {};
+  VkDeviceMemory hizReadbackMemory[kHiZReadbackSlots] = {};
+  void* hizReadbackMapped[kHiZReadbackSlots] = {};
+  bool hizReadbackCoherent = true;
+  bool hizValid = false;     // pyramid built by at least one submitted frame
+  int hizReadableSlot = -1;  // written by a completed frame
+  // On-demand rendering state. A window is dirty when its contents need to
+  // be redrawn (input, resize, expose or Context::invalidateWindow).
+  std::atomic<bool> dirty{true};
+  // Set when the swapchain no longer matches the surface (resize,
+  // VK_ERROR_OUT_OF_DATE_KHR / VK_SUBOPTIMAL_KHR); rebuilt before the next frame.
+  std::atomic<bool> swapchainOutOfDate{false};
+  // Dynamic resolution: while active the main pass draws into the top-left
+  // renderExtent of an offscreen target the size of the swapchain, which is
+  // then upscaled into the backbuffer before buildGraph's passes. The scale
+  // follows the GPU time measured with timestamp queries.
+  DynamicResolutionSettings dynamicResolution;
+  float renderScale = 1.0f;
+  VkExtent2D renderExtent = {0, 0};  // swapchainExtent when not scaling
+  double gpuFrameMs = 0.0;           // smoothed; measured while enabled
+  VkQueryPool timestampPool = VK_NULL_HANDLE;  // two queries per frame in flight
+  // Context::debugReadback target, created on first use with the swapchain
+  VkBuffer debugStagingBuffer = VK_NULL_HANDLE;
+  VkDeviceMemory debugStagingMemory = VK_NULL_HANDLE;
+  // Heap allocations made while rendering (VKLITE_COUNT_ALLOCATIONS builds;
+  // see alloc_counter.h). A window reaches steady state a few frames after
+  // its swapchain is built; from then on frames should not allocate.
+  uint32_t steadyFrames = 0;            // frames since the swapchain was built, saturating
+  uint64_t frameAllocations = 0;        // during the last renderWindow
+  uint64_t steadyStateAllocations = 0;  // summed over steady-state frames
+  // Colour the backbuffer is cleared to before the main pass
+  float clearColor[4] = {1.0f, 0.0f, 0.0f, 1.0f};
+  // Record one command buffer per swapchain image and resubmit it as long as
+  // the window's state hash (swapchain, pipeline, extent, clear colour,
+  // depth) is unchanged. Only frames without capture, debug readback,
+  // dynamic resolution or a depth pyramid are cached; buildGraph then runs
+  // only when a buffer is re-recorded (see Context::invalidateCommandBuffers).
+  bool cacheCommandBuffers = false;
+  struct CachedCommands {
+    VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+    uint64_t stateHash = 0;
+  };
+  std::vector<CachedCommands> cachedCommands;  // per swapchain image
+  uint64_t commandEpoch = 0;                   // bumped by invalidateCommandBuffers
+  uint64_t commandBuffersRecorded = 0;
+  uint64_t commandBuffersReused = 0;
+  // Optional frame-rate cap for this window (0 = uncapped)
+  double maxFps = 0.0;
+  double lastFrameTime = 0.0;
+  uint64_t framesRendered = 0;  // submitted frames
+  // Frames given up because the frame slot or the next image was not ready
+  // while other windows were waiting to render
+  uint64_t framesSkipped = 0;
+  // Per-window render graph, rebuilt every frame by renderWindow. Created on
+  // first use; transient images persist while the graph shape is stable.
+  std::unique_ptr<RenderGraph> graph;
+  // Optional hook to add passes after the main pass, e.g. post-processing on
+  // the backbuffer. depth is kInvalidRGResource without a depth attachment.
+  std::function<void(RenderGraph& graph, RGResource backbuffer, RGResource depth)> buildGraph;
+  // Active frame capture (Context::startCapture), owned by the context
+  FrameCapture* capture = nullptr;
   int width = 0;
   int height = 0;
   std::string title;
@@ -0,0 +1,64 @@
+// alloc_counter.cpp - optional global operator new replacement that counts allocations
+#include "alloc_counter.h"
+
+#if defined(VKLITE_COUNT_ALLOCATIONS)
+#include <cstdlib>
+#include <new>
+
+namespace {
+thread_local uint64_t t_allocations = 0;
+
+void* countedAlloc(std::size_t size) {
+  ++t_allocations;
+  if (void* p = std::malloc(size ? size : 1)) return p;
+  throw std::bad_alloc();
+}
+
+void* countedAlignedAlloc(std::size_t size, std::size_t alignment) {
+  ++t_allocations;
+#if defined(_WIN32)
+  void* p = _aligned_malloc(size ? size : 1, alignment);
+#else
+  // aligned_alloc wants a multiple of the alignment
+  void* p = std::aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment);
+#endif
+  if (p) return p;
+  throw std::bad_alloc();
+}
+
+void alignedFree(void* p) {
+#if defined(_WIN32)
+  _aligned_free(p);
+#else
+  std::free(p);
+#endif
+}
+} // namespace
+
+// The remaining forms (nothrow, sized delete) forward to these by default
+void* operator new(std::size_t size) { return countedAlloc(size); }
+void* operator new[](std::size_t size) { return countedAlloc(size); }
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t) noexcept { std::free(p); }
+void* operator new(std::size_t size, std::align_val_t a) { return countedAlignedAlloc(size, static_cast<std::size_t>(a)); }
+void* operator new[](std::size_t size, std::align_val_t a) { return countedAlignedAlloc(size, static_cast<std::size_t>(a)); }
+void operator delete(void* p, std::align_val_t) noexcept { alignedFree(p); }
+void operator delete[](void* p, std::align_val_t) noexcept { alignedFree(p); }
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept { alignedFree(p); }
+void operator delete[](void* p, std::size_t, std::align_val_t) noexcept { alignedFree(p); }
+
+namespace vklite {
+bool allocationCountingEnabled() { return true; }
+uint64_t threadAllocationCount() { return t_allocations; }
+} // namespace vklite
+
+#else
+
+namespace vklite {
+bool allocationCountingEnabled() { return false; }
+uint64_t threadAllocationCount() { return 0; }
+} // namespace vklite
+
+#endif
@@ -0,0 +1,219 @@
+// capture.cpp - record window frames to disk through a ring of readback buffers
+#include "vklite.h"
+#include "frame_writer.h"
+#include "log.h"
+
+namespace vklite {
+
+// One slot per frame in flight, one the writer is encoding and a spare so a
+// slow encode does not drop the next frame straight away
+constexpr int kCaptureSlots = kMaxFramesInFlight + 2;
+
+struct FrameCapture {
+  CaptureSettings settings;
+  VkExtent2D extent = {0, 0};
+  bool bgra = false;
+  VkBuffer buffers[kCaptureSlots] = {};
+  VkDeviceMemory memory[kCaptureSlots] = {};
+  void* mapped[kCaptureSlots] = {};
+  bool coherent = true;
+  // Set while a frame copies into the slot or the writer encodes it; the
+  // writer clears it on its thread
+  std::atomic<bool> busy[kCaptureSlots];
+  std::unique_ptr<FrameWriter> writer;
+  uint64_t frameCounter = 0;  // rendered frames, for `every`
+  uint64_t captured = 0;
+  uint64_t dropped = 0;
+  bool warnedExtent = false;
+};
+
+namespace {
+
+void destroyCaptureBuffers(Context& ctx, FrameCapture* cap) {
+  for (int slot = 0; slot < kCaptureSlots; ++slot) {
+    if (cap->buffers[slot] != VK_NULL_HANDLE) ctx.vk.vkDestroyBuffer(ctx.device, cap->buffers[slot], nullptr);
+    // Freeing also unmaps the persistently mapped memory
+    ctx.freeMemory(cap->memory[slot]);
+    cap->buffers[slot] = VK_NULL_HANDLE;
+    cap->memory[slot] = VK_NULL_HANDLE;
+    cap->mapped[slot] = nullptr;
+  }
+}
+
+} // namespace
+
+bool Context::startCapture(Window* window, const CaptureSettings& settings) {
+  if (!window || window->swapchain == VK_NULL_HANDLE || device == VK_NULL_HANDLE) return false;
+  if (window->capture) stopCapture(window);
+  if (!window->swapchainTransferSrc) {
+    VKLITE_LOG_ERROR("startCapture: swapchain images do not support transfer reads");
+    return false;
+  }
+  bool bgra = false;
+  switch (window->swapchainFormat) {
+    case VK_FORMAT_B8G8R8A8_UNORM:
+    case VK_FORMAT_B8G8R8A8_SRGB:
+      bgra = true;
+      break;
+    case VK_FORMAT_R8G8B8A8_UNORM:
+    case VK_FORMAT_R8G8B8A8_SRGB:
+      break;
+    default:
+      VKLITE_LOG_ERROR("startCapture: unsupported swapchain format %d", static_cast<int>(window->swapchainFormat));
+      return false;
+  }
+
+  FrameCapture* cap = new FrameCapture();
+  cap->settings = settings;
+  if (cap->settings.every == 0) cap->settings.every = 1;
+  cap->extent = window->swapchainExtent;
+  cap->bgra = bgra;
+  for (auto& b : cap->busy) b = false;
+
+  const VkDeviceSize size = static_cast<VkDeviceSize>(cap->extent.width) * cap->extent.height * 4;
+  bool ok = true;
+  for (int slot = 0; slot < kCaptureSlots && ok; ++slot) {
+    VkBufferCreateInfo bci{};
+    bci.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bci.size = size;
+    bci.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+    bci.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    if (vk.vkCreateBuffer(device, &bci, nullptr, &cap->buffers[slot]) != VK_SUCCESS) {
+      cap->buffers[slot] = VK_NULL_HANDLE;
+      ok = false;
+      break;
+    }
+    VkMemoryRequirements req{};
+    vk.vkGetBufferMemoryRequirements(device, cap->buffers[slot], &req);
+    VkMemoryAllocateInfo mai{};
+    mai.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    mai.allocationSize = req.size;
+    // The CPU reads every byte: cached memory is much faster to read back
+    mai.memoryTypeIndex = findMemoryType(req.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, VK_MEMORY_PROPERTY_HOST_CACHED_BIT);
+    if (mai.memoryTypeIndex == UINT32_MAX || allocateMemory(mai, MemoryCategory::Readback, &cap->memory[slot]) != VK_SUCCESS) {
+      cap->memory[slot] = VK_NULL_HANDLE;
+      ok = false;
+      break;
+    }
+    cap->coherent = (memoryProperties.memoryTypes[mai.memoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != 0;
+    vk.vkBindBufferMemory(device, cap->buffers[slot], cap->memory[slot], 0);
+    ok = vk.vkMapMemory(device, cap->memory[slot], 0, VK_WHOLE_SIZE, 0, &cap->mapped[slot]) == VK_SUCCESS;
+  }
+  if (!ok) {
+    VKLITE_LOG_ERROR("startCapture: failed to allocate readback buffers");
+  } else {
+    cap->writer = std::make_unique<FrameWriter>(cap->settings, cap->extent.width, cap->extent.height);
+    ok = cap->writer->open();
+  }
+  if (!ok) {
+    cap->writer.reset();
+    destroyCaptureBuffers(*this, cap);
+    delete cap;
+    return false;
+  }
+  window->capture = cap;
+  return true;
+}
+
+void Context::stopCapture(Window* window) {
+  if (!window || !window->capture) return;
+  FrameCapture* cap = window->capture;
+  // Hand over frames still in flight, then let the writer drain
+  flushCaptureFrames(window);
+  cap->writer->finish();
+  // No submitted frame references the buffers any more
+  destroyCaptureBuffers(*this, cap);
+  delete cap;
+  window->capture = nullptr;
+}
+
+Context::CaptureStats Context::getCaptureStats(const Window* window) const {
+  CaptureStats s;
+  if (!window || !window->capture) return s;
+  const FrameCapture* cap = window->capture;
+  s.captured = cap->captured;
+  s.written = cap->writer->framesWritten();
+  s.dropped = cap->dropped;
+  s.active = !cap->writer->failed() && (cap->settings.maxFrames == 0 || cap->captured < cap->settings.maxFrames);
+  return s;
+}
+
+// Pick the readback slot for the frame being recorded, or -1 to skip it
+int Context::beginCaptureFrame(Window* window) {
+  FrameCapture* cap = window->capture;
+  if (!cap) return -1;
+  if (cap->frameCounter++ % cap->settings.every != 0) return -1;
+  if (cap->settings.maxFrames > 0 && cap->captured >= cap->settings.maxFrames) return -1;
+  if (cap->writer->failed()) return -1;
+  if (window->swapchainExtent.width != cap->extent.width || window->swapchainExtent.height != cap->extent.height) {
+    if (!cap->warnedExtent) {
+      VKLITE_LOG_WARN("capture: window resized, dropping frames until it returns to %ux%u", cap->extent.width, cap->extent.height);
+      cap->warnedExtent = true;
+    }
+    ++cap->dropped;
+    return -1;
+  }
+  for (int slot = 0; slot < kCaptureSlots; ++slot) {
+    if (!cap->busy[slot]) {
+      cap->busy[slot] = true;
+      ++cap->captured;
+      return slot;
+    }
+  }
+  // The writer is behind; skip rather than stall the frame
+  ++cap->dropped;
+  return -1;
+}
+
+void Context::recordCaptureCopy(Window* window, RenderGraph& graph, RGResource backbuffer, uint32_t imageIndex, int slot) {
+  VkBuffer buffer = window->capture->buffers[slot];
+  const VkExtent2D extent = window->capture->extent;
+  RGResource target = graph.importBuffer("capture", buffer, VK_PIPELINE_STAGE_2_NONE, 0);
+  graph.addPass("capture", [this, window, imageIndex, buffer, extent](VkCommandBuffer cb) {
+    VkBufferImageCopy bic{};
+    bic.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+    bic.imageExtent = { extent.width, extent.height, 1 };
+    vk.vkCmdCopyImageToBuffer(cb, window->swapchainImages[imageIndex], VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, buffer, 1, &bic);
+  })
+      .read(backbuffer, RGAccess::TransferRead)
+      .write(target, RGAccess::TransferWrite);
+  graph.markOutput(target, RGAccess::HostRead);
+}
+
+// The frame's fence has signalled: its copy is complete
+void Context::completeCaptureFrame(Window* window, FrameResources& frame) {
+  const int slot = frame.captureSlot;
+  frame.captureSlot = -1;
+  FrameCapture* cap = window->capture;
+  if (!cap || slot < 0) return;
+  if (!cap->coherent) {
+    VkMappedMemoryRange range{};
+    range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+    range.memory = cap->memory[slot];
+    range.size = VK_WHOLE_SIZE;
+    vk.vkInvalidateMappedMemoryRanges(device, 1, &range);
+  }
+  cap->writer->push(static_cast<const uint8_t*>(cap->mapped[slot]), cap->bgra, [cap, slot] { cap->busy[slot] = false; });
+}
+
+// The frame was never submitted
+void Context::cancelCaptureFrame(Window* window, int slot) {
+  FrameCapture* cap = window->capture;
+  if (!cap || slot < 0) return;
+  cap->busy[slot] = false;
+  --cap->captured;
+}
+
+// Wait for frames in flight that carry a capture and hand them to the
+// writer, oldest first
+void Context::flushCaptureFrames(Window* window) {
+  const size_t count = window->frames.size();
+  for (size_t i = 0; i < count; ++i) {
+    FrameResources& frame = window->frames[(window->frameIndex + i) % count];
+    if (frame.captureSlot < 0) continue;
+    vk.vkWaitForFences(device, 1, &frame.inFlight, VK_TRUE, UINT64_MAX);
+    completeCaptureFrame(window, frame);
+  }
+}
+
+} // namespace vklite
@@ -0,0 +1,108 @@
+// command_cache.cpp - per-swapchain-image command buffers resubmitted while the window state is unchanged
+#include "vklite.h"
+#include "log.h"
+#include "trace.h"
+
+namespace vklite {
+
+namespace {
+
+constexpr uint64_t kFnvOffset = 1469598103934665603ull;
+constexpr uint64_t kFnvPrime = 1099511628211ull;
+
+struct Hasher {
+  uint64_t h = kFnvOffset;
+  template <typename T> void value(const T& v) {
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(&v);
+    for (size_t i = 0; i < sizeof(T); ++i) {
+      h ^= p[i];
+      h *= kFnvPrime;
+    }
+  }
+  // 0 is reserved for "not recorded"
+  uint64_t result() const { return h ? h : 1; }
+};
+
+// Everything recordFrameCommands reads for a cacheable frame. Per-image
+// handles (backbuffer, view) are fixed for the swapchain's lifetime.
+uint64_t commandStateHash(const Window* window) {
+  Hasher h;
+  h.value(window->swapchain);
+  h.value(window->swapchainExtent.width);
+  h.value(window->swapchainExtent.height);
+  h.value(window->renderExtent.width);
+  h.value(window->renderExtent.height);
+  for (float c : window->clearColor) h.value(c);
+  h.value(window->depthView);
+  h.value(static_cast<bool>(window->buildGraph));
+  h.value(window->commandEpoch);
+  const Context::Pipeline* p = static_cast<const Context::Pipeline*>(window->pipeline);
+  h.value(p);
+  if (p) {
+    // A hot reload swaps the VkPipeline under the same Pipeline object
+    h.value(p->pipeline);
+    h.value(p->generation);
+    h.value(p->vertexCount);
+  }
+  return h.result();
+}
+
+} // namespace
+
+void Context::invalidateCommandBuffers(Window* window) {
+  if (!window) return;
+  ++window->commandEpoch;
+  window->dirty = true;
+}
+
+// Frames whose commands change every frame are always recorded: capture and
+// debug readback copy into per-frame slots, dynamic resolution writes
+// timestamps and moves the render area, and the depth pyramid feeds a
+// per-frame readback ring.
+bool Context::commandCachingActive(const Window* window) const {
+  return window->cacheCommandBuffers && !window->capture && !debugReadback && !dynamicResolutionActive(window) && !window->hizEnabled;
+}
+
+// Command buffer for swapchain image `imageIndex`, re-recorded if the state
+// hash changed since it was last recorded
+VkCommandBuffer Context::cachedFrameCommands(Window* window, uint32_t imageIndex, uint32_t frameSlot) {
+  if (window->cachedCommands.size() != window->swapchainImages.size()) window->cachedCommands.resize(window->swapchainImages.size());
+  Window::CachedCommands& cached = window->cachedCommands[imageIndex];
+  const uint64_t hash = commandStateHash(window);
+  if (cached.commandBuffer != VK_NULL_HANDLE && cached.stateHash == hash) {
+    ++window->commandBuffersReused;
+    return cached.commandBuffer;
+  }
+
+  VKLITE_TRACE_ZONE("recordCachedCommands");
+  // The stale buffer may still be pending on the GPU: free it once its
+  // submissions have completed and record into a fresh one
+  if (cached.commandBuffer != VK_NULL_HANDLE) {
+    VkDevice dev = device;
+    VkCommandPool pool = window->commandPool;
+    VkCommandBuffer stale = cached.commandBuffer;
+    deferDestroy([this, dev, pool, stale] { vk.vkFreeCommandBuffers(dev, pool, 1, &stale); });
+    cached.commandBuffer = VK_NULL_HANDLE;
+    cached.stateHash = 0;
+  }
+  VkCommandBufferAllocateInfo cbi{};
+  cbi.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+  cbi.commandPool = window->commandPool;
+  cbi.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+  cbi.commandBufferCount = 1;
+  VkCommandBuffer cmd = window->frames[frameSlot].commandBuffer;
+  if (vk.vkAllocateCommandBuffers(device, &cbi, &cached.commandBuffer) != VK_SUCCESS) {
+    VKLITE_LOG_WARN("cachedFrameCommands: command buffer allocation failed, recording this frame");
+    cached.commandBuffer = VK_NULL_HANDLE;
+    recordFrameCommands(window, cmd, imageIndex, frameSlot, VK_NULL_HANDLE, -1, false, 0);
+    return cmd;
+  }
+  // Resubmitted while an earlier submission of it may still be executing
+  recordFrameCommands(window, cached.commandBuffer, imageIndex, frameSlot, VK_NULL_HANDLE, -1, false,
+                      VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT);
+  cached.stateHash = hash;
+  ++window->commandBuffersRecorded;
+  return cached.commandBuffer;
+}
+
+} // namespace vklite
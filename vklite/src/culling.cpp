@@ -0,0 +1,446 @@
+// culling.cpp - SoA frustum culling kernels (scalar / SSE / AVX2) for vklite
+#include "culling.h"
+#include "jobs.h"
+#include <algorithm>
+#include <cmath>
+#include <memory>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define VKLITE_CULL_SSE 1
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#define VKLITE_CULL_AVX2 1
+#define VKLITE_TARGET_AVX2
+#elif defined(__GNUC__) || defined(__clang__)
+#define VKLITE_CULL_AVX2 1
+#define VKLITE_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+#endif
+
+namespace vklite {
+
+Frustum Frustum::fromViewProjection(const float* m) {
+  // Row i of the matrix; m is column-major so element (row, col) is m[col * 4 + row].
+  auto row = [m](int i, float out[4]) {
+    out[0] = m[0 * 4 + i];
+    out[1] = m[1 * 4 + i];
+    out[2] = m[2 * 4 + i];
+    out[3] = m[3 * 4 + i];
+  };
+  float r0[4], r1[4], r2[4], r3[4];
+  row(0, r0);
+  row(1, r1);
+  row(2, r2);
+  row(3, r3);
+
+  Frustum f;
+  for (int c = 0; c < 4; ++c) {
+    f.planes[0][c] = r3[c] + r0[c]; // left
+    f.planes[1][c] = r3[c] - r0[c]; // right
+    f.planes[2][c] = r3[c] + r1[c]; // bottom
+    f.planes[3][c] = r3[c] - r1[c]; // top
+    f.planes[4][c] = r2[c];         // near (Vulkan: z >= 0)
+    f.planes[5][c] = r3[c] - r2[c]; // far
+  }
+  // Normalize so the plane distance is in world units (needed for sphere radii)
+  for (auto& p : f.planes) {
+    float len = std::sqrt(p[0] * p[0] + p[1] * p[1] + p[2] * p[2]);
+    if (len > 0.0f) {
+      p[0] /= len;
+      p[1] /= len;
+      p[2] /= len;
+      p[3] /= len;
+    }
+  }
+  return f;
+}
+
+uint32_t SphereBounds::add(float x, float y, float z, float r) {
+  centerX.push_back(x);
+  centerY.push_back(y);
+  centerZ.push_back(z);
+  radius.push_back(r);
+  return static_cast<uint32_t>(radius.size() - 1);
+}
+
+void SphereBounds::set(uint32_t index, float x, float y, float z, float r) {
+  centerX[index] = x;
+  centerY[index] = y;
+  centerZ[index] = z;
+  radius[index] = r;
+}
+
+void SphereBounds::reserve(size_t count) {
+  centerX.reserve(count);
+  centerY.reserve(count);
+  centerZ.reserve(count);
+  radius.reserve(count);
+}
+
+void SphereBounds::clear() {
+  centerX.clear();
+  centerY.clear();
+  centerZ.clear();
+  radius.clear();
+}
+
+uint32_t AabbBounds::add(const float minCorner[3], const float maxCorner[3]) {
+  centerX.push_back(0.0f);
+  centerY.push_back(0.0f);
+  centerZ.push_back(0.0f);
+  extentX.push_back(0.0f);
+  extentY.push_back(0.0f);
+  extentZ.push_back(0.0f);
+  uint32_t index = static_cast<uint32_t>(extentX.size() - 1);
+  set(index, minCorner, maxCorner);
+  return index;
+}
+
+void AabbBounds::set(uint32_t index, const float minCorner[3], const float maxCorner[3]) {
+  centerX[index] = 0.5f * (minCorner[0] + maxCorner[0]);
+  centerY[index] = 0.5f * (minCorner[1] + maxCorner[1]);
+  centerZ[index] = 0.5f * (minCorner[2] + maxCorner[2]);
+  extentX[index] = 0.5f * (maxCorner[0] - minCorner[0]);
+  extentY[index] = 0.5f * (maxCorner[1] - minCorner[1]);
+  extentZ[index] = 0.5f * (maxCorner[2] - minCorner[2]);
+}
+
+void AabbBounds::reserve(size_t count) {
+  centerX.reserve(count);
+  centerY.reserve(count);
+  centerZ.reserve(count);
+  extentX.reserve(count);
+  extentY.reserve(count);
+  extentZ.reserve(count);
+}
+
+void AabbBounds::clear() {
+  centerX.clear();
+  centerY.clear();
+  centerZ.clear();
+  extentX.clear();
+  extentY.clear();
+  extentZ.clear();
+}
+
+namespace {
+
+// Kernels test the half-open range [begin, end) and write visible indices
+// contiguously starting at out[0]. They return the number written. The
+// compaction is branch-free: every index is stored, the cursor only advances
+// for visible ones, so out must have room for (end - begin) entries.
+using SphereKernelFn = size_t (*)(const Frustum&, const SphereBounds&, uint32_t, uint32_t, uint32_t*);
+using AabbKernelFn = size_t (*)(const Frustum&, const AabbBounds&, uint32_t, uint32_t, uint32_t*);
+
+size_t cullSpheresScalar(const Frustum& f, const SphereBounds& s, uint32_t begin, uint32_t end, uint32_t* out) {
+  size_t n = 0;
+  for (uint32_t i = begin; i < end; ++i) {
+    const float x = s.centerX[i], y = s.centerY[i], z = s.centerZ[i], r = s.radius[i];
+    bool inside = true;
+    for (const auto& p : f.planes) {
+      inside &= (p[0] * x + p[1] * y + p[2] * z + p[3]) >= -r;
+    }
+    out[n] = i;
+    n += inside ? 1 : 0;
+  }
+  return n;
+}
+
+size_t cullAabbsScalar(const Frustum& f, const AabbBounds& b, uint32_t begin, uint32_t end, uint32_t* out) {
+  size_t n = 0;
+  for (uint32_t i = begin; i < end; ++i) {
+    const float x = b.centerX[i], y = b.centerY[i], z = b.centerZ[i];
+    const float ex = b.extentX[i], ey = b.extentY[i], ez = b.extentZ[i];
+    bool inside = true;
+    for (const auto& p : f.planes) {
+      float dist = p[0] * x + p[1] * y + p[2] * z + p[3];
+      float rad = std::fabs(p[0]) * ex + std::fabs(p[1]) * ey + std::fabs(p[2]) * ez;
+      inside &= (dist + rad) >= 0.0f;
+    }
+    out[n] = i;
+    n += inside ? 1 : 0;
+  }
+  return n;
+}
+
+#if defined(VKLITE_CULL_SSE)
+inline size_t emitMask4(int mask, uint32_t base, uint32_t* out, size_t n) {
+  out[n] = base + 0; n += (mask >> 0) & 1;
+  out[n] = base + 1; n += (mask >> 1) & 1;
+  out[n] = base + 2; n += (mask >> 2) & 1;
+  out[n] = base + 3; n += (mask >> 3) & 1;
+  return n;
+}
+
+size_t cullSpheresSSE(const Frustum& f, const SphereBounds& s, uint32_t begin, uint32_t end, uint32_t* out) {
+  __m128 px[6], py[6], pz[6], pd[6];
+  for (int p = 0; p < 6; ++p) {
+    px[p] = _mm_set1_ps(f.planes[p][0]);
+    py[p] = _mm_set1_ps(f.planes[p][1]);
+    pz[p] = _mm_set1_ps(f.planes[p][2]);
+    pd[p] = _mm_set1_ps(f.planes[p][3]);
+  }
+  const __m128 zero = _mm_setzero_ps();
+  size_t n = 0;
+  uint32_t i = begin;
+  for (; i + 4 <= end; i += 4) {
+    const __m128 x = _mm_loadu_ps(&s.centerX[i]);
+    const __m128 y = _mm_loadu_ps(&s.centerY[i]);
+    const __m128 z = _mm_loadu_ps(&s.centerZ[i]);
+    const __m128 negR = _mm_sub_ps(zero, _mm_loadu_ps(&s.radius[i]));
+    __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+    for (int p = 0; p < 6; ++p) {
+      __m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(px[p], x), _mm_mul_ps(py[p], y)), _mm_add_ps(_mm_mul_ps(pz[p], z), pd[p]));
+      inside = _mm_and_ps(inside, _mm_cmpge_ps(d, negR));
+    }
+    n = emitMask4(_mm_movemask_ps(inside), i, out, n);
+  }
+  return n + cullSpheresScalar(f, s, i, end, out + n);
+}
+
+size_t cullAabbsSSE(const Frustum& f, const AabbBounds& b, uint32_t begin, uint32_t end, uint32_t* out) {
+  __m128 px[6], py[6], pz[6], pd[6], ax[6], ay[6], az[6];
+  for (int p = 0; p < 6; ++p) {
+    px[p] = _mm_set1_ps(f.planes[p][0]);
+    py[p] = _mm_set1_ps(f.planes[p][1]);
+    pz[p] = _mm_set1_ps(f.planes[p][2]);
+    pd[p] = _mm_set1_ps(f.planes[p][3]);
+    ax[p] = _mm_set1_ps(std::fabs(f.planes[p][0]));
+    ay[p] = _mm_set1_ps(std::fabs(f.planes[p][1]));
+    az[p] = _mm_set1_ps(std::fabs(f.planes[p][2]));
+  }
+  const __m128 zero = _mm_setzero_ps();
+  size_t n = 0;
+  uint32_t i = begin;
+  for (; i + 4 <= end; i += 4) {
+    const __m128 x = _mm_loadu_ps(&b.centerX[i]);
+    const __m128 y = _mm_loadu_ps(&b.centerY[i]);
+    const __m128 z = _mm_loadu_ps(&b.centerZ[i]);
+    const __m128 ex = _mm_loadu_ps(&b.extentX[i]);
+    const __m128 ey = _mm_loadu_ps(&b.extentY[i]);
+    const __m128 ez = _mm_loadu_ps(&b.extentZ[i]);
+    __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+    for (int p = 0; p < 6; ++p) {
+      __m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(px[p], x), _mm_mul_ps(py[p], y)), _mm_add_ps(_mm_mul_ps(pz[p], z), pd[p]));
+      __m128 r = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ax[p], ex), _mm_mul_ps(ay[p], ey)), _mm_mul_ps(az[p], ez));
+      inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(d, r), zero));
+    }
+    n = emitMask4(_mm_movemask_ps(inside), i, out, n);
+  }
+  return n + cullAabbsScalar(f, b, i, end, out + n);
+}
+#endif
+
+#if defined(VKLITE_CULL_AVX2)
+VKLITE_TARGET_AVX2 inline size_t emitMask8(int mask, uint32_t base, uint32_t* out, size_t n) {
+  for (uint32_t k = 0; k < 8; ++k) {
+    out[n] = base + k;
+    n += (mask >> k) & 1;
+  }
+  return n;
+}
+
+VKLITE_TARGET_AVX2 size_t cullSpheresAVX2(const Frustum& f, const SphereBounds& s, uint32_t begin, uint32_t end, uint32_t* out) {
+  __m256 px[6], py[6], pz[6], pd[6];
+  for (int p = 0; p < 6; ++p) {
+    px[p] = _mm256_set1_ps(f.planes[p][0]);
+    py[p] = _mm256_set1_ps(f.planes[p][1]);
+    pz[p] = _mm256_set1_ps(f.planes[p][2]);
+    pd[p] = _mm256_set1_ps(f.planes[p][3]);
+  }
+  const __m256 zero = _mm256_setzero_ps();
+  size_t n = 0;
+  uint32_t i = begin;
+  for (; i + 8 <= end; i += 8) {
+    const __m256 x = _mm256_loadu_ps(&s.centerX[i]);
+    const __m256 y = _mm256_loadu_ps(&s.centerY[i]);
+    const __m256 z = _mm256_loadu_ps(&s.centerZ[i]);
+    const __m256 negR = _mm256_sub_ps(zero, _mm256_loadu_ps(&s.radius[i]));
+    __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+    for (int p = 0; p < 6; ++p) {
+      __m256 d = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(px[p], x), _mm256_mul_ps(py[p], y)), _mm256_add_ps(_mm256_mul_ps(pz[p], z), pd[p]));
+      inside = _mm256_and_ps(inside, _mm256_cmp_ps(d, negR, _CMP_GE_OQ));
+    }
+    n = emitMask8(_mm256_movemask_ps(inside), i, out, n);
+  }
+  return n + cullSpheresScalar(f, s, i, end, out + n);
+}
+
+VKLITE_TARGET_AVX2 size_t cullAabbsAVX2(const Frustum& f, const AabbBounds& b, uint32_t begin, uint32_t end, uint32_t* out) {
+  __m256 px[6], py[6], pz[6], pd[6], ax[6], ay[6], az[6];
+  for (int p = 0; p < 6; ++p) {
+    px[p] = _mm256_set1_ps(f.planes[p][0]);
+    py[p] = _mm256_set1_ps(f.planes[p][1]);
+    pz[p] = _mm256_set1_ps(f.planes[p][2]);
+    pd[p] = _mm256_set1_ps(f.planes[p][3]);
+    ax[p] = _mm256_set1_ps(std::fabs(f.planes[p][0]));
+    ay[p] = _mm256_set1_ps(std::fabs(f.planes[p][1]));
+    az[p] = _mm256_set1_ps(std::fabs(f.planes[p][2]));
+  }
+  const __m256 zero = _mm256_setzero_ps();
+  size_t n = 0;
+  uint32_t i = begin;
+  for (; i + 8 <= end; i += 8) {
+    const __m256 x = _mm256_loadu_ps(&b.centerX[i]);
+    const __m256 y = _mm256_loadu_ps(&b.centerY[i]);
+    const __m256 z = _mm256_loadu_ps(&b.centerZ[i]);
+    const __m256 ex = _mm256_loadu_ps(&b.extentX[i]);
+    const __m256 ey = _mm256_loadu_ps(&b.extentY[i]);
+    const __m256 ez = _mm256_loadu_ps(&b.extentZ[i]);
+    __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+    for (int p = 0; p < 6; ++p) {
+      __m256 d = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(px[p], x), _mm256_mul_ps(py[p], y)), _mm256_add_ps(_mm256_mul_ps(pz[p], z), pd[p]));
+      __m256 r = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ax[p], ex), _mm256_mul_ps(ay[p], ey)), _mm256_mul_ps(az[p], ez));
+      inside = _mm256_and_ps(inside, _mm256_cmp_ps(_mm256_add_ps(d, r), zero, _CMP_GE_OQ));
+    }
+    n = emitMask8(_mm256_movemask_ps(inside), i, out, n);
+  }
+  return n + cullAabbsScalar(f, b, i, end, out + n);
+}
+
+bool cpuSupportsAvx2() {
+#if defined(_MSC_VER) && !defined(__clang__)
+  int info[4] = {};
+  __cpuid(info, 1);
+  const bool osxsave = (info[2] & (1 << 27)) != 0;
+  const bool avx = (info[2] & (1 << 28)) != 0;
+  if (!osxsave || !avx) return false;
+  // The OS must save YMM state on context switches
+  if ((_xgetbv(0) & 0x6) != 0x6) return false;
+  __cpuidex(info, 7, 0);
+  return (info[1] & (1 << 5)) != 0;
+#else
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("avx2") != 0;
+#endif
+}
+#endif
+
+// Kernel output needs an entry per tested object, most of them overwritten
+// or dropped. Kept per thread at its high-water size and never zero-filled,
+// so only the visible indices are ever copied into the caller's vector.
+struct CullScratch {
+  std::unique_ptr<uint32_t[]> data;
+  size_t capacity = 0;
+
+  uint32_t* reserve(size_t count) {
+    if (count > capacity) {
+      data.reset(new uint32_t[count]);  // default-initialized
+      capacity = count;
+    }
+    return data.get();
+  }
+};
+thread_local CullScratch t_cullScratch;
+
+// Split [0, count) across the job pool, run the kernel on each chunk into
+// the scratch buffer and gather the per-chunk results so indices stay in
+// ascending order.
+template <typename Bounds, typename KernelFn>
+size_t cullParallel(const Frustum& f, const Bounds& bounds, std::vector<uint32_t>& visible, const CullOptions& options, KernelFn kernel) {
+  const size_t count = bounds.size();
+  visible.clear();
+  if (count == 0) return 0;
+
+  // At most 64 chunks so the per-chunk bookkeeping stays on the stack
+  constexpr size_t kMaxChunks = 64;
+  uint32_t threads = options.jobs ? options.threadCount : 1;
+  if (threads == 0) threads = options.jobs->workerCount() + 1;
+  const size_t minPerThread = std::max<size_t>(options.minObjectsPerThread, 8);
+  size_t chunks = std::min<size_t>({ threads, kMaxChunks, (count + minPerThread - 1) / minPerThread });
+  chunks = std::max<size_t>(chunks, 1);
+
+  uint32_t* out = t_cullScratch.reserve(count);
+  if (chunks == 1) {
+    const size_t n = kernel(f, bounds, 0, static_cast<uint32_t>(count), out);
+    visible.insert(visible.end(), out, out + n);
+    return n;
+  }
+
+  // Chunk boundaries are multiples of 8 so every chunk but the last runs the
+  // vector loop without a scalar tail.
+  size_t chunkSize = ((count + chunks - 1) / chunks + 7) & ~size_t(7);
+  size_t begins[kMaxChunks], counts[kMaxChunks];
+  for (size_t c = 0; c < chunks; ++c) begins[c] = std::min(count, c * chunkSize);
+  options.jobs->parallelFor(static_cast<uint32_t>(chunks), [&](uint32_t c) {
+    const size_t b = begins[c];
+    const size_t e = std::min(count, b + chunkSize);
+    counts[c] = kernel(f, bounds, static_cast<uint32_t>(b), static_cast<uint32_t>(e), out + b);
+  });
+
+  for (size_t c = 0; c < chunks; ++c) visible.insert(visible.end(), out + begins[c], out + begins[c] + counts[c]);
+  return visible.size();
+}
+
+} // namespace
+
+CullKernel resolveCullKernel(CullKernel requested) {
+#if defined(VKLITE_CULL_AVX2)
+  static const bool hasAvx2 = cpuSupportsAvx2();
+#else
+  const bool hasAvx2 = false;
+#endif
+#if defined(VKLITE_CULL_SSE)
+  const bool hasSse = true;
+#else
+  const bool hasSse = false;
+#endif
+  switch (requested) {
+    case CullKernel::AVX2:
+      if (hasAvx2) return CullKernel::AVX2;
+      [[fallthrough]]; // next best kernel
+    case CullKernel::SSE:
+      if (hasSse) return CullKernel::SSE;
+      return CullKernel::Scalar;
+    case CullKernel::Scalar:
+      return CullKernel::Scalar;
+    case CullKernel::Auto:
+    default:
+      if (hasAvx2) return CullKernel::AVX2;
+      if (hasSse) return CullKernel::SSE;
+      return CullKernel::Scalar;
+  }
+}
+
+const char* cullKernelName(CullKernel kernel) {
+  switch (kernel) {
+    case CullKernel::Auto: return "auto";
+    case CullKernel::Scalar: return "scalar";
+    case CullKernel::SSE: return "sse";
+    case CullKernel::AVX2: return "avx2";
+  }
+  return "unknown";
+}
+
+size_t cullSpheres(const Frustum& frustum, const SphereBounds& spheres, std::vector<uint32_t>& visible, const CullOptions& options) {
+  SphereKernelFn kernel = cullSpheresScalar;
+  switch (resolveCullKernel(options.kernel)) {
+#if defined(VKLITE_CULL_AVX2)
+    case CullKernel::AVX2: kernel = cullSpheresAVX2; break;
+#endif
+#if defined(VKLITE_CULL_SSE)
+    case CullKernel::SSE: kernel = cullSpheresSSE; break;
+#endif
+    default: break;
+  }
+  return cullParallel(frustum, spheres, visible, options, kernel);
+}
+
+size_t cullAabbs(const Frustum& frustum, const AabbBounds& boxes, std::vector<uint32_t>& visible, const CullOptions& options) {
+  AabbKernelFn kernel = cullAabbsScalar;
+  switch (resolveCullKernel(options.kernel)) {
+#if defined(VKLITE_CULL_AVX2)
+    case CullKernel::AVX2: kernel = cullAabbsAVX2; break;
+#endif
+#if defined(VKLITE_CULL_SSE)
+    case CullKernel::SSE: kernel = cullAabbsSSE; break;
+#endif
+    default: break;
+  }
+  return cullParallel(frustum, boxes, visible, options, kernel);
+}
+
+} // namespace vklite
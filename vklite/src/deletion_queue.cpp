@@ -0,0 +1,54 @@
+// deletion_queue.cpp - destroy GPU objects once the submissions that may use them completed
+#include "vklite.h"
+#include <algorithm>
+
+namespace vklite {
+
+void Context::deferDestroy(std::function<void()> destroy) {
+  if (!destroy) return;
+  deferredDeletions.push_back({ submitSerial, std::move(destroy) });
+}
+
+// (Shader modules and pipeline layouts may be destroyed while their pipelines
+// are in use, so only VkPipelines need to go through the queue.)
+void Context::retirePipeline(VkPipeline handle) {
+  if (handle == VK_NULL_HANDLE) return;
+  VkDevice dev = device;
+  deferDestroy([this, dev, handle] { vk.vkDestroyPipeline(dev, handle, nullptr); });
+}
+
+uint64_t Context::completedSubmitSerial() const {
+  if (device == VK_NULL_HANDLE) return submitSerial;
+  if (submitTimeline != VK_NULL_HANDLE) {
+    uint64_t value = 0;
+    if (vk.vkGetSemaphoreCounterValue(device, submitTimeline, &value) == VK_SUCCESS) return value;
+    return 0;
+  }
+  // One queue completes in submission order: everything before the oldest
+  // unfinished frame is done. Windows wait for their own frames before
+  // their fences are destroyed, so no submission is lost here.
+  uint64_t completed = submitSerial;
+  for (const auto& w : windows) {
+    if (!w) continue;
+    for (const auto& f : w->frames) {
+      if (f.submitSerial == 0 || f.submitSerial > completed) continue;
+      if (vk.vkGetFenceStatus(device, f.inFlight) != VK_SUCCESS) completed = f.submitSerial - 1;
+    }
+  }
+  return completed;
+}
+
+// Run the deletions whose submissions have completed, oldest first; `all`
+// after vkDeviceWaitIdle at shutdown.
+void Context::collectDeferredDeletions(bool all) {
+  if (deferredDeletions.empty()) return;
+  const uint64_t completed = all ? submitSerial : completedSubmitSerial();
+  // Entries are queued in serial order; a destroy callback may queue more
+  while (!deferredDeletions.empty() && deferredDeletions.front().serial <= completed) {
+    std::function<void()> destroy = std::move(deferredDeletions.front().destroy);
+    deferredDeletions.pop_front();
+    destroy();
+  }
+}
+
+} // namespace vklite
@@ -0,0 +1,21 @@
+// device_dispatch.cpp - resolve the device-level function table
+#include "device_dispatch.h"
+
+namespace vklite {
+
+bool DeviceDispatch::load(VkDevice device, const char** missing) {
+  *this = DeviceDispatch{};
+  const char* firstMissing = nullptr;
+#define VKLITE_LOAD_REQUIRED(name)                                               \
+  name = reinterpret_cast<PFN_##name>(vkGetDeviceProcAddr(device, #name));     \
+  if (!name && !firstMissing) firstMissing = #name;
+#define VKLITE_LOAD_OPTIONAL(name) name = reinterpret_cast<PFN_##name>(vkGetDeviceProcAddr(device, #name));
+  VKLITE_DEVICE_FUNCTIONS(VKLITE_LOAD_REQUIRED)
+  VKLITE_OPTIONAL_DEVICE_FUNCTIONS(VKLITE_LOAD_OPTIONAL)
+#undef VKLITE_LOAD_REQUIRED
+#undef VKLITE_LOAD_OPTIONAL
+  if (missing) *missing = firstMissing;
+  return firstMissing == nullptr;
+}
+
+} // namespace vklite
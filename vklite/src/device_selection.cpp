@@ -0,0 +1,264 @@
+// device_selection.cpp - score physical devices, honour overrides and map queue families
+#include "vklite.h"
+#include "log.h"
+#include <GLFW/glfw3.h>
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+
+namespace vklite {
+
+namespace {
+
+// Score weights: each optional feature outranks any device type, and the
+// device type outranks any amount of VRAM (counted in MiB).
+constexpr int64_t kFeatureWeight = 10000000;
+constexpr int64_t kTypeWeight = 1000000;
+constexpr int64_t kMaxVramMiB = kTypeWeight - 1;
+
+int64_t typeRank(VkPhysicalDeviceType type) {
+  switch (type) {
+    case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU: return 4;
+    case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU: return 3;
+    case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU: return 2;
+    case VK_PHYSICAL_DEVICE_TYPE_CPU: return 0;  // software rasterizers
+    default: return 1;
+  }
+}
+
+std::vector<VkQueueFamilyProperties> queueFamilies(VkPhysicalDevice device) {
+  uint32_t count = 0;
+  vkGetPhysicalDeviceQueueFamilyProperties(device, &count, nullptr);
+  std::vector<VkQueueFamilyProperties> families(count);
+  vkGetPhysicalDeviceQueueFamilyProperties(device, &count, families.data());
+  return families;
+}
+
+bool canPresent(VkInstance instance, VkPhysicalDevice device, uint32_t family) {
+  return glfwGetPhysicalDevicePresentationSupport(instance, device, family) == GLFW_TRUE;
+}
+
+PhysicalDeviceInfo describeDevice(VkInstance instance, VkPhysicalDevice device) {
+  PhysicalDeviceInfo info;
+  info.device = device;
+  VkPhysicalDeviceIDProperties idProps{};
+  idProps.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ID_PROPERTIES;
+  VkPhysicalDeviceProperties2 props2{};
+  props2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+  props2.pNext = &idProps;
+  vkGetPhysicalDeviceProperties2(device, &props2);
+  const VkPhysicalDeviceProperties& props = props2.properties;
+  info.name = props.deviceName;
+  std::memcpy(info.uuid, idProps.deviceUUID, VK_UUID_SIZE);
+  info.type = props.deviceType;
+  info.apiVersion = props.apiVersion;
+
+  VkPhysicalDeviceMemoryProperties memory{};
+  vkGetPhysicalDeviceMemoryProperties(device, &memory);
+  for (uint32_t i = 0; i < memory.memoryHeapCount; ++i) {
+    if (memory.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) info.deviceLocalBytes += memory.memoryHeaps[i].size;
+  }
+
+  uint32_t extCount = 0;
+  vkEnumerateDeviceExtensionProperties(device, nullptr, &extCount, nullptr);
+  std::vector<VkExtensionProperties> extProps(extCount);
+  vkEnumerateDeviceExtensionProperties(device, nullptr, &extCount, extProps.data());
+  auto hasExtension = [&](const char* name) {
+    for (const auto& e : extProps) {
+      if (std::strcmp(e.extensionName, name) == 0) return true;
+    }
+    return false;
+  };
+  info.swapchain = hasExtension(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+
+  // Feature structs are only valid in the chain when core or extension-provided
+  VkPhysicalDeviceDynamicRenderingFeatures dynamicRendering{};
+  dynamicRendering.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DYNAMIC_RENDERING_FEATURES;
+  VkPhysicalDeviceTimelineSemaphoreFeatures timeline{};
+  timeline.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES;
+  VkPhysicalDeviceDescriptorIndexingFeatures indexing{};
+  indexing.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES;
+  void* chain = nullptr;
+  if (props.apiVersion >= VK_API_VERSION_1_3 || hasExtension("VK_KHR_dynamic_rendering")) {
+    dynamicRendering.pNext = chain;
+    chain = &dynamicRendering;
+  }
+  if (props.apiVersion >= VK_API_VERSION_1_2 || hasExtension("VK_KHR_timeline_semaphore")) {
+    timeline.pNext = chain;
+    chain = &timeline;
+  }
+  if (props.apiVersion >= VK_API_VERSION_1_2 || hasExtension("VK_EXT_descriptor_indexing")) {
+    indexing.pNext = chain;
+    chain = &indexing;
+  }
+  if (chain) {
+    VkPhysicalDeviceFeatures2 features2{};
+    features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    features2.pNext = chain;
+    vkGetPhysicalDeviceFeatures2(device, &features2);
+  }
+  info.dynamicRendering = dynamicRendering.dynamicRendering == VK_TRUE;
+  info.timelineSemaphores = timeline.timelineSemaphore == VK_TRUE;
+  info.descriptorIndexing = indexing.descriptorBindingPartiallyBound == VK_TRUE && indexing.runtimeDescriptorArray == VK_TRUE &&
+                            indexing.shaderSampledImageArrayNonUniformIndexing == VK_TRUE;
+
+  bool graphics = false;
+  const std::vector<VkQueueFamilyProperties> families = queueFamilies(device);
+  for (uint32_t i = 0; i < families.size(); ++i) {
+    if (!(families[i].queueFlags & VK_QUEUE_GRAPHICS_BIT)) continue;
+    graphics = true;
+    if (canPresent(instance, device, i)) info.presentSupport = true;
+  }
+
+  if (props.apiVersion < VK_API_VERSION_1_2) {
+    // Embedded and runtime-compiled SPIR-V targets Vulkan 1.2
+    info.unusable = "Vulkan 1.1 or older";
+  } else if (!graphics) {
+    info.unusable = "no graphics queue";
+  } else if (!info.presentSupport) {
+    info.unusable = "cannot present";
+  } else if (!info.swapchain) {
+    info.unusable = "no VK_KHR_swapchain";
+  } else if (!info.dynamicRendering) {
+    // renderWindow draws nothing without it
+    info.unusable = "no dynamic rendering";
+  } else {
+    // Without timeline semaphores completion is tracked through the frame
+    // fences; descriptor indexing is not used yet
+    const int64_t features = int64_t(info.timelineSemaphores) + int64_t(info.descriptorIndexing);
+    const int64_t vramMiB = std::min<int64_t>(static_cast<int64_t>(info.deviceLocalBytes >> 20), kMaxVramMiB);
+    info.score = features * kFeatureWeight + typeRank(info.type) * kTypeWeight + vramMiB;
+  }
+  return info;
+}
+
+// Name substring (case-insensitive) or full UUID, dashes optional
+bool matchesDevice(const PhysicalDeviceInfo& info, const std::string& wanted) {
+  auto normalize = [](const std::string& s, bool dropDashes) {
+    std::string out;
+    for (char c : s) {
+      if (dropDashes && c == '-') continue;
+      out.push_back(static_cast<char>(std::tolower(static_cast<unsigned char>(c))));
+    }
+    return out;
+  };
+  const std::string uuid = normalize(formatDeviceUuid(info.uuid), true);
+  if (normalize(wanted, true) == uuid) return true;
+  return normalize(info.name, false).find(normalize(wanted, false)) != std::string::npos;
+}
+
+QueueTopology discoverQueues(VkInstance instance, VkPhysicalDevice device) {
+  QueueTopology topology;
+  const std::vector<VkQueueFamilyProperties> families = queueFamilies(device);
+  const uint32_t count = static_cast<uint32_t>(families.size());
+  // Graphics: prefer a family that also computes, so compute work can stay
+  // on the graphics queue when there is no dedicated family
+  for (uint32_t i = 0; i < count; ++i) {
+    const VkQueueFlags flags = families[i].queueFlags;
+    if (!(flags & VK_QUEUE_GRAPHICS_BIT) || !canPresent(instance, device, i)) continue;
+    if (topology.graphicsFamily == UINT32_MAX || (flags & VK_QUEUE_COMPUTE_BIT)) topology.graphicsFamily = i;
+    if (flags & VK_QUEUE_COMPUTE_BIT) break;
+  }
+  topology.computeFamily = topology.graphicsFamily;
+  topology.transferFamily = topology.graphicsFamily;
+  for (uint32_t i = 0; i < count; ++i) {
+    const VkQueueFlags flags = families[i].queueFlags;
+    if (flags & VK_QUEUE_GRAPHICS_BIT) continue;
+    if ((flags & VK_QUEUE_COMPUTE_BIT) && !topology.dedicatedCompute) {
+      topology.computeFamily = i;
+      topology.dedicatedCompute = true;
+    } else if (!(flags & VK_QUEUE_COMPUTE_BIT) && (flags & VK_QUEUE_TRANSFER_BIT) && !topology.dedicatedTransfer) {
+      topology.transferFamily = i;
+      topology.dedicatedTransfer = true;
+    }
+  }
+  if (topology.transferFamily < count) topology.transferGranularity = families[topology.transferFamily].minImageTransferGranularity;
+  return topology;
+}
+
+} // namespace
+
+const char* physicalDeviceTypeName(VkPhysicalDeviceType type) {
+  switch (type) {
+    case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU: return "discrete GPU";
+    case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU: return "integrated GPU";
+    case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU: return "virtual GPU";
+    case VK_PHYSICAL_DEVICE_TYPE_CPU: return "CPU";
+    default: return "other";
+  }
+}
+
+std::string formatDeviceUuid(const uint8_t uuid[VK_UUID_SIZE]) {
+  static const char kHex[] = "0123456789abcdef";
+  std::string out;
+  for (uint32_t i = 0; i < VK_UUID_SIZE; ++i) {
+    if (i == 4 || i == 6 || i == 8 || i == 10) out.push_back('-');
+    out.push_back(kHex[uuid[i] >> 4]);
+    out.push_back(kHex[uuid[i] & 0xf]);
+  }
+  return out;
+}
+
+// Rank every device, apply preferredDevice / VKLITE_DEVICE, and map the
+// chosen device's queue families. Called by initialize after GLFW is up.
+bool Context::selectPhysicalDevice() {
+  uint32_t deviceCount = 0;
+  vkEnumeratePhysicalDevices(instance, &deviceCount, nullptr);
+  if (deviceCount == 0) {
+    VKLITE_LOG_ERROR("No Vulkan physical devices found");
+    return false;
+  }
+  std::vector<VkPhysicalDevice> devices(deviceCount);
+  vkEnumeratePhysicalDevices(instance, &deviceCount, devices.data());
+
+  physicalDevices.clear();
+  for (VkPhysicalDevice dev : devices) physicalDevices.push_back(describeDevice(instance, dev));
+  // Ties keep the loader's order
+  std::stable_sort(physicalDevices.begin(), physicalDevices.end(),
+                   [](const PhysicalDeviceInfo& a, const PhysicalDeviceInfo& b) { return a.score > b.score; });
+  for (const auto& d : physicalDevices) {
+    const std::string uuid = formatDeviceUuid(d.uuid);
+    if (d.score < 0) {
+      VKLITE_LOG_INFO("  device %s (%s, uuid %s): unusable, %s", d.name.c_str(), physicalDeviceTypeName(d.type), uuid.c_str(), d.unusable);
+    } else {
+      VKLITE_LOG_INFO("  device %s (%s, %llu MiB, uuid %s): score %lld", d.name.c_str(), physicalDeviceTypeName(d.type),
+                      static_cast<unsigned long long>(d.deviceLocalBytes >> 20), uuid.c_str(), static_cast<long long>(d.score));
+    }
+  }
+
+  const PhysicalDeviceInfo* chosen = nullptr;
+  std::string wanted = preferredDevice;
+  const char* env = std::getenv("VKLITE_DEVICE");
+  if (env && *env) wanted = env;
+  if (!wanted.empty()) {
+    for (const auto& d : physicalDevices) {
+      if (!matchesDevice(d, wanted)) continue;
+      if (d.score < 0) {
+        VKLITE_LOG_WARN("device \"%s\" matches %s, which is unusable (%s); skipping it", wanted.c_str(), d.name.c_str(), d.unusable);
+        continue;
+      }
+      chosen = &d;
+      break;
+    }
+    if (!chosen) VKLITE_LOG_WARN("no usable device matches \"%s\"; choosing by score", wanted.c_str());
+  }
+  if (!chosen && physicalDevices.front().score >= 0) chosen = &physicalDevices.front();
+  if (!chosen) {
+    VKLITE_LOG_ERROR("Failed to find a suitable physical device: it needs a graphics queue that can present, "
+                     "Vulkan 1.2, VK_KHR_swapchain and dynamic rendering");
+    return false;
+  }
+
+  physicalDevice = chosen->device;
+  queueTopology = discoverQueues(instance, physicalDevice);
+  graphicsQueueFamily = queueTopology.graphicsFamily;
+  timestampValidBits = queueFamilies(physicalDevice)[graphicsQueueFamily].timestampValidBits;
+  VKLITE_LOG_INFO("vklite: using %s (%s); queue families: graphics %u, compute %u%s, transfer %u%s", chosen->name.c_str(),
+                  physicalDeviceTypeName(chosen->type), queueTopology.graphicsFamily, queueTopology.computeFamily,
+                  queueTopology.dedicatedCompute ? " (dedicated)" : "", queueTopology.transferFamily,
+                  queueTopology.dedicatedTransfer ? " (dedicated)" : "");
+  return true;
+}
+
+} // namespace vklite
@@ -0,0 +1,104 @@
+// dynamic_resolution.cpp - scale the render resolution to fit the GPU frame-time budget
+#include "vklite.h"
+#include "log.h"
+#include <algorithm>
+#include <cmath>
+
+namespace vklite {
+
+namespace {
+
+// Smoothing of the measured GPU time (weight of the newest frame)
+constexpr double kGpuTimeSmoothing = 0.2;
+// Over budget the scale moves quickly towards the estimate to avoid missed
+// frames; it only grows back once well under budget, and slowly, so the
+// resolution does not oscillate around the budget.
+constexpr double kShrinkRate = 0.5;
+constexpr double kGrowRate = 0.1;
+constexpr double kGrowBelow = 0.85;  // fraction of the budget
+
+double frameBudgetMs(const Window* window) {
+  if (window->dynamicResolution.targetGpuMs > 0.0) return window->dynamicResolution.targetGpuMs;
+  return 1000.0 / (window->maxFps > 0.0 ? window->maxFps : 60.0);
+}
+
+} // namespace
+
+bool Context::setDynamicResolution(Window* window, const DynamicResolutionSettings& settings) {
+  if (!window) return false;
+  DynamicResolutionSettings s = settings;
+  if (s.enabled) {
+    if (timestampValidBits == 0) {
+      VKLITE_LOG_WARN("setDynamicResolution: the graphics queue has no timestamp support");
+      return false;
+    }
+    if (window->hizEnabled) {
+      VKLITE_LOG_WARN("setDynamicResolution: not supported on windows building a depth pyramid");
+      return false;
+    }
+    VkFormatProperties fp{};
+    vkGetPhysicalDeviceFormatProperties(physicalDevice, window->swapchainFormat, &fp);
+    const VkFormatFeatureFlags blit = VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT;
+    if ((fp.optimalTilingFeatures & blit) != blit) {
+      VKLITE_LOG_WARN("setDynamicResolution: swapchain format %d cannot be blitted", static_cast<int>(window->swapchainFormat));
+      return false;
+    }
+    if (s.filter == VK_FILTER_LINEAR && !(fp.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT)) s.filter = VK_FILTER_NEAREST;
+    s.minScale = std::clamp(s.minScale, 0.1f, 1.0f);
+    s.maxScale = std::clamp(s.maxScale, s.minScale, 1.0f);
+  }
+  const bool toggled = s.enabled != window->dynamicResolution.enabled;
+  window->dynamicResolution = s;
+  window->renderScale = s.enabled ? s.maxScale : 1.0f;
+  window->gpuFrameMs = 0.0;
+  if (!toggled) return true;
+  // The swapchain needs TRANSFER_DST and the frames a timestamp pool
+  window->swapchainOutOfDate = true;
+  return recreateSwapchainForWindow(window);
+}
+
+bool Context::dynamicResolutionActive(const Window* window) const {
+  return window->dynamicResolution.enabled && window->timestampPool != VK_NULL_HANDLE && window->swapchainTransferDst && !window->hizEnabled;
+}
+
+// Runs once the frame slot's fence has signalled: fold its GPU time into the
+// estimate, then pick the extent the next frame in this slot renders at
+void Context::updateDynamicResolution(Window* window, FrameResources& frame, uint32_t frameSlot) {
+  const VkExtent2D full = window->swapchainExtent;
+  if (!dynamicResolutionActive(window)) {
+    window->renderScale = 1.0f;
+    window->renderExtent = full;
+    frame.timestampsWritten = false;
+    return;
+  }
+
+  if (frame.timestampsWritten) {
+    frame.timestampsWritten = false;
+    uint64_t ticks[2] = {};
+    if (vk.vkGetQueryPoolResults(device, window->timestampPool, 2 * frameSlot, 2, sizeof(ticks), ticks, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) == VK_SUCCESS) {
+      const uint64_t mask = timestampValidBits >= 64 ? ~0ull : (1ull << timestampValidBits) - 1;
+      const double ms = static_cast<double>((ticks[1] - ticks[0]) & mask) * timestampPeriod / 1.0e6;
+      window->gpuFrameMs = window->gpuFrameMs == 0.0 ? ms : window->gpuFrameMs + kGpuTimeSmoothing * (ms - window->gpuFrameMs);
+
+      // GPU time grows roughly with the pixel count, i.e. with scale squared
+      const double budget = frameBudgetMs(window);
+      if (window->gpuFrameMs > 0.0) {
+        const double estimate = window->renderScale * std::sqrt(budget / window->gpuFrameMs);
+        double scale = window->renderScale;
+        if (window->gpuFrameMs > budget) {
+          scale += kShrinkRate * (estimate - scale);
+        } else if (window->gpuFrameMs < kGrowBelow * budget) {
+          scale += kGrowRate * (estimate - scale);
+        }
+        window->renderScale = std::clamp(static_cast<float>(scale), window->dynamicResolution.minScale, window->dynamicResolution.maxScale);
+      }
+    }
+  }
+
+  window->renderExtent.width = std::max(1u, static_cast<uint32_t>(std::lround(full.width * window->renderScale)));
+  window->renderExtent.height = std::max(1u, static_cast<uint32_t>(std::lround(full.height * window->renderScale)));
+  window->renderExtent.width = std::min(window->renderExtent.width, full.width);
+  window->renderExtent.height = std::min(window->renderExtent.height, full.height);
+}
+
+} // namespace vklite
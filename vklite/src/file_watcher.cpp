@@ -0,0 +1,163 @@
+// file_watcher.cpp - background file change notification (inotify or mtime polling)
+#include "file_watcher.h"
+#include "log.h"
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+
+#if defined(__linux__)
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+namespace vklite {
+
+namespace {
+
+// Editors often emit several events per save; wait for them to settle
+constexpr double kDebounceSeconds = 0.05;
+constexpr int kPollIntervalMs = 250;
+
+double nowSeconds() {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+long long modificationTime(const std::string& path) {
+  std::error_code ec;
+  auto t = std::filesystem::last_write_time(path, ec);
+  return ec ? 0 : static_cast<long long>(t.time_since_epoch().count());
+}
+
+} // namespace
+
+FileWatcher::FileWatcher(Callback onChange) : onChange_(std::move(onChange)) {
+#if defined(__linux__)
+  inotifyFd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (inotifyFd_ < 0) VKLITE_LOG_WARN("FileWatcher: inotify unavailable, polling file times");
+#endif
+  running_ = true;
+  thread_ = std::thread([this] { run(); });
+}
+
+FileWatcher::~FileWatcher() {
+  stop();
+}
+
+void FileWatcher::stop() {
+  running_ = false;
+  if (thread_.joinable()) thread_.join();
+#if defined(__linux__)
+  if (inotifyFd_ >= 0) {
+    close(inotifyFd_);
+    inotifyFd_ = -1;
+  }
+#endif
+}
+
+bool FileWatcher::watch(const std::string& path) {
+  std::filesystem::path p(path);
+  Entry e;
+  e.path = path;
+  e.directory = p.has_parent_path() ? p.parent_path().string() : std::string(".");
+  e.name = p.filename().string();
+  e.mtime = modificationTime(path);
+#if defined(__linux__)
+  if (inotifyFd_ >= 0) {
+    // Directory watches survive the file being replaced by a rename
+    e.wd = inotify_add_watch(inotifyFd_, e.directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+    if (e.wd < 0) {
+      VKLITE_LOG_WARN("FileWatcher: cannot watch directory %s", e.directory.c_str());
+      return false;
+    }
+  }
+#endif
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (const Entry& existing : entries_) {
+    if (existing.path == path) return true;
+  }
+  entries_.push_back(e);
+  return true;
+}
+
+void FileWatcher::unwatch(const std::string& path) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = std::find_if(entries_.begin(), entries_.end(), [&](const Entry& e) { return e.path == path; });
+  if (it == entries_.end()) return;
+  const int wd = it->wd;
+  entries_.erase(it);
+#if defined(__linux__)
+  // inotify returns the same descriptor for every file in a directory
+  bool shared = std::any_of(entries_.begin(), entries_.end(), [&](const Entry& e) { return e.wd == wd; });
+  if (wd >= 0 && !shared && inotifyFd_ >= 0) inotify_rm_watch(inotifyFd_, wd);
+#else
+  (void)wd;
+#endif
+}
+
+void FileWatcher::run() {
+  while (running_) {
+    if (inotifyFd_ >= 0) {
+      pollInotify(static_cast<int>(kDebounceSeconds * 1000.0));
+    } else {
+      std::this_thread::sleep_for(std::chrono::milliseconds(kPollIntervalMs));
+      pollTimestamps();
+    }
+    flushPending(nowSeconds());
+  }
+}
+
+void FileWatcher::pollInotify(int timeoutMs) {
+#if defined(__linux__)
+  pollfd pfd{ inotifyFd_, POLLIN, 0 };
+  if (poll(&pfd, 1, timeoutMs) <= 0) return;
+  alignas(inotify_event) char buffer[4096];
+  const double now = nowSeconds();
+  while (true) {
+    ssize_t len = read(inotifyFd_, buffer, sizeof(buffer));
+    if (len <= 0) break;
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (char* ptr = buffer; ptr < buffer + len;) {
+      const inotify_event* ev = reinterpret_cast<const inotify_event*>(ptr);
+      if (ev->len > 0) {
+        for (Entry& e : entries_) {
+          if (e.wd == ev->wd && e.name == ev->name) e.pendingSince = now;
+        }
+      }
+      ptr += sizeof(inotify_event) + ev->len;
+    }
+  }
+#else
+  (void)timeoutMs;
+#endif
+}
+
+void FileWatcher::pollTimestamps() {
+  const double now = nowSeconds();
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (Entry& e : entries_) {
+    long long t = modificationTime(e.path);
+    if (t != 0 && t != e.mtime) {
+      e.mtime = t;
+      e.pendingSince = now;
+    }
+  }
+}
+
+void FileWatcher::flushPending(double now) {
+  std::vector<std::string> changed;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (Entry& e : entries_) {
+      if (e.pendingSince >= 0.0 && now - e.pendingSince >= kDebounceSeconds) {
+        e.pendingSince = -1.0;
+        changed.push_back(e.path);
+      }
+    }
+  }
+  for (const std::string& path : changed) {
+    if (onChange_) onChange_(path);
+  }
+}
+
+} // namespace vklite
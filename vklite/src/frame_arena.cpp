@@ -0,0 +1,62 @@
+// frame_arena.cpp - per-frame linear allocator
+#include "frame_arena.h"
+#include <algorithm>
+#include <cstdlib>
+
+namespace vklite {
+
+FrameArena::FrameArena(size_t initialBytes) : initialBytes_(std::max<size_t>(initialBytes, 256)) {}
+
+FrameArena::~FrameArena() {
+  for (Block& b : blocks_) std::free(b.data);
+}
+
+void* FrameArena::allocate(size_t bytes, size_t alignment) {
+  if (bytes == 0) bytes = 1;
+  if (!blocks_.empty()) {
+    Block& b = blocks_.back();
+    const uintptr_t base = reinterpret_cast<uintptr_t>(b.data);
+    const size_t start = ((base + offset_ + alignment - 1) & ~(uintptr_t(alignment) - 1)) - base;
+    if (start + bytes <= b.size) {
+      offset_ = start + bytes;
+      used_ += bytes;
+      return b.data + start;
+    }
+  }
+  // Chain a block that fits this request with room to spare
+  const size_t last = blocks_.empty() ? initialBytes_ / 2 : blocks_.back().size;
+  Block b;
+  b.size = std::max(last * 2, bytes + alignment);
+  b.data = static_cast<uint8_t*>(std::malloc(b.size));
+  if (!b.data) throw std::bad_alloc();
+  blocks_.push_back(b);
+  offset_ = 0;
+  return allocate(bytes, alignment);
+}
+
+void FrameArena::reset() {
+  highWater_ = std::max(highWater_, used_);
+  if (blocks_.size() > 1) {
+    // The frame spilled over: replace the chain with one block sized for it
+    size_t total = 0;
+    for (Block& b : blocks_) {
+      total += b.size;
+      std::free(b.data);
+    }
+    blocks_.clear();
+    Block b;
+    b.size = total;
+    b.data = static_cast<uint8_t*>(std::malloc(b.size));
+    if (b.data) blocks_.push_back(b);
+  }
+  offset_ = 0;
+  used_ = 0;
+}
+
+size_t FrameArena::capacity() const {
+  size_t total = 0;
+  for (const Block& b : blocks_) total += b.size;
+  return total;
+}
+
+} // namespace vklite
@@ -0,0 +1,319 @@
+// frame_writer.cpp - encode captured frames and write them on a worker thread
+#include "frame_writer.h"
+#include "log.h"
+#include "trace.h"
+#include <algorithm>
+#include <cstring>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define VKLITE_FRAME_WRITER_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace vklite {
+
+namespace {
+
+// Frames reserved up front when maxFrames is not set; the file doubles after
+constexpr uint64_t kInitialFrames = 16;
+
+const char kFrameMarker[] = "FRAME\n";
+constexpr size_t kFrameMarkerSize = sizeof(kFrameMarker) - 1;
+
+inline void loadRgb(const uint8_t* px, bool bgra, uint8_t& r, uint8_t& g, uint8_t& b) {
+  r = bgra ? px[2] : px[0];
+  g = px[1];
+  b = bgra ? px[0] : px[2];
+}
+
+// BT.601 limited range, planar Y, Cb, Cr
+void encodeY4m(const uint8_t* src, bool bgra, uint32_t width, uint32_t height, uint8_t* dst) {
+  std::memcpy(dst, kFrameMarker, kFrameMarkerSize);
+  const size_t count = static_cast<size_t>(width) * height;
+  uint8_t* y = dst + kFrameMarkerSize;
+  uint8_t* cb = y + count;
+  uint8_t* cr = cb + count;
+  for (size_t i = 0; i < count; ++i) {
+    uint8_t r, g, b;
+    loadRgb(src + i * 4, bgra, r, g, b);
+    y[i] = static_cast<uint8_t>(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+    cb[i] = static_cast<uint8_t>(((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+    cr[i] = static_cast<uint8_t>(((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+  }
+}
+
+void encodeRaw(const uint8_t* src, bool bgra, uint32_t width, uint32_t height, uint8_t* dst) {
+  const size_t count = static_cast<size_t>(width) * height;
+  if (!bgra) {
+    std::memcpy(dst, src, count * 4);
+    return;
+  }
+  for (size_t i = 0; i < count; ++i) {
+    dst[i * 4 + 0] = src[i * 4 + 2];
+    dst[i * 4 + 1] = src[i * 4 + 1];
+    dst[i * 4 + 2] = src[i * 4 + 0];
+    dst[i * 4 + 3] = src[i * 4 + 3];
+  }
+}
+
+uint32_t crc32(const uint8_t* data, size_t size, uint32_t crc = 0) {
+  static const auto table = [] {
+    std::vector<uint32_t> t(256);
+    for (uint32_t n = 0; n < 256; ++n) {
+      uint32_t c = n;
+      for (int k = 0; k < 8; ++k) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+      t[n] = c;
+    }
+    return t;
+  }();
+  crc = ~crc;
+  for (size_t i = 0; i < size; ++i) crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+  return ~crc;
+}
+
+void putBe32(std::vector<uint8_t>& out, uint32_t v) {
+  out.push_back(static_cast<uint8_t>(v >> 24));
+  out.push_back(static_cast<uint8_t>(v >> 16));
+  out.push_back(static_cast<uint8_t>(v >> 8));
+  out.push_back(static_cast<uint8_t>(v));
+}
+
+void putChunk(std::vector<uint8_t>& out, const char* type, const uint8_t* data, size_t size) {
+  putBe32(out, static_cast<uint32_t>(size));
+  const size_t start = out.size();
+  out.insert(out.end(), type, type + 4);
+  if (size) out.insert(out.end(), data, data + size);
+  putBe32(out, crc32(out.data() + start, size + 4));
+}
+
+// 8-bit RGB PNG. The image data uses stored (uncompressed) deflate blocks:
+// encoding stays cheap enough to keep up with rendering, and captures for
+// regression runs are compared and discarded, not archived.
+void encodePng(const uint8_t* src, bool bgra, uint32_t width, uint32_t height, std::vector<uint8_t>& out) {
+  const size_t rowBytes = 1 + static_cast<size_t>(width) * 3;  // filter byte + RGB
+  std::vector<uint8_t> raw(rowBytes * height);
+  uint32_t a = 1, b = 0;  // Adler-32 of the uncompressed stream
+  for (uint32_t yy = 0; yy < height; ++yy) {
+    uint8_t* row = raw.data() + yy * rowBytes;
+    row[0] = 0;  // filter: none
+    const uint8_t* in = src + static_cast<size_t>(yy) * width * 4;
+    for (uint32_t x = 0; x < width; ++x) loadRgb(in + x * 4, bgra, row[1 + x * 3], row[2 + x * 3], row[3 + x * 3]);
+    for (size_t i = 0; i < rowBytes; ++i) {
+      a = (a + row[i]) % 65521;
+      b = (b + a) % 65521;
+    }
+  }
+
+  std::vector<uint8_t> z;
+  z.reserve(raw.size() + raw.size() / 65535 * 5 + 16);
+  z.push_back(0x78);
+  z.push_back(0x01);
+  size_t offset = 0;
+  do {
+    const size_t len = std::min<size_t>(65535, raw.size() - offset);
+    const bool last = offset + len == raw.size();
+    z.push_back(last ? 1 : 0);
+    z.push_back(static_cast<uint8_t>(len));
+    z.push_back(static_cast<uint8_t>(len >> 8));
+    z.push_back(static_cast<uint8_t>(~len));
+    z.push_back(static_cast<uint8_t>(~len >> 8));
+    z.insert(z.end(), raw.begin() + offset, raw.begin() + offset + len);
+    offset += len;
+  } while (offset < raw.size());
+  putBe32(z, (b << 16) | a);
+
+  static const uint8_t kSignature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+  out.assign(kSignature, kSignature + 8);
+  std::vector<uint8_t> ihdr;
+  putBe32(ihdr, width);
+  putBe32(ihdr, height);
+  ihdr.push_back(8);  // bit depth
+  ihdr.push_back(2);  // colour type: RGB
+  ihdr.push_back(0);  // compression
+  ihdr.push_back(0);  // filter
+  ihdr.push_back(0);  // interlace
+  putChunk(out, "IHDR", ihdr.data(), ihdr.size());
+  putChunk(out, "IDAT", z.data(), z.size());
+  putChunk(out, "IEND", nullptr, 0);
+}
+
+} // namespace
+
+FrameWriter::FrameWriter(const CaptureSettings& settings, uint32_t width, uint32_t height)
+  : settings_(settings), width_(width), height_(height) {
+  const uint64_t pixels = static_cast<uint64_t>(width) * height;
+  if (settings_.format == CaptureFormat::Raw) frameBytes_ = pixels * 4;
+  else if (settings_.format == CaptureFormat::Y4M) frameBytes_ = kFrameMarkerSize + pixels * 3;
+}
+
+FrameWriter::~FrameWriter() {
+  finish();
+}
+
+bool FrameWriter::open() {
+  if (settings_.path.empty() || width_ == 0 || height_ == 0) {
+    VKLITE_LOG_ERROR("capture: no output path or empty frame size");
+    return false;
+  }
+  if (settings_.format != CaptureFormat::Png) {
+#if defined(VKLITE_FRAME_WRITER_MMAP)
+    fd_ = ::open(settings_.path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd_ < 0) {
+      VKLITE_LOG_ERROR("capture: cannot create %s", settings_.path.c_str());
+      return false;
+    }
+#else
+    stream_ = std::fopen(settings_.path.c_str(), "wb");
+    if (!stream_) {
+      VKLITE_LOG_ERROR("capture: cannot create %s", settings_.path.c_str());
+      return false;
+    }
+#endif
+    std::string header;
+    if (settings_.format == CaptureFormat::Y4M) {
+      header = "YUV4MPEG2 W" + std::to_string(width_) + " H" + std::to_string(height_) + " F" +
+               std::to_string(std::max(1u, settings_.fps)) + ":1 Ip A1:1 C444\n";
+    }
+    const uint64_t frames = settings_.maxFrames > 0 ? settings_.maxFrames : kInitialFrames;
+    if (!reserve(header.size() + frames * frameBytes_)) {
+      closeOutput();
+      return false;
+    }
+    if (mapped_) std::memcpy(mapped_, header.data(), header.size());
+    else if (!header.empty()) std::fwrite(header.data(), 1, header.size(), stream_);
+    fileSize_ = header.size();
+  }
+  worker_ = std::thread([this] { run(); });
+  return true;
+}
+
+void FrameWriter::push(const uint8_t* pixels, bool bgra, std::function<void()> done) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (worker_.joinable() && !stopping_) {
+      queue_.push_back({ pixels, bgra, std::move(done) });
+      wake_.notify_one();
+      return;
+    }
+  }
+  if (done) done();
+}
+
+void FrameWriter::finish() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  wake_.notify_one();
+  if (worker_.joinable()) worker_.join();
+  closeOutput();
+}
+
+void FrameWriter::run() {
+  setTraceThreadName("vklite capture");
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    wake_.wait(lock, [this] { return stopping_ || !queue_.empty(); });
+    if (queue_.empty()) break;  // stopping with nothing left
+    Job job = std::move(queue_.front());
+    queue_.pop_front();
+    lock.unlock();
+    if (!failed_) encode(job);
+    if (job.done) job.done();
+    lock.lock();
+  }
+}
+
+void FrameWriter::encode(const Job& job) {
+  VKLITE_TRACE_ZONE("captureEncode");
+  if (settings_.format == CaptureFormat::Png) {
+    std::vector<uint8_t> png;
+    encodePng(job.pixels, job.bgra, width_, height_, png);
+    char suffix[32];
+    std::snprintf(suffix, sizeof(suffix), "_%06llu.png", static_cast<unsigned long long>(nextIndex_++));
+    const std::string path = settings_.path + suffix;
+    std::FILE* f = std::fopen(path.c_str(), "wb");
+    const bool ok = f && std::fwrite(png.data(), 1, png.size(), f) == png.size();
+    if (f) std::fclose(f);
+    if (!ok) {
+      VKLITE_LOG_ERROR("capture: cannot write %s", path.c_str());
+      failed_ = true;
+      return;
+    }
+    ++written_;
+    return;
+  }
+
+  // Encode straight into the mapping when there is one
+  uint8_t* dst = nullptr;
+  if (fd_ >= 0) {
+    if (!reserve(fileSize_ + frameBytes_)) {
+      failed_ = true;
+      return;
+    }
+    dst = mapped_ + fileSize_;
+  } else {
+    scratch_.resize(frameBytes_);
+    dst = scratch_.data();
+  }
+  if (settings_.format == CaptureFormat::Y4M) encodeY4m(job.pixels, job.bgra, width_, height_, dst);
+  else encodeRaw(job.pixels, job.bgra, width_, height_, dst);
+  if (stream_ && std::fwrite(dst, 1, frameBytes_, stream_) != frameBytes_) {
+    VKLITE_LOG_ERROR("capture: write to %s failed", settings_.path.c_str());
+    failed_ = true;
+    return;
+  }
+  fileSize_ += frameBytes_;
+  ++written_;
+}
+
+// Make the mapping cover at least `bytes`, doubling the file as it fills
+bool FrameWriter::reserve(uint64_t bytes) {
+#if defined(VKLITE_FRAME_WRITER_MMAP)
+  if (fd_ < 0) return false;
+  if (bytes <= mappedSize_) return true;
+  const uint64_t size = std::max(bytes, mappedSize_ * 2);
+  if (mapped_) munmap(mapped_, mappedSize_);
+  mapped_ = nullptr;
+  mappedSize_ = 0;
+  if (ftruncate(fd_, static_cast<off_t>(size)) != 0) {
+    VKLITE_LOG_ERROR("capture: cannot grow %s to %llu bytes", settings_.path.c_str(), static_cast<unsigned long long>(size));
+    return false;
+  }
+  void* p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+  if (p == MAP_FAILED) {
+    VKLITE_LOG_ERROR("capture: cannot map %s", settings_.path.c_str());
+    return false;
+  }
+  mapped_ = static_cast<uint8_t*>(p);
+  mappedSize_ = size;
+  return true;
+#else
+  (void)bytes;
+  return stream_ != nullptr;
+#endif
+}
+
+void FrameWriter::closeOutput() {
+#if defined(VKLITE_FRAME_WRITER_MMAP)
+  if (mapped_) munmap(mapped_, mappedSize_);
+  mapped_ = nullptr;
+  mappedSize_ = 0;
+  if (fd_ >= 0) {
+    // Drop the unused tail of the last reservation
+    if (ftruncate(fd_, static_cast<off_t>(fileSize_)) != 0) {
+      VKLITE_LOG_ERROR("capture: cannot truncate %s", settings_.path.c_str());
+    }
+    ::close(fd_);
+    fd_ = -1;
+  }
+#endif
+  if (stream_) {
+    std::fclose(stream_);
+    stream_ = nullptr;
+  }
+}
+
+} // namespace vklite
@@ -0,0 +1,621 @@
+// hiz.cpp - per-window depth attachment, Hi-Z depth pyramid and occlusion culling
+#include "vklite.h"
+#include "window.h"
+#include "log.h"
+#include "hiz_build.comp.spv.h"
+#include "hiz_cull.comp.spv.h"
+#include <vulkan/vulkan.h>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace vklite {
+
+namespace {
+
+// Compute shaders are compiled at build time (shaders/hiz_*.comp), or on
+// first use when no compiler was found then (VKLITE_EMBEDDED_GLSL)
+struct HiZBuildPush {
+  int32_t srcSize[2];
+  int32_t dstSize[2];
+};
+
+struct HiZCullPush {
+  float viewProj[16];
+  float pyramidSize[2];
+  uint32_t objectCount;
+  uint32_t levelCount;
+};
+
+VkFormat chooseDepthFormat(VkPhysicalDevice physicalDevice, bool sampled) {
+  const VkFormat candidates[] = { VK_FORMAT_D32_SFLOAT, VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D24_UNORM_S8_UINT };
+  VkFormatFeatureFlags needed = VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT;
+  if (sampled) needed |= VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT;
+  for (VkFormat f : candidates) {
+    VkFormatProperties props{};
+    vkGetPhysicalDeviceFormatProperties(physicalDevice, f, &props);
+    if ((props.optimalTilingFeatures & needed) == needed) return f;
+  }
+  return VK_FORMAT_UNDEFINED;
+}
+
+VkImageView createView(const DeviceDispatch& vk, VkDevice device, VkImage image, VkFormat format, VkImageAspectFlags aspect, uint32_t baseLevel, uint32_t levelCount) {
+  VkImageViewCreateInfo iv{};
+  iv.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+  iv.image = image;
+  iv.viewType = VK_IMAGE_VIEW_TYPE_2D;
+  iv.format = format;
+  iv.subresourceRange.aspectMask = aspect;
+  iv.subresourceRange.baseMipLevel = baseLevel;
+  iv.subresourceRange.levelCount = levelCount;
+  iv.subresourceRange.baseArrayLayer = 0;
+  iv.subresourceRange.layerCount = 1;
+  VkImageView view = VK_NULL_HANDLE;
+  if (vk.vkCreateImageView(device, &iv, nullptr, &view) != VK_SUCCESS) return VK_NULL_HANDLE;
+  return view;
+}
+
+} // namespace
+
+bool Context::enableDepthForWindow(Window* window, bool buildHiZ) {
+  if (!window || device == VK_NULL_HANDLE) return false;
+  // Old resources are released once frames in flight finish with them
+  destroyDepthResources(window);
+  window->depthEnabled = true;
+  window->hizEnabled = buildHiZ;
+  if (buildHiZ && !createHiZPipelines()) {
+    window->hizEnabled = false;
+    return false;
+  }
+  return createDepthResources(window);
+}
+
+bool Context::createDepthResources(Window* window) {
+  if (!window || !window->depthEnabled) return true;
+  if (window->swapchainExtent.width == 0 || window->swapchainExtent.height == 0) return false;
+
+  window->depthFormat = chooseDepthFormat(physicalDevice, window->hizEnabled);
+  if (window->depthFormat == VK_FORMAT_UNDEFINED) {
+    VKLITE_LOG_ERROR("createDepthResources: no supported depth format");
+    return false;
+  }
+
+  VkImageCreateInfo ici{};
+  ici.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+  ici.imageType = VK_IMAGE_TYPE_2D;
+  ici.format = window->depthFormat;
+  ici.extent = { window->swapchainExtent.width, window->swapchainExtent.height, 1 };
+  ici.mipLevels = 1;
+  ici.arrayLayers = 1;
+  ici.samples = VK_SAMPLE_COUNT_1_BIT;
+  ici.tiling = VK_IMAGE_TILING_OPTIMAL;
+  ici.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+  if (window->hizEnabled) ici.usage |= VK_IMAGE_USAGE_SAMPLED_BIT;
+  ici.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+  ici.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+  if (vk.vkCreateImage(device, &ici, nullptr, &window->depthImage) != VK_SUCCESS) return false;
+
+  VkMemoryRequirements req{};
+  vk.vkGetImageMemoryRequirements(device, window->depthImage, &req);
+  VkMemoryAllocateInfo mai{};
+  mai.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+  mai.allocationSize = req.size;
+  mai.memoryTypeIndex = findMemoryType(req.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+  if (mai.memoryTypeIndex == UINT32_MAX || allocateMemory(mai, MemoryCategory::Images, &window->depthMemory) != VK_SUCCESS) {
+    destroyDepthResources(window);
+    return false;
+  }
+  vk.vkBindImageMemory(device, window->depthImage, window->depthMemory, 0);
+  window->depthView = createView(vk, device, window->depthImage, window->depthFormat, VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1);
+  if (window->depthView == VK_NULL_HANDLE) {
+    destroyDepthResources(window);
+    return false;
+  }
+  if (!window->hizEnabled) return true;
+
+  // --- Depth pyramid ---
+  VkExtent2D base = { std::max(1u, (window->swapchainExtent.width + 1) / 2), std::max(1u, (window->swapchainExtent.height + 1) / 2) };
+  uint32_t levels = 1;
+  while ((std::max(base.width, base.height) >> levels) > 0) ++levels;
+  window->hizExtent = base;
+  window->hizLevels = levels;
+
+  ici.format = VK_FORMAT_R32_SFLOAT;
+  ici.extent = { base.width, base.height, 1 };
+  ici.mipLevels = levels;
+  ici.usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+  if (vk.vkCreateImage(device, &ici, nullptr, &window->hizImage) != VK_SUCCESS) {
+    destroyDepthResources(window);
+    return false;
+  }
+  vk.vkGetImageMemoryRequirements(device, window->hizImage, &req);
+  mai.allocationSize = req.size;
+  mai.memoryTypeIndex = findMemoryType(req.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+  if (mai.memoryTypeIndex == UINT32_MAX || allocateMemory(mai, MemoryCategory::Images, &window->hizMemory) != VK_SUCCESS) {
+    destroyDepthResources(window);
+    return false;
+  }
+  vk.vkBindImageMemory(device, window->hizImage, window->hizMemory, 0);
+  window->hizView = createView(vk, device, window->hizImage, VK_FORMAT_R32_SFLOAT, VK_IMAGE_ASPECT_COLOR_BIT, 0, levels);
+  for (uint32_t l = 0; l < levels; ++l) {
+    window->hizLevelViews.push_back(createView(vk, device, window->hizImage, VK_FORMAT_R32_SFLOAT, VK_IMAGE_ASPECT_COLOR_BIT, l, 1));
+    if (window->hizLevelViews.back() == VK_NULL_HANDLE || window->hizView == VK_NULL_HANDLE) {
+      destroyDepthResources(window);
+      return false;
+    }
+  }
+
+  // CPU readback: the first level no wider than 256 texels keeps the copy small
+  uint32_t rbLevel = 0;
+  while (rbLevel + 1 < levels && std::max(1u, base.width >> rbLevel) > 256) ++rbLevel;
+  window->hizReadbackLevel = rbLevel;
+  window->hizReadbackExtent = { std::max(1u, base.width >> rbLevel), std::max(1u, base.height >> rbLevel) };
+  VkDeviceSize rbSize = static_cast<VkDeviceSize>(window->hizReadbackExtent.width) * window->hizReadbackExtent.height * sizeof(float);
+  for (int slot = 0; slot < kHiZReadbackSlots; ++slot) {
+    VkBufferCreateInfo bci{};
+    bci.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bci.size = rbSize;
+    bci.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+    bci.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    if (vk.vkCreateBuffer(device, &bci, nullptr, &window->hizReadbackBuffers[slot]) != VK_SUCCESS) {
+      destroyDepthResources(window);
+      return false;
+    }
+    vk.vkGetBufferMemoryRequirements(device, window->hizReadbackBuffers[slot], &req);
+    mai.allocationSize = req.size;
+    mai.memoryTypeIndex = findMemoryType(req.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT);
+    if (mai.memoryTypeIndex == UINT32_MAX || allocateMemory(mai, MemoryCategory::Readback, &window->hizReadbackMemory[slot]) != VK_SUCCESS) {
+      destroyDepthResources(window);
+      return false;
+    }
+    window->hizReadbackCoherent = (memoryProperties.memoryTypes[mai.memoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != 0;
+    vk.vkBindBufferMemory(device, window->hizReadbackBuffers[slot], window->hizReadbackMemory[slot], 0);
+    vk.vkMapMemory(device, window->hizReadbackMemory[slot], 0, VK_WHOLE_SIZE, 0, &window->hizReadbackMapped[slot]);
+  }
+  window->hizValid = false;
+  window->hizReadableSlot = -1;
+  for (auto& f : window->frames) f.hizSlot = -1;
+
+  // Descriptor sets: one per build level plus a handful for GPU culling
+  const uint32_t cullSets = 16;
+  VkDescriptorPoolSize sizes[3] = {
+    { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, levels + cullSets },
+    { VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, levels },
+    { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2 * cullSets },
+  };
+  VkDescriptorPoolCreateInfo dpci{};
+  dpci.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+  dpci.maxSets = levels + cullSets;
+  dpci.poolSizeCount = 3;
+  dpci.pPoolSizes = sizes;
+  if (vk.vkCreateDescriptorPool(device, &dpci, nullptr, &window->hizDescriptorPool) != VK_SUCCESS) {
+    destroyDepthResources(window);
+    return false;
+  }
+  std::vector<VkDescriptorSetLayout> setLayouts(levels, hizBuildSetLayout);
+  window->hizBuildSets.resize(levels);
+  VkDescriptorSetAllocateInfo dsai{};
+  dsai.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+  dsai.descriptorPool = window->hizDescriptorPool;
+  dsai.descriptorSetCount = levels;
+  dsai.pSetLayouts = setLayouts.data();
+  if (vk.vkAllocateDescriptorSets(device, &dsai, window->hizBuildSets.data()) != VK_SUCCESS) {
+    destroyDepthResources(window);
+    return false;
+  }
+  for (uint32_t l = 0; l < levels; ++l) {
+    VkDescriptorImageInfo src{};
+    src.sampler = hizSampler;
+    src.imageView = l == 0 ? window->depthView : window->hizLevelViews[l - 1];
+    src.imageLayout = l == 0 ? VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_GENERAL;
+    VkDescriptorImageInfo dst{};
+    dst.imageView = window->hizLevelViews[l];
+    dst.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+    VkWriteDescriptorSet writes[2]{};
+    writes[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    writes[0].dstSet = window->hizBuildSets[l];
+    writes[0].dstBinding = 0;
+    writes[0].descriptorCount = 1;
+    writes[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    writes[0].pImageInfo = &src;
+    writes[1] = writes[0];
+    writes[1].dstBinding = 1;
+    writes[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    writes[1].pImageInfo = &dst;
+    vk.vkUpdateDescriptorSets(device, 2, writes, 0, nullptr);
+  }
+  return true;
+}
+
+// Frames in flight may still render to depth, build the pyramid or copy it
+// back, so the objects are released through the deletion queue.
+void Context::destroyDepthResources(Window* window) {
+  if (!window || device == VK_NULL_HANDLE) return;
+  std::vector<VkImageView> views;
+  std::vector<VkImage> images;
+  std::vector<VkBuffer> buffers;
+  std::vector<VkDeviceMemory> memory;
+  VkDescriptorPool pool = window->hizDescriptorPool;
+  window->hizDescriptorPool = VK_NULL_HANDLE;
+  window->hizBuildSets.clear();
+  window->hizCullBindings.clear();
+  for (int slot = 0; slot < kHiZReadbackSlots; ++slot) {
+    buffers.push_back(window->hizReadbackBuffers[slot]);
+    memory.push_back(window->hizReadbackMemory[slot]);
+    window->hizReadbackBuffers[slot] = VK_NULL_HANDLE;
+    window->hizReadbackMemory[slot] = VK_NULL_HANDLE;
+    window->hizReadbackMapped[slot] = nullptr;
+  }
+  window->hizValid = false;
+  window->hizReadableSlot = -1;
+  for (auto& f : window->frames) f.hizSlot = -1;
+  views.insert(views.end(), window->hizLevelViews.begin(), window->hizLevelViews.end());
+  window->hizLevelViews.clear();
+  views.push_back(window->hizView);
+  images.push_back(window->hizImage);
+  memory.push_back(window->hizMemory);
+  window->hizView = VK_NULL_HANDLE;
+  window->hizImage = VK_NULL_HANDLE;
+  window->hizMemory = VK_NULL_HANDLE;
+  window->hizLevels = 0;
+  window->hizExtent = {0, 0};
+
+  views.push_back(window->depthView);
+  images.push_back(window->depthImage);
+  memory.push_back(window->depthMemory);
+  window->depthView = VK_NULL_HANDLE;
+  window->depthImage = VK_NULL_HANDLE;
+  window->depthMemory = VK_NULL_HANDLE;
+
+  VkDevice dev = device;
+  deferDestroy([this, dev, pool, views, images, buffers, memory] {
+    if (pool != VK_NULL_HANDLE) vk.vkDestroyDescriptorPool(dev, pool, nullptr);
+    for (auto v : views) {
+      if (v != VK_NULL_HANDLE) vk.vkDestroyImageView(dev, v, nullptr);
+    }
+    for (auto i : images) {
+      if (i != VK_NULL_HANDLE) vk.vkDestroyImage(dev, i, nullptr);
+    }
+    for (auto b : buffers) {
+      if (b != VK_NULL_HANDLE) vk.vkDestroyBuffer(dev, b, nullptr);
+    }
+    // Freeing also unmaps the persistently mapped readback memory
+    for (auto m : memory) freeMemory(m);
+  });
+}
+
+bool Context::createHiZPipelines() {
+  if (hizBuildPipeline != VK_NULL_HANDLE) return true;
+  if (device == VK_NULL_HANDLE) return false;
+
+  VkSamplerCreateInfo sci{};
+  sci.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+  sci.magFilter = VK_FILTER_NEAREST;
+  sci.minFilter = VK_FILTER_NEAREST;
+  sci.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+  sci.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+  sci.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+  sci.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+  sci.maxLod = 16.0f;
+  if (vk.vkCreateSampler(device, &sci, nullptr, &hizSampler) != VK_SUCCESS) return false;
+
+  // Pyramid build: sampled source + storage destination
+  VkDescriptorSetLayoutBinding buildBindings[2]{};
+  buildBindings[0].binding = 0;
+  buildBindings[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+  buildBindings[0].descriptorCount = 1;
+  buildBindings[0].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+  buildBindings[1] = buildBindings[0];
+  buildBindings[1].binding = 1;
+  buildBindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+  VkDescriptorSetLayoutCreateInfo dslci{};
+  dslci.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+  dslci.bindingCount = 2;
+  dslci.pBindings = buildBindings;
+  if (vk.vkCreateDescriptorSetLayout(device, &dslci, nullptr, &hizBuildSetLayout) != VK_SUCCESS) {
+    destroyHiZPipelines();
+    return false;
+  }
+
+  // Occlusion cull: pyramid + bounds + indirect draws
+  VkDescriptorSetLayoutBinding cullBindings[3]{};
+  cullBindings[0] = buildBindings[0];
+  cullBindings[1].binding = 1;
+  cullBindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+  cullBindings[1].descriptorCount = 1;
+  cullBindings[1].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+  cullBindings[2] = cullBindings[1];
+  cullBindings[2].binding = 2;
+  dslci.bindingCount = 3;
+  dslci.pBindings = cullBindings;
+  if (vk.vkCreateDescriptorSetLayout(device, &dslci, nullptr, &hizCullSetLayout) != VK_SUCCESS) {
+    destroyHiZPipelines();
+    return false;
+  }
+
+  VkPushConstantRange pcr{};
+  pcr.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+  pcr.offset = 0;
+  pcr.size = sizeof(HiZBuildPush);
+  VkPipelineLayoutCreateInfo plci{};
+  plci.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+  plci.setLayoutCount = 1;
+  plci.pSetLayouts = &hizBuildSetLayout;
+  plci.pushConstantRangeCount = 1;
+  plci.pPushConstantRanges = &pcr;
+  if (vk.vkCreatePipelineLayout(device, &plci, nullptr, &hizBuildLayout) != VK_SUCCESS) {
+    destroyHiZPipelines();
+    return false;
+  }
+  pcr.size = sizeof(HiZCullPush);
+  plci.pSetLayouts = &hizCullSetLayout;
+  if (vk.vkCreatePipelineLayout(device, &plci, nullptr, &hizCullLayout) != VK_SUCCESS) {
+    destroyHiZPipelines();
+    return false;
+  }
+
+#if defined(VKLITE_EMBEDDED_GLSL)
+  std::vector<uint32_t> buildSpirv, cullSpirv;
+  if (!compileGlslToSpirv(shaders::hiz_build_comp_glsl, VK_SHADER_STAGE_COMPUTE_BIT, buildSpirv) ||
+      !compileGlslToSpirv(shaders::hiz_cull_comp_glsl, VK_SHADER_STAGE_COMPUTE_BIT, cullSpirv)) {
+    VKLITE_LOG_ERROR("createHiZPipelines: failed to compile the Hi-Z shaders at runtime");
+    destroyHiZPipelines();
+    return false;
+  }
+  VkShaderModule buildModule = createShaderModule(buildSpirv);
+  VkShaderModule cullModule = createShaderModule(cullSpirv);
+#else
+  VkShaderModule buildModule = createShaderModule(shaders::hiz_build_comp);
+  VkShaderModule cullModule = createShaderModule(shaders::hiz_cull_comp);
+#endif
+  bool ok = buildModule != VK_NULL_HANDLE && cullModule != VK_NULL_HANDLE;
+  if (ok) {
+    VkComputePipelineCreateInfo cpci[2]{};
+    for (int i = 0; i < 2; ++i) {
+      cpci[i].sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+      cpci[i].stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+      cpci[i].stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+      cpci[i].stage.pName = "main";
+    }
+    cpci[0].stage.module = buildModule;
+    cpci[0].layout = hizBuildLayout;
+    cpci[1].stage.module = cullModule;
+    cpci[1].layout = hizCullLayout;
+    VkPipeline pipelines[2] = { VK_NULL_HANDLE, VK_NULL_HANDLE };
+    ok = vk.vkCreateComputePipelines(device, VK_NULL_HANDLE, 2, cpci, nullptr, pipelines) == VK_SUCCESS;
+    hizBuildPipeline = pipelines[0];
+    hizCullPipeline = pipelines[1];
+  }
+  if (buildModule != VK_NULL_HANDLE) vk.vkDestroyShaderModule(device, buildModule, nullptr);
+  if (cullModule != VK_NULL_HANDLE) vk.vkDestroyShaderModule(device, cullModule, nullptr);
+  if (!ok) {
+    VKLITE_LOG_ERROR("createHiZPipelines: failed to create compute pipelines");
+    destroyHiZPipelines();
+    return false;
+  }
+  return true;
+}
+
+void Context::destroyHiZPipelines() {
+  if (device == VK_NULL_HANDLE) return;
+  if (hizBuildPipeline != VK_NULL_HANDLE) vk.vkDestroyPipeline(device, hizBuildPipeline, nullptr);
+  if (hizCullPipeline != VK_NULL_HANDLE) vk.vkDestroyPipeline(device, hizCullPipeline, nullptr);
+  if (hizBuildLayout != VK_NULL_HANDLE) vk.vkDestroyPipelineLayout(device, hizBuildLayout, nullptr);
+  if (hizCullLayout != VK_NULL_HANDLE) vk.vkDestroyPipelineLayout(device, hizCullLayout, nullptr);
+  if (hizBuildSetLayout != VK_NULL_HANDLE) vk.vkDestroyDescriptorSetLayout(device, hizBuildSetLayout, nullptr);
+  if (hizCullSetLayout != VK_NULL_HANDLE) vk.vkDestroyDescriptorSetLayout(device, hizCullSetLayout, nullptr);
+  if (hizSampler != VK_NULL_HANDLE) vk.vkDestroySampler(device, hizSampler, nullptr);
+  hizBuildPipeline = hizCullPipeline = VK_NULL_HANDLE;
+  hizBuildLayout = hizCullLayout = VK_NULL_HANDLE;
+  hizBuildSetLayout = hizCullSetLayout = VK_NULL_HANDLE;
+  hizSampler = VK_NULL_HANDLE;
+}
+
+void Context::recordHiZBuild(Window* window, VkCommandBuffer cmd) {
+  if (!window || !window->hizEnabled || window->hizImage == VK_NULL_HANDLE || hizBuildPipeline == VK_NULL_HANDLE) return;
+
+  // Runs as the window graph's "hiz" pass: depth is already SHADER_READ_ONLY
+  // and the pyramid GENERAL (previous contents discarded). Only the
+  // level-to-level dependencies inside the pass are recorded here.
+  VkImageMemoryBarrier lb{};
+  lb.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+  lb.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+  lb.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_TRANSFER_READ_BIT;
+  lb.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+  lb.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+  lb.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  lb.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  lb.image = window->hizImage;
+
+  vk.vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, hizBuildPipeline);
+  VkExtent2D src = window->swapchainExtent;
+  for (uint32_t l = 0; l < window->hizLevels; ++l) {
+    VkExtent2D dst = { std::max(1u, window->hizExtent.width >> l), std::max(1u, window->hizExtent.height >> l) };
+    HiZBuildPush push{};
+    push.srcSize[0] = static_cast<int32_t>(src.width);
+    push.srcSize[1] = static_cast<int32_t>(src.height);
+    push.dstSize[0] = static_cast<int32_t>(dst.width);
+    push.dstSize[1] = static_cast<int32_t>(dst.height);
+    vk.vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, hizBuildLayout, 0, 1, &window->hizBuildSets[l], 0, nullptr);
+    vk.vkCmdPushConstants(cmd, hizBuildLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(push), &push);
+    vk.vkCmdDispatch(cmd, (dst.width + 7) / 8, (dst.height + 7) / 8, 1);
+
+    // Level l is read by the next dispatch (and by the readback copy)
+    lb.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, l, 1, 0, 1 };
+    vk.vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         0, 0, nullptr, 0, nullptr, 1, &lb);
+    src = dst;
+  }
+
+  window->hizValid = true;
+
+  // Copy the coarse level into a slot neither readable by the CPU nor still
+  // being written by another frame in flight
+  int slot = 0;
+  for (; slot < kHiZReadbackSlots; ++slot) {
+    bool busy = slot == window->hizReadableSlot;
+    for (const auto& f : window->frames) busy = busy || f.hizSlot == slot;
+    if (!busy) break;
+  }
+  if (slot < kHiZReadbackSlots && window->hizReadbackBuffers[slot] != VK_NULL_HANDLE) {
+    VkBufferImageCopy bic{};
+    bic.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, window->hizReadbackLevel, 0, 1 };
+    bic.imageExtent = { window->hizReadbackExtent.width, window->hizReadbackExtent.height, 1 };
+    vk.vkCmdCopyImageToBuffer(cmd, window->hizImage, VK_IMAGE_LAYOUT_GENERAL, window->hizReadbackBuffers[slot], 1, &bic);
+
+    VkBufferMemoryBarrier host{};
+    host.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    host.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    host.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+    host.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    host.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    host.buffer = window->hizReadbackBuffers[slot];
+    host.offset = 0;
+    host.size = VK_WHOLE_SIZE;
+    vk.vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 0, nullptr, 1, &host, 0, nullptr);
+    window->frames[window->frameIndex].hizSlot = slot;
+  }
+}
+
+size_t Context::cullOcclusion(Window* window, const float* viewProj, const SphereBounds& spheres, const std::vector<uint32_t>& candidates, std::vector<uint32_t>& visible) {
+  visible.clear();
+  if (!window || !viewProj || !window->hizEnabled || window->hizReadableSlot < 0) {
+    visible.assign(candidates.begin(), candidates.end());
+    return visible.size();
+  }
+  const int slot = window->hizReadableSlot;
+  if (!window->hizReadbackCoherent) {
+    VkMappedMemoryRange range{};
+    range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+    range.memory = window->hizReadbackMemory[slot];
+    range.offset = 0;
+    range.size = VK_WHOLE_SIZE;
+    vk.vkInvalidateMappedMemoryRanges(device, 1, &range);
+  }
+  const float* depth = static_cast<const float*>(window->hizReadbackMapped[slot]);
+  const uint32_t lw = window->hizReadbackExtent.width;
+  const uint32_t lh = window->hizReadbackExtent.height;
+  const float* m = viewProj;
+
+  visible.reserve(candidates.size());
+  for (uint32_t idx : candidates) {
+    const float cx = spheres.centerX[idx], cy = spheres.centerY[idx], cz = spheres.centerZ[idx], r = spheres.radius[idx];
+    float loX = 1.0f, loY = 1.0f, hiX = 0.0f, hiY = 0.0f, nearest = 1.0f;
+    bool crossesNear = false;
+    for (int c = 0; c < 8 && !crossesNear; ++c) {
+      const float x = cx + ((c & 1) ? r : -r);
+      const float y = cy + ((c & 2) ? r : -r);
+      const float z = cz + ((c & 4) ? r : -r);
+      const float w = m[3] * x + m[7] * y + m[11] * z + m[15];
+      if (w <= 1e-5f) {
+        crossesNear = true;
+        break;
+      }
+      const float u = 0.5f * (m[0] * x + m[4] * y + m[8] * z + m[12]) / w + 0.5f;
+      const float v = 0.5f * (m[1] * x + m[5] * y + m[9] * z + m[13]) / w + 0.5f;
+      const float d = (m[2] * x + m[6] * y + m[10] * z + m[14]) / w;
+      loX = std::min(loX, u);
+      loY = std::min(loY, v);
+      hiX = std::max(hiX, u);
+      hiY = std::max(hiY, v);
+      nearest = std::min(nearest, d);
+    }
+    if (crossesNear || nearest <= 0.0f) {
+      visible.push_back(idx);
+      continue;
+    }
+    loX = std::clamp(loX, 0.0f, 1.0f);
+    loY = std::clamp(loY, 0.0f, 1.0f);
+    hiX = std::clamp(hiX, 0.0f, 1.0f);
+    hiY = std::clamp(hiY, 0.0f, 1.0f);
+    const uint32_t x0 = std::min(static_cast<uint32_t>(loX * lw), lw - 1);
+    const uint32_t y0 = std::min(static_cast<uint32_t>(loY * lh), lh - 1);
+    const uint32_t x1 = std::min(static_cast<uint32_t>(std::ceil(hiX * lw)), lw - 1);
+    const uint32_t y1 = std::min(static_cast<uint32_t>(std::ceil(hiY * lh)), lh - 1);
+    // Large objects are rarely occluded and expensive to test at this level
+    if ((x1 - x0 + 1) * (y1 - y0 + 1) > 64) {
+      visible.push_back(idx);
+      continue;
+    }
+    float farthest = 0.0f;
+    for (uint32_t y = y0; y <= y1; ++y) {
+      for (uint32_t x = x0; x <= x1; ++x) farthest = std::max(farthest, depth[y * lw + x]);
+    }
+    if (nearest <= farthest) visible.push_back(idx);
+  }
+  return visible.size();
+}
+
+bool Context::recordOcclusionCullGpu(Window* window, VkCommandBuffer cmd, const OcclusionCullGpuParams& params) {
+  if (!window || cmd == VK_NULL_HANDLE || !window->hizEnabled || hizCullPipeline == VK_NULL_HANDLE) return false;
+  if (params.boundsBuffer == VK_NULL_HANDLE || params.drawBuffer == VK_NULL_HANDLE || params.objectCount == 0) return false;
+  // The pyramid has undefined contents until the first frame has built it
+  if (!window->hizValid) return false;
+
+  VkDescriptorSet set = VK_NULL_HANDLE;
+  for (const auto& b : window->hizCullBindings) {
+    if (b.bounds == params.boundsBuffer && b.draws == params.drawBuffer) {
+      set = b.set;
+      break;
+    }
+  }
+  if (set == VK_NULL_HANDLE) {
+    VkDescriptorSetAllocateInfo dsai{};
+    dsai.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    dsai.descriptorPool = window->hizDescriptorPool;
+    dsai.descriptorSetCount = 1;
+    dsai.pSetLayouts = &hizCullSetLayout;
+    if (vk.vkAllocateDescriptorSets(device, &dsai, &set) != VK_SUCCESS) {
+      VKLITE_LOG_ERROR("recordOcclusionCullGpu: out of descriptor sets for new buffer pairs");
+      return false;
+    }
+    VkDescriptorImageInfo pyramid{ hizSampler, window->hizView, VK_IMAGE_LAYOUT_GENERAL };
+    VkDescriptorBufferInfo bounds{ params.boundsBuffer, 0, VK_WHOLE_SIZE };
+    VkDescriptorBufferInfo draws{ params.drawBuffer, 0, VK_WHOLE_SIZE };
+    VkWriteDescriptorSet writes[3]{};
+    for (uint32_t i = 0; i < 3; ++i) {
+      writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+      writes[i].dstSet = set;
+      writes[i].dstBinding = i;
+      writes[i].descriptorCount = 1;
+      writes[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    }
+    writes[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    writes[0].pImageInfo = &pyramid;
+    writes[1].pBufferInfo = &bounds;
+    writes[2].pBufferInfo = &draws;
+    vk.vkUpdateDescriptorSets(device, 3, writes, 0, nullptr);
+    window->hizCullBindings.push_back({ params.boundsBuffer, params.drawBuffer, set });
+  }
+
+  // Pyramid writes from the last frame and earlier indirect reads of drawBuffer
+  VkMemoryBarrier before{};
+  before.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+  before.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+  before.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+  vk.vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT,
+                       VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &before, 0, nullptr, 0, nullptr);
+
+  HiZCullPush push{};
+  std::memcpy(push.viewProj, params.viewProj, sizeof(push.viewProj));
+  push.pyramidSize[0] = static_cast<float>(window->hizExtent.width);
+  push.pyramidSize[1] = static_cast<float>(window->hizExtent.height);
+  push.objectCount = params.objectCount;
+  push.levelCount = window->hizLevels;
+  vk.vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, hizCullPipeline);
+  vk.vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, hizCullLayout, 0, 1, &set, 0, nullptr);
+  vk.vkCmdPushConstants(cmd, hizCullLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(push), &push);
+  vk.vkCmdDispatch(cmd, (params.objectCount + 63) / 64, 1, 1);
+
+  VkMemoryBarrier after{};
+  after.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+  after.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+  after.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+  vk.vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                       VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT,
+                       0, 1, &after, 0, nullptr, 0, nullptr);
+  return true;
+}
+
+} // namespace vklite
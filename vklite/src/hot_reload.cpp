@@ -0,0 +1,283 @@
+// hot_reload.cpp - file-backed pipelines rebuilt in the background and swapped at frame boundaries
+#include "vklite.h"
+#include "file_watcher.h"
+#include "log.h"
+#include "trace.h"
+#include <algorithm>
+#include <condition_variable>
+#include <fstream>
+#include <iterator>
+#include <mutex>
+
+namespace vklite {
+
+struct Context::HotReloader {
+  // What is needed to rebuild a pipeline; layout is owned by the Pipeline
+  // and stays valid while the source is registered.
+  struct Source {
+    Pipeline* pipeline = nullptr;
+    std::string vertPath;
+    std::string fragPath;
+    VkPipelineLayout layout = VK_NULL_HANDLE;
+    PipelineDesc desc;  // fixed-function state; sources are re-read from disk
+  };
+  // Built by the build job, waiting for the next frame boundary
+  struct Result {
+    Pipeline* pipeline = nullptr;
+    VkPipeline handle = VK_NULL_HANDLE;
+    VkShaderModule vert = VK_NULL_HANDLE;
+    VkShaderModule frag = VK_NULL_HANDLE;
+  };
+  std::unique_ptr<FileWatcher> watcher;
+  std::mutex mutex;
+  std::condition_variable idle;   // destroyPipeline: build job left `building`
+  std::vector<Source> sources;
+  std::vector<Pipeline*> queued;
+  std::vector<Result> results;
+  Pipeline* building = nullptr;
+  // A build job on Context::jobs is draining `queued`; at most one runs at a
+  // time, so rebuilds of a pipeline land in the order the files were saved
+  bool draining = false;
+  JobHandle drain;
+  bool stopping = false;
+};
+
+namespace {
+
+bool readTextFile(const std::string& path, std::string& out) {
+  std::ifstream in(path, std::ios::binary);
+  if (!in) return false;
+  out.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+  return true;
+}
+
+} // namespace
+
+Context::Pipeline* Context::createPipelineFromFiles(const std::string& vertPath, const std::string& fragPath, uint32_t vertexCount, VkFormat colorFormat, VkFormat depthFormat, bool hotReload) {
+  std::string vertGlsl, fragGlsl;
+  if (!readTextFile(vertPath, vertGlsl)) {
+    VKLITE_LOG_ERROR("createPipelineFromFiles: cannot read %s", vertPath.c_str());
+    return nullptr;
+  }
+  if (!readTextFile(fragPath, fragGlsl)) {
+    VKLITE_LOG_ERROR("createPipelineFromFiles: cannot read %s", fragPath.c_str());
+    return nullptr;
+  }
+  PipelineDesc desc;
+  desc.vertGlsl = std::move(vertGlsl);
+  desc.fragGlsl = std::move(fragGlsl);
+  desc.hashSources();
+  desc.vertPath = vertPath;
+  desc.fragPath = fragPath;
+  desc.vertexCount = vertexCount;
+  desc.colorFormat = colorFormat;
+  desc.depthFormat = depthFormat;
+  Pipeline* p = getOrCreatePipeline(desc);
+  if (!p || !hotReload) return p;
+
+  if (!hotReloader) {
+    hotReloader = new HotReloader();
+    HotReloader* hr = hotReloader;
+    // Builds queued pipelines on the job pool until the queue runs dry
+    auto build = [this, hr] {
+      std::unique_lock<std::mutex> lock(hr->mutex);
+      while (!hr->stopping && !hr->queued.empty()) {
+        Pipeline* target = hr->queued.front();
+        hr->queued.erase(hr->queued.begin());
+        auto it = std::find_if(hr->sources.begin(), hr->sources.end(), [&](const HotReloader::Source& s) { return s.pipeline == target; });
+        if (it == hr->sources.end()) continue;
+        const HotReloader::Source src = *it;
+        hr->building = target;
+        lock.unlock();
+
+        // Compile and build off the main thread; the old pipeline keeps
+        // rendering until the swap.
+        VKLITE_TRACE_ZONE("hotReloadBuild");
+        HotReloader::Result res;
+        res.pipeline = target;
+        PipelineDesc desc = src.desc;
+        std::vector<uint32_t> vspirv, fspirv;
+        bool ok = readTextFile(src.vertPath, desc.vertGlsl) && readTextFile(src.fragPath, desc.fragGlsl) &&
+                  compileGlslToSpirv(desc.vertGlsl, VK_SHADER_STAGE_VERTEX_BIT, vspirv) &&
+                  compileGlslToSpirv(desc.fragGlsl, VK_SHADER_STAGE_FRAGMENT_BIT, fspirv);
+        if (ok) {
+          res.vert = createShaderModule(vspirv);
+          res.frag = createShaderModule(fspirv);
+          if (res.vert != VK_NULL_HANDLE && res.frag != VK_NULL_HANDLE) {
+            res.handle = createGraphicsPipeline(desc, res.vert, res.frag, src.layout);
+          }
+          ok = res.handle != VK_NULL_HANDLE;
+        }
+        if (!ok) {
+          if (res.vert != VK_NULL_HANDLE) vk.vkDestroyShaderModule(device, res.vert, nullptr);
+          if (res.frag != VK_NULL_HANDLE) vk.vkDestroyShaderModule(device, res.frag, nullptr);
+          VKLITE_LOG_WARN("hot reload: keeping previous pipeline for %s / %s", src.vertPath.c_str(), src.fragPath.c_str());
+        }
+
+        lock.lock();
+        hr->building = nullptr;
+        hr->idle.notify_all();
+        if (!ok) continue;
+        // A newer build supersedes one the main thread has not picked up yet;
+        // that one was never used by the GPU.
+        for (auto r = hr->results.begin(); r != hr->results.end(); ++r) {
+          if (r->pipeline != target) continue;
+          vk.vkDestroyPipeline(device, r->handle, nullptr);
+          vk.vkDestroyShaderModule(device, r->vert, nullptr);
+          vk.vkDestroyShaderModule(device, r->frag, nullptr);
+          hr->results.erase(r);
+          break;
+        }
+        hr->results.push_back(res);
+        wakeMainLoop(); // wake an idle OnDemand loop
+      }
+      hr->draining = false;
+    };
+
+    hr->watcher = std::make_unique<FileWatcher>([this, hr, build](const std::string& path) {
+      std::lock_guard<std::mutex> lock(hr->mutex);
+      for (const auto& s : hr->sources) {
+        if ((s.vertPath == path || s.fragPath == path) &&
+            std::find(hr->queued.begin(), hr->queued.end(), s.pipeline) == hr->queued.end()) {
+          hr->queued.push_back(s.pipeline);
+        }
+      }
+      if (!hr->queued.empty() && !hr->draining && !hr->stopping) {
+        hr->draining = true;
+        hr->drain = jobs->submit(build);
+      }
+    });
+  }
+
+  HotReloader::Source src;
+  src.pipeline = p;
+  src.vertPath = vertPath;
+  src.fragPath = fragPath;
+  src.layout = p->layout;
+  src.desc = desc;
+  src.desc.vertGlsl.clear();
+  src.desc.fragGlsl.clear();
+  src.desc.vertSourceHash = src.desc.fragSourceHash = 0;
+  {
+    std::lock_guard<std::mutex> lock(hotReloader->mutex);
+    // Identical requests share one cached pipeline; register it once
+    for (const auto& s : hotReloader->sources) {
+      if (s.pipeline == p) return p;
+    }
+    hotReloader->sources.push_back(src);
+  }
+  hotReloader->watcher->watch(vertPath);
+  hotReloader->watcher->watch(fragPath);
+  return p;
+}
+
+void Context::applyShaderReloads() {
+  VKLITE_TRACE_ZONE("applyShaderReloads");
+  applyOptimizedPipelines();
+  if (!hotReloader) {
+    collectDeferredDeletions(false);
+    checkMemoryBudget(false);
+    return;
+  }
+  HotReloader* hr = hotReloader;
+  std::vector<HotReloader::Result> ready;
+  {
+    std::lock_guard<std::mutex> lock(hr->mutex);
+    ready.swap(hr->results);
+  }
+  for (const auto& res : ready) {
+    Pipeline* p = res.pipeline;
+    // Frames already submitted may still use the old pipeline
+    retirePipeline(p->pipeline);
+    // The rebuilt pipeline is monolithic; drop the library parts and any
+    // optimized link still pending for the old shaders
+    releasePipelineLibraries(p);
+    p->optimized = true;
+    if (p->vertKey != 0) releaseShaderModule(p->vertKey);
+    else vk.vkDestroyShaderModule(device, p->vert, nullptr);
+    if (p->fragKey != 0) releaseShaderModule(p->fragKey);
+    else vk.vkDestroyShaderModule(device, p->frag, nullptr);
+    // The edited variant no longer matches its cached description; it keeps
+    // its references but new requests build a fresh variant. It stays in
+    // ownedPipelines, so shutdown still frees it if never destroyed.
+    if (p->cacheKey != 0) variantCache.erase(p->cacheKey);
+    p->cacheKey = p->vertKey = p->fragKey = 0;
+    p->pipeline = res.handle;
+    p->vert = res.vert;
+    p->frag = res.frag;
+    ++p->generation;
+    // Retiring the old pipeline allocates; not a steady-state frame
+    for (auto& w : windows) {
+      if (w && w->pipeline == p) {
+        w->dirty = true;
+        w->steadyFrames = 0;
+      }
+    }
+    VKLITE_LOG_INFO("hot reload: pipeline updated (generation %llu)", static_cast<unsigned long long>(p->generation));
+  }
+
+  collectDeferredDeletions(false);
+  checkMemoryBudget(false);
+}
+
+void Context::forgetHotReload(Pipeline* p) {
+  if (!hotReloader || !p) return;
+  HotReloader* hr = hotReloader;
+  std::vector<std::string> paths;
+  {
+    std::unique_lock<std::mutex> lock(hr->mutex);
+    // The build job reads the layout while building; wait for it to finish
+    hr->idle.wait(lock, [&] { return hr->building != p; });
+    for (auto it = hr->sources.begin(); it != hr->sources.end();) {
+      if (it->pipeline == p) {
+        paths.push_back(it->vertPath);
+        paths.push_back(it->fragPath);
+        it = hr->sources.erase(it);
+      } else {
+        ++it;
+      }
+    }
+    hr->queued.erase(std::remove(hr->queued.begin(), hr->queued.end(), p), hr->queued.end());
+    for (auto it = hr->results.begin(); it != hr->results.end();) {
+      if (it->pipeline == p) {
+        vk.vkDestroyPipeline(device, it->handle, nullptr);
+        vk.vkDestroyShaderModule(device, it->vert, nullptr);
+        vk.vkDestroyShaderModule(device, it->frag, nullptr);
+        it = hr->results.erase(it);
+      } else {
+        ++it;
+      }
+    }
+    // Stop watching files no other pipeline uses
+    for (const auto& s : hr->sources) {
+      paths.erase(std::remove(paths.begin(), paths.end(), s.vertPath), paths.end());
+      paths.erase(std::remove(paths.begin(), paths.end(), s.fragPath), paths.end());
+    }
+  }
+  for (const auto& path : paths) hr->watcher->unwatch(path);
+}
+
+void Context::shutdownHotReload() {
+  if (!hotReloader) return;
+  HotReloader* hr = hotReloader;
+  // No new builds once the watcher has stopped; a running one stops at
+  // its next pipeline
+  hr->watcher->stop();
+  JobHandle drain;
+  {
+    std::lock_guard<std::mutex> lock(hr->mutex);
+    hr->stopping = true;
+    drain = hr->drain;
+  }
+  jobs->wait(drain);
+  // Called after vkDeviceWaitIdle: everything left can go
+  for (const auto& r : hr->results) {
+    vk.vkDestroyPipeline(device, r.handle, nullptr);
+    vk.vkDestroyShaderModule(device, r.vert, nullptr);
+    vk.vkDestroyShaderModule(device, r.frag, nullptr);
+  }
+  delete hr;
+  hotReloader = nullptr;
+}
+
+} // namespace vklite
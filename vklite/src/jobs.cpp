@@ -0,0 +1,540 @@
+// jobs.cpp - work-stealing job system shared by the library's parallel work
+#include "jobs.h"
+#include "log.h"
+#include "trace.h"
+#include <algorithm>
+#include <string>
+#include <thread>
+
+#if defined(_WIN32)
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace vklite {
+
+struct JobHandle::Job {
+  std::function<void()> fn;
+  void (*run)(void* data) = nullptr;  // used instead of fn by parallelFor
+  void* data = nullptr;
+  std::atomic<uint32_t> refs{0};  // handles, plus the pool until it has run
+  std::atomic<uint32_t> pendingDependencies{0};
+  std::atomic<bool> done{false};
+  std::mutex mutex;                 // orders `done` against continuations
+  std::vector<Job*> continuations;  // queued once this job is done
+};
+
+struct JobSystem::Counters {
+  std::atomic<uint64_t> executed{0};
+  std::atomic<uint64_t> stolen{0};
+  std::atomic<uint64_t> helped{0};
+  std::atomic<uint64_t> failedSteals{0};
+  std::atomic<uint64_t> sleeps{0};
+};
+
+// One parallelFor call. Helper jobs join it only while it is open; once
+// the caller has taken the last index and closed it, helpers that start
+// late leave without touching fn or data (which live on the caller's stack).
+struct JobSystem::Batch {
+  static constexpr uint32_t kClosed = 0x80000000u;
+
+  JobSystem* system = nullptr;
+  void (*fn)(void* data, uint32_t index) = nullptr;
+  void* data = nullptr;
+  uint32_t count = 0;
+  std::atomic<uint32_t> next{0};
+  std::atomic<uint32_t> state{0};  // kClosed | number of helpers running chunks
+  std::atomic<uint32_t> refs{0};   // the caller and every helper job not yet run
+
+  void drain() {
+    for (uint32_t i; (i = next.fetch_add(1, std::memory_order_relaxed)) < count;) fn(data, i);
+  }
+};
+
+// Chase-Lev deque with a fixed capacity. The owning worker pushes and pops
+// at the bottom; any thread steals from the top. The pop/steal race for the
+// last item is settled by sequentially consistent operations on top and
+// bottom rather than standalone fences, which keeps it visible to TSan.
+struct JobSystem::Worker {
+  static constexpr int64_t kCapacity = 1024;  // power of two
+
+  alignas(64) std::atomic<int64_t> top{0};
+  alignas(64) std::atomic<int64_t> bottom{0};
+  std::atomic<Job*> items[kCapacity];
+  Counters counters;
+  std::thread thread;
+
+  // Owner only. False when full; the job then goes to the shared queue.
+  bool push(Job* job) {
+    const int64_t b = bottom.load(std::memory_order_relaxed);
+    const int64_t t = top.load(std::memory_order_acquire);
+    if (b - t >= kCapacity) return false;
+    items[b & (kCapacity - 1)].store(job, std::memory_order_relaxed);
+    bottom.store(b + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Owner only
+  Job* pop() {
+    const int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+    bottom.store(b, std::memory_order_seq_cst);
+    int64_t t = top.load(std::memory_order_seq_cst);
+    if (t > b) {
+      bottom.store(b + 1, std::memory_order_relaxed);
+      return nullptr;
+    }
+    Job* job = items[b & (kCapacity - 1)].load(std::memory_order_relaxed);
+    if (t == b) {
+      // Last item: race the thieves for it
+      if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) job = nullptr;
+      bottom.store(b + 1, std::memory_order_relaxed);
+    }
+    return job;
+  }
+
+  // Any thread. Null when empty or another thread won the race.
+  Job* steal() {
+    int64_t t = top.load(std::memory_order_seq_cst);
+    const int64_t b = bottom.load(std::memory_order_seq_cst);
+    if (t >= b) return nullptr;
+    Job* job = items[t & (kCapacity - 1)].load(std::memory_order_relaxed);
+    if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) return nullptr;
+    return job;
+  }
+};
+
+namespace {
+
+// Attempts to find work before an idle worker goes to sleep
+constexpr uint32_t kIdleSpins = 64;
+
+struct WorkerIdentity {
+  const JobSystem* system = nullptr;
+  uint32_t index = 0;
+  uint32_t random = 0;  // xorshift state for picking steal victims
+};
+thread_local WorkerIdentity t_worker;
+
+uint32_t nextRandom(uint32_t& state) {
+  uint32_t x = state ? state : 0x9e3779b9u;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  state = x;
+  return x;
+}
+
+void pinThread(std::thread& thread, uint32_t cpu) {
+#if defined(_WIN32)
+  if (cpu >= 64 || SetThreadAffinityMask(thread.native_handle(), DWORD_PTR(1) << cpu) == 0) {
+    VKLITE_LOG_WARN("jobs: cannot pin worker to CPU %u", cpu);
+  }
+#elif defined(__linux__)
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  if (cpu >= CPU_SETSIZE) {
+    VKLITE_LOG_WARN("jobs: cannot pin worker to CPU %u", cpu);
+    return;
+  }
+  CPU_SET(cpu, &set);
+  if (pthread_setaffinity_np(thread.native_handle(), sizeof(set), &set) != 0) {
+    VKLITE_LOG_WARN("jobs: cannot pin worker to CPU %u", cpu);
+  }
+#else
+  // macOS only has affinity hints between threads, not CPUs
+  (void)thread;
+  (void)cpu;
+#endif
+}
+
+} // namespace
+
+JobHandle::JobHandle(const JobHandle& other) : system_(other.system_), job_(other.job_) {
+  if (job_) system_->retain(job_);
+}
+
+JobHandle::JobHandle(JobHandle&& other) noexcept : system_(other.system_), job_(other.job_) {
+  other.system_ = nullptr;
+  other.job_ = nullptr;
+}
+
+JobHandle& JobHandle::operator=(const JobHandle& other) {
+  if (this != &other) {
+    JobHandle copy(other);
+    *this = std::move(copy);
+  }
+  return *this;
+}
+
+JobHandle& JobHandle::operator=(JobHandle&& other) noexcept {
+  if (this != &other) {
+    if (job_) system_->release(job_);
+    system_ = other.system_;
+    job_ = other.job_;
+    other.system_ = nullptr;
+    other.job_ = nullptr;
+  }
+  return *this;
+}
+
+JobHandle::~JobHandle() {
+  if (job_) system_->release(job_);
+}
+
+bool JobHandle::done() const {
+  return !job_ || job_->done.load(std::memory_order_acquire);
+}
+
+JobSystem::JobSystem(const JobSettings& settings) : external_(new Counters()) {
+  uint32_t count = settings.workerCount;
+  if (count == 0) {
+    const uint32_t hw = std::thread::hardware_concurrency();
+    count = hw > 1 ? hw - 1 : 1;
+  }
+#if !defined(_WIN32) && !defined(__linux__)
+  if (!settings.affinity.empty()) VKLITE_LOG_WARN("jobs: worker affinity is not supported on this platform");
+#endif
+  workers_.reserve(count);
+  for (uint32_t i = 0; i < count; ++i) workers_.emplace_back(new Worker());
+  // Every worker exists before any of them looks for a victim
+  for (uint32_t i = 0; i < count; ++i) {
+    Worker& w = *workers_[i];
+    w.thread = std::thread([this, i] { workerMain(i); });
+    if (!settings.affinity.empty()) pinThread(w.thread, settings.affinity[i % settings.affinity.size()]);
+  }
+  VKLITE_LOG_INFO("jobs: %u worker threads", count);
+}
+
+JobSystem::~JobSystem() {
+  {
+    std::lock_guard<std::mutex> lock(sleepMutex_);
+    stopping_.store(true, std::memory_order_seq_cst);
+  }
+  sleepCv_.notify_all();
+  for (auto& w : workers_) {
+    if (w->thread.joinable()) w->thread.join();
+  }
+}
+
+JobSystem::Job* JobSystem::allocateJob() {
+  Job* job = nullptr;
+  {
+    std::lock_guard<std::mutex> lock(freeMutex_);
+    if (!freeJobs_.empty()) {
+      job = freeJobs_.back();
+      freeJobs_.pop_back();
+    } else {
+      allJobs_.emplace_back(new Job());
+      job = allJobs_.back().get();
+      // Room to recycle every node without growing
+      freeJobs_.reserve(allJobs_.size());
+    }
+  }
+  job->run = nullptr;
+  job->data = nullptr;
+  job->done.store(false, std::memory_order_relaxed);
+  job->continuations.clear();
+  return job;
+}
+
+void JobSystem::retain(Job* job) {
+  job->refs.fetch_add(1, std::memory_order_relaxed);
+}
+
+void JobSystem::release(Job* job) {
+  if (job->refs.fetch_sub(1, std::memory_order_acq_rel) != 1) return;
+  std::lock_guard<std::mutex> lock(freeMutex_);
+  freeJobs_.push_back(job);
+}
+
+JobHandle JobSystem::submit(std::function<void()> fn) {
+  return submit(std::move(fn), nullptr, 0);
+}
+
+JobHandle JobSystem::submit(std::function<void()> fn, std::initializer_list<JobHandle> dependencies) {
+  return submit(std::move(fn), dependencies.begin(), dependencies.size());
+}
+
+JobHandle JobSystem::submit(std::function<void()> fn, const JobHandle* dependencies, size_t dependencyCount) {
+  Job* job = allocateJob();
+  job->fn = std::move(fn);
+  job->refs.store(2, std::memory_order_relaxed);  // the returned handle and the pool
+  // One extra so the job cannot be queued before every dependency is seen
+  job->pendingDependencies.store(static_cast<uint32_t>(dependencyCount) + 1, std::memory_order_relaxed);
+  submitted_.fetch_add(1, std::memory_order_relaxed);
+  for (size_t i = 0; i < dependencyCount; ++i) {
+    Job* dep = dependencies[i].job_;
+    bool pending = false;
+    if (dep) {
+      std::lock_guard<std::mutex> lock(dep->mutex);
+      if (!dep->done.load(std::memory_order_relaxed)) {
+        dep->continuations.push_back(job);
+        pending = true;
+      }
+    }
+    if (!pending) job->pendingDependencies.fetch_sub(1, std::memory_order_acq_rel);
+  }
+  if (job->pendingDependencies.fetch_sub(1, std::memory_order_acq_rel) == 1) push(job);
+  return JobHandle(this, job);
+}
+
+void JobSystem::push(Job* job) {
+  queuedJobs_.fetch_add(1, std::memory_order_seq_cst);
+  if (t_worker.system != this || !workers_[t_worker.index]->push(job)) {
+    std::lock_guard<std::mutex> lock(injectMutex_);
+    injected_.push_back(job);
+    injectedJobs_.fetch_add(1, std::memory_order_relaxed);
+  }
+  // Pairs with the re-check under sleepMutex_ in workerMain and helpUntil
+  const bool sleepers = sleepers_.load(std::memory_order_seq_cst) > 0;
+  const bool waiters = waiters_.load(std::memory_order_seq_cst) > 0;
+  if (!sleepers && !waiters) return;
+  { std::lock_guard<std::mutex> lock(sleepMutex_); }
+  if (sleepers) sleepCv_.notify_one();
+  if (waiters) waitCv_.notify_all();
+}
+
+JobSystem::Job* JobSystem::findWork(Counters& counters) {
+  const bool isWorker = t_worker.system == this;
+  if (isWorker) {
+    if (Job* job = workers_[t_worker.index]->pop()) {
+      queuedJobs_.fetch_sub(1, std::memory_order_relaxed);
+      return job;
+    }
+  }
+  if (queuedJobs_.load(std::memory_order_relaxed) <= 0) return nullptr;
+  if (injectedJobs_.load(std::memory_order_relaxed) > 0) {
+    std::lock_guard<std::mutex> lock(injectMutex_);
+    if (!injected_.empty()) {
+      Job* job = injected_.front();
+      injected_.pop_front();
+      injectedJobs_.fetch_sub(1, std::memory_order_relaxed);
+      queuedJobs_.fetch_sub(1, std::memory_order_relaxed);
+      return job;
+    }
+  }
+  const uint32_t n = workerCount();
+  static thread_local uint32_t externalRandom = 0;
+  uint32_t& random = isWorker ? t_worker.random : externalRandom;
+  const uint32_t start = nextRandom(random) % n;
+  for (uint32_t k = 0; k < n; ++k) {
+    const uint32_t victim = (start + k) % n;
+    if (isWorker && victim == t_worker.index) continue;
+    if (Job* job = workers_[victim]->steal()) {
+      counters.stolen.fetch_add(1, std::memory_order_relaxed);
+      queuedJobs_.fetch_sub(1, std::memory_order_relaxed);
+      return job;
+    }
+  }
+  counters.failedSteals.fetch_add(1, std::memory_order_relaxed);
+  return nullptr;
+}
+
+void JobSystem::execute(Job* job, Counters& counters, bool helping) {
+  if (job->run) {
+    job->run(job->data);
+  } else if (job->fn) {
+    job->fn();
+  }
+  counters.executed.fetch_add(1, std::memory_order_relaxed);
+  if (helping) counters.helped.fetch_add(1, std::memory_order_relaxed);
+  finish(job);
+}
+
+void JobSystem::finish(Job* job) {
+  job->fn = nullptr;  // captured state goes with the job, not the node
+  {
+    std::lock_guard<std::mutex> lock(job->mutex);
+    job->done.store(true, std::memory_order_seq_cst);
+    for (Job* next : job->continuations) {
+      if (next->pendingDependencies.fetch_sub(1, std::memory_order_acq_rel) == 1) push(next);
+    }
+    job->continuations.clear();
+  }
+  if (waiters_.load(std::memory_order_seq_cst) > 0) {
+    { std::lock_guard<std::mutex> lock(sleepMutex_); }
+    waitCv_.notify_all();
+  }
+  release(job);
+}
+
+JobSystem::Counters& JobSystem::countersForThisThread() {
+  return t_worker.system == this ? workers_[t_worker.index]->counters : *external_;
+}
+
+// Run jobs until done(data); block only when there is nothing to run.
+void JobSystem::helpUntil(bool (*done)(const void* data), const void* data) {
+  Counters& counters = countersForThisThread();
+  uint32_t spins = 0;
+  while (!done(data)) {
+    if (Job* job = findWork(counters)) {
+      execute(job, counters, true);
+      spins = 0;
+      continue;
+    }
+    if (++spins < kIdleSpins) {
+      std::this_thread::yield();
+      continue;
+    }
+    spins = 0;
+    std::unique_lock<std::mutex> lock(sleepMutex_);
+    waiters_.fetch_add(1, std::memory_order_seq_cst);
+    if (!done(data) && queuedJobs_.load(std::memory_order_seq_cst) <= 0) waitCv_.wait(lock);
+    waiters_.fetch_sub(1, std::memory_order_relaxed);
+  }
+}
+
+void JobSystem::wait(const JobHandle& job) {
+  if (job.done()) return;
+  helpUntil([](const void* h) { return static_cast<const JobHandle*>(h)->done(); }, &job);
+}
+
+JobSystem::Batch* JobSystem::allocateBatch() {
+  std::lock_guard<std::mutex> lock(freeMutex_);
+  if (freeBatches_.empty()) {
+    allBatches_.emplace_back(new Batch());
+    freeBatches_.reserve(allBatches_.size());
+    return allBatches_.back().get();
+  }
+  Batch* batch = freeBatches_.back();
+  freeBatches_.pop_back();
+  return batch;
+}
+
+void JobSystem::releaseBatch(Batch* batch) {
+  if (batch->refs.fetch_sub(1, std::memory_order_acq_rel) != 1) return;
+  std::lock_guard<std::mutex> lock(freeMutex_);
+  freeBatches_.push_back(batch);
+}
+
+// The caller runs indices of its own batch only: helping with whatever is
+// queued could pick up a long pipeline build in the middle of a frame.
+void JobSystem::parallelFor(uint32_t count, void (*fn)(void* data, uint32_t index), void* data) {
+  if (count == 0) return;
+  parallelFors_.fetch_add(1, std::memory_order_relaxed);
+  const uint32_t helpers = std::min(count - 1, workerCount());
+  if (helpers == 0) {
+    for (uint32_t i = 0; i < count; ++i) fn(data, i);
+    return;
+  }
+
+  Batch* batch = allocateBatch();
+  batch->system = this;
+  batch->fn = fn;
+  batch->data = data;
+  batch->count = count;
+  batch->next.store(0, std::memory_order_relaxed);
+  batch->state.store(0, std::memory_order_relaxed);
+  batch->refs.store(helpers + 1, std::memory_order_relaxed);
+  for (uint32_t h = 0; h < helpers; ++h) {
+    Job* job = allocateJob();
+    job->run = [](void* b) {
+      Batch* batch = static_cast<Batch*>(b);
+      uint32_t state = batch->state.load(std::memory_order_seq_cst);
+      while (!(state & Batch::kClosed)) {
+        if (batch->state.compare_exchange_weak(state, state + 1, std::memory_order_seq_cst)) {
+          batch->drain();
+          batch->state.fetch_sub(1, std::memory_order_seq_cst);
+          break;
+        }
+      }
+      batch->system->releaseBatch(batch);
+    };
+    job->data = batch;
+    job->refs.store(1, std::memory_order_relaxed);  // the pool only
+    job->pendingDependencies.store(0, std::memory_order_relaxed);
+    submitted_.fetch_add(1, std::memory_order_relaxed);
+    push(job);
+  }
+  batch->drain();
+
+  // Every index is taken; wait only for helpers still inside a chunk
+  batch->state.fetch_or(Batch::kClosed, std::memory_order_seq_cst);
+  uint32_t spins = 0;
+  while ((batch->state.load(std::memory_order_seq_cst) & ~Batch::kClosed) != 0) {
+    if (++spins < kIdleSpins) {
+      std::this_thread::yield();
+      continue;
+    }
+    spins = 0;
+    // Woken by finish() of the helper job, which follows its decrement
+    std::unique_lock<std::mutex> lock(sleepMutex_);
+    waiters_.fetch_add(1, std::memory_order_seq_cst);
+    if ((batch->state.load(std::memory_order_seq_cst) & ~Batch::kClosed) != 0) waitCv_.wait(lock);
+    waiters_.fetch_sub(1, std::memory_order_relaxed);
+  }
+  releaseBatch(batch);
+}
+
+void JobSystem::workerMain(uint32_t index) {
+  t_worker.system = this;
+  t_worker.index = index;
+  t_worker.random = index * 0x9e3779b9u + 1;
+  setTraceThreadName(("vklite worker " + std::to_string(index)).c_str());
+  Counters& counters = workers_[index]->counters;
+  uint32_t spins = 0;
+  while (true) {
+    if (Job* job = findWork(counters)) {
+      execute(job, counters, false);
+      spins = 0;
+      continue;
+    }
+    // Continuations of jobs still running elsewhere are queued by the
+    // thread that finishes them, so no work is lost once the queues are empty
+    if (stopping_.load(std::memory_order_acquire) && queuedJobs_.load(std::memory_order_seq_cst) <= 0) break;
+    if (++spins < kIdleSpins) {
+      std::this_thread::yield();
+      continue;
+    }
+    spins = 0;
+    std::unique_lock<std::mutex> lock(sleepMutex_);
+    sleepers_.fetch_add(1, std::memory_order_seq_cst);
+    if (queuedJobs_.load(std::memory_order_seq_cst) <= 0 && !stopping_.load(std::memory_order_relaxed)) {
+      counters.sleeps.fetch_add(1, std::memory_order_relaxed);
+      sleepCv_.wait(lock);
+    }
+    sleepers_.fetch_sub(1, std::memory_order_relaxed);
+  }
+  t_worker = WorkerIdentity{};
+}
+
+JobSystem::Stats JobSystem::stats() const {
+  Stats s;
+  s.workers = workerCount();
+  s.submitted = submitted_.load(std::memory_order_relaxed);
+  s.parallelFors = parallelFors_.load(std::memory_order_relaxed);
+  auto add = [&s](const Counters& c) {
+    s.executed += c.executed.load(std::memory_order_relaxed);
+    s.stolen += c.stolen.load(std::memory_order_relaxed);
+    s.helped += c.helped.load(std::memory_order_relaxed);
+    s.failedSteals += c.failedSteals.load(std::memory_order_relaxed);
+    s.sleeps += c.sleeps.load(std::memory_order_relaxed);
+  };
+  for (const auto& w : workers_) add(w->counters);
+  add(*external_);
+  return s;
+}
+
+void JobSystem::resetStats() {
+  submitted_.store(0, std::memory_order_relaxed);
+  parallelFors_.store(0, std::memory_order_relaxed);
+  auto reset = [](Counters& c) {
+    c.executed.store(0, std::memory_order_relaxed);
+    c.stolen.store(0, std::memory_order_relaxed);
+    c.helped.store(0, std::memory_order_relaxed);
+    c.failedSteals.store(0, std::memory_order_relaxed);
+    c.sleeps.store(0, std::memory_order_relaxed);
+  };
+  for (auto& w : workers_) reset(w->counters);
+  reset(*external_);
+}
+
+} // namespace vklite
@@ -0,0 +1,330 @@
+// lod.cpp - mesh LOD generation (vertex clustering) and screen-space LOD selection
+#include "lod.h"
+#include "log.h"
+#include <tiny_obj_loader.h>
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <unordered_map>
+
+namespace vklite {
+
+namespace {
+
+using Triangle = std::array<uint32_t, 3>;
+
+void computeBounds(Mesh& mesh) {
+  const size_t n = mesh.vertexCount();
+  if (n == 0) {
+    mesh.boundsCenter[0] = mesh.boundsCenter[1] = mesh.boundsCenter[2] = 0.0f;
+    mesh.boundsRadius = 0.0f;
+    return;
+  }
+  float mn[3] = { mesh.positions[0], mesh.positions[1], mesh.positions[2] };
+  float mx[3] = { mn[0], mn[1], mn[2] };
+  for (size_t i = 1; i < n; ++i) {
+    for (int a = 0; a < 3; ++a) {
+      mn[a] = std::min(mn[a], mesh.positions[i * 3 + a]);
+      mx[a] = std::max(mx[a], mesh.positions[i * 3 + a]);
+    }
+  }
+  for (int a = 0; a < 3; ++a) mesh.boundsCenter[a] = 0.5f * (mn[a] + mx[a]);
+  float r2 = 0.0f;
+  for (size_t i = 0; i < n; ++i) {
+    float dx = mesh.positions[i * 3 + 0] - mesh.boundsCenter[0];
+    float dy = mesh.positions[i * 3 + 1] - mesh.boundsCenter[1];
+    float dz = mesh.positions[i * 3 + 2] - mesh.boundsCenter[2];
+    r2 = std::max(r2, dx * dx + dy * dy + dz * dz);
+  }
+  mesh.boundsRadius = std::sqrt(r2);
+}
+
+// Cluster the vertices used by `source` on a grid of `cellSize` and emit the
+// surviving triangles. Each cluster collapses onto its member closest to the
+// cluster mean, so LODs keep indexing the original vertex array. Returns the
+// largest distance a vertex moved (the LOD's geometric error).
+float clusterTriangles(const Mesh& mesh, const std::vector<uint32_t>& source, float cellSize, const float origin[3], std::vector<uint32_t>& out) {
+  struct Cluster {
+    float sum[3] = { 0.0f, 0.0f, 0.0f };
+    uint32_t count = 0;
+    uint32_t representative = UINT32_MAX;
+    float bestDist = 0.0f;
+  };
+  const float inv = 1.0f / cellSize;
+  auto cellOf = [&](uint32_t v) {
+    uint64_t key = 0;
+    for (int a = 0; a < 3; ++a) {
+      uint64_t c = static_cast<uint64_t>(std::max(0.0f, std::floor((mesh.positions[v * 3 + a] - origin[a]) * inv))) & 0x1FFFFF;
+      key |= c << (21 * a);
+    }
+    return key;
+  };
+
+  std::unordered_map<uint64_t, Cluster> clusters;
+  std::vector<uint64_t> vertexCell(mesh.vertexCount(), UINT64_MAX);
+  for (uint32_t v : source) {
+    if (vertexCell[v] != UINT64_MAX) continue;
+    uint64_t key = cellOf(v);
+    vertexCell[v] = key;
+    Cluster& c = clusters[key];
+    for (int a = 0; a < 3; ++a) c.sum[a] += mesh.positions[v * 3 + a];
+    ++c.count;
+  }
+  for (size_t v = 0; v < vertexCell.size(); ++v) {
+    if (vertexCell[v] == UINT64_MAX) continue;
+    Cluster& c = clusters[vertexCell[v]];
+    float d2 = 0.0f;
+    for (int a = 0; a < 3; ++a) {
+      float d = mesh.positions[v * 3 + a] - c.sum[a] / static_cast<float>(c.count);
+      d2 += d * d;
+    }
+    if (c.representative == UINT32_MAX || d2 < c.bestDist) {
+      c.representative = static_cast<uint32_t>(v);
+      c.bestDist = d2;
+    }
+  }
+
+  float error2 = 0.0f;
+  std::vector<uint32_t> remap(mesh.vertexCount(), UINT32_MAX);
+  for (size_t v = 0; v < vertexCell.size(); ++v) {
+    if (vertexCell[v] == UINT64_MAX) continue;
+    uint32_t rep = clusters[vertexCell[v]].representative;
+    remap[v] = rep;
+    float d2 = 0.0f;
+    for (int a = 0; a < 3; ++a) {
+      float d = mesh.positions[v * 3 + a] - mesh.positions[rep * 3 + a];
+      d2 += d * d;
+    }
+    error2 = std::max(error2, d2);
+  }
+
+  // Drop collapsed triangles and duplicates (rotated so the smallest index
+  // comes first, which keeps the winding).
+  std::vector<Triangle> tris;
+  tris.reserve(source.size() / 3);
+  for (size_t i = 0; i + 2 < source.size(); i += 3) {
+    Triangle t = { remap[source[i]], remap[source[i + 1]], remap[source[i + 2]] };
+    if (t[0] == t[1] || t[1] == t[2] || t[0] == t[2]) continue;
+    while (t[0] > t[1] || t[0] > t[2]) std::rotate(t.begin(), t.begin() + 1, t.end());
+    tris.push_back(t);
+  }
+  std::sort(tris.begin(), tris.end());
+  tris.erase(std::unique(tris.begin(), tris.end()), tris.end());
+
+  out.clear();
+  out.reserve(tris.size() * 3);
+  for (const Triangle& t : tris) out.insert(out.end(), t.begin(), t.end());
+  return std::sqrt(error2);
+}
+
+const char kMeshCacheMagic[4] = { 'V', 'K', 'L', 'M' };
+const uint32_t kMeshCacheVersion = 1;
+
+} // namespace
+
+void buildMeshLods(Mesh& mesh, const LodBuildOptions& options) {
+  // Nothing to simplify; lods[0] still describes the (empty) index list
+  if (mesh.indices.empty() || mesh.vertexCount() == 0) {
+    mesh.lods.assign(1, { 0, static_cast<uint32_t>(mesh.indices.size()), 0.0f });
+    computeBounds(mesh);
+    return;
+  }
+  // Keep only the full-resolution range, moved to the start of the index array
+  if (!mesh.lods.empty()) {
+    const LodLevel full = mesh.lods[0];
+    if (static_cast<size_t>(full.indexOffset) + full.indexCount <= mesh.indices.size()) {
+      std::vector<uint32_t> base(mesh.indices.begin() + full.indexOffset, mesh.indices.begin() + full.indexOffset + full.indexCount);
+      mesh.indices.swap(base);
+    } else {
+      VKLITE_LOG_WARN("buildMeshLods: lods[0] lies outside the index array; using all %zu indices", mesh.indices.size());
+    }
+  }
+  mesh.lods.clear();
+  mesh.lods.push_back({ 0, static_cast<uint32_t>(mesh.indices.size()), 0.0f });
+  computeBounds(mesh);
+  const size_t vertexCount = mesh.vertexCount();
+  if (std::any_of(mesh.indices.begin(), mesh.indices.end(), [&](uint32_t i) { return i >= vertexCount; })) {
+    VKLITE_LOG_ERROR("buildMeshLods: index out of range of %zu vertices; no coarser LODs built", vertexCount);
+    return;
+  }
+  if (mesh.indices.empty() || mesh.boundsRadius <= 0.0f) return;
+
+  float origin[3];
+  for (int a = 0; a < 3; ++a) origin[a] = mesh.boundsCenter[a] - mesh.boundsRadius;
+  const std::vector<uint32_t> full(mesh.indices);
+  float cellSize = (2.0f * mesh.boundsRadius) / 256.0f;
+  std::vector<uint32_t> candidate;
+
+  while (mesh.lods.size() < std::max(1u, options.maxLods)) {
+    const uint32_t prevTris = mesh.lods.back().indexCount / 3;
+    if (prevTris <= options.minTriangles) break;
+    const uint32_t target = std::max<uint32_t>(options.minTriangles, static_cast<uint32_t>(prevTris * options.reductionTarget));
+
+    // Grow the grid until the reduction target is met (or the whole mesh
+    // collapses into a single cell).
+    float error = 0.0f;
+    bool found = false;
+    while (cellSize <= 2.0f * mesh.boundsRadius) {
+      error = clusterTriangles(mesh, full, cellSize, origin, candidate);
+      if (candidate.size() / 3 <= target) {
+        found = true;
+        break;
+      }
+      cellSize *= 1.25f;
+    }
+    if (!found || candidate.empty()) break;
+
+    LodLevel lod;
+    lod.indexOffset = static_cast<uint32_t>(mesh.indices.size());
+    lod.indexCount = static_cast<uint32_t>(candidate.size());
+    lod.error = error;
+    mesh.indices.insert(mesh.indices.end(), candidate.begin(), candidate.end());
+    mesh.lods.push_back(lod);
+    cellSize *= 1.25f;
+  }
+}
+
+bool loadMeshFromObj(const std::string& path, Mesh& mesh, const LodBuildOptions& options) {
+  tinyobj::ObjReaderConfig config;
+  config.triangulate = true;
+  tinyobj::ObjReader reader;
+  if (!reader.ParseFromFile(path, config)) {
+    VKLITE_LOG_ERROR("loadMeshFromObj: failed to load %s: %s", path.c_str(), reader.Error().c_str());
+    return false;
+  }
+  if (!reader.Warning().empty()) VKLITE_LOG_WARN("loadMeshFromObj: %s", reader.Warning().c_str());
+
+  const auto& attrib = reader.GetAttrib();
+  mesh = Mesh{};
+  mesh.positions.assign(attrib.vertices.begin(), attrib.vertices.end());
+  for (const auto& shape : reader.GetShapes()) {
+    for (const auto& idx : shape.mesh.indices) {
+      if (idx.vertex_index < 0) continue;
+      mesh.indices.push_back(static_cast<uint32_t>(idx.vertex_index));
+    }
+  }
+  mesh.indices.resize(mesh.indices.size() - mesh.indices.size() % 3);
+  if (mesh.indices.empty()) {
+    VKLITE_LOG_ERROR("loadMeshFromObj: %s contains no triangles", path.c_str());
+    return false;
+  }
+  buildMeshLods(mesh, options);
+  return true;
+}
+
+bool writeMeshCache(const std::string& path, const Mesh& mesh) {
+  std::ofstream out(path, std::ios::binary | std::ios::trunc);
+  if (!out) return false;
+  const uint32_t header[4] = {
+    kMeshCacheVersion,
+    static_cast<uint32_t>(mesh.positions.size()),
+    static_cast<uint32_t>(mesh.indices.size()),
+    static_cast<uint32_t>(mesh.lods.size()),
+  };
+  out.write(kMeshCacheMagic, sizeof(kMeshCacheMagic));
+  out.write(reinterpret_cast<const char*>(header), sizeof(header));
+  out.write(reinterpret_cast<const char*>(mesh.boundsCenter), sizeof(mesh.boundsCenter));
+  out.write(reinterpret_cast<const char*>(&mesh.boundsRadius), sizeof(mesh.boundsRadius));
+  out.write(reinterpret_cast<const char*>(mesh.positions.data()), mesh.positions.size() * sizeof(float));
+  out.write(reinterpret_cast<const char*>(mesh.indices.data()), mesh.indices.size() * sizeof(uint32_t));
+  out.write(reinterpret_cast<const char*>(mesh.lods.data()), mesh.lods.size() * sizeof(LodLevel));
+  return static_cast<bool>(out);
+}
+
+bool readMeshCache(const std::string& path, Mesh& mesh) {
+  std::ifstream in(path, std::ios::binary | std::ios::ate);
+  if (!in) return false;
+  const uint64_t fileSize = static_cast<uint64_t>(in.tellg());
+  in.seekg(0);
+  char magic[4] = {};
+  uint32_t header[4] = {};
+  in.read(magic, sizeof(magic));
+  in.read(reinterpret_cast<char*>(header), sizeof(header));
+  if (!in || std::memcmp(magic, kMeshCacheMagic, sizeof(magic)) != 0 || header[0] != kMeshCacheVersion) return false;
+  // The counts must describe exactly the rest of the file, so a truncated or
+  // corrupt cache is rejected before anything is allocated for it
+  const uint64_t expected = sizeof(magic) + sizeof(header) + sizeof(Mesh::boundsCenter) + sizeof(Mesh::boundsRadius) +
+                            uint64_t(header[1]) * sizeof(float) + uint64_t(header[2]) * sizeof(uint32_t) + uint64_t(header[3]) * sizeof(LodLevel);
+  if (expected != fileSize || header[1] % 3 != 0 || header[2] % 3 != 0 || header[3] == 0) {
+    VKLITE_LOG_WARN("readMeshCache: %s is truncated or corrupt", path.c_str());
+    return false;
+  }
+  Mesh loaded;
+  loaded.positions.resize(header[1]);
+  loaded.indices.resize(header[2]);
+  loaded.lods.resize(header[3]);
+  in.read(reinterpret_cast<char*>(loaded.boundsCenter), sizeof(loaded.boundsCenter));
+  in.read(reinterpret_cast<char*>(&loaded.boundsRadius), sizeof(loaded.boundsRadius));
+  in.read(reinterpret_cast<char*>(loaded.positions.data()), loaded.positions.size() * sizeof(float));
+  in.read(reinterpret_cast<char*>(loaded.indices.data()), loaded.indices.size() * sizeof(uint32_t));
+  in.read(reinterpret_cast<char*>(loaded.lods.data()), loaded.lods.size() * sizeof(LodLevel));
+  if (!in) return false;
+  const size_t vertexCount = loaded.vertexCount();
+  bool valid = std::all_of(loaded.indices.begin(), loaded.indices.end(), [&](uint32_t i) { return i < vertexCount; });
+  for (const LodLevel& lod : loaded.lods) {
+    if (static_cast<size_t>(lod.indexOffset) + lod.indexCount > loaded.indices.size()) valid = false;
+  }
+  if (!valid) {
+    VKLITE_LOG_WARN("readMeshCache: %s is corrupt", path.c_str());
+    return false;
+  }
+  mesh = std::move(loaded);
+  return true;
+}
+
+void LodSelector::resize(size_t objectCount) {
+  current_.resize(objectCount, 0);
+}
+
+void LodSelector::reset() {
+  std::fill(current_.begin(), current_.end(), 0);
+  budgetBias_ = 1.0f;
+  smoothedFrameMs_ = 0.0f;
+}
+
+uint32_t LodSelector::select(uint32_t object, const Mesh& mesh, const float center[3], float scale, const LodCamera& camera) {
+  if (object >= current_.size()) resize(object + 1);
+  const uint32_t lodCount = static_cast<uint32_t>(mesh.lods.size());
+  if (lodCount <= 1) return current_[object] = 0;
+
+  const float dx = center[0] - camera.position[0];
+  const float dy = center[1] - camera.position[1];
+  const float dz = center[2] - camera.position[2];
+  // Distance to the nearest point of the bounding sphere; inside it use the
+  // finest LOD.
+  const float distance = std::sqrt(dx * dx + dy * dy + dz * dz) - mesh.boundsRadius * scale;
+  if (distance <= 1e-4f) return current_[object] = 0;
+
+  const float pixelsPerUnit = scale * camera.projScale / distance;
+  auto pixelError = [&](uint32_t lod) { return mesh.lods[lod].error * pixelsPerUnit; };
+  const float threshold = effectiveThreshold();
+
+  uint32_t lod = std::min<uint32_t>(current_[object], lodCount - 1);
+  if (pixelError(lod) > threshold * (1.0f + hysteresis)) {
+    // Too coarse: refine to the coarsest LOD that meets the threshold
+    while (lod > 0 && pixelError(lod) > threshold) --lod;
+  } else {
+    // Coarsen only once the next LOD is clearly below the threshold
+    while (lod + 1 < lodCount && pixelError(lod + 1) <= threshold * (1.0f - hysteresis)) ++lod;
+  }
+  current_[object] = static_cast<uint8_t>(lod);
+  return lod;
+}
+
+void LodSelector::reportFrameTime(float frameMs) {
+  if (frameBudgetMs <= 0.0f) {
+    budgetBias_ = 1.0f;
+    return;
+  }
+  smoothedFrameMs_ = smoothedFrameMs_ <= 0.0f ? frameMs : smoothedFrameMs_ + 0.1f * (frameMs - smoothedFrameMs_);
+  // Back off quickly when over budget, recover quality slowly when well under
+  if (smoothedFrameMs_ > frameBudgetMs * 1.05f) {
+    budgetBias_ = std::min(maxBudgetBias, budgetBias_ * 1.1f);
+  } else if (smoothedFrameMs_ < frameBudgetMs * 0.85f) {
+    budgetBias_ = std::max(1.0f, budgetBias_ / 1.03f);
+  }
+}
+
+} // namespace vklite
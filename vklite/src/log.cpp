@@ -0,0 +1,196 @@
+// log.cpp - lock-free message ring drained by a background thread
+#include "log.h"
+#include <chrono>
+#include <condition_variable>
+#include <cstdarg>
+#include <cstdio>
+#include <mutex>
+#include <thread>
+
+namespace vklite {
+
+namespace {
+
+constexpr size_t kLogRingSize = 512;  // power of two
+constexpr auto kDrainInterval = std::chrono::milliseconds(5);
+
+std::atomic<int> g_logLevel{ static_cast<int>(LogLevel::Info) };
+
+int64_t nowMs() {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void defaultSink(LogLevel level, const char* message) {
+  std::FILE* out = level >= LogLevel::Warning ? stderr : stdout;
+  std::fputs(message, out);
+  std::fputc('\n', out);
+  std::fflush(out);
+}
+
+// Bounded multi-producer ring (sequence numbers per cell, after Vyukov's
+// MPMC queue) with the logging thread as the only consumer. A cell is
+// published when its sequence is one past its ring position.
+class Logger {
+public:
+  Logger() {
+    for (size_t i = 0; i < kLogRingSize; ++i) cells_[i].sequence.store(i, std::memory_order_relaxed);
+    thread_ = std::thread([this] { run(); });
+  }
+
+  ~Logger() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stopping_ = true;
+    }
+    wake_.notify_one();
+    if (thread_.joinable()) thread_.join();
+  }
+
+  void push(LogLevel level, uint32_t suppressed, const char* format, va_list args) {
+    size_t pos = enqueuePos_.load(std::memory_order_relaxed);
+    Cell* cell = nullptr;
+    while (true) {
+      cell = &cells_[pos & (kLogRingSize - 1)];
+      const size_t seq = cell->sequence.load(std::memory_order_acquire);
+      const intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+      if (diff == 0) {
+        if (enqueuePos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+      } else if (diff < 0) {
+        dropped_.fetch_add(1, std::memory_order_relaxed);  // full
+        return;
+      } else {
+        pos = enqueuePos_.load(std::memory_order_relaxed);
+      }
+    }
+    cell->level = level;
+    int len = std::vsnprintf(cell->text, kLogMessageBytes, format, args);
+    if (len < 0) len = 0;
+    if (suppressed > 0 && static_cast<size_t>(len) < kLogMessageBytes) {
+      std::snprintf(cell->text + len, kLogMessageBytes - len, " (%u similar messages suppressed)", suppressed);
+    }
+    cell->sequence.store(pos + 1, std::memory_order_release);
+  }
+
+  void setSink(LogSink sink) {
+    std::lock_guard<std::mutex> lock(sinkMutex_);
+    sink_ = std::move(sink);
+  }
+
+  void flush() {
+    const size_t target = enqueuePos_.load(std::memory_order_acquire);
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (delivered_.load(std::memory_order_acquire) < target && !stopping_) {
+      flushRequested_ = true;
+      wake_.notify_one();
+      drained_.wait_for(lock, kDrainInterval);
+    }
+  }
+
+  uint64_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+private:
+  struct Cell {
+    std::atomic<size_t> sequence{0};
+    LogLevel level = LogLevel::Info;
+    char text[kLogMessageBytes];
+  };
+
+  void drain() {
+    while (true) {
+      Cell& cell = cells_[dequeuePos_ & (kLogRingSize - 1)];
+      if (cell.sequence.load(std::memory_order_acquire) != dequeuePos_ + 1) break;
+      {
+        std::lock_guard<std::mutex> lock(sinkMutex_);
+        if (sink_) sink_(cell.level, cell.text);
+        else defaultSink(cell.level, cell.text);
+      }
+      // Hand the cell back to producers for the next lap of the ring
+      cell.sequence.store(dequeuePos_ + kLogRingSize, std::memory_order_release);
+      ++dequeuePos_;
+      delivered_.store(dequeuePos_, std::memory_order_release);
+    }
+  }
+
+  void run() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+      lock.unlock();
+      drain();
+      lock.lock();
+      flushRequested_ = false;
+      drained_.notify_all();
+      if (stopping_) break;
+      // Producers never take the mutex, so poll; flushLog wakes us early
+      wake_.wait_for(lock, kDrainInterval, [this] { return stopping_ || flushRequested_; });
+    }
+    lock.unlock();
+    drain();
+  }
+
+  Cell cells_[kLogRingSize];
+  std::atomic<size_t> enqueuePos_{0};
+  size_t dequeuePos_ = 0;  // logging thread only
+  std::atomic<size_t> delivered_{0};
+  std::atomic<uint64_t> dropped_{0};
+
+  std::mutex sinkMutex_;
+  LogSink sink_;
+
+  std::thread thread_;
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  std::condition_variable drained_;
+  bool stopping_ = false;
+  bool flushRequested_ = false;
+};
+
+Logger& logger() {
+  static Logger instance;
+  return instance;
+}
+
+} // namespace
+
+void setLogSink(LogSink sink) {
+  logger().setSink(std::move(sink));
+}
+
+void setLogLevel(LogLevel level) {
+  g_logLevel.store(static_cast<int>(level), std::memory_order_relaxed);
+}
+
+LogLevel logLevel() {
+  return static_cast<LogLevel>(g_logLevel.load(std::memory_order_relaxed));
+}
+
+void flushLog() {
+  logger().flush();
+}
+
+uint64_t droppedLogMessages() {
+  return logger().dropped();
+}
+
+void logMessage(LogLevel level, LogSite* site, const char* format, ...) {
+  uint32_t suppressed = 0;
+  if (site) {
+    // One-second windows per call site; races between threads only shift
+    // a message or two across the limit
+    const int64_t now = nowMs();
+    int64_t start = site->windowStart.load(std::memory_order_relaxed);
+    if (now - start >= 1000 && site->windowStart.compare_exchange_strong(start, now, std::memory_order_relaxed)) {
+      site->count.store(0, std::memory_order_relaxed);
+      suppressed = site->suppressed.exchange(0, std::memory_order_relaxed);
+    }
+    if (site->count.fetch_add(1, std::memory_order_relaxed) >= kLogSiteBurst) {
+      site->suppressed.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+  }
+  va_list args;
+  va_start(args, format);
+  logger().push(level, suppressed, format, args);
+  va_end(args);
+}
+
+} // namespace vklite
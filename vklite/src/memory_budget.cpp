@@ -0,0 +1,121 @@
+// memory_budget.cpp - device memory accounting against the driver's per-heap budget
+#include "vklite.h"
+#include "log.h"
+#include <GLFW/glfw3.h>
+#include <mutex>
+
+namespace vklite {
+
+namespace {
+
+// Budget queries are cheap but not free; frame boundaries poll this often
+constexpr double kMemoryBudgetPollSeconds = 0.25;
+
+VkDeviceSize bytesPerPixel(VkFormat format) {
+  switch (format) {
+    case VK_FORMAT_R16G16B16A16_SFLOAT:
+      return 8;
+    default:
+      return 4;  // 8-bit RGBA/BGRA and 10-bit packed formats
+  }
+}
+
+} // namespace
+
+VkResult Context::allocateMemory(const VkMemoryAllocateInfo& info, MemoryCategory category, VkDeviceMemory* memory) {
+  const VkResult r = vk.vkAllocateMemory(device, &info, nullptr, memory);
+  if (r != VK_SUCCESS) return r;
+  const uint32_t heap = memoryProperties.memoryTypes[info.memoryTypeIndex].heapIndex;
+  {
+    std::lock_guard<std::mutex> lock(memoryMutex);
+    trackedAllocations[*memory] = { info.allocationSize, heap, category };
+    categoryAllocated[static_cast<size_t>(category)] += info.allocationSize;
+    heapAllocated[heap] += info.allocationSize;
+  }
+  checkMemoryBudget(true);
+  return r;
+}
+
+void Context::freeMemory(VkDeviceMemory memory) {
+  if (memory == VK_NULL_HANDLE) return;
+  {
+    std::lock_guard<std::mutex> lock(memoryMutex);
+    auto it = trackedAllocations.find(memory);
+    if (it != trackedAllocations.end()) {
+      categoryAllocated[static_cast<size_t>(it->second.category)] -= it->second.size;
+      heapAllocated[it->second.heap] -= it->second.size;
+      trackedAllocations.erase(it);
+    }
+  }
+  vk.vkFreeMemory(device, memory, nullptr);
+}
+
+MemoryStats Context::getMemoryStats() const {
+  std::lock_guard<std::mutex> lock(memoryMutex);
+  return memoryStatsLocked();
+}
+
+// With memoryMutex held
+MemoryStats Context::memoryStatsLocked() const {
+  MemoryStats s;
+  if (physicalDevice == VK_NULL_HANDLE) return s;
+  VkPhysicalDeviceMemoryBudgetPropertiesEXT budget{};
+  budget.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+  if (memoryBudgetSupported) {
+    VkPhysicalDeviceMemoryProperties2 props2{};
+    props2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+    props2.pNext = &budget;
+    vkGetPhysicalDeviceMemoryProperties2(physicalDevice, &props2);
+    s.fromDriverBudget = true;
+  }
+  s.heapCount = memoryProperties.memoryHeapCount;
+  for (uint32_t h = 0; h < s.heapCount; ++h) {
+    MemoryHeapBudget& heap = s.heaps[h];
+    heap.heapIndex = h;
+    heap.deviceLocal = (memoryProperties.memoryHeaps[h].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) != 0;
+    heap.size = memoryProperties.memoryHeaps[h].size;
+    heap.allocated = heapAllocated[h];
+    heap.budget = s.fromDriverBudget ? budget.heapBudget[h] : heap.size;
+    heap.usage = s.fromDriverBudget ? budget.heapUsage[h] : heap.allocated;
+  }
+  for (size_t c = 0; c < kMemoryCategoryCount; ++c) s.categories[c] = categoryAllocated[c];
+  for (const auto& w : windows) {
+    if (!w) continue;
+    s.categories[static_cast<size_t>(MemoryCategory::Swapchain)] +=
+        static_cast<VkDeviceSize>(w->swapchainImages.size()) * w->swapchainExtent.width * w->swapchainExtent.height * bytesPerPixel(w->swapchainFormat);
+  }
+  return s;
+}
+
+// Report heaps crossing memoryBudgetThreshold in either direction. The
+// callback runs after memoryMutex is released, so it may allocate or free.
+void Context::checkMemoryBudget(bool force) {
+  if (!memoryBudgetCallback || physicalDevice == VK_NULL_HANDLE) return;
+  const double now = glfwGetTime();
+  MemoryStats stats;
+  bool crossed[VK_MAX_MEMORY_HEAPS] = {};
+  bool over[VK_MAX_MEMORY_HEAPS] = {};
+  {
+    std::lock_guard<std::mutex> lock(memoryMutex);
+    if (!force && now - lastMemoryBudgetCheck < kMemoryBudgetPollSeconds) return;
+    lastMemoryBudgetCheck = now;
+    stats = memoryStatsLocked();
+    for (uint32_t h = 0; h < stats.heapCount; ++h) {
+      const MemoryHeapBudget& heap = stats.heaps[h];
+      over[h] = heap.budget > 0 && static_cast<double>(heap.usage) > static_cast<double>(heap.budget) * memoryBudgetThreshold;
+      crossed[h] = over[h] != heapOverThreshold[h];
+      heapOverThreshold[h] = over[h];
+    }
+  }
+  for (uint32_t h = 0; h < stats.heapCount; ++h) {
+    if (!crossed[h]) continue;
+    const MemoryHeapBudget& heap = stats.heaps[h];
+    if (over[h]) {
+      VKLITE_LOG_WARN("memory heap %u above %.0f%% of budget (%llu of %llu MiB)", heap.heapIndex, memoryBudgetThreshold * 100.0f,
+                      static_cast<unsigned long long>(heap.usage >> 20), static_cast<unsigned long long>(heap.budget >> 20));
+    }
+    memoryBudgetCallback(heap, over[h]);
+  }
+}
+
+} // namespace vklite
@@ -1,8 +1,9 @@
 // Minimal pipeline helper for vklite: load SPIR-V, create shader modules and a graphics pipeline
 #include "vklite.h"
+#include "log.h"
+#include "trace.h"
 #include <fstream>
 #include <vector>
-#include <iostream>
 #include <memory>
 #include <string>
 #include <GLFW/glfw3.h>
@@ -10,10 +11,14 @@
 #include <shaderc/shaderc.hpp>
 #endif
 
+#include <atomic>
 #include <cstdio>
-#include <vector>
+#include <cstring>
+#if !defined(VKLITE_USE_SHADERC) && !defined(VKLITE_NO_RUNTIME_SHADER_COMPILER)
+#include <unistd.h>
+#endif
 
-#if !defined(VKLITE_USE_SHADERC)
+#if !defined(VKLITE_USE_SHADERC) && !defined(VKLITE_NO_RUNTIME_SHADER_COMPILER)
 // Fallback helper: run a command and capture stdout into outBytes; stderr goes to errPath
 static int runCommandCaptureBinary(const std::string& cmd, const std::string& errPath, std::vector<char>& outBytes) {
   outBytes.clear();
@@ -41,144 +46,136 @@ namespace vklite {
 // process exit code. If errPath is provided, stderr is redirected there.
 
 
-void Context::destroyPipeline(Pipeline* p) {
-  if (!p) return;
-  if (device != VK_NULL_HANDLE) {
-    if (p->pipeline != VK_NULL_HANDLE) vkDestroyPipeline(device, p->pipeline, nullptr);
-    if (p->layout != VK_NULL_HANDLE) vkDestroyPipelineLayout(device, p->layout, nullptr);
-    if (p->frag != VK_NULL_HANDLE) vkDestroyShaderModule(device, p->frag, nullptr);
-    if (p->vert != VK_NULL_HANDLE) vkDestroyShaderModule(device, p->vert, nullptr);
-  }
-  delete p;
-}
-
 void Context::recordPipelineDraw(Pipeline* p, Window* window, VkCommandBuffer cmdBuf) {
   if (!p || !window || cmdBuf == VK_NULL_HANDLE) return;
-  // Set viewport and scissor for this window using its framebuffer size
-  int fbw = 0, fbh = 0;
-  if (window->handle) glfwGetFramebufferSize(static_cast<GLFWwindow*>(window->handle), &fbw, &fbh);
+  // Set viewport and scissor to the render extent: the swapchain extent,
+  // scaled by dynamic resolution (the framebuffer may already have been
+  // resized ahead of swapchain recreation)
   VkViewport vp{};
   vp.x = 0.0f;
   vp.y = 0.0f;
-  vp.width = fbw > 0 ? static_cast<float>(fbw) : static_cast<float>(window->width);
-  vp.height = fbh > 0 ? static_cast<float>(fbh) : static_cast<float>(window->height);
+  vp.width = static_cast<float>(window->renderExtent.width);
+  vp.height = static_cast<float>(window->renderExtent.height);
   vp.minDepth = 0.0f;
   vp.maxDepth = 1.0f;
-  vkCmdSetViewport(cmdBuf, 0, 1, &vp);
+  vk.vkCmdSetViewport(cmdBuf, 0, 1, &vp);
 
   VkRect2D sc{};
   sc.offset = {0, 0};
   sc.extent = { static_cast<uint32_t>(vp.width), static_cast<uint32_t>(vp.height) };
-  vkCmdSetScissor(cmdBuf, 0, 1, &sc);
+  vk.vkCmdSetScissor(cmdBuf, 0, 1, &sc);
 
   // Bind pipeline and issue a non-indexed draw using vertexCount
-  vkCmdBindPipeline(cmdBuf, VK_PIPELINE_BIND_POINT_GRAPHICS, p->pipeline);
-  vkCmdDraw(cmdBuf, p->vertexCount, 1, 0, 0);
+  vk.vkCmdBindPipeline(cmdBuf, VK_PIPELINE_BIND_POINT_GRAPHICS, p->pipeline);
+  vk.vkCmdDraw(cmdBuf, p->vertexCount, 1, 0, 0);
 }
 
-Context::Pipeline* Context::createPipelineFromGlsl(const std::string& vertGlsl, const std::string& fragGlsl, uint32_t vertexCount, VkFormat colorFormat) {
-  if (device == VK_NULL_HANDLE) return nullptr;
-  std::vector<uint32_t> vspirv;
-  std::vector<uint32_t> fspirv;
-#ifdef VKLITE_USE_SHADERC
+bool Context::compileGlslToSpirv(const std::string& source, VkShaderStageFlagBits stage, std::vector<uint32_t>& spirv) {
+  VKLITE_TRACE_ZONE("compileGlslToSpirv");
+  spirv.clear();
+  const char* stageName = "vert";
+  switch (stage) {
+    case VK_SHADER_STAGE_VERTEX_BIT: stageName = "vert"; break;
+    case VK_SHADER_STAGE_FRAGMENT_BIT: stageName = "frag"; break;
+    case VK_SHADER_STAGE_COMPUTE_BIT: stageName = "comp"; break;
+    default:
+      VKLITE_LOG_ERROR("compileGlslToSpirv: unsupported shader stage %d", static_cast<int>(stage));
+      return false;
+  }
+#if defined(VKLITE_NO_RUNTIME_SHADER_COMPILER)
+  (void)source;
+  VKLITE_LOG_ERROR("compileGlslToSpirv (%s): built without a runtime shader compiler; "
+                   "embed SPIR-V with vklite_add_shaders and use createPipelineFromSpirv", stageName);
+  return false;
+#elif defined(VKLITE_USE_SHADERC)
   // Compile GLSL to SPIR-V in-memory using shaderc
   shaderc::Compiler compiler;
   shaderc::CompileOptions options;
-  options.SetTargetEnvironment(shaderc_target_env_vulkan, shaderc_env_version_vulkan_1_3);
-
-  shaderc::SpvCompilationResult vertResult = compiler.CompileGlslToSpv(vertGlsl, shaderc_vertex_shader, "vert", options);
-  if (vertResult.GetCompilationStatus() != shaderc_compilation_status_success) {
-    std::cerr << "Vertex shader compilation failed: " << vertResult.GetErrorMessage() << std::endl;
-    return nullptr;
-  }
-  vspirv.assign(vertResult.cbegin(), vertResult.cend());
+  options.SetTargetEnvironment(shaderc_target_env_vulkan, shaderc_env_version_vulkan_1_2);
+  shaderc_shader_kind kind = shaderc_vertex_shader;
+  if (stage == VK_SHADER_STAGE_FRAGMENT_BIT) kind = shaderc_fragment_shader;
+  else if (stage == VK_SHADER_STAGE_COMPUTE_BIT) kind = shaderc_compute_shader;
 
-  shaderc::SpvCompilationResult fragResult = compiler.CompileGlslToSpv(fragGlsl, shaderc_fragment_shader, "frag", options);
-  if (fragResult.GetCompilationStatus() != shaderc_compilation_status_success) {
-    std::cerr << "Fragment shader compilation failed: " << fragResult.GetErrorMessage() << std::endl;
-    return nullptr;
+  shaderc::SpvCompilationResult result = compiler.CompileGlslToSpv(source, kind, stageName, options);
+  if (result.GetCompilationStatus() != shaderc_compilation_status_success) {
+    VKLITE_LOG_ERROR("Shader compilation failed (%s): %s", stageName, result.GetErrorMessage().c_str());
+    return false;
   }
-  fspirv.assign(fragResult.cbegin(), fragResult.cend());
+  spirv.assign(result.cbegin(), result.cend());
 #else
-  // Fallback: invoke glslangValidator and capture SPIR-V from stdout
-  std::string vertErr = "/tmp/vklite_vert.err";
-  std::string fragErr = "/tmp/vklite_frag.err";
-  std::vector<char> vbytes, fbytes;
-  std::string cmd1 = "glslangValidator -V -S vert -o - -"; // read from stdin
-  std::string cmd2 = "glslangValidator -V -S frag -o - -";
-  // write GLSL to a temp file because some glslang builds don't accept '-' reliably; keep simple
-  std::string vtmp = "/tmp/vklite_tmp_vert.glsl";
-  std::string ftmp = "/tmp/vklite_tmp_frag.glsl";
-  {
-    std::ofstream ov(vtmp, std::ios::binary);
-    if (!ov) return nullptr;
-    ov.write(vertGlsl.data(), vertGlsl.size());
-  }
+  // Fallback: invoke glslangValidator and capture SPIR-V from stdout.
+  // Write GLSL to a temp file because some glslang builds don't accept '-' reliably; keep simple
+  // Unique names: shaders may be compiled concurrently by hot-reload jobs
+  static std::atomic<unsigned> tmpCounter{0};
+  const std::string tag = std::to_string(getpid()) + "_" + std::to_string(tmpCounter++);
+  std::string tmp = std::string("/tmp/vklite_tmp_") + stageName + "_" + tag + ".glsl";
+  std::string errPath = std::string("/tmp/vklite_") + stageName + "_" + tag + ".err";
   {
-    std::ofstream of(ftmp, std::ios::binary);
-    if (!of) return nullptr;
-    of.write(fragGlsl.data(), fragGlsl.size());
+    std::ofstream o(tmp, std::ios::binary);
+    if (!o) return false;
+    o.write(source.data(), source.size());
   }
-  cmd1 = "glslangValidator -V -S vert " + vtmp + " -o -";
-  cmd2 = "glslangValidator -V -S frag " + ftmp + " -o -";
-  int r1 = runCommandCaptureBinary(cmd1, vertErr, vbytes);
-  int r2 = runCommandCaptureBinary(cmd2, fragErr, fbytes);
-  if (r1 != 0 || r2 != 0) {
-    std::string out1, out2;
+  std::vector<char> bytes;
+  std::string cmd = std::string("glslangValidator -V -S ") + stageName + " " + tmp + " -o -";
+  int rc = runCommandCaptureBinary(cmd, errPath, bytes);
+  if (rc != 0) {
+    std::string out;
     {
-      std::ifstream e(vertErr);
-      out1.assign((std::istreambuf_iterator<char>(e)), std::istreambuf_iterator<char>());
+      std::ifstream e(errPath);
+      out.assign((std::istreambuf_iterator<char>(e)), std::istreambuf_iterator<char>());
     }
-    {
-      std::ifstream e(fragErr);
-      out2.assign((std::istreambuf_iterator<char>(e)), std::istreambuf_iterator<char>());
-    }
-    std::cerr << "glslangValidator failed:\n" << out1 << "\n" << out2 << std::endl;
-    // cleanup temp files
-    std::remove(vtmp.c_str());
-    std::remove(ftmp.c_str());
-    std::remove(vertErr.c_str());
-    std::remove(fragErr.c_str());
-    return nullptr;
+    VKLITE_LOG_ERROR("glslangValidator failed (%s):\n%s", stageName, out.c_str());
+    std::remove(tmp.c_str());
+    std::remove(errPath.c_str());
+    return false;
   }
-  // convert bytes to uint32_t vectors
-  if (vbytes.size() % 4 != 0 || fbytes.size() % 4 != 0) {
-    std::cerr << "SPIR-V size not multiple of 4\n";
-    return nullptr;
+  std::remove(tmp.c_str());
+  std::remove(errPath.c_str());
+  // convert bytes to uint32_t words
+  if (bytes.size() % 4 != 0) {
+    VKLITE_LOG_ERROR("SPIR-V size not multiple of 4");
+    return false;
   }
-  vspirv.resize(vbytes.size() / 4);
-  memcpy(vspirv.data(), vbytes.data(), vbytes.size());
-  fspirv.resize(fbytes.size() / 4);
-  memcpy(fspirv.data(), fbytes.data(), fbytes.size());
+  spirv.resize(bytes.size() / 4);
+  memcpy(spirv.data(), bytes.data(), bytes.size());
 #endif
+  return true;
+}
 
+VkShaderModule Context::createShaderModule(SpirvView spirv) {
   VkShaderModuleCreateInfo smci{};
   smci.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-  smci.codeSize = vspirv.size() * sizeof(uint32_t);
-  smci.pCode = reinterpret_cast<const uint32_t*>(vspirv.data());
-  VkShaderModule vertModule = VK_NULL_HANDLE;
-  if (vkCreateShaderModule(device, &smci, nullptr, &vertModule) != VK_SUCCESS) return nullptr;
+  smci.codeSize = spirv.words * sizeof(uint32_t);
+  smci.pCode = spirv.code;
+  VkShaderModule module = VK_NULL_HANDLE;
+  if (vk.vkCreateShaderModule(device, &smci, nullptr, &module) != VK_SUCCESS) return VK_NULL_HANDLE;
+  return module;
+}
 
-  smci.codeSize = fspirv.size() * sizeof(uint32_t);
-  smci.pCode = reinterpret_cast<const uint32_t*>(fspirv.data());
-  VkShaderModule fragModule = VK_NULL_HANDLE;
-  if (vkCreateShaderModule(device, &smci, nullptr, &fragModule) != VK_SUCCESS) {
-    vkDestroyShaderModule(device, vertModule, nullptr);
-    return nullptr;
-  }
+Context::Pipeline* Context::createPipelineFromGlsl(const std::string& vertGlsl, const std::string& fragGlsl, uint32_t vertexCount, VkFormat colorFormat, VkFormat depthFormat) {
+  PipelineDesc desc;
+  desc.vertGlsl = vertGlsl;
+  desc.fragGlsl = fragGlsl;
+  desc.vertexCount = vertexCount;
+  desc.colorFormat = colorFormat;
+  desc.depthFormat = depthFormat;
+  return getOrCreatePipeline(desc);
+}
 
-  // Pipeline layout (no descriptors for this simple demo)
-  VkPipelineLayoutCreateInfo plci{};
-  plci.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-  plci.setLayoutCount = 0;
-  plci.pushConstantRangeCount = 0;
-  VkPipelineLayout layout = VK_NULL_HANDLE;
-  if (vkCreatePipelineLayout(device, &plci, nullptr, &layout) != VK_SUCCESS) {
-    vkDestroyShaderModule(device, fragModule, nullptr);
-    vkDestroyShaderModule(device, vertModule, nullptr);
-    return nullptr;
-  }
+Context::Pipeline* Context::createPipelineFromSpirv(SpirvView vertSpirv, SpirvView fragSpirv, uint32_t vertexCount, VkFormat colorFormat, VkFormat depthFormat) {
+  PipelineDesc desc;
+  desc.vertSpirv = vertSpirv;
+  desc.fragSpirv = fragSpirv;
+  desc.vertexCount = vertexCount;
+  desc.colorFormat = colorFormat;
+  desc.depthFormat = depthFormat;
+  return getOrCreatePipeline(desc);
+}
 
+// Build a VkPipeline for `desc` from already-created modules and layout.
+// Safe to call from a worker thread.
+VkPipeline Context::createGraphicsPipeline(const PipelineDesc& desc, VkShaderModule vertModule, VkShaderModule fragModule, VkPipelineLayout layout) {
+  VKLITE_TRACE_ZONE("createGraphicsPipeline");
   // Shader stages
   VkPipelineShaderStageCreateInfo stages[2]{};
   stages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
@@ -189,31 +186,56 @@ Context::Pipeline* Context::createPipelineFromGlsl(const std::string& vertGlsl,
   stages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
   stages[1].module = fragModule;
   stages[1].pName = "main";
+  const VkSpecializationInfo vertSpec = desc.vertConstants.info();
+  const VkSpecializationInfo fragSpec = desc.fragConstants.info();
+  if (!desc.vertConstants.empty()) stages[0].pSpecializationInfo = &vertSpec;
+  if (!desc.fragConstants.empty()) stages[1].pSpecializationInfo = &fragSpec;
 
-  // Vertex input (none; we'll use gl_VertexIndex in the shader)
+  // Vertex input (empty for shaders that use gl_VertexIndex)
+  std::vector<VkVertexInputBindingDescription> bindings;
+  for (const auto& b : desc.vertexBindings) bindings.push_back({ b.binding, b.stride, b.inputRate });
+  std::vector<VkVertexInputAttributeDescription> attributes;
+  for (const auto& a : desc.vertexAttributes) attributes.push_back({ a.location, a.binding, a.format, a.offset });
   VkPipelineVertexInputStateCreateInfo vi{};
   vi.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+  vi.vertexBindingDescriptionCount = static_cast<uint32_t>(bindings.size());
+  vi.pVertexBindingDescriptions = bindings.data();
+  vi.vertexAttributeDescriptionCount = static_cast<uint32_t>(attributes.size());
+  vi.pVertexAttributeDescriptions = attributes.data();
 
   VkPipelineInputAssemblyStateCreateInfo ia{};
   ia.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-  ia.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+  ia.topology = desc.topology;
   ia.primitiveRestartEnable = VK_FALSE;
 
   VkPipelineRasterizationStateCreateInfo rs{};
   rs.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
-  rs.polygonMode = VK_POLYGON_MODE_FILL;
-  // Disable back-face culling for debug to ensure geometry isn't culled
-  rs.cullMode = VK_CULL_MODE_NONE;
-  rs.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+  rs.polygonMode = desc.polygonMode;
+  rs.cullMode = desc.cullMode;
+  rs.frontFace = desc.frontFace;
   rs.lineWidth = 1.0f;
 
   VkPipelineMultisampleStateCreateInfo ms{};
   ms.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
   ms.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
 
+  // Depth state only applies when the pipeline targets a depth attachment
+  const bool hasDepth = desc.depthFormat != VK_FORMAT_UNDEFINED;
+  VkPipelineDepthStencilStateCreateInfo ds{};
+  ds.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+  ds.depthTestEnable = hasDepth && desc.depthTest ? VK_TRUE : VK_FALSE;
+  ds.depthWriteEnable = hasDepth && desc.depthWrite ? VK_TRUE : VK_FALSE;
+  ds.depthCompareOp = desc.depthCompare;
+
   VkPipelineColorBlendAttachmentState ca{};
-  ca.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
-  ca.blendEnable = VK_FALSE;
+  ca.colorWriteMask = desc.blend.writeMask;
+  ca.blendEnable = desc.blend.enable ? VK_TRUE : VK_FALSE;
+  ca.srcColorBlendFactor = desc.blend.srcColor;
+  ca.dstColorBlendFactor = desc.blend.dstColor;
+  ca.colorBlendOp = desc.blend.colorOp;
+  ca.srcAlphaBlendFactor = desc.blend.srcAlpha;
+  ca.dstAlphaBlendFactor = desc.blend.dstAlpha;
+  ca.alphaBlendOp = desc.blend.alphaOp;
 
   VkPipelineColorBlendStateCreateInfo cb{};
   cb.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
@@ -242,6 +264,7 @@ Context::Pipeline* Context::createPipelineFromGlsl(const std::string& vertGlsl,
   gpi.pViewportState = &vp;
   gpi.pRasterizationState = &rs;
   gpi.pMultisampleState = &ms;
+  gpi.pDepthStencilState = &ds;
   gpi.pColorBlendState = &cb;
   gpi.pDynamicState = &dync;
   gpi.layout = layout;
@@ -252,26 +275,14 @@ Context::Pipeline* Context::createPipelineFromGlsl(const std::string& vertGlsl,
   prci.sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO;
   prci.viewMask = 0;
   prci.colorAttachmentCount = 1;
-  prci.pColorAttachmentFormats = &colorFormat;
+  prci.pColorAttachmentFormats = &desc.colorFormat;
+  prci.depthAttachmentFormat = desc.depthFormat;
   gpi.pNext = &prci;
   gpi.renderPass = VK_NULL_HANDLE; // dynamic rendering will be used
 
   VkPipeline pipeline = VK_NULL_HANDLE;
-  VkResult r = vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &gpi, nullptr, &pipeline);
-  if (r != VK_SUCCESS) {
-    vkDestroyPipelineLayout(device, layout, nullptr);
-    vkDestroyShaderModule(device, fragModule, nullptr);
-    vkDestroyShaderModule(device, vertModule, nullptr);
-    return nullptr;
-  }
-
-  Pipeline* p = new Pipeline();
-  p->pipeline = pipeline;
-  p->layout = layout;
-  p->vert = vertModule;
-  p->frag = fragModule;
-  p->vertexCount = vertexCount;
-  return p;
+  if (vk.vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &gpi, nullptr, &pipeline) != VK_SUCCESS) return VK_NULL_HANDLE;
+  return pipeline;
 }
 
 } // namespace vklite
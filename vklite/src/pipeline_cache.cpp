@@ -0,0 +1,321 @@
+// pipeline_cache.cpp - deduplicating pipeline variant cache with shared modules and layouts
+#include "vklite.h"
+#include "log.h"
+#include "trace.h"
+
+namespace vklite {
+
+namespace {
+
+constexpr uint64_t kFnvOffset = 1469598103934665603ull;
+constexpr uint64_t kFnvPrime = 1099511628211ull;
+
+struct Hasher {
+  uint64_t h = kFnvOffset;
+  void bytes(const void* data, size_t size) {
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < size; ++i) {
+      h ^= p[i];
+      h *= kFnvPrime;
+    }
+  }
+  template <typename T> void value(const T& v) { bytes(&v, sizeof(v)); }
+  void string(const std::string& s) {
+    value(s.size());
+    bytes(s.data(), s.size());
+  }
+  // 0 is reserved for "not cached"
+  uint64_t result() const { return h ? h : 1; }
+};
+
+bool samePushConstants(const std::vector<VkPushConstantRange>& a, const std::vector<VkPushConstantRange>& b) {
+  if (a.size() != b.size()) return false;
+  for (size_t i = 0; i < a.size(); ++i) {
+    if (a[i].stageFlags != b[i].stageFlags || a[i].offset != b[i].offset || a[i].size != b[i].size) return false;
+  }
+  return true;
+}
+
+void hashConstants(Hasher& h, const SpecializationConstants& c) {
+  h.value(c.entries().size());
+  for (const auto& e : c.entries()) {
+    h.value(e.constantID);
+    h.value(e.size);
+  }
+  h.value(c.data().size());
+  h.bytes(c.data().data(), c.data().size());
+}
+
+uint64_t hashPushConstants(const std::vector<VkPushConstantRange>& ranges) {
+  Hasher h;
+  h.value(ranges.size());
+  for (const auto& r : ranges) {
+    h.value(r.stageFlags);
+    h.value(r.offset);
+    h.value(r.size);
+  }
+  return h.result();
+}
+
+} // namespace
+
+uint64_t hashShaderSource(const std::string& glsl, SpirvView spirv) {
+  Hasher h;
+  h.string(glsl);
+  h.value(spirv.words);
+  h.bytes(spirv.code, spirv.words * sizeof(uint32_t));
+  return h.result();
+}
+
+void PipelineDesc::hashSources() {
+  if (vertSourceHash == 0) vertSourceHash = hashShaderSource(vertGlsl, vertSpirv);
+  if (fragSourceHash == 0) fragSourceHash = hashShaderSource(fragGlsl, fragSpirv);
+}
+
+namespace {
+
+// Everything but the source contents
+bool sameFixedState(const PipelineDesc& a, const PipelineDesc& b) {
+  if (a.vertPath != b.vertPath || a.fragPath != b.fragPath) return false;
+  if (a.vertConstants != b.vertConstants || a.fragConstants != b.fragConstants) return false;
+  if (a.vertexBindings.size() != b.vertexBindings.size() || a.vertexAttributes.size() != b.vertexAttributes.size()) return false;
+  for (size_t i = 0; i < a.vertexBindings.size(); ++i) {
+    const auto& x = a.vertexBindings[i];
+    const auto& y = b.vertexBindings[i];
+    if (x.binding != y.binding || x.stride != y.stride || x.inputRate != y.inputRate) return false;
+  }
+  for (size_t i = 0; i < a.vertexAttributes.size(); ++i) {
+    const auto& x = a.vertexAttributes[i];
+    const auto& y = b.vertexAttributes[i];
+    if (x.location != y.location || x.binding != y.binding || x.format != y.format || x.offset != y.offset) return false;
+  }
+  const BlendState& x = a.blend;
+  const BlendState& y = b.blend;
+  if (x.enable != y.enable || x.srcColor != y.srcColor || x.dstColor != y.dstColor || x.colorOp != y.colorOp ||
+      x.srcAlpha != y.srcAlpha || x.dstAlpha != y.dstAlpha || x.alphaOp != y.alphaOp || x.writeMask != y.writeMask) return false;
+  return a.topology == b.topology && a.polygonMode == b.polygonMode && a.cullMode == b.cullMode && a.frontFace == b.frontFace &&
+         a.depthTest == b.depthTest && a.depthWrite == b.depthWrite && a.depthCompare == b.depthCompare &&
+         a.colorFormat == b.colorFormat && a.depthFormat == b.depthFormat && a.vertexCount == b.vertexCount &&
+         samePushConstants(a.pushConstants, b.pushConstants);
+}
+
+uint64_t hashDesc(const PipelineDesc& d, uint64_t vertHash, uint64_t fragHash) {
+  // Field by field: the structs have padding, so never hash them whole
+  Hasher h;
+  h.value(vertHash);
+  h.value(fragHash);
+  h.string(d.vertPath);
+  h.string(d.fragPath);
+  hashConstants(h, d.vertConstants);
+  hashConstants(h, d.fragConstants);
+  h.value(d.vertexBindings.size());
+  for (const auto& b : d.vertexBindings) {
+    h.value(b.binding);
+    h.value(b.stride);
+    h.value(b.inputRate);
+  }
+  h.value(d.vertexAttributes.size());
+  for (const auto& a : d.vertexAttributes) {
+    h.value(a.location);
+    h.value(a.binding);
+    h.value(a.format);
+    h.value(a.offset);
+  }
+  h.value(d.topology);
+  h.value(d.polygonMode);
+  h.value(d.cullMode);
+  h.value(d.frontFace);
+  h.value(d.blend.enable);
+  h.value(d.blend.srcColor);
+  h.value(d.blend.dstColor);
+  h.value(d.blend.colorOp);
+  h.value(d.blend.srcAlpha);
+  h.value(d.blend.dstAlpha);
+  h.value(d.blend.alphaOp);
+  h.value(d.blend.writeMask);
+  h.value(d.depthTest);
+  h.value(d.depthWrite);
+  h.value(d.depthCompare);
+  h.value(d.colorFormat);
+  h.value(d.depthFormat);
+  h.value(hashPushConstants(d.pushConstants));
+  h.value(d.vertexCount);
+  return h.result();
+}
+
+} // namespace
+
+bool PipelineDesc::operator==(const PipelineDesc& o) const {
+  return vertHash() == o.vertHash() && fragHash() == o.fragHash() && sameFixedState(*this, o);
+}
+
+uint64_t hashPipelineDesc(const PipelineDesc& d) {
+  return hashDesc(d, d.vertHash(), d.fragHash());
+}
+
+VkShaderModule Context::acquireShaderModule(const std::string& glsl, SpirvView spirv, uint64_t sourceHash, VkShaderStageFlagBits stage, uint64_t& key) {
+  Hasher h;
+  h.value(stage);
+  h.value(sourceHash);
+  key = h.result();
+  auto it = shaderModuleCache.find(key);
+  if (it != shaderModuleCache.end() && it->second.stage == stage && it->second.sourceHash == sourceHash) {
+    ++it->second.refs;
+    return it->second.module;
+  }
+  // Precompiled words go straight to the driver; GLSL is compiled first
+  std::vector<uint32_t> compiled;
+  if (spirv.empty()) {
+    if (!compileGlslToSpirv(glsl, stage, compiled)) return VK_NULL_HANDLE;
+  }
+  VkShaderModule module = createShaderModule(spirv.empty() ? SpirvView(compiled) : spirv);
+  if (module == VK_NULL_HANDLE) return VK_NULL_HANDLE;
+  if (it != shaderModuleCache.end()) {
+    // Hash collision with different source: keep this module private
+    key = 0;
+    return module;
+  }
+  shaderModuleCache[key] = { module, stage, sourceHash, 1 };
+  return module;
+}
+
+void Context::releaseShaderModule(uint64_t key) {
+  auto it = shaderModuleCache.find(key);
+  if (it == shaderModuleCache.end()) return;
+  if (--it->second.refs > 0) return;
+  if (device != VK_NULL_HANDLE) vk.vkDestroyShaderModule(device, it->second.module, nullptr);
+  shaderModuleCache.erase(it);
+}
+
+VkPipelineLayout Context::acquirePipelineLayout(const std::vector<VkPushConstantRange>& ranges, uint64_t& key) {
+  key = hashPushConstants(ranges);
+  auto it = layoutCache.find(key);
+  if (it != layoutCache.end() && samePushConstants(it->second.ranges, ranges)) {
+    ++it->second.refs;
+    return it->second.layout;
+  }
+  VkPipelineLayoutCreateInfo plci{};
+  plci.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+  plci.setLayoutCount = 0;
+  plci.pushConstantRangeCount = static_cast<uint32_t>(ranges.size());
+  plci.pPushConstantRanges = ranges.data();
+  VkPipelineLayout layout = VK_NULL_HANDLE;
+  if (vk.vkCreatePipelineLayout(device, &plci, nullptr, &layout) != VK_SUCCESS) return VK_NULL_HANDLE;
+  if (it != layoutCache.end()) {
+    key = 0;
+    return layout;
+  }
+  layoutCache[key] = { layout, ranges, 1 };
+  return layout;
+}
+
+void Context::releasePipelineLayout(uint64_t key) {
+  auto it = layoutCache.find(key);
+  if (it == layoutCache.end()) return;
+  if (--it->second.refs > 0) return;
+  if (device != VK_NULL_HANDLE) vk.vkDestroyPipelineLayout(device, it->second.layout, nullptr);
+  layoutCache.erase(it);
+}
+
+Context::Pipeline* Context::getOrCreatePipeline(const PipelineDesc& desc) {
+  if (device == VK_NULL_HANDLE) return nullptr;
+  // Hashes each source at most once per call, not at all when the
+  // description carries its hashes; the sources are never compared
+  const uint64_t vertHash = desc.vertHash();
+  const uint64_t fragHash = desc.fragHash();
+  const uint64_t key = hashDesc(desc, vertHash, fragHash);
+  auto found = variantCache.find(key);
+  const CachedVariant* cached = found != variantCache.end() ? &found->second : nullptr;
+  if (cached && cached->desc.vertSourceHash == vertHash && cached->desc.fragSourceHash == fragHash && sameFixedState(cached->desc, desc)) {
+    ++variantHits;
+    ++cached->pipeline->refCount;
+    return cached->pipeline;
+  }
+  ++variantMisses;
+  VKLITE_TRACE_ZONE("createPipelineVariant");
+
+  Pipeline* p = new Pipeline();
+  ownedPipelines.insert(p);
+  p->vertexCount = desc.vertexCount;
+  p->vert = acquireShaderModule(desc.vertGlsl, desc.vertSpirv, vertHash, VK_SHADER_STAGE_VERTEX_BIT, p->vertKey);
+  if (p->vert != VK_NULL_HANDLE) p->frag = acquireShaderModule(desc.fragGlsl, desc.fragSpirv, fragHash, VK_SHADER_STAGE_FRAGMENT_BIT, p->fragKey);
+  if (p->frag != VK_NULL_HANDLE) p->layout = acquirePipelineLayout(desc.pushConstants, p->layoutKey);
+  if (p->layout != VK_NULL_HANDLE && graphicsPipelineLibrarySupported) p->pipeline = createLinkedPipeline(desc, p);
+  if (p->layout != VK_NULL_HANDLE && p->pipeline == VK_NULL_HANDLE) {
+    p->pipeline = createGraphicsPipeline(desc, p->vert, p->frag, p->layout);
+    p->optimized = true;
+  }
+  if (p->pipeline == VK_NULL_HANDLE) {
+    VKLITE_LOG_ERROR("getOrCreatePipeline: failed to create pipeline");
+    p->refCount = 1;
+    destroyPipeline(p);
+    return nullptr;
+  }
+  // A colliding key keeps the first variant; this one stays uncached. The
+  // entry stores the source hashes, not the sources.
+  if (!cached) {
+    p->cacheKey = key;
+    CachedVariant& entry = variantCache[key];
+    entry.desc = desc;
+    entry.desc.vertGlsl.clear();
+    entry.desc.fragGlsl.clear();
+    entry.desc.vertSpirv = SpirvView();
+    entry.desc.fragSpirv = SpirvView();
+    entry.desc.vertSourceHash = vertHash;
+    entry.desc.fragSourceHash = fragHash;
+    entry.pipeline = p;
+  }
+  return p;
+}
+
+void Context::destroyPipeline(Pipeline* p) {
+  if (!p) return;
+  if (p->refCount > 1) {
+    --p->refCount;
+    return;
+  }
+  if (p->cacheKey != 0) variantCache.erase(p->cacheKey);
+  ownedPipelines.erase(p);
+  forgetHotReload(p);
+  // Cancels a pending optimized link, which still reads the layout
+  releasePipelineLibraries(p);
+  if (device != VK_NULL_HANDLE) {
+    // Frames already submitted may still bind it
+    retirePipeline(p->pipeline);
+    if (p->layoutKey != 0) releasePipelineLayout(p->layoutKey);
+    else if (p->layout != VK_NULL_HANDLE) vk.vkDestroyPipelineLayout(device, p->layout, nullptr);
+    if (p->fragKey != 0) releaseShaderModule(p->fragKey);
+    else if (p->frag != VK_NULL_HANDLE) vk.vkDestroyShaderModule(device, p->frag, nullptr);
+    if (p->vertKey != 0) releaseShaderModule(p->vertKey);
+    else if (p->vert != VK_NULL_HANDLE) vk.vkDestroyShaderModule(device, p->vert, nullptr);
+  }
+  delete p;
+}
+
+Context::PipelineCacheStats Context::pipelineCacheStats() const {
+  PipelineCacheStats s;
+  s.variants = variantCache.size();
+  s.shaderModules = shaderModuleCache.size();
+  s.layouts = layoutCache.size();
+  s.libraries = pipelineLibraryCount();
+  s.hits = variantHits;
+  s.misses = variantMisses;
+  return s;
+}
+
+void Context::destroyPipelineCache() {
+  // Pipelines the application never released, cached or not
+  while (!ownedPipelines.empty()) {
+    Pipeline* p = *ownedPipelines.begin();
+    p->refCount = 1;
+    destroyPipeline(p);
+  }
+  if (device != VK_NULL_HANDLE) {
+    for (auto& m : shaderModuleCache) vk.vkDestroyShaderModule(device, m.second.module, nullptr);
+    for (auto& l : layoutCache) vk.vkDestroyPipelineLayout(device, l.second.layout, nullptr);
+  }
+  shaderModuleCache.clear();
+  layoutCache.clear();
+}
+
+} // namespace vklite
@@ -0,0 +1,431 @@
+// pipeline_library.cpp - graphics pipeline library parts, fast linking and background optimization
+#include "vklite.h"
+#include "log.h"
+#include "trace.h"
+#include <algorithm>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+
+namespace vklite {
+
+namespace {
+
+// The four independently compiled parts of a graphics pipeline; indices into
+// Pipeline::libraryKeys.
+enum LibraryPart : uint32_t {
+  kVertexInput = 0,
+  kPreRasterization,
+  kFragmentShader,
+  kFragmentOutput,
+  kLibraryPartCount,
+};
+
+const VkGraphicsPipelineLibraryFlagsEXT kPartFlags[kLibraryPartCount] = {
+  VK_GRAPHICS_PIPELINE_LIBRARY_VERTEX_INPUT_INTERFACE_BIT_EXT,
+  VK_GRAPHICS_PIPELINE_LIBRARY_PRE_RASTERIZATION_SHADERS_BIT_EXT,
+  VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_SHADER_BIT_EXT,
+  VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_OUTPUT_INTERFACE_BIT_EXT,
+};
+
+// Canonical bytes of the state one part depends on. Parts with equal bytes
+// are interchangeable, so the bytes double as the cache's collision check.
+struct PartState {
+  std::string bytes;
+  template <typename T> void value(const T& v) { bytes.append(reinterpret_cast<const char*>(&v), sizeof(v)); }
+};
+
+void constants(PartState& s, const SpecializationConstants& c) {
+  s.value(c.entries().size());
+  for (const auto& e : c.entries()) {
+    s.value(e.constantID);
+    s.value(e.size);
+  }
+  s.bytes.append(c.data().begin(), c.data().end());
+}
+
+PartState partState(LibraryPart part, const PipelineDesc& d, const Context::Pipeline* p) {
+  const bool hasDepth = d.depthFormat != VK_FORMAT_UNDEFINED;
+  PartState s;
+  s.value(part);
+  switch (part) {
+    case kVertexInput:
+      s.value(d.vertexBindings.size());
+      for (const auto& b : d.vertexBindings) {
+        s.value(b.binding);
+        s.value(b.stride);
+        s.value(b.inputRate);
+      }
+      s.value(d.vertexAttributes.size());
+      for (const auto& a : d.vertexAttributes) {
+        s.value(a.location);
+        s.value(a.binding);
+        s.value(a.format);
+        s.value(a.offset);
+      }
+      s.value(d.topology);
+      break;
+    case kPreRasterization:
+      s.value(p->vertKey);
+      s.value(p->layoutKey);
+      constants(s, d.vertConstants);
+      s.value(d.polygonMode);
+      s.value(d.cullMode);
+      s.value(d.frontFace);
+      break;
+    case kFragmentShader:
+      // Rendering formats must match the output part it is linked with
+      s.value(p->fragKey);
+      s.value(p->layoutKey);
+      constants(s, d.fragConstants);
+      s.value(hasDepth && d.depthTest);
+      s.value(hasDepth && d.depthWrite);
+      s.value(d.depthCompare);
+      s.value(d.colorFormat);
+      s.value(d.depthFormat);
+      break;
+    case kFragmentOutput:
+      s.value(d.blend.enable);
+      s.value(d.blend.srcColor);
+      s.value(d.blend.dstColor);
+      s.value(d.blend.colorOp);
+      s.value(d.blend.srcAlpha);
+      s.value(d.blend.dstAlpha);
+      s.value(d.blend.alphaOp);
+      s.value(d.blend.writeMask);
+      s.value(d.colorFormat);
+      s.value(d.depthFormat);
+      break;
+    default:
+      break;
+  }
+  return s;
+}
+
+// Compile one part as a library. Same fixed-function state as
+// Context::createGraphicsPipeline, split by the part that owns it.
+VkPipeline createLibraryPart(const DeviceDispatch& vk, VkDevice device, LibraryPart part, const PipelineDesc& desc, const Context::Pipeline* p) {
+  VkGraphicsPipelineLibraryCreateInfoEXT libInfo{};
+  libInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_LIBRARY_CREATE_INFO_EXT;
+  libInfo.flags = kPartFlags[part];
+
+  VkPipelineRenderingCreateInfo prci{};
+  prci.sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO;
+  prci.viewMask = 0;
+  prci.colorAttachmentCount = 1;
+  prci.pColorAttachmentFormats = &desc.colorFormat;
+  prci.depthAttachmentFormat = desc.depthFormat;
+
+  VkGraphicsPipelineCreateInfo gpi{};
+  gpi.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+  // Keep the intermediate representation so the background link can optimize
+  gpi.flags = VK_PIPELINE_CREATE_LIBRARY_BIT_KHR | VK_PIPELINE_CREATE_RETAIN_LINK_TIME_OPTIMIZATION_INFO_BIT_EXT;
+  gpi.pNext = &libInfo;
+  gpi.renderPass = VK_NULL_HANDLE; // dynamic rendering
+
+  std::vector<VkVertexInputBindingDescription> bindings;
+  std::vector<VkVertexInputAttributeDescription> attributes;
+  VkPipelineVertexInputStateCreateInfo vi{};
+  VkPipelineInputAssemblyStateCreateInfo ia{};
+  VkPipelineShaderStageCreateInfo stage{};
+  VkSpecializationInfo spec{};
+  VkPipelineViewportStateCreateInfo vp{};
+  VkPipelineRasterizationStateCreateInfo rs{};
+  VkDynamicState dynStates[] = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+  VkPipelineDynamicStateCreateInfo dync{};
+  VkPipelineMultisampleStateCreateInfo ms{};
+  ms.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+  ms.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+  VkPipelineDepthStencilStateCreateInfo ds{};
+  VkPipelineColorBlendAttachmentState ca{};
+  VkPipelineColorBlendStateCreateInfo cb{};
+  const bool hasDepth = desc.depthFormat != VK_FORMAT_UNDEFINED;
+
+  switch (part) {
+    case kVertexInput:
+      for (const auto& b : desc.vertexBindings) bindings.push_back({ b.binding, b.stride, b.inputRate });
+      for (const auto& a : desc.vertexAttributes) attributes.push_back({ a.location, a.binding, a.format, a.offset });
+      vi.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+      vi.vertexBindingDescriptionCount = static_cast<uint32_t>(bindings.size());
+      vi.pVertexBindingDescriptions = bindings.data();
+      vi.vertexAttributeDescriptionCount = static_cast<uint32_t>(attributes.size());
+      vi.pVertexAttributeDescriptions = attributes.data();
+      ia.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+      ia.topology = desc.topology;
+      ia.primitiveRestartEnable = VK_FALSE;
+      gpi.pVertexInputState = &vi;
+      gpi.pInputAssemblyState = &ia;
+      break;
+    case kPreRasterization:
+      stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+      stage.stage = VK_SHADER_STAGE_VERTEX_BIT;
+      stage.module = p->vert;
+      stage.pName = "main";
+      spec = desc.vertConstants.info();
+      if (!desc.vertConstants.empty()) stage.pSpecializationInfo = &spec;
+      vp.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+      vp.viewportCount = 1;
+      vp.scissorCount = 1;
+      rs.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+      rs.polygonMode = desc.polygonMode;
+      rs.cullMode = desc.cullMode;
+      rs.frontFace = desc.frontFace;
+      rs.lineWidth = 1.0f;
+      dync.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+      dync.dynamicStateCount = 2;
+      dync.pDynamicStates = dynStates;
+      gpi.stageCount = 1;
+      gpi.pStages = &stage;
+      gpi.pViewportState = &vp;
+      gpi.pRasterizationState = &rs;
+      gpi.pDynamicState = &dync;
+      gpi.layout = p->layout;
+      libInfo.pNext = &prci;
+      break;
+    case kFragmentShader:
+      stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+      stage.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+      stage.module = p->frag;
+      stage.pName = "main";
+      spec = desc.fragConstants.info();
+      if (!desc.fragConstants.empty()) stage.pSpecializationInfo = &spec;
+      ds.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+      ds.depthTestEnable = hasDepth && desc.depthTest ? VK_TRUE : VK_FALSE;
+      ds.depthWriteEnable = hasDepth && desc.depthWrite ? VK_TRUE : VK_FALSE;
+      ds.depthCompareOp = desc.depthCompare;
+      gpi.stageCount = 1;
+      gpi.pStages = &stage;
+      gpi.pMultisampleState = &ms;
+      gpi.pDepthStencilState = &ds;
+      gpi.layout = p->layout;
+      libInfo.pNext = &prci;
+      break;
+    case kFragmentOutput:
+      ca.colorWriteMask = desc.blend.writeMask;
+      ca.blendEnable = desc.blend.enable ? VK_TRUE : VK_FALSE;
+      ca.srcColorBlendFactor = desc.blend.srcColor;
+      ca.dstColorBlendFactor = desc.blend.dstColor;
+      ca.colorBlendOp = desc.blend.colorOp;
+      ca.srcAlphaBlendFactor = desc.blend.srcAlpha;
+      ca.dstAlphaBlendFactor = desc.blend.dstAlpha;
+      ca.alphaBlendOp = desc.blend.alphaOp;
+      cb.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+      cb.attachmentCount = 1;
+      cb.pAttachments = &ca;
+      gpi.pMultisampleState = &ms;
+      gpi.pColorBlendState = &cb;
+      libInfo.pNext = &prci;
+      break;
+    default:
+      return VK_NULL_HANDLE;
+  }
+
+  VkPipeline library = VK_NULL_HANDLE;
+  if (vk.vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &gpi, nullptr, &library) != VK_SUCCESS) return VK_NULL_HANDLE;
+  return library;
+}
+
+// Link the four parts into an executable pipeline. Without `optimize` this
+// is the cheap fast link; with it the driver re-optimizes across stages.
+VkPipeline linkLibraries(const DeviceDispatch& vk, VkDevice device, const VkPipeline* parts, VkPipelineLayout layout, bool optimize) {
+  VkPipelineLibraryCreateInfoKHR libs{};
+  libs.sType = VK_STRUCTURE_TYPE_PIPELINE_LIBRARY_CREATE_INFO_KHR;
+  libs.libraryCount = kLibraryPartCount;
+  libs.pLibraries = parts;
+
+  VkGraphicsPipelineCreateInfo gpi{};
+  gpi.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+  gpi.pNext = &libs;
+  gpi.flags = optimize ? VK_PIPELINE_CREATE_LINK_TIME_OPTIMIZATION_BIT_EXT : 0;
+  gpi.layout = layout;
+  gpi.renderPass = VK_NULL_HANDLE;
+
+  VkPipeline pipeline = VK_NULL_HANDLE;
+  if (vk.vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &gpi, nullptr, &pipeline) != VK_SUCCESS) return VK_NULL_HANDLE;
+  return pipeline;
+}
+
+} // namespace
+
+struct Context::PipelineLibraries {
+  struct Library {
+    VkPipeline handle = VK_NULL_HANDLE;
+    std::string state;
+    uint32_t refs = 0;
+  };
+  // Optimized link requested for a fast-linked pipeline. The parts and the
+  // layout stay alive while the job is queued or building: the pipeline
+  // holds references to them and releasePipelineLibraries cancels first.
+  struct Job {
+    Pipeline* pipeline = nullptr;
+    VkPipeline parts[kLibraryPartCount] = {};
+    VkPipelineLayout layout = VK_NULL_HANDLE;
+  };
+  // Built on the job pool, waiting for the next frame boundary
+  struct Result {
+    Pipeline* pipeline = nullptr;
+    VkPipeline handle = VK_NULL_HANDLE;
+  };
+
+  std::unordered_map<uint64_t, Library> cache;  // main thread only
+  std::vector<JobHandle> pending;               // main thread only
+  std::mutex mutex;
+  std::condition_variable idle;      // releasePipelineLibraries: a link left `building`
+  std::vector<Job> queued;
+  std::vector<Result> results;
+  std::vector<Pipeline*> building;   // links in progress
+  bool stopping = false;
+};
+
+VkPipeline Context::createLinkedPipeline(const PipelineDesc& desc, Pipeline* p) {
+  // Privately owned modules or layouts (hash collisions) have no key the
+  // parts could be cached under; those variants use a monolithic build.
+  if (p->vertKey == 0 || p->fragKey == 0 || p->layoutKey == 0) return VK_NULL_HANDLE;
+  VKLITE_TRACE_ZONE("linkPipeline");
+
+  if (!pipelineLibraries) {
+    pipelineLibraries = new PipelineLibraries();
+  }
+  PipelineLibraries* pl = pipelineLibraries;
+
+  VkPipeline parts[kLibraryPartCount] = {};
+  bool ok = true;
+  for (uint32_t i = 0; i < kLibraryPartCount && ok; ++i) {
+    const LibraryPart part = static_cast<LibraryPart>(i);
+    PartState state = partState(part, desc, p);
+    uint64_t key = std::hash<std::string>{}(state.bytes);
+    if (key == 0) key = 1;  // 0 means "no part"
+    auto it = pl->cache.find(key);
+    if (it != pl->cache.end()) {
+      // A colliding key falls back to the monolithic build
+      ok = it->second.state == state.bytes;
+      if (!ok) break;
+      ++it->second.refs;
+      parts[i] = it->second.handle;
+      p->libraryKeys[i] = key;
+      continue;
+    }
+    parts[i] = createLibraryPart(vk, device, part, desc, p);
+    ok = parts[i] != VK_NULL_HANDLE;
+    if (!ok) break;
+    pl->cache[key] = { parts[i], std::move(state.bytes), 1 };
+    p->libraryKeys[i] = key;
+  }
+
+  VkPipeline linked = ok ? linkLibraries(vk, device, parts, p->layout, false) : VK_NULL_HANDLE;
+  if (linked == VK_NULL_HANDLE) {
+    releasePipelineLibraries(p);
+    return VK_NULL_HANDLE;
+  }
+
+  PipelineLibraries::Job job;
+  job.pipeline = p;
+  std::copy(parts, parts + kLibraryPartCount, job.parts);
+  job.layout = p->layout;
+  {
+    std::lock_guard<std::mutex> lock(pl->mutex);
+    pl->queued.push_back(job);
+  }
+  // One pool job per link, each taking the oldest queued one; links run in
+  // parallel on idle workers. A link cancelled by releasePipelineLibraries
+  // leaves its job nothing to do.
+  pl->pending.erase(std::remove_if(pl->pending.begin(), pl->pending.end(), [](const JobHandle& h) { return h.done(); }), pl->pending.end());
+  pl->pending.push_back(jobs->submit([this, pl] {
+    PipelineLibraries::Job next;
+    {
+      std::lock_guard<std::mutex> lock(pl->mutex);
+      if (pl->stopping || pl->queued.empty()) return;
+      next = pl->queued.front();
+      pl->queued.erase(pl->queued.begin());
+      pl->building.push_back(next.pipeline);
+    }
+
+    VkPipeline optimized = VK_NULL_HANDLE;
+    {
+      VKLITE_TRACE_ZONE("optimizePipeline");
+      optimized = linkLibraries(vk, device, next.parts, next.layout, true);
+    }
+
+    std::lock_guard<std::mutex> lock(pl->mutex);
+    pl->building.erase(std::find(pl->building.begin(), pl->building.end(), next.pipeline));
+    pl->idle.notify_all();
+    if (optimized == VK_NULL_HANDLE) {
+      VKLITE_LOG_WARN("pipeline library: optimized link failed, keeping the fast-linked pipeline");
+      return;
+    }
+    pl->results.push_back({ next.pipeline, optimized });
+    wakeMainLoop(); // wake an idle OnDemand loop
+  }));
+  p->optimized = false;
+  return linked;
+}
+
+void Context::releasePipelineLibraries(Pipeline* p) {
+  if (!pipelineLibraries || !p) return;
+  PipelineLibraries* pl = pipelineLibraries;
+  {
+    std::unique_lock<std::mutex> lock(pl->mutex);
+    // A link job reads the parts and layout while linking
+    pl->idle.wait(lock, [&] { return std::find(pl->building.begin(), pl->building.end(), p) == pl->building.end(); });
+    pl->queued.erase(std::remove_if(pl->queued.begin(), pl->queued.end(), [&](const PipelineLibraries::Job& j) { return j.pipeline == p; }), pl->queued.end());
+    for (auto it = pl->results.begin(); it != pl->results.end();) {
+      if (it->pipeline == p) {
+        // Never bound: nothing to wait for
+        vk.vkDestroyPipeline(device, it->handle, nullptr);
+        it = pl->results.erase(it);
+      } else {
+        ++it;
+      }
+    }
+  }
+  for (uint64_t& key : p->libraryKeys) {
+    if (key == 0) continue;
+    auto it = pl->cache.find(key);
+    if (it != pl->cache.end() && --it->second.refs == 0) {
+      vk.vkDestroyPipeline(device, it->second.handle, nullptr);
+      pl->cache.erase(it);
+    }
+    key = 0;
+  }
+}
+
+void Context::applyOptimizedPipelines() {
+  if (!pipelineLibraries) return;
+  std::vector<PipelineLibraries::Result> ready;
+  {
+    std::lock_guard<std::mutex> lock(pipelineLibraries->mutex);
+    ready.swap(pipelineLibraries->results);
+  }
+  for (const auto& r : ready) {
+    // Frames already submitted may still use the fast-linked pipeline
+    retirePipeline(r.pipeline->pipeline);
+    r.pipeline->pipeline = r.handle;
+    r.pipeline->optimized = true;
+    // Retiring allocates; the windows drawing with it settle again
+    for (auto& w : windows) {
+      if (w && w->pipeline == r.pipeline) w->steadyFrames = 0;
+    }
+  }
+}
+
+size_t Context::pipelineLibraryCount() const {
+  return pipelineLibraries ? pipelineLibraries->cache.size() : 0;
+}
+
+void Context::shutdownPipelineLibraries() {
+  if (!pipelineLibraries) return;
+  PipelineLibraries* pl = pipelineLibraries;
+  {
+    std::lock_guard<std::mutex> lock(pl->mutex);
+    pl->stopping = true;
+  }
+  // Links not started yet return at once; help the running ones finish
+  for (const JobHandle& h : pl->pending) jobs->wait(h);
+  // Called after vkDeviceWaitIdle and destroyPipelineCache
+  for (const auto& r : pl->results) vk.vkDestroyPipeline(device, r.handle, nullptr);
+  for (auto& l : pl->cache) vk.vkDestroyPipeline(device, l.second.handle, nullptr);
+  delete pl;
+  pipelineLibraries = nullptr;
+}
+
+} // namespace vklite
@@ -0,0 +1,588 @@
+// render_graph.cpp - per-frame render graph: pass culling, barrier batching, transient aliasing
+#include "render_graph.h"
+#include "vklite.h"
+#include "log.h"
+#include <algorithm>
+
+namespace vklite {
+
+namespace {
+
+struct AccessInfo {
+  VkPipelineStageFlags2 stages;
+  VkAccessFlags2 read;
+  VkAccessFlags2 write;
+  VkImageLayout layout;
+  VkImageUsageFlags usage;
+};
+
+AccessInfo accessInfo(RGAccess access) {
+  switch (access) {
+    case RGAccess::ColorAttachment:
+      return { VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_2_COLOR_ATTACHMENT_READ_BIT, VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT,
+               VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT };
+    case RGAccess::DepthAttachment:
+      return { VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT,
+               VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT, VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+               VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT };
+    case RGAccess::DepthRead:
+      return { VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT,
+               VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT, 0,
+               VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT };
+    case RGAccess::FragmentSampled:
+      return { VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT, VK_ACCESS_2_SHADER_SAMPLED_READ_BIT, 0,
+               VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_USAGE_SAMPLED_BIT };
+    case RGAccess::ComputeSampled:
+      return { VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_SAMPLED_READ_BIT, 0,
+               VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_USAGE_SAMPLED_BIT };
+    case RGAccess::ComputeStorageRead:
+      return { VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_READ_BIT, 0,
+               VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_USAGE_STORAGE_BIT };
+    case RGAccess::ComputeStorageWrite:
+      return { VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_READ_BIT, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+               VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_USAGE_STORAGE_BIT };
+    case RGAccess::VertexStorageRead:
+      return { VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_READ_BIT, 0,
+               VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_USAGE_STORAGE_BIT };
+    case RGAccess::IndirectRead:
+      return { VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT, VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT, 0,
+               VK_IMAGE_LAYOUT_UNDEFINED, 0 };
+    case RGAccess::TransferRead:
+      return { VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_READ_BIT, 0,
+               VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_SRC_BIT };
+    case RGAccess::TransferWrite:
+      return { VK_PIPELINE_STAGE_2_TRANSFER_BIT, 0, VK_ACCESS_2_TRANSFER_WRITE_BIT,
+               VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_DST_BIT };
+    case RGAccess::HostRead:
+      return { VK_PIPELINE_STAGE_2_HOST_BIT, VK_ACCESS_2_HOST_READ_BIT, 0,
+               VK_IMAGE_LAYOUT_GENERAL, 0 };
+    case RGAccess::Present:
+      // Presentation is ordered by the render-finished semaphore; only the
+      // layout transition matters here.
+      return { VK_PIPELINE_STAGE_2_NONE, VK_ACCESS_2_NONE, 0, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, 0 };
+    case RGAccess::None:
+    default:
+      return { VK_PIPELINE_STAGE_2_NONE, VK_ACCESS_2_NONE, 0, VK_IMAGE_LAYOUT_UNDEFINED, 0 };
+  }
+}
+
+// synchronization2 -> legacy flags for devices without the feature. The
+// classic stage/access bits share their values with the *2 variants.
+VkPipelineStageFlags legacyStages(VkPipelineStageFlags2 stages, bool src) {
+  if (stages & (VK_PIPELINE_STAGE_2_COPY_BIT | VK_PIPELINE_STAGE_2_BLIT_BIT | VK_PIPELINE_STAGE_2_CLEAR_BIT)) stages |= VK_PIPELINE_STAGE_2_TRANSFER_BIT;
+  VkPipelineStageFlags legacy = static_cast<VkPipelineStageFlags>(stages & 0xFFFFFFFFull);
+  if (legacy == 0) legacy = src ? VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT : VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+  return legacy;
+}
+
+VkAccessFlags legacyAccess(VkAccessFlags2 access) {
+  if (access & (VK_ACCESS_2_SHADER_SAMPLED_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_READ_BIT)) access |= VK_ACCESS_2_SHADER_READ_BIT;
+  if (access & VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT) access |= VK_ACCESS_2_SHADER_WRITE_BIT;
+  return static_cast<VkAccessFlags>(access & 0xFFFFFFFFull);
+}
+
+VkDeviceSize alignUp(VkDeviceSize v, VkDeviceSize a) {
+  return a > 1 ? (v + a - 1) / a * a : v;
+}
+
+bool sameTransient(const RGImageDesc& a, const RGImageDesc& b) {
+  return a.format == b.format && a.extent.width == b.extent.width && a.extent.height == b.extent.height &&
+         a.mipLevels == b.mipLevels && a.aspect == b.aspect;
+}
+
+} // namespace
+
+RenderGraph::RenderGraph(Context& context) : ctx_(context) {}
+
+RenderGraph::~RenderGraph() {
+  destroyPassCallables();
+  releaseTransients();
+}
+
+void RenderGraph::reset() {
+  destroyPassCallables();
+  arena_.reset();
+  resources_.clear();
+  compiled_ = false;
+  stats_ = Stats{};
+}
+
+void RenderGraph::destroyPassCallables() {
+  for (uint32_t i = 0; i < passCount_; ++i) {
+    Pass& p = passes_[i];
+    if (p.destroy) p.destroy(p.callable);
+    p.callable = nullptr;
+  }
+  passCount_ = 0;
+}
+
+RGResource RenderGraph::importImage(const char* name, VkImage image, VkImageView view, VkImageAspectFlags aspect, uint32_t mipLevels, VkImageLayout layout,
+                                    VkPipelineStageFlags2 lastStages, VkAccessFlags2 lastWrites) {
+  Resource r;
+  r.name = name;
+  r.image = image;
+  r.view = view;
+  r.aspect = aspect;
+  r.mipLevels = std::max(1u, mipLevels);
+  r.initial.layout = layout;
+  r.initial.writeStages = lastStages;
+  r.initial.writeAccess = lastWrites;
+  resources_.push_back(r);
+  return static_cast<RGResource>(resources_.size() - 1);
+}
+
+RGResource RenderGraph::importBuffer(const char* name, VkBuffer buffer, VkPipelineStageFlags2 lastStages, VkAccessFlags2 lastWrites) {
+  Resource r;
+  r.name = name;
+  r.isImage = false;
+  r.buffer = buffer;
+  r.initial.writeStages = lastStages;
+  r.initial.writeAccess = lastWrites;
+  resources_.push_back(r);
+  return static_cast<RGResource>(resources_.size() - 1);
+}
+
+RGResource RenderGraph::createImage(const char* name, const RGImageDesc& desc) {
+  Resource r;
+  r.name = name;
+  r.transient = true;
+  r.desc = desc;
+  r.aspect = desc.aspect;
+  r.mipLevels = std::max(1u, desc.mipLevels);
+  resources_.push_back(r);
+  return static_cast<RGResource>(resources_.size() - 1);
+}
+
+RenderGraph::PassBuilder RenderGraph::addPassRecord(const char* name, void* callable, void (*invoke)(void*, VkCommandBuffer), void (*destroy)(void*)) {
+  // Reuse last frame's slot so its access list keeps its capacity
+  if (passCount_ == passes_.size()) passes_.emplace_back();
+  Pass& p = passes_[passCount_];
+  p.name = name;
+  p.callable = callable;
+  p.invoke = invoke;
+  p.destroy = destroy;
+  p.accesses.clear();
+  p.sideEffect = false;
+  p.culled = false;
+  return PassBuilder(this, passCount_++);
+}
+
+RenderGraph::PassBuilder& RenderGraph::PassBuilder::read(RGResource resource, RGAccess access) {
+  graph_->addAccess(pass_, resource, access, false);
+  return *this;
+}
+
+RenderGraph::PassBuilder& RenderGraph::PassBuilder::write(RGResource resource, RGAccess access) {
+  graph_->addAccess(pass_, resource, access, true);
+  return *this;
+}
+
+RenderGraph::PassBuilder& RenderGraph::PassBuilder::sideEffect() {
+  graph_->passes_[pass_].sideEffect = true;
+  return *this;
+}
+
+void RenderGraph::addAccess(uint32_t pass, RGResource resource, RGAccess access, bool write) {
+  if (resource >= resources_.size() || pass >= passCount_) return;
+  passes_[pass].accesses.push_back({ resource, access, write });
+}
+
+void RenderGraph::markOutput(RGResource resource, RGAccess finalAccess) {
+  if (resource >= resources_.size()) return;
+  resources_[resource].output = true;
+  resources_[resource].finalAccess = finalAccess;
+}
+
+bool RenderGraph::compile() {
+  stats_ = Stats{};
+  stats_.passes = passCount_;
+
+  // Cull: walk passes backwards keeping those that write something needed
+  // later (an output or an input of a kept pass) or have side effects.
+  char* needed = arena_.allocateArray<char>(resources_.size());
+  for (size_t i = 0; i < resources_.size(); ++i) needed[i] = resources_[i].output;
+  for (size_t p = passCount_; p-- > 0;) {
+    Pass& pass = passes_[p];
+    bool keep = pass.sideEffect;
+    for (const Access& a : pass.accesses) keep = keep || (a.write && needed[a.resource]);
+    pass.culled = !keep;
+    if (!keep) {
+      ++stats_.culledPasses;
+      continue;
+    }
+    for (const Access& a : pass.accesses) needed[a.resource] = 1;
+  }
+
+  // Lifetimes and usage of the resources touched by surviving passes
+  for (Resource& r : resources_) {
+    r.firstPass = r.lastPass = -1;
+    r.usage = 0;
+  }
+  for (size_t p = 0; p < passCount_; ++p) {
+    if (passes_[p].culled) continue;
+    for (const Access& a : passes_[p].accesses) {
+      Resource& r = resources_[a.resource];
+      if (r.firstPass < 0) r.firstPass = static_cast<int>(p);
+      r.lastPass = static_cast<int>(p);
+      r.usage |= accessInfo(a.access).usage;
+    }
+  }
+
+  Transient* wanted = arena_.allocateArray<Transient>(resources_.size());
+  size_t wantedCount = 0;
+  for (Resource& r : resources_) {
+    if (!r.transient || r.firstPass < 0) continue;
+    if (r.output) r.lastPass = static_cast<int>(passCount_);
+    Transient* t = new (&wanted[wantedCount]) Transient();
+    t->desc = r.desc;
+    t->usage = r.usage;
+    t->firstPass = r.firstPass;
+    t->lastPass = r.lastPass;
+    r.transientIndex = static_cast<uint32_t>(wantedCount++);
+  }
+
+  // Reuse last frame's transients when nothing about them changed
+  bool reuse = wantedCount == transients_.size();
+  for (size_t i = 0; reuse && i < wantedCount; ++i) {
+    reuse = sameTransient(wanted[i].desc, transients_[i].desc) && wanted[i].usage == transients_[i].usage &&
+            wanted[i].firstPass == transients_[i].firstPass && wanted[i].lastPass == transients_[i].lastPass;
+  }
+  if (!reuse && !allocateTransients(wanted, wantedCount)) return false;
+
+  // Every first use waits for all stages that touch the same memory range
+  // (earlier aliases this frame, and any alias from the previous frame).
+  VkPipelineStageFlags2* stagesOf = arena_.allocateZeroed<VkPipelineStageFlags2>(transients_.size());
+  VkAccessFlags2* writesOf = arena_.allocateZeroed<VkAccessFlags2>(transients_.size());
+  for (uint32_t p = 0; p < passCount_; ++p) {
+    const Pass& pass = passes_[p];
+    if (pass.culled) continue;
+    for (const Access& a : pass.accesses) {
+      const Resource& r = resources_[a.resource];
+      if (!r.transient || r.transientIndex == UINT32_MAX) continue;
+      AccessInfo info = accessInfo(a.access);
+      stagesOf[r.transientIndex] |= info.stages;
+      if (a.write) writesOf[r.transientIndex] |= info.write;
+    }
+  }
+  for (size_t i = 0; i < transients_.size(); ++i) {
+    Transient& t = transients_[i];
+    t.aliasStages = 0;
+    t.aliasWrites = 0;
+    for (size_t j = 0; j < transients_.size(); ++j) {
+      const Transient& o = transients_[j];
+      if (o.block != t.block) continue;
+      if (o.offset >= t.offset + t.requirements.size || t.offset >= o.offset + o.requirements.size) continue;
+      t.aliasStages |= stagesOf[j];
+      t.aliasWrites |= writesOf[j];
+    }
+  }
+
+  for (Resource& r : resources_) {
+    r.state = r.initial;
+    r.touched = false;
+    if (r.transient && r.transientIndex != UINT32_MAX) {
+      const Transient& t = transients_[r.transientIndex];
+      r.image = t.image;
+      r.view = t.view;
+      r.state = UseState{};
+      r.state.writeStages = t.aliasStages;
+      r.state.writeAccess = t.aliasWrites;
+    }
+  }
+  for (const Transient& t : transients_) stats_.transientBytesUnaliased += t.requirements.size;
+  compiled_ = true;
+  return true;
+}
+
+bool RenderGraph::allocateTransients(const Transient* wanted, size_t count) {
+  releaseTransients();
+  VkDevice device = ctx_.device;
+  const DeviceDispatch& vk = ctx_.vk;
+  transients_.assign(wanted, wanted + count);
+
+  for (Transient& t : transients_) {
+    VkImageCreateInfo ici{};
+    ici.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    ici.imageType = VK_IMAGE_TYPE_2D;
+    ici.format = t.desc.format;
+    ici.extent = { t.desc.extent.width, t.desc.extent.height, 1 };
+    ici.mipLevels = std::max(1u, t.desc.mipLevels);
+    ici.arrayLayers = 1;
+    ici.samples = VK_SAMPLE_COUNT_1_BIT;
+    ici.tiling = VK_IMAGE_TILING_OPTIMAL;
+    ici.usage = t.usage;
+    ici.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    ici.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    if (vk.vkCreateImage(device, &ici, nullptr, &t.image) != VK_SUCCESS) {
+      VKLITE_LOG_ERROR("RenderGraph: failed to create transient image");
+      releaseTransients();
+      return false;
+    }
+    vk.vkGetImageMemoryRequirements(device, t.image, &t.requirements);
+    t.memoryType = ctx_.findMemoryType(t.requirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    if (t.memoryType == UINT32_MAX) {
+      VKLITE_LOG_ERROR("RenderGraph: no device-local memory type for transient image");
+      releaseTransients();
+      return false;
+    }
+  }
+
+  // Place the largest images first at the lowest offset that does not overlap
+  // any already-placed image of the same memory type with an overlapping lifetime.
+  std::vector<uint32_t> order(transients_.size());
+  for (uint32_t i = 0; i < order.size(); ++i) order[i] = i;
+  std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return transients_[a].requirements.size > transients_[b].requirements.size; });
+
+  std::vector<uint32_t> blockTypes;
+  std::vector<VkDeviceSize> blockSizes;
+  std::vector<uint32_t> placed;
+  std::vector<std::pair<VkDeviceSize, VkDeviceSize>> busy;
+  for (uint32_t idx : order) {
+    Transient& t = transients_[idx];
+    auto it = std::find(blockTypes.begin(), blockTypes.end(), t.memoryType);
+    if (it == blockTypes.end()) {
+      blockTypes.push_back(t.memoryType);
+      blockSizes.push_back(0);
+      it = blockTypes.end() - 1;
+    }
+    t.block = static_cast<uint32_t>(it - blockTypes.begin());
+
+    busy.clear();
+    for (uint32_t o : placed) {
+      const Transient& other = transients_[o];
+      if (other.block != t.block) continue;
+      if (other.lastPass < t.firstPass || t.lastPass < other.firstPass) continue;
+      busy.push_back({ other.offset, other.offset + other.requirements.size });
+    }
+    std::sort(busy.begin(), busy.end());
+    VkDeviceSize offset = 0;
+    for (const auto& b : busy) {
+      if (alignUp(offset, t.requirements.alignment) + t.requirements.size <= b.first) break;
+      offset = std::max(offset, b.second);
+    }
+    t.offset = alignUp(offset, t.requirements.alignment);
+    blockSizes[t.block] = std::max(blockSizes[t.block], t.offset + t.requirements.size);
+    placed.push_back(idx);
+  }
+
+  transientMemory_.assign(blockTypes.size(), VK_NULL_HANDLE);
+  for (size_t b = 0; b < blockTypes.size(); ++b) {
+    VkMemoryAllocateInfo mai{};
+    mai.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    mai.allocationSize = blockSizes[b];
+    mai.memoryTypeIndex = blockTypes[b];
+    if (ctx_.allocateMemory(mai, MemoryCategory::Images, &transientMemory_[b]) != VK_SUCCESS) {
+      VKLITE_LOG_ERROR("RenderGraph: failed to allocate %llu bytes of transient memory", static_cast<unsigned long long>(blockSizes[b]));
+      releaseTransients();
+      return false;
+    }
+  }
+
+  for (Transient& t : transients_) {
+    vk.vkBindImageMemory(device, t.image, transientMemory_[t.block], t.offset);
+    VkImageViewCreateInfo iv{};
+    iv.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    iv.image = t.image;
+    iv.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    iv.format = t.desc.format;
+    iv.subresourceRange = { t.desc.aspect, 0, std::max(1u, t.desc.mipLevels), 0, 1 };
+    if (vk.vkCreateImageView(device, &iv, nullptr, &t.view) != VK_SUCCESS) {
+      releaseTransients();
+      return false;
+    }
+  }
+  return true;
+}
+
+void RenderGraph::releaseTransients() {
+  if (transients_.empty() && transientMemory_.empty()) return;
+  VkDevice device = ctx_.device;
+  if (device == VK_NULL_HANDLE) {
+    transients_.clear();
+    transientMemory_.clear();
+    return;
+  }
+  // Transients may still be referenced by frames in flight
+  std::vector<VkImageView> views;
+  std::vector<VkImage> images;
+  for (Transient& t : transients_) {
+    views.push_back(t.view);
+    images.push_back(t.image);
+  }
+  std::vector<VkDeviceMemory> memory;
+  memory.swap(transientMemory_);
+  transients_.clear();
+  Context* ctx = &ctx_;
+  ctx_.deferDestroy([ctx, device, views, images, memory] {
+    for (VkImageView v : views) {
+      if (v != VK_NULL_HANDLE) ctx->vk.vkDestroyImageView(device, v, nullptr);
+    }
+    for (VkImage i : images) {
+      if (i != VK_NULL_HANDLE) ctx->vk.vkDestroyImage(device, i, nullptr);
+    }
+    for (VkDeviceMemory m : memory) ctx->freeMemory(m);
+  });
+}
+
+void RenderGraph::transition(Resource& r, RGAccess access, bool write) {
+  if (access == RGAccess::None) return;
+  const AccessInfo info = accessInfo(access);
+  const VkAccessFlags2 mask = write ? (info.read | info.write) : info.read;
+  const bool layoutChange = r.isImage && info.layout != VK_IMAGE_LAYOUT_UNDEFINED && info.layout != r.state.layout;
+  UseState& s = r.state;
+
+  VkPipelineStageFlags2 srcStages = 0;
+  VkAccessFlags2 srcAccess = 0;
+  bool needBarrier = false;
+  if (write || layoutChange) {
+    // Wait for the last write and every read since (write-after-read only
+    // needs an execution dependency)
+    srcStages = s.writeStages | s.readStages;
+    srcAccess = s.writeAccess;
+    needBarrier = layoutChange || srcStages != 0;
+    if (write) {
+      s.writeStages = info.stages;
+      s.writeAccess = info.write;
+      s.readStages = 0;
+      s.readAccess = 0;
+    } else {
+      // A layout transition behaves like a write at the destination stages
+      s.writeStages = info.stages;
+      s.writeAccess = 0;
+      s.readStages = info.stages;
+      s.readAccess = info.read;
+    }
+  } else {
+    // Read-after-read in the same layout needs nothing once visible
+    if ((s.readStages & info.stages) == info.stages && (s.readAccess & info.read) == info.read) return;
+    srcStages = s.writeStages;
+    srcAccess = s.writeAccess;
+    needBarrier = srcStages != 0;
+    s.readStages |= info.stages;
+    s.readAccess |= info.read;
+  }
+  const VkImageLayout oldLayout = r.state.layout;
+  if (r.isImage && info.layout != VK_IMAGE_LAYOUT_UNDEFINED) s.layout = info.layout;
+  r.touched = true;
+  if (!needBarrier) return;
+
+  if (r.isImage) {
+    VkImageMemoryBarrier2 b{};
+    b.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
+    b.srcStageMask = srcStages;
+    b.srcAccessMask = srcAccess;
+    b.dstStageMask = info.stages;
+    b.dstAccessMask = mask;
+    b.oldLayout = oldLayout;
+    b.newLayout = s.layout;
+    b.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    b.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    b.image = r.image;
+    b.subresourceRange = { r.aspect, 0, r.mipLevels, 0, 1 };
+    imageBarriers_.push_back(b);
+  } else {
+    VkBufferMemoryBarrier2 b{};
+    b.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2;
+    b.srcStageMask = srcStages;
+    b.srcAccessMask = srcAccess;
+    b.dstStageMask = info.stages;
+    b.dstAccessMask = mask;
+    b.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    b.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    b.buffer = r.buffer;
+    b.offset = 0;
+    b.size = VK_WHOLE_SIZE;
+    bufferBarriers_.push_back(b);
+  }
+}
+
+void RenderGraph::flushBarriers(VkCommandBuffer cmd) {
+  if (imageBarriers_.empty() && bufferBarriers_.empty()) return;
+  ++stats_.barrierBatches;
+  stats_.imageBarriers += static_cast<uint32_t>(imageBarriers_.size());
+  stats_.bufferBarriers += static_cast<uint32_t>(bufferBarriers_.size());
+
+  if (ctx_.synchronization2Supported) {
+    VkDependencyInfo dep{};
+    dep.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+    dep.bufferMemoryBarrierCount = static_cast<uint32_t>(bufferBarriers_.size());
+    dep.pBufferMemoryBarriers = bufferBarriers_.data();
+    dep.imageMemoryBarrierCount = static_cast<uint32_t>(imageBarriers_.size());
+    dep.pImageMemoryBarriers = imageBarriers_.data();
+    ctx_.vk.vkCmdPipelineBarrier2(cmd, &dep);
+  } else {
+    // Legacy path: one call with the union of stages
+    VkPipelineStageFlags2 src = 0, dst = 0;
+    VkImageMemoryBarrier* images = arena_.allocateArray<VkImageMemoryBarrier>(imageBarriers_.size());
+    VkBufferMemoryBarrier* buffers = arena_.allocateArray<VkBufferMemoryBarrier>(bufferBarriers_.size());
+    uint32_t imageCount = 0, bufferCount = 0;
+    for (const auto& b : imageBarriers_) {
+      src |= b.srcStageMask;
+      dst |= b.dstStageMask;
+      VkImageMemoryBarrier l{};
+      l.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+      l.srcAccessMask = legacyAccess(b.srcAccessMask);
+      l.dstAccessMask = legacyAccess(b.dstAccessMask);
+      l.oldLayout = b.oldLayout;
+      l.newLayout = b.newLayout;
+      l.srcQueueFamilyIndex = b.srcQueueFamilyIndex;
+      l.dstQueueFamilyIndex = b.dstQueueFamilyIndex;
+      l.image = b.image;
+      l.subresourceRange = b.subresourceRange;
+      images[imageCount++] = l;
+    }
+    for (const auto& b : bufferBarriers_) {
+      src |= b.srcStageMask;
+      dst |= b.dstStageMask;
+      VkBufferMemoryBarrier l{};
+      l.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+      l.srcAccessMask = legacyAccess(b.srcAccessMask);
+      l.dstAccessMask = legacyAccess(b.dstAccessMask);
+      l.srcQueueFamilyIndex = b.srcQueueFamilyIndex;
+      l.dstQueueFamilyIndex = b.dstQueueFamilyIndex;
+      l.buffer = b.buffer;
+      l.offset = b.offset;
+      l.size = b.size;
+      buffers[bufferCount++] = l;
+    }
+    ctx_.vk.vkCmdPipelineBarrier(cmd, legacyStages(src, true), legacyStages(dst, false), 0, 0, nullptr,
+                         bufferCount, buffers, imageCount, images);
+  }
+  imageBarriers_.clear();
+  bufferBarriers_.clear();
+}
+
+void RenderGraph::execute(VkCommandBuffer cmd) {
+  if (!compiled_ && !compile()) return;
+  for (uint32_t p = 0; p < passCount_; ++p) {
+    Pass& pass = passes_[p];
+    if (pass.culled) continue;
+    for (const Access& a : pass.accesses) transition(resources_[a.resource], a.access, a.write);
+    flushBarriers(cmd);
+    pass.invoke(pass.callable, cmd);
+  }
+  // Final states for outputs, batched into one call
+  for (Resource& r : resources_) {
+    if (r.output && r.finalAccess != RGAccess::None) transition(r, r.finalAccess, false);
+  }
+  flushBarriers(cmd);
+
+  VkDeviceSize allocated = 0;
+  for (const Transient& t : transients_) allocated = std::max(allocated, t.offset + t.requirements.size);
+  stats_.transientBytes = allocated;
+  compiled_ = false;
+}
+
+VkImage RenderGraph::image(RGResource resource) const {
+  return resource < resources_.size() ? resources_[resource].image : VK_NULL_HANDLE;
+}
+
+VkImageView RenderGraph::view(RGResource resource) const {
+  return resource < resources_.size() ? resources_[resource].view : VK_NULL_HANDLE;
+}
+
+VkBuffer RenderGraph::buffer(RGResource resource) const {
+  return resource < resources_.size() ? resources_[resource].buffer : VK_NULL_HANDLE;
+}
+
+} // namespace vklite
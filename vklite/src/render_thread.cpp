@@ -0,0 +1,253 @@
+// render_thread.cpp - optional render thread and the input hand-off from the event thread
+#include "vklite.h"
+#include "log.h"
+#include "trace.h"
+#include <GLFW/glfw3.h>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+namespace vklite {
+
+namespace {
+// Input between two frames rarely exceeds a few dozen events; a full ring
+// drops new events rather than blocking the event thread
+constexpr size_t kInputQueueCapacity = 1024;
+} // namespace
+
+struct Context::RenderThread {
+  // Event thread -> thread that renders
+  SpscQueue<InputEvent, kInputQueueCapacity> input;
+  std::atomic<uint64_t> droppedInput{0};
+
+  std::thread thread;
+  std::mutex mutex;
+  std::condition_variable wake;       // the render thread sleeps on this
+  std::condition_variable pauseDone;  // the event thread waits for a pause on this
+  bool running = false;
+  bool stopRequested = false;
+  bool pauseRequested = false;
+  bool paused = false;
+  bool woken = false;
+
+  // Native windows whose surfaces are gone; GLFW destroys windows on the
+  // event thread only
+  std::mutex retiredMutex;
+  std::vector<GLFWwindow*> retiredWindows;
+};
+
+void Context::initThreading() {
+  if (!renderThread) renderThread = new RenderThread();
+}
+
+// After the workers that may call wakeMainLoop have stopped
+void Context::shutdownThreading() {
+  if (!renderThread) return;
+  stopRenderThread();
+  delete renderThread;
+  renderThread = nullptr;
+}
+
+bool Context::postInputEvent(const InputEvent& event) {
+  RenderThread* rt = renderThread;
+  if (!rt || !inputCallback) return false;
+  if (!rt->input.push(event)) {
+    rt->droppedInput.fetch_add(1, std::memory_order_relaxed);
+    VKLITE_LOG_WARN("input queue full, event dropped");
+    return false;
+  }
+  std::lock_guard<std::mutex> lock(rt->mutex);
+  if (rt->running) {
+    rt->woken = true;
+    rt->wake.notify_one();
+  }
+  return true;
+}
+
+uint64_t Context::droppedInputEvents() const {
+  return renderThread ? renderThread->droppedInput.load(std::memory_order_relaxed) : 0;
+}
+
+void Context::dispatchInputEvents() {
+  RenderThread* rt = renderThread;
+  if (!rt) return;
+  InputEvent ev;
+  while (rt->input.pop(ev)) {
+    // The window may have been destroyed since the event was queued
+    const bool open = std::any_of(windows.begin(), windows.end(), [&](const std::unique_ptr<Window>& w) { return w.get() == ev.window; });
+    if (open && inputCallback) inputCallback(ev);
+  }
+}
+
+// Safe from any thread: wakes whichever loop may be idle
+void Context::wakeMainLoop() {
+  glfwPostEmptyEvent();
+  RenderThread* rt = renderThread;
+  if (!rt) return;
+  std::lock_guard<std::mutex> lock(rt->mutex);
+  if (rt->running) {
+    rt->woken = true;
+    rt->wake.notify_one();
+  }
+}
+
+void Context::retireNativeWindow(void* handle) {
+  if (!handle) return;
+  if (!renderThread) {
+    glfwDestroyWindow(static_cast<GLFWwindow*>(handle));
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(renderThread->retiredMutex);
+    renderThread->retiredWindows.push_back(static_cast<GLFWwindow*>(handle));
+  }
+  glfwPostEmptyEvent();
+}
+
+void Context::destroyRetiredNativeWindows() {
+  if (!renderThread) return;
+  std::vector<GLFWwindow*> retired;
+  {
+    std::lock_guard<std::mutex> lock(renderThread->retiredMutex);
+    retired.swap(renderThread->retiredWindows);
+  }
+  for (GLFWwindow* gw : retired) glfwDestroyWindow(gw);
+}
+
+void Context::runThreadedMainLoop() {
+  RenderThread* rt = renderThread;
+  if (!rt || windows.empty()) return;
+  {
+    std::lock_guard<std::mutex> lock(rt->mutex);
+    rt->running = true;
+    rt->stopRequested = false;
+    rt->pauseRequested = false;
+    rt->woken = true;
+  }
+  rt->thread = std::thread([this] { renderThreadMain(); });
+
+  std::vector<Window*> toDestroy;
+  while (true) {
+    // The render thread posts an empty event after each frame while an
+    // updateCallback is set, so the simulation keeps one frame ahead
+    {
+      VKLITE_TRACE_ZONE("waitEvents");
+      glfwWaitEvents();
+    }
+    destroyRetiredNativeWindows();
+    if (updateCallback) updateCallback();
+
+    // Windows are only added or removed while the render thread is parked
+    toDestroy.clear();
+    for (auto& up : windows) {
+      Window* w = up.get();
+      if (w && w->handle && glfwWindowShouldClose(static_cast<GLFWwindow*>(w->handle))) toDestroy.push_back(w);
+    }
+    if (!toDestroy.empty()) {
+      pauseRenderThread();
+      for (Window* w : toDestroy) destroyWindow(w);
+      resumeRenderThread();
+    }
+    if (windows.empty()) break;
+  }
+  stopRenderThread();
+  destroyRetiredNativeWindows();
+}
+
+void Context::renderThreadMain() {
+  setTraceThreadName("vklite render");
+  std::vector<Window*> due;
+  double waitTimeout = 0.0;
+  while (waitRenderThread(waitTimeout)) {
+    const LoopAllocationCheck allocationCheck = beginLoopAllocationCheck();
+
+    // Frame boundary: nothing is being recorded, so rebuilt pipelines can be swapped in
+    applyShaderReloads();
+
+    const double now = glfwGetTime();
+    collectDueWindows(now, due);
+    for (Window* w : due) {
+      if (w->presentProfile == PresentProfile::LowLatency) waitForFrameSlot(w);
+    }
+    dispatchInputEvents();
+    const double inputTime = glfwGetTime();
+    for (Window* w : due) {
+      w->dirty = false;
+      w->inputSampleTime = inputTime;
+      const uint64_t rendered = w->framesRendered;
+      renderWindow(w);
+      // A skipped frame is retried next iteration, not a frame interval later
+      if (w->framesRendered != rendered) w->lastFrameTime = now;
+    }
+    if (!due.empty() && updateCallback) glfwPostEmptyEvent();
+    waitTimeout = nextFrameTimeout();
+    endLoopAllocationCheck(allocationCheck);
+  }
+}
+
+// Sleep until woken, paused, stopped or `timeout` seconds pass (0 = don't
+// sleep, < 0 = no timeout). Returns false when the thread should exit.
+bool Context::waitRenderThread(double timeout) {
+  RenderThread* rt = renderThread;
+  std::unique_lock<std::mutex> lock(rt->mutex);
+  const auto deadline = std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(std::max(timeout, 0.0)));
+  while (true) {
+    if (rt->stopRequested) return false;
+    if (rt->pauseRequested) {
+      rt->paused = true;
+      rt->pauseDone.notify_all();
+      rt->wake.wait(lock, [rt] { return !rt->pauseRequested || rt->stopRequested; });
+      rt->paused = false;
+      rt->woken = true;  // the window set changed
+      continue;
+    }
+    if (rt->woken || timeout == 0.0) {
+      rt->woken = false;
+      return true;
+    }
+    VKLITE_TRACE_ZONE("renderWait");
+    if (timeout < 0.0) {
+      rt->wake.wait(lock);
+    } else if (rt->wake.wait_until(lock, deadline) == std::cv_status::timeout) {
+      return !rt->stopRequested;
+    }
+  }
+}
+
+// Park the render thread at its next frame boundary and wait until it is
+void Context::pauseRenderThread() {
+  RenderThread* rt = renderThread;
+  if (!rt) return;
+  std::unique_lock<std::mutex> lock(rt->mutex);
+  if (!rt->running) return;
+  rt->pauseRequested = true;
+  rt->wake.notify_all();
+  rt->pauseDone.wait(lock, [rt] { return rt->paused; });
+}
+
+void Context::resumeRenderThread() {
+  RenderThread* rt = renderThread;
+  if (!rt) return;
+  std::lock_guard<std::mutex> lock(rt->mutex);
+  rt->pauseRequested = false;
+  rt->wake.notify_all();
+}
+
+void Context::stopRenderThread() {
+  RenderThread* rt = renderThread;
+  if (!rt) return;
+  {
+    std::lock_guard<std::mutex> lock(rt->mutex);
+    if (!rt->running) return;
+    rt->stopRequested = true;
+    rt->wake.notify_all();
+  }
+  if (rt->thread.joinable()) rt->thread.join();
+  std::lock_guard<std::mutex> lock(rt->mutex);
+  rt->running = false;
+  rt->stopRequested = false;
+}
+
+} // namespace vklite
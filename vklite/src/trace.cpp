@@ -0,0 +1,162 @@
+// trace.cpp - per-thread CPU zone buffers and Chrome trace JSON export
+#include "trace.h"
+#include "log.h"
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace vklite {
+
+namespace detail {
+std::atomic<bool> g_traceRunning{false};
+} // namespace detail
+
+namespace {
+
+struct TraceEvent {
+  const char* name = nullptr;
+  uint64_t beginNs = 0;
+  uint64_t endNs = 0;
+};
+
+// Written only by its thread; the registry mutex guards name and resizing
+struct ThreadBuffer {
+  uint32_t tid = 0;
+  std::string name;
+  std::atomic<uint64_t> generation{0};  // trace the events belong to
+  std::vector<TraceEvent> events;
+  std::atomic<size_t> count{0};
+};
+
+struct TraceRegistry {
+  std::mutex mutex;
+  std::vector<std::unique_ptr<ThreadBuffer>> threads;
+  std::atomic<uint64_t> generation{0};
+  size_t capacity = 0;
+  uint64_t startNs = 0;
+  std::atomic<uint64_t> dropped{0};
+};
+
+TraceRegistry& registry() {
+  static TraceRegistry r;
+  return r;
+}
+
+thread_local ThreadBuffer* t_buffer = nullptr;
+
+ThreadBuffer* threadBuffer() {
+  if (!t_buffer) {
+    TraceRegistry& reg = registry();
+    std::lock_guard<std::mutex> lock(reg.mutex);
+    reg.threads.push_back(std::make_unique<ThreadBuffer>());
+    t_buffer = reg.threads.back().get();
+    t_buffer->tid = static_cast<uint32_t>(reg.threads.size());
+  }
+  return t_buffer;
+}
+
+void writeJsonString(std::FILE* f, const char* s) {
+  std::fputc('"', f);
+  for (; *s; ++s) {
+    if (*s == '"' || *s == '\\') std::fputc('\\', f);
+    if (static_cast<unsigned char>(*s) >= 0x20) std::fputc(*s, f);
+  }
+  std::fputc('"', f);
+}
+
+} // namespace
+
+uint64_t detail::traceNowNs() {
+  return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+void detail::traceRecord(const char* name, uint64_t beginNs, uint64_t endNs) {
+  TraceRegistry& reg = registry();
+  ThreadBuffer* b = threadBuffer();
+  const uint64_t generation = reg.generation.load(std::memory_order_acquire);
+  if (b->generation.load(std::memory_order_relaxed) != generation) {
+    // First event of this trace on the thread: (re)size the buffer once
+    std::lock_guard<std::mutex> lock(reg.mutex);
+    b->count.store(0, std::memory_order_relaxed);
+    b->events.assign(reg.capacity, TraceEvent{});
+    b->generation.store(generation, std::memory_order_release);
+  }
+  const size_t n = b->count.load(std::memory_order_relaxed);
+  if (n >= b->events.size()) {
+    reg.dropped.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+  b->events[n] = { name, beginNs, endNs };
+  b->count.store(n + 1, std::memory_order_release);
+}
+
+void startTrace(size_t eventsPerThread) {
+  TraceRegistry& reg = registry();
+  {
+    std::lock_guard<std::mutex> lock(reg.mutex);
+    reg.capacity = eventsPerThread;
+    reg.startNs = detail::traceNowNs();
+    reg.dropped.store(0, std::memory_order_relaxed);
+    reg.generation.fetch_add(1, std::memory_order_release);
+  }
+  detail::g_traceRunning.store(true, std::memory_order_relaxed);
+}
+
+void stopTrace() {
+  detail::g_traceRunning.store(false, std::memory_order_relaxed);
+}
+
+void setTraceThreadName(const char* name) {
+  ThreadBuffer* b = threadBuffer();
+  std::lock_guard<std::mutex> lock(registry().mutex);
+  b->name = name ? name : "";
+}
+
+uint64_t droppedTraceEvents() {
+  return registry().dropped.load(std::memory_order_relaxed);
+}
+
+bool writeTrace(const std::string& path) {
+  TraceRegistry& reg = registry();
+  std::lock_guard<std::mutex> lock(reg.mutex);
+  std::FILE* f = std::fopen(path.c_str(), "wb");
+  if (!f) {
+    VKLITE_LOG_ERROR("writeTrace: cannot create %s", path.c_str());
+    return false;
+  }
+  const uint64_t generation = reg.generation.load(std::memory_order_relaxed);
+  size_t written = 0;
+  std::fputs("{\"traceEvents\":[\n", f);
+  std::fputs("{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"vklite\"}}", f);
+  for (const auto& b : reg.threads) {
+    if (!b->name.empty()) {
+      std::fprintf(f, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":", b->tid);
+      writeJsonString(f, b->name.c_str());
+      std::fputs("}}", f);
+    }
+    if (b->generation.load(std::memory_order_acquire) != generation) continue;
+    const size_t n = b->count.load(std::memory_order_acquire);
+    for (size_t i = 0; i < n; ++i) {
+      const TraceEvent& e = b->events[i];
+      if (e.beginNs < reg.startNs) continue;  // zone opened before startTrace
+      std::fputs(",\n{\"name\":", f);
+      writeJsonString(f, e.name);
+      std::fprintf(f, ",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}", b->tid,
+                   static_cast<double>(e.beginNs - reg.startNs) / 1000.0, static_cast<double>(e.endNs - e.beginNs) / 1000.0);
+      ++written;
+    }
+  }
+  std::fputs("\n],\"displayTimeUnit\":\"ms\"}\n", f);
+  const bool ok = std::fclose(f) == 0;
+  if (!ok) {
+    VKLITE_LOG_ERROR("writeTrace: failed writing %s", path.c_str());
+    return false;
+  }
+  VKLITE_LOG_INFO("writeTrace: %zu events written to %s (%llu dropped)", written, path.c_str(),
+                  static_cast<unsigned long long>(reg.dropped.load(std::memory_order_relaxed)));
+  return true;
+}
+
+} // namespace vklite
@@ -1,28 +1,41 @@
 
 #include "vklite.h"
-#include <iostream>
+#include "log.h"
+#include "trace.h"
+#include <cstdlib>
 #include <vector>
 #include <cstring>
 #include <stdexcept>
 #include <GLFW/glfw3.h>
 
 static void vklite_glfw_error_callback(int error, const char* description) {
-  std::cerr << "GLFW error [" << error << "]: " << (description ? description : "<null>") << std::endl;
+  VKLITE_LOG_ERROR("GLFW error [%d]: %s", error, description ? description : "<null>");
 }
 
 namespace vklite {
 
 bool Context::initialize(const std::string &appName){
 
-  std::cout << "vklite: initialize for " << appName;
 #if defined(VKLITE_PLAT_WINDOWS)
-  std::cout << " [platform: windows]";
+  const char* platform = " [platform: windows]";
 #elif defined(VKLITE_PLAT_MAC)
-  std::cout << " [platform: macos]";
+  const char* platform = " [platform: macos]";
 #elif defined(VKLITE_PLAT_LINUX)
-  std::cout << " [platform: linux]";
+  const char* platform = " [platform: linux]";
+#else
+  const char* platform = "";
 #endif
-  std::cout << std::endl;
+  VKLITE_LOG_INFO("vklite: initialize for %s%s", appName.c_str(), platform);
+
+  // VKLITE_TRACE=<file>: trace CPU zones from here on, written by shutdown
+  setTraceThreadName("main");
+  const char* tracePath = std::getenv("VKLITE_TRACE");
+  if (tracePath && *tracePath) {
+    traceOutputPath = tracePath;
+    startTrace();
+  }
+
+  if (!jobs) jobs = new JobSystem(jobSettings);
 
   // Query Vulkan loader for supported API version
   uint32_t apiVersion = 0;
@@ -34,9 +47,9 @@ bool Context::initialize(const std::string &appName){
   uint32_t major = VK_VERSION_MAJOR(apiVersion);
   uint32_t minor = VK_VERSION_MINOR(apiVersion);
   uint32_t patch = VK_VERSION_PATCH(apiVersion);
-  std::cout << "Vulkan loader supports API version: " << major << "." << minor << "." << patch << std::endl;
+  VKLITE_LOG_INFO("Vulkan loader supports API version: %u.%u.%u", major, minor, patch);
   if (apiVersion < VK_API_VERSION_1_3) {
-    std::cerr << "Vulkan 1.3 or higher is required!" << std::endl;
+    VKLITE_LOG_ERROR("Vulkan 1.3 or higher is required!");
     return false;
   }
 
@@ -46,9 +59,10 @@ bool Context::initialize(const std::string &appName){
 
   bool glfw_inited = glfwInit() != 0;
   if (!glfw_inited) {
-    std::cerr << "Failed to initialize GLFW!" << std::endl;
+    VKLITE_LOG_ERROR("Failed to initialize GLFW!");
     return false;
   }
+  initThreading();
   // We use Vulkan for rendering; tell GLFW not to create an OpenGL context
   glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
   uint32_t glfwExtensionCount = 0;
@@ -90,7 +104,7 @@ bool Context::initialize(const std::string &appName){
 
   VkResult result = vkCreateInstance(&createInfo, nullptr, &instance);
   if (result != VK_SUCCESS) {
-    std::cerr << "Failed to create Vulkan instance!" << std::endl;
+    VKLITE_LOG_ERROR("Failed to create Vulkan instance!");
     instance = VK_NULL_HANDLE;
     return false;
   }
@@ -110,6 +124,10 @@ bool Context::initialize(const std::string &appName){
         Context* ctx = reinterpret_cast<Context*>(pUserData);
         if (ctx && ctx->validation_callback) {
           ctx->validation_callback(severity, types, std::string(pCallbackData->pMessage));
+        } else if (severity & VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT) {
+          VKLITE_LOG_ERROR("validation: %s", pCallbackData->pMessage);
+        } else {
+          VKLITE_LOG_WARN("validation: %s", pCallbackData->pMessage);
         }
         return VK_FALSE;
       };
@@ -118,42 +136,24 @@ bool Context::initialize(const std::string &appName){
     }
   }
   // --- Physical device selection ---
-  uint32_t deviceCount = 0;
-  vkEnumeratePhysicalDevices(instance, &deviceCount, nullptr);
-  if (deviceCount == 0) {
-    std::cerr << "No Vulkan physical devices found" << std::endl;
-    return false;
-  }
-  std::vector<VkPhysicalDevice> devices(deviceCount);
-  vkEnumeratePhysicalDevices(instance, &deviceCount, devices.data());
-
-  // Pick the first device that has a graphics queue
-  for (auto dev : devices) {
-    uint32_t qCount = 0;
-    vkGetPhysicalDeviceQueueFamilyProperties(dev, &qCount, nullptr);
-    std::vector<VkQueueFamilyProperties> qprops(qCount);
-    vkGetPhysicalDeviceQueueFamilyProperties(dev, &qCount, qprops.data());
-    for (uint32_t i = 0; i < qCount; ++i) {
-      if (qprops[i].queueFlags & VK_QUEUE_GRAPHICS_BIT) {
-        physicalDevice = dev;
-        graphicsQueueFamily = i;
-        break;
-      }
-    }
-    if (physicalDevice != VK_NULL_HANDLE) break;
-  }
-  if (physicalDevice == VK_NULL_HANDLE) {
-    std::cerr << "Failed to find a suitable physical device with graphics queue" << std::endl;
-    return false;
-  }
+  if (!selectPhysicalDevice()) return false;
+  vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
 
   // --- Device creation ---
+  // One queue per distinct family of the topology
   float queuePriority = 1.0f;
-  VkDeviceQueueCreateInfo queueCreate{};
-  queueCreate.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
-  queueCreate.queueFamilyIndex = graphicsQueueFamily;
-  queueCreate.queueCount = 1;
-  queueCreate.pQueuePriorities = &queuePriority;
+  std::vector<VkDeviceQueueCreateInfo> queueCreates;
+  for (uint32_t family : { queueTopology.graphicsFamily, queueTopology.computeFamily, queueTopology.transferFamily }) {
+    bool seen = false;
+    for (const auto& q : queueCreates) seen = seen || q.queueFamilyIndex == family;
+    if (seen) continue;
+    VkDeviceQueueCreateInfo queueCreate{};
+    queueCreate.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+    queueCreate.queueFamilyIndex = family;
+    queueCreate.queueCount = 1;
+    queueCreate.pQueuePriorities = &queuePriority;
+    queueCreates.push_back(queueCreate);
+  }
 
   // Required device extensions
   std::vector<const char*> deviceExtensions = { "VK_KHR_swapchain" };
@@ -163,47 +163,174 @@ bool Context::initialize(const std::string &appName){
   vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extCount, nullptr);
   std::vector<VkExtensionProperties> extProps(extCount);
   vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extCount, extProps.data());
-  bool dynamicRenderingAvailable = false;
-  for (auto &e : extProps) {
-    if (std::strcmp(e.extensionName, "VK_KHR_dynamic_rendering") == 0) {
-      dynamicRenderingAvailable = true;
-      deviceExtensions.push_back("VK_KHR_dynamic_rendering");
-      break;
+  auto hasExtension = [&](const char* name) {
+    for (auto &e : extProps) {
+      if (std::strcmp(e.extensionName, name) == 0) return true;
     }
+    return false;
+  };
+  bool dynamicRenderingAvailable = hasExtension("VK_KHR_dynamic_rendering");
+  if (dynamicRenderingAvailable) deviceExtensions.push_back("VK_KHR_dynamic_rendering");
+
+  // Present id/wait are used for latency measurement and low-latency pacing;
+  // only enable them when the device actually supports both features.
+  VkPhysicalDevicePresentIdFeaturesKHR presentIdFeature{};
+  presentIdFeature.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_ID_FEATURES_KHR;
+  VkPhysicalDevicePresentWaitFeaturesKHR presentWaitFeature{};
+  presentWaitFeature.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_WAIT_FEATURES_KHR;
+  if (hasExtension("VK_KHR_present_id") && hasExtension("VK_KHR_present_wait")) {
+    presentIdFeature.pNext = &presentWaitFeature;
+    VkPhysicalDeviceFeatures2 features2{};
+    features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    features2.pNext = &presentIdFeature;
+    vkGetPhysicalDeviceFeatures2(physicalDevice, &features2);
+    presentWaitSupported = presentIdFeature.presentId && presentWaitFeature.presentWait;
+  }
+  if (presentWaitSupported) {
+    deviceExtensions.push_back("VK_KHR_present_id");
+    deviceExtensions.push_back("VK_KHR_present_wait");
+  }
+
+  // synchronization2 is core in 1.3 but still an optional feature; the render
+  // graph falls back to legacy barriers without it.
+  VkPhysicalDeviceProperties deviceProps{};
+  vkGetPhysicalDeviceProperties(physicalDevice, &deviceProps);
+  timestampPeriod = deviceProps.limits.timestampPeriod;
+  VkPhysicalDeviceSynchronization2Features sync2Feature{};
+  sync2Feature.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SYNCHRONIZATION_2_FEATURES;
+  if (deviceProps.apiVersion >= VK_API_VERSION_1_3) {
+    VkPhysicalDeviceFeatures2 features2{};
+    features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    features2.pNext = &sync2Feature;
+    vkGetPhysicalDeviceFeatures2(physicalDevice, &features2);
+    synchronization2Supported = sync2Feature.synchronization2 == VK_TRUE;
+  }
+
+  // A timeline semaphore signalled with each submission's serial tells the
+  // deletion queue how far the GPU has got, across all windows.
+  VkPhysicalDeviceTimelineSemaphoreFeatures timelineFeature{};
+  timelineFeature.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES;
+  if (deviceProps.apiVersion >= VK_API_VERSION_1_2) {
+    VkPhysicalDeviceFeatures2 features2{};
+    features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    features2.pNext = &timelineFeature;
+    vkGetPhysicalDeviceFeatures2(physicalDevice, &features2);
+    timelineSemaphoreSupported = timelineFeature.timelineSemaphore == VK_TRUE;
   }
 
+  // Graphics pipeline libraries let new variants fast-link from cached parts
+  // instead of blocking on a monolithic compile (pipeline_library.cpp).
+  VkPhysicalDeviceGraphicsPipelineLibraryFeaturesEXT gplFeature{};
+  gplFeature.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_GRAPHICS_PIPELINE_LIBRARY_FEATURES_EXT;
+  if (hasExtension(VK_KHR_PIPELINE_LIBRARY_EXTENSION_NAME) && hasExtension(VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME)) {
+    VkPhysicalDeviceFeatures2 features2{};
+    features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    features2.pNext = &gplFeature;
+    vkGetPhysicalDeviceFeatures2(physicalDevice, &features2);
+    graphicsPipelineLibrarySupported = gplFeature.graphicsPipelineLibrary == VK_TRUE;
+  }
+  if (graphicsPipelineLibrarySupported) {
+    deviceExtensions.push_back(VK_KHR_PIPELINE_LIBRARY_EXTENSION_NAME);
+    deviceExtensions.push_back(VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME);
+  }
+
+  // Per-heap budget and usage for the whole process (memory_budget.cpp)
+  memoryBudgetSupported = hasExtension(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+  if (memoryBudgetSupported) deviceExtensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+
+  // Feature structs are chained only when their extension is enabled
+  void* featureChain = nullptr;
   VkPhysicalDeviceDynamicRenderingFeatures dynamicRenderingFeature{};
   dynamicRenderingFeature.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DYNAMIC_RENDERING_FEATURES;
-  dynamicRenderingFeature.pNext = nullptr;
-  dynamicRenderingFeature.dynamicRendering = dynamicRenderingAvailable ? VK_TRUE : VK_FALSE;
+  dynamicRenderingFeature.dynamicRendering = VK_TRUE;
+  if (timelineSemaphoreSupported) {
+    timelineFeature.pNext = featureChain;
+    featureChain = &timelineFeature;
+  }
+  if (graphicsPipelineLibrarySupported) {
+    gplFeature.pNext = featureChain;
+    featureChain = &gplFeature;
+  }
+  if (synchronization2Supported) {
+    sync2Feature.pNext = featureChain;
+    featureChain = &sync2Feature;
+  }
+  if (presentWaitSupported) {
+    presentWaitFeature.pNext = featureChain;
+    presentIdFeature.pNext = &presentWaitFeature;
+    featureChain = &presentIdFeature;
+  }
+  if (dynamicRenderingAvailable) {
+    dynamicRenderingFeature.pNext = featureChain;
+    featureChain = &dynamicRenderingFeature;
+  }
 
   VkDeviceCreateInfo deviceCreate{};
   deviceCreate.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
-  deviceCreate.pNext = dynamicRenderingAvailable ? &dynamicRenderingFeature : nullptr;
-  deviceCreate.queueCreateInfoCount = 1;
-  deviceCreate.pQueueCreateInfos = &queueCreate;
+  deviceCreate.pNext = featureChain;
+  deviceCreate.queueCreateInfoCount = static_cast<uint32_t>(queueCreates.size());
+  deviceCreate.pQueueCreateInfos = queueCreates.data();
   deviceCreate.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size());
   deviceCreate.ppEnabledExtensionNames = deviceExtensions.data();
 
   result = vkCreateDevice(physicalDevice, &deviceCreate, nullptr, &device);
   if (result != VK_SUCCESS) {
-    std::cerr << "Failed to create logical device" << std::endl;
+    VKLITE_LOG_ERROR("Failed to create logical device");
     device = VK_NULL_HANDLE;
     return false;
   }
 
-  vkGetDeviceQueue(device, graphicsQueueFamily, 0, &graphicsQueue);
-
-  // Load device-level function pointers for dynamic rendering, if enabled
-  if (dynamicRenderingAvailable) {
-    vkCmdBeginRenderingKHR = reinterpret_cast<PFN_vkCmdBeginRenderingKHR>(vkGetDeviceProcAddr(device, "vkCmdBeginRenderingKHR"));
-    vkCmdEndRenderingKHR = reinterpret_cast<PFN_vkCmdEndRenderingKHR>(vkGetDeviceProcAddr(device, "vkCmdEndRenderingKHR"));
+  // Resolve the whole device-level table once; see device_dispatch.h
+  const char* missing = nullptr;
+  if (!vk.load(device, &missing)) {
+    VKLITE_LOG_ERROR("Device function %s is missing", missing);
+    return false;
+  }
+  vk.vkGetDeviceQueue(device, graphicsQueueFamily, 0, &graphicsQueue);
+  vk.vkGetDeviceQueue(device, queueTopology.computeFamily, 0, &computeQueue);
+  vk.vkGetDeviceQueue(device, queueTopology.transferFamily, 0, &transferQueue);
+
+  // Entry points of features that were not enabled stay null in the table
+  if (!dynamicRenderingAvailable) {
+    vk.vkCmdBeginRenderingKHR = nullptr;
+    vk.vkCmdEndRenderingKHR = nullptr;
+  }
+  if (!presentWaitSupported) vk.vkWaitForPresentKHR = nullptr;
+  presentWaitSupported = vk.vkWaitForPresentKHR != nullptr;
+  synchronization2Supported = synchronization2Supported && vk.vkCmdPipelineBarrier2 != nullptr;
+  timelineSemaphoreSupported = timelineSemaphoreSupported && vk.vkGetSemaphoreCounterValue != nullptr;
+  if (timelineSemaphoreSupported) {
+    VkSemaphoreTypeCreateInfo typeInfo{};
+    typeInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+    typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+    typeInfo.initialValue = 0;
+    VkSemaphoreCreateInfo semInfo{};
+    semInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    semInfo.pNext = &typeInfo;
+    if (vk.vkCreateSemaphore(device, &semInfo, nullptr, &submitTimeline) != VK_SUCCESS) {
+      submitTimeline = VK_NULL_HANDLE;
+      timelineSemaphoreSupported = false;
+    }
   }
 
   return true;
 }
 
 
+// Pick a memory type allowed by typeBits that has all `required` flags,
+// favouring one that also has the `preferred` flags. Returns UINT32_MAX if none.
+uint32_t Context::findMemoryType(uint32_t typeBits, VkMemoryPropertyFlags required, VkMemoryPropertyFlags preferred) const {
+  uint32_t fallback = UINT32_MAX;
+  for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; ++i) {
+    if (!(typeBits & (1u << i))) continue;
+    VkMemoryPropertyFlags flags = memoryProperties.memoryTypes[i].propertyFlags;
+    if ((flags & required) != required) continue;
+    if ((flags & preferred) == preferred) return i;
+    if (fallback == UINT32_MAX) fallback = i;
+  }
+  return fallback;
+}
+
 // Window-related methods are implemented in src/window.cpp
 
 void Context::shutdown(){
@@ -213,16 +340,35 @@ void Context::shutdown(){
     destroyWindow(windows.back().get());
   }
 
+  // The only device-wide wait: window resources above were deferred and are
+  // released here, before GLFW goes away.
+  if (device != VK_NULL_HANDLE) vk.vkDeviceWaitIdle(device);
+  collectDeferredDeletions(true);
+
+  // Native windows are handed back by those deletions
+  stopRenderThread();
+  destroyRetiredNativeWindows();
+
   // Terminate GLFW after windows are destroyed.
   glfwTerminate();
 
-  // Ensure the device is idle and destroy it before destroying the instance.
+  // Destroy the device before destroying the instance.
   if (device != VK_NULL_HANDLE) {
-    vkDeviceWaitIdle(device);
-    vkDestroyDevice(device, nullptr);
+    shutdownHotReload();
+    destroyPipelineCache();
+    shutdownPipelineLibraries();
+    collectDeferredDeletions(true);
+    destroyHiZPipelines();
+    if (submitTimeline != VK_NULL_HANDLE) vk.vkDestroySemaphore(device, submitTimeline, nullptr);
+    submitTimeline = VK_NULL_HANDLE;
+    vk.vkDestroyDevice(device, nullptr);
     device = VK_NULL_HANDLE;
+    vk = DeviceDispatch();
     graphicsQueue = VK_NULL_HANDLE;
+    computeQueue = VK_NULL_HANDLE;
+    transferQueue = VK_NULL_HANDLE;
     graphicsQueueFamily = UINT32_MAX;
+    queueTopology = QueueTopology{};
   }
 
   // Destroy debug messenger (uses instance) and then destroy the instance.
@@ -236,7 +382,19 @@ void Context::shutdown(){
     instance = VK_NULL_HANDLE;
   }
 
-  std::cout << "vklite: shutdown" << std::endl;
+  // Background builds were drained above
+  delete jobs;
+  jobs = nullptr;
+
+  shutdownThreading();
+
+  if (!traceOutputPath.empty()) {
+    stopTrace();
+    writeTrace(traceOutputPath);
+    traceOutputPath.clear();
+  }
+  VKLITE_LOG_INFO("vklite: shutdown");
+  flushLog();
 }
 
 } // namespace vklite
@@ -1,14 +1,118 @@
 // window.cpp - window management implementation for vklite
 #include "vklite.h"
 #include "window.h"
+#include "log.h"
+#include "trace.h"
+#include "alloc_counter.h"
 #include <GLFW/glfw3.h>
 #include <vector>
-#include <iostream>
 #include <vulkan/vulkan.h>
 #include <algorithm>
+#include <cstdlib>
 
 namespace vklite {
 
+namespace {
+
+Window* windowFromHandle(GLFWwindow* gw) {
+  return static_cast<Window*>(glfwGetWindowUserPointer(gw));
+}
+
+void markDirty(GLFWwindow* gw) {
+  if (Window* w = windowFromHandle(gw)) w->dirty = true;
+}
+
+// Windows with nothing on screen to draw to
+bool windowHidden(const Window* w) {
+  return w->iconified || !w->visible || w->framebufferWidth == 0 || w->framebufferHeight == 0;
+}
+
+// With several windows due, one whose frame slot or next image is not ready
+// within this long is skipped for the iteration rather than holding up the rest
+constexpr uint64_t kSharedFrameWaitNs = 2ull * 1000 * 1000;
+
+// Marks the window dirty and queues the event for Context::inputCallback
+void postInput(GLFWwindow* gw, InputEvent ev) {
+  Window* w = windowFromHandle(gw);
+  if (!w) return;
+  w->dirty = true;
+  if (!w->context) return;
+  ev.window = w;
+  ev.time = glfwGetTime();
+  w->context->postInputEvent(ev);
+}
+
+// Any input or window-system event that may change what is displayed marks
+// the window dirty so OnDemand mode redraws it.
+void installDirtyCallbacks(GLFWwindow* gw) {
+  glfwSetFramebufferSizeCallback(gw, [](GLFWwindow* h, int width, int height) {
+    if (Window* w = windowFromHandle(h)) {
+      w->framebufferWidth = width;
+      w->framebufferHeight = height;
+      w->swapchainOutOfDate = true;
+    }
+    InputEvent ev;
+    ev.type = InputEventType::FramebufferResize;
+    ev.x = width;
+    ev.y = height;
+    postInput(h, ev);
+  });
+  glfwSetWindowRefreshCallback(gw, [](GLFWwindow* h) { markDirty(h); });
+  glfwSetWindowFocusCallback(gw, [](GLFWwindow* h, int focused) {
+    if (Window* w = windowFromHandle(h)) w->focused = focused == GLFW_TRUE;
+    InputEvent ev;
+    ev.type = InputEventType::Focus;
+    ev.action = focused;
+    postInput(h, ev);
+  });
+  glfwSetWindowIconifyCallback(gw, [](GLFWwindow* h, int iconified) {
+    if (Window* w = windowFromHandle(h)) w->iconified = iconified == GLFW_TRUE;
+    InputEvent ev;
+    ev.type = InputEventType::Iconify;
+    ev.action = iconified;
+    postInput(h, ev);
+  });
+  glfwSetKeyCallback(gw, [](GLFWwindow* h, int key, int scancode, int action, int mods) {
+    InputEvent ev;
+    ev.type = InputEventType::Key;
+    ev.key = key;
+    ev.scancode = scancode;
+    ev.action = action;
+    ev.mods = mods;
+    postInput(h, ev);
+  });
+  glfwSetCharCallback(gw, [](GLFWwindow* h, unsigned int codepoint) {
+    InputEvent ev;
+    ev.type = InputEventType::Char;
+    ev.codepoint = codepoint;
+    postInput(h, ev);
+  });
+  glfwSetMouseButtonCallback(gw, [](GLFWwindow* h, int button, int action, int mods) {
+    InputEvent ev;
+    ev.type = InputEventType::MouseButton;
+    ev.key = button;
+    ev.action = action;
+    ev.mods = mods;
+    postInput(h, ev);
+  });
+  glfwSetCursorPosCallback(gw, [](GLFWwindow* h, double x, double y) {
+    InputEvent ev;
+    ev.type = InputEventType::CursorPos;
+    ev.x = x;
+    ev.y = y;
+    postInput(h, ev);
+  });
+  glfwSetScrollCallback(gw, [](GLFWwindow* h, double x, double y) {
+    InputEvent ev;
+    ev.type = InputEventType::Scroll;
+    ev.x = x;
+    ev.y = y;
+    postInput(h, ev);
+  });
+}
+
+} // namespace
+
 Window* Context::createWindow(int width, int height, const std::string& title) {
   GLFWwindow* win = glfwCreateWindow(width, height, title.c_str(), nullptr, nullptr);
   if (!win) {
@@ -18,11 +122,21 @@ Window* Context::createWindow(int width, int height, const std::string& title) {
   }
   auto w = std::make_unique<Window>();
   w->handle = win;
+  w->context = this;
+  int fbw = 0, fbh = 0;
+  glfwGetFramebufferSize(win, &fbw, &fbh);
+  w->framebufferWidth = fbw;
+  w->framebufferHeight = fbh;
+  w->iconified = glfwGetWindowAttrib(win, GLFW_ICONIFIED) == GLFW_TRUE;
+  w->visible = glfwGetWindowAttrib(win, GLFW_VISIBLE) == GLFW_TRUE;
+  w->focused = glfwGetWindowAttrib(win, GLFW_FOCUSED) == GLFW_TRUE;
   w->width = width;
   w->height = height;
   w->title = title;
   windows.push_back(std::move(w));
   Window* created = windows.back().get();
+  glfwSetWindowUserPointer(win, created);
+  installDirtyCallbacks(win);
 
   // Create a VkSurfaceKHR for this window and a swapchain
   if (!createSurfaceForWindow(created)) {
@@ -38,14 +152,25 @@ Window* Context::createWindow(int width, int height, const std::string& title) {
 
 void Context::destroyWindow(Window* window) {
   if (!window || !window->handle) return;
-  // Destroy swapchain and surface
+  // Destroy swapchain and surface. Frames of this window may still be in
+  // flight: the Vulkan objects go through the deletion queue, so closing a
+  // window never stalls the others.
+  stopCapture(window);
   destroySwapchainForWindow(window);
-  if (window->surface != VK_NULL_HANDLE && instance != VK_NULL_HANDLE) {
-    vkDestroySurfaceKHR(instance, window->surface, nullptr);
-    window->surface = VK_NULL_HANDLE;
-  }
+  window->graph.reset();
   GLFWwindow* gw = static_cast<GLFWwindow*>(window->handle);
-  glfwDestroyWindow(gw);
+  glfwSetWindowUserPointer(gw, nullptr);
+  glfwHideWindow(gw);
+  // The surface outlives the swapchain (queued earlier) and the native
+  // window outlives the surface. The deletion may run on the render thread,
+  // so the native window is handed back to the event thread.
+  VkInstance inst = instance;
+  VkSurfaceKHR surface = window->surface;
+  deferDestroy([this, inst, surface, gw] {
+    if (surface != VK_NULL_HANDLE && inst != VK_NULL_HANDLE) vkDestroySurfaceKHR(inst, surface, nullptr);
+    retireNativeWindow(gw);
+  });
+  window->surface = VK_NULL_HANDLE;
   window->handle = nullptr;
   for (auto it = windows.begin(); it != windows.end(); ++it) {
     if (it->get() == window) {
@@ -61,20 +186,124 @@ bool Context::isWindowOpen(const Window* window) const {
 }
 
 void Context::pollEvents() {
+  VKLITE_TRACE_ZONE("pollEvents");
   glfwPollEvents();
+  destroyRetiredNativeWindows();
+}
+
+void Context::setWindowVisible(Window* window, bool visible) {
+  if (!window || !window->handle) return;
+  GLFWwindow* gw = static_cast<GLFWwindow*>(window->handle);
+  if (visible) {
+    glfwShowWindow(gw);
+  } else {
+    glfwHideWindow(gw);
+  }
+  window->visible = visible;
+  if (visible) invalidateWindow(window);
+}
+
+void Context::invalidateWindow(Window* window) {
+  if (!window) return;
+  window->dirty = true;
+  wakeMainLoop();
+}
+
+// Minimum time between two frames of the window
+double Context::frameInterval(const Window* window) const {
+  double fps = window->maxFps;
+  if (!window->focused && unfocusedMaxFps > 0.0) fps = fps > 0.0 ? std::min(fps, unfocusedMaxFps) : unfocusedMaxFps;
+  return fps > 0.0 ? 1.0 / fps : 0.0;
+}
+
+void Context::collectDueWindows(double now, std::vector<Window*>& due) {
+  due.clear();
+  for (auto& up : windows) {
+    Window* w = up.get();
+    if (!w || !w->handle) continue;
+    // Nothing to present to; restoring or showing the window marks it dirty
+    if (windowHidden(w)) continue;
+    if (w->swapchainOutOfDate && !recreateSwapchainForWindow(w)) continue;
+    if (renderMode == RenderMode::OnDemand && !w->dirty) continue;
+    if (now < w->lastFrameTime + frameInterval(w)) continue;
+    due.push_back(w);
+  }
+  manyWindowsDue = due.size() > 1;
+}
+
+// Seconds until the next window wants a frame: zero if one can render right
+// away, otherwise until the earliest frame-capped window is due, or -1 when
+// nothing wants a frame.
+double Context::nextFrameTimeout() const {
+  double timeout = -1.0;
+  const double after = glfwGetTime();
+  for (auto& up : windows) {
+    const Window* w = up.get();
+    if (!w || !w->handle) continue;
+    if (renderMode == RenderMode::OnDemand && !w->dirty) continue;
+    if (windowHidden(w)) continue; // a restore or show event will wake us
+    const double t = std::max(0.0, w->lastFrameTime + frameInterval(w) - after);
+    timeout = timeout < 0.0 ? t : std::min(timeout, t);
+  }
+  return timeout;
 }
 
 void Context::runMainLoop() {
+  if (threadingMode == ThreadingMode::RenderThread) {
+    runThreadedMainLoop();
+    return;
+  }
+  // Seconds to wait for events before the next iteration: 0 = just poll,
+  // < 0 = block until an event arrives.
+  double waitTimeout = 0.0;
+  // Reused every iteration so the loop itself does not allocate
+  std::vector<Window*> due;
+  std::vector<Window*> toDestroy;
   while (true) {
+    // The whole iteration, waits and budget checks included, must not
+    // allocate once the windows have settled
+    const LoopAllocationCheck allocationCheck = beginLoopAllocationCheck();
+
+    // Frame boundary: nothing is being recorded, so rebuilt pipelines can be swapped in
+    applyShaderReloads();
+
+    // Frame limiter: sleep inside the event wait, before input is sampled,
+    // rather than after submit. Input still wakes the loop early.
+    if (waitTimeout < 0.0) {
+      VKLITE_TRACE_ZONE("waitEvents");
+      glfwWaitEvents();
+    } else if (waitTimeout > 0.0) {
+      VKLITE_TRACE_ZONE("waitEvents");
+      glfwWaitEventsTimeout(waitTimeout);
+    }
+
+    // Collect the windows that are due for a frame
+    const double now = glfwGetTime();
+    collectDueWindows(now, due);
+
+    // Low-latency windows block on the GPU and display here, so the input
+    // sampled below is as fresh as possible when the frame is recorded.
+    for (Window* w : due) {
+      if (w->presentProfile == PresentProfile::LowLatency) waitForFrameSlot(w);
+    }
     pollEvents();
-    // Render each window
-    for (auto& up : windows) {
-      Window* w = up.get();
-      if (w && w->handle) renderWindow(w);
+    dispatchInputEvents();
+    if (updateCallback) updateCallback();
+    const double inputTime = glfwGetTime();
+    for (Window* w : due) {
+      w->dirty = false;
+      w->inputSampleTime = inputTime;
+      const uint64_t rendered = w->framesRendered;
+      renderWindow(w);
+      // A skipped frame is retried next iteration, not a frame interval later
+      if (w->framesRendered != rendered) w->lastFrameTime = now;
     }
 
+    waitTimeout = nextFrameTimeout();
+    endLoopAllocationCheck(allocationCheck);
+
     // Collect windows requested to close
-    std::vector<Window*> toDestroy;
+    toDestroy.clear();
     for (auto& up : windows) {
       Window* w = up.get();
       if (w && w->handle && glfwWindowShouldClose(static_cast<GLFWwindow*>(w->handle))) {
@@ -96,8 +325,10 @@ bool Context::createSurfaceForWindow(Window* window) {
   return true;
 }
 
-bool Context::createSwapchainForWindow(Window* window) {
+bool Context::createSwapchainForWindow(Window* window, VkSwapchainKHR oldSwapchain) {
   if (!window || window->surface == VK_NULL_HANDLE || physicalDevice == VK_NULL_HANDLE || device == VK_NULL_HANDLE) return false;
+  VKLITE_TRACE_ZONE("createSwapchain");
+  window->steadyFrames = 0;
 
   // Query surface capabilities and formats
   VkSurfaceCapabilitiesKHR caps{};
@@ -118,22 +349,23 @@ bool Context::createSwapchainForWindow(Window* window) {
     }
   }
 
-  // Choose present mode (prefer MAILBOX, fallback to FIFO)
+  // Choose present mode from the window's profile. FIFO is always available;
+  // only LowLatency accepts tearing (IMMEDIATE) when MAILBOX is missing.
   uint32_t pmCount = 0;
   vkGetPhysicalDeviceSurfacePresentModesKHR(physicalDevice, window->surface, &pmCount, nullptr);
   std::vector<VkPresentModeKHR> presentModes(pmCount);
   vkGetPhysicalDeviceSurfacePresentModesKHR(physicalDevice, window->surface, &pmCount, presentModes.data());
+  auto hasMode = [&](VkPresentModeKHR m) { return std::find(presentModes.begin(), presentModes.end(), m) != presentModes.end(); };
   VkPresentModeKHR chosenPresent = VK_PRESENT_MODE_FIFO_KHR;
-  for (auto &p : presentModes) {
-    if (p == VK_PRESENT_MODE_MAILBOX_KHR) { chosenPresent = p; break; }
+  if (window->presentProfile != PresentProfile::Vsync) {
+    if (hasMode(VK_PRESENT_MODE_MAILBOX_KHR)) chosenPresent = VK_PRESENT_MODE_MAILBOX_KHR;
+    else if (window->presentProfile == PresentProfile::LowLatency && hasMode(VK_PRESENT_MODE_IMMEDIATE_KHR)) chosenPresent = VK_PRESENT_MODE_IMMEDIATE_KHR;
   }
 
   // Determine swap extent
   // Use framebuffer size (pixel dimensions) to account for high-DPI displays
-  int fbw = 0, fbh = 0;
-  if (window->handle) {
-    glfwGetFramebufferSize(static_cast<GLFWwindow*>(window->handle), &fbw, &fbh);
-  }
+  const int fbw = window->framebufferWidth;
+  const int fbh = window->framebufferHeight;
   VkExtent2D extent;
   if (caps.currentExtent.width != UINT32_MAX) {
     extent = caps.currentExtent;
@@ -144,8 +376,24 @@ bool Context::createSwapchainForWindow(Window* window) {
     extent.height = std::max(caps.minImageExtent.height, std::min(caps.maxImageExtent.height, extent.height));
   }
 
+  // Image count and frames in flight per profile. Low latency keeps the
+  // queue as short as possible (MAILBOX still needs a spare image to avoid
+  // blocking); throughput adds an image so the CPU never waits on present.
   uint32_t imageCount = caps.minImageCount + 1;
+  uint32_t framesInFlight = 2;
+  switch (window->presentProfile) {
+    case PresentProfile::LowLatency:
+      imageCount = std::max(2u, caps.minImageCount + (chosenPresent == VK_PRESENT_MODE_MAILBOX_KHR ? 1u : 0u));
+      framesInFlight = 1;
+      break;
+    case PresentProfile::Vsync:
+      break;
+    case PresentProfile::Throughput:
+      imageCount = std::max(3u, caps.minImageCount + 1);
+      break;
+  }
   if (caps.maxImageCount > 0 && imageCount > caps.maxImageCount) imageCount = caps.maxImageCount;
+  framesInFlight = std::min(framesInFlight, kMaxFramesInFlight);
 
   VkSwapchainCreateInfoKHR scCreate{};
   scCreate.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
@@ -156,21 +404,27 @@ bool Context::createSwapchainForWindow(Window* window) {
   scCreate.imageExtent = extent;
   scCreate.imageArrayLayers = 1;
   scCreate.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+  // The debug readback copies out of the backbuffer
+  window->swapchainTransferSrc = (caps.supportedUsageFlags & VK_IMAGE_USAGE_TRANSFER_SRC_BIT) != 0;
+  if (window->swapchainTransferSrc) scCreate.imageUsage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+  // Dynamic resolution blits its offscreen target into the backbuffer
+  window->swapchainTransferDst = window->dynamicResolution.enabled && (caps.supportedUsageFlags & VK_IMAGE_USAGE_TRANSFER_DST_BIT) != 0;
+  if (window->swapchainTransferDst) scCreate.imageUsage |= VK_IMAGE_USAGE_TRANSFER_DST_BIT;
   scCreate.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE;
   scCreate.preTransform = caps.currentTransform;
   scCreate.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
   scCreate.presentMode = chosenPresent;
   scCreate.clipped = VK_TRUE;
-  scCreate.oldSwapchain = VK_NULL_HANDLE;
+  scCreate.oldSwapchain = oldSwapchain;
 
-  VkResult r = vkCreateSwapchainKHR(device, &scCreate, nullptr, &window->swapchain);
+  VkResult r = vk.vkCreateSwapchainKHR(device, &scCreate, nullptr, &window->swapchain);
   if (r != VK_SUCCESS) return false;
 
   // Retrieve images
   uint32_t scImgCount = 0;
-  vkGetSwapchainImagesKHR(device, window->swapchain, &scImgCount, nullptr);
+  vk.vkGetSwapchainImagesKHR(device, window->swapchain, &scImgCount, nullptr);
   window->swapchainImages.resize(scImgCount);
-  vkGetSwapchainImagesKHR(device, window->swapchain, &scImgCount, window->swapchainImages.data());
+  vk.vkGetSwapchainImagesKHR(device, window->swapchain, &scImgCount, window->swapchainImages.data());
 
   // Create image views
   window->swapchainImageViews.clear();
@@ -191,45 +445,74 @@ bool Context::createSwapchainForWindow(Window* window) {
     iv.subresourceRange.baseArrayLayer = 0;
     iv.subresourceRange.layerCount = 1;
     VkImageView view;
-    if (vkCreateImageView(device, &iv, nullptr, &view) != VK_SUCCESS) return false;
+    if (vk.vkCreateImageView(device, &iv, nullptr, &view) != VK_SUCCESS) return false;
     window->swapchainImageViews.push_back(view);
   }
 
   // Remember the swapchain image format for pipeline creation
   window->swapchainFormat = chosenFormat.format;
-  std::cerr << "createSwapchainForWindow: chosenFormat=" << static_cast<int>(chosenFormat.format) << "\n";
+  window->swapchainExtent = extent;
+  window->renderExtent = extent;
+  VKLITE_LOG_DEBUG("createSwapchainForWindow: chosenFormat=%d", static_cast<int>(chosenFormat.format));
 
-  // Create command pool and buffer
+  window->presentMode = chosenPresent;
+  window->framesInFlight = framesInFlight;
+  window->presentIdCounter = 0;
+  window->pendingPresents.clear();
+
+  // Create command pool and per-frame command buffers
   VkCommandPoolCreateInfo cp{};
   cp.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
   cp.queueFamilyIndex = graphicsQueueFamily;
   cp.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
-  if (vkCreateCommandPool(device, &cp, nullptr, &window->commandPool) != VK_SUCCESS) return false;
+  if (vk.vkCreateCommandPool(device, &cp, nullptr, &window->commandPool) != VK_SUCCESS) return false;
 
+  window->frames.assign(framesInFlight, FrameResources{});
+  window->frameIndex = 0;
+  std::vector<VkCommandBuffer> cmdBufs(framesInFlight);
   VkCommandBufferAllocateInfo cbi{};
   cbi.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
   cbi.commandPool = window->commandPool;
   cbi.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-  cbi.commandBufferCount = 1;
-  if (vkAllocateCommandBuffers(device, &cbi, &window->commandBuffer) != VK_SUCCESS) return false;
+  cbi.commandBufferCount = framesInFlight;
+  if (vk.vkAllocateCommandBuffers(device, &cbi, cmdBufs.data()) != VK_SUCCESS) return false;
 
-  // Semaphores and fence
+  // Semaphores and fences. Render-finished semaphores are per image: a
+  // semaphore waited by present may only be reused once that image returns.
   VkSemaphoreCreateInfo semInfo{};
   semInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
-  vkCreateSemaphore(device, &semInfo, nullptr, &window->imageAvailableSemaphore);
-  vkCreateSemaphore(device, &semInfo, nullptr, &window->renderFinishedSemaphore);
-
   VkFenceCreateInfo fenceInfo{};
   fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
   fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
-  vkCreateFence(device, &fenceInfo, nullptr, &window->inFlightFence);
+  for (uint32_t i = 0; i < framesInFlight; ++i) {
+    FrameResources& f = window->frames[i];
+    f.commandBuffer = cmdBufs[i];
+    if (vk.vkCreateSemaphore(device, &semInfo, nullptr, &f.imageAvailable) != VK_SUCCESS) return false;
+    if (vk.vkCreateFence(device, &fenceInfo, nullptr, &f.inFlight) != VK_SUCCESS) return false;
+  }
+  window->renderFinishedSemaphores.assign(scImgCount, VK_NULL_HANDLE);
+  for (auto& sem : window->renderFinishedSemaphores) {
+    if (vk.vkCreateSemaphore(device, &semInfo, nullptr, &sem) != VK_SUCCESS) return false;
+  }
 
   // Dynamic rendering requires device-level function pointers
-  if (!vkCmdBeginRenderingKHR || !vkCmdEndRenderingKHR) {
+  if (!vk.vkCmdBeginRenderingKHR || !vk.vkCmdEndRenderingKHR) {
     // We expect dynamic rendering function pointers to be loaded; fail if not present
     return false;
   }
 
+  // GPU timing for dynamic resolution: a begin/end timestamp pair per frame
+  if (window->dynamicResolution.enabled && timestampValidBits != 0) {
+    VkQueryPoolCreateInfo qpi{};
+    qpi.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    qpi.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    qpi.queryCount = 2 * framesInFlight;
+    if (vk.vkCreateQueryPool(device, &qpi, nullptr, &window->timestampPool) != VK_SUCCESS) window->timestampPool = VK_NULL_HANDLE;
+  }
+
+  // Depth attachment (and Hi-Z pyramid) follow the swapchain extent
+  if (window->depthEnabled && !createDepthResources(window)) return false;
+
   return true;
 }
 
@@ -244,213 +527,510 @@ void Context::destroySwapchainForWindow(Window* window) {
     return;
   }
 
-  // Wait for device idle before destroying per-window resources
-  vkDeviceWaitIdle(device);
-  for (auto iv : window->swapchainImageViews) {
-    if (iv != VK_NULL_HANDLE) vkDestroyImageView(device, iv, nullptr);
+  // Captured frames still in flight are written out before the frame
+  // resources go
+  if (window->capture) flushCaptureFrames(window);
+
+  // Without a timeline semaphore completion is read from this window's
+  // fences, which are about to go: wait for its own frames only.
+  if (!timelineSemaphoreSupported) {
+    std::vector<VkFence> fences;
+    for (auto& f : window->frames) {
+      if (f.inFlight != VK_NULL_HANDLE && f.submitSerial != 0) fences.push_back(f.inFlight);
+    }
+    if (!fences.empty()) vk.vkWaitForFences(device, static_cast<uint32_t>(fences.size()), fences.data(), VK_TRUE, UINT64_MAX);
   }
-  window->swapchainImageViews.clear();
-  if (window->commandPool != VK_NULL_HANDLE) {
-    vkDestroyCommandPool(device, window->commandPool, nullptr);
-    window->commandPool = VK_NULL_HANDLE;
-  }
-  if (window->imageAvailableSemaphore != VK_NULL_HANDLE) vkDestroySemaphore(device, window->imageAvailableSemaphore, nullptr);
-  if (window->renderFinishedSemaphore != VK_NULL_HANDLE) vkDestroySemaphore(device, window->renderFinishedSemaphore, nullptr);
-  if (window->inFlightFence != VK_NULL_HANDLE) vkDestroyFence(device, window->inFlightFence, nullptr);
-  if (window->swapchain != VK_NULL_HANDLE) {
-    vkDestroySwapchainKHR(device, window->swapchain, nullptr);
-    window->swapchain = VK_NULL_HANDLE;
+
+  // Frames in flight may still use everything below; hand it to the
+  // deletion queue instead of idling the device.
+  destroyDepthResources(window);
+  VkDevice dev = device;
+  std::vector<VkImageView> views;
+  views.swap(window->swapchainImageViews);
+  std::vector<VkSemaphore> semaphores;
+  semaphores.swap(window->renderFinishedSemaphores);
+  std::vector<VkFence> fences;
+  for (auto& f : window->frames) {
+    semaphores.push_back(f.imageAvailable);
+    fences.push_back(f.inFlight);
   }
+  window->frames.clear();
+  VkCommandPool pool = window->commandPool;
+  VkSwapchainKHR swapchain = window->swapchain;
+  VkQueryPool timestamps = window->timestampPool;
+  window->commandPool = VK_NULL_HANDLE;
+  window->swapchain = VK_NULL_HANDLE;
+  window->timestampPool = VK_NULL_HANDLE;
   window->swapchainImages.clear();
+  window->cachedCommands.clear();  // freed with the pool
+  if (window->debugStagingBuffer != VK_NULL_HANDLE) {
+    VkBuffer staging = window->debugStagingBuffer;
+    VkDeviceMemory stagingMemory = window->debugStagingMemory;
+    window->debugStagingBuffer = VK_NULL_HANDLE;
+    window->debugStagingMemory = VK_NULL_HANDLE;
+    deferDestroy([this, dev, staging, stagingMemory] {
+      vk.vkDestroyBuffer(dev, staging, nullptr);
+      freeMemory(stagingMemory);
+    });
+  }
+  deferDestroy([this, dev, views, semaphores, fences, pool, swapchain, timestamps] {
+    for (auto iv : views) {
+      if (iv != VK_NULL_HANDLE) vk.vkDestroyImageView(dev, iv, nullptr);
+    }
+    if (pool != VK_NULL_HANDLE) vk.vkDestroyCommandPool(dev, pool, nullptr);
+    for (auto sem : semaphores) {
+      if (sem != VK_NULL_HANDLE) vk.vkDestroySemaphore(dev, sem, nullptr);
+    }
+    for (auto fence : fences) {
+      if (fence != VK_NULL_HANDLE) vk.vkDestroyFence(dev, fence, nullptr);
+    }
+    if (swapchain != VK_NULL_HANDLE) vk.vkDestroySwapchainKHR(dev, swapchain, nullptr);
+    if (timestamps != VK_NULL_HANDLE) vk.vkDestroyQueryPool(dev, timestamps, nullptr);
+  });
 }
 
-// Minimal per-window render: acquire, clear via render pass, present
-void Context::renderWindow(Window* window) {
-  if (!window || window->swapchain == VK_NULL_HANDLE) return;
+bool Context::recreateSwapchainForWindow(Window* window) {
+  if (!window || !window->handle) return false;
+  const int fbw = window->framebufferWidth;
+  const int fbh = window->framebufferHeight;
+  if (fbw == 0 || fbh == 0) return false; // minimized; try again after restore
+  VKLITE_TRACE_ZONE("recreateSwapchain");
+  // Hand the old swapchain to the new one so presentation continues; it is
+  // destroyed through the deletion queue with the rest.
+  VkSwapchainKHR oldSwapchain = window->swapchain;
+  window->swapchain = VK_NULL_HANDLE;
+  destroySwapchainForWindow(window);
+  const bool created = createSwapchainForWindow(window, oldSwapchain);
+  if (oldSwapchain != VK_NULL_HANDLE) {
+    VkDevice dev = device;
+    deferDestroy([this, dev, oldSwapchain] { vk.vkDestroySwapchainKHR(dev, oldSwapchain, nullptr); });
+  }
+  if (!created) {
+    VKLITE_LOG_ERROR("recreateSwapchainForWindow: failed to recreate swapchain");
+    return false;
+  }
+  window->width = fbw;
+  window->height = fbh;
+  window->swapchainOutOfDate = false;
+  window->dirty = true;
+  return true;
+}
 
-  if (!vkCmdBeginRenderingKHR || !vkCmdEndRenderingKHR) return; // dynamic rendering required
+namespace {
 
-  // Wait for previous frame
-  vkWaitForFences(device, 1, &window->inFlightFence, VK_TRUE, UINT64_MAX);
-  vkResetFences(device, 1, &window->inFlightFence);
+// Bounded so a hidden or occluded window cannot stall the whole loop
+constexpr uint64_t kAcquireTimeoutNs = 100ull * 1000 * 1000;
+constexpr uint64_t kPresentWaitTimeoutNs = 50ull * 1000 * 1000;
+constexpr size_t kMaxPendingPresents = 8;
 
-  uint32_t imageIndex = 0;
-  VkResult r = vkAcquireNextImageKHR(device, window->swapchain, UINT64_MAX, window->imageAvailableSemaphore, VK_NULL_HANDLE, &imageIndex);
-  if (r != VK_SUCCESS && r != VK_SUBOPTIMAL_KHR) {
-    std::cerr << "vkAcquireNextImageKHR failed result=" << r << "\n";
+// Frames after a swapchain rebuild during which the graph, frame arena and
+// per-window arrays are still growing to their steady-state sizes
+constexpr uint32_t kSteadyStateFrames = 8;
+
+// Counts the heap allocations made by one renderWindow call (only with
+// VKLITE_COUNT_ALLOCATIONS) and adds them to `total`. Capture and debug
+// readback frames are exempt.
+class FrameAllocationCheck {
+public:
+  FrameAllocationCheck(const Context& ctx, Window* window, uint64_t& total)
+      : ctx_(ctx), window_(window), total_(total), start_(threadAllocationCount()) {}
+  ~FrameAllocationCheck() {
+    const uint64_t count = threadAllocationCount() - start_;
+    total_ += count;
+    window_->frameAllocations = count;
+    const bool steady = window_->steadyFrames >= kSteadyStateFrames && !window_->capture && !ctx_.debugReadback;
+    if (window_->steadyFrames < kSteadyStateFrames) ++window_->steadyFrames;
+    if (!steady || count == 0) return;
+    window_->steadyStateAllocations += count;
+    VKLITE_LOG_WARN("renderWindow: %llu heap allocation(s) in a steady-state frame of '%s'", static_cast<unsigned long long>(count), window_->title.c_str());
+    if (ctx_.failOnFrameAllocations) {
+      flushLog();
+      std::abort();
+    }
+  }
+
+private:
+  const Context& ctx_;
+  Window* window_;
+  uint64_t& total_;
+  uint64_t start_;
+};
+
+void recordLatency(PresentLatencyStats& stats, double seconds, bool atPresent) {
+  const double ms = seconds * 1000.0;
+  stats.lastMs = ms;
+  stats.averageMs = stats.samples == 0 ? ms : stats.averageMs + 0.1 * (ms - stats.averageMs);
+  stats.maxMs = std::max(stats.maxMs, ms);
+  stats.measuredAtPresent = atPresent;
+  ++stats.samples;
+}
+
+} // namespace
+
+// Every window that can render has settled, and none is capturing
+bool Context::windowsInSteadyState() const {
+  if (debugReadback) return false;
+  for (const auto& w : windows) {
+    if (!w || !w->handle || windowHidden(w.get())) continue;
+    if (w->steadyFrames < kSteadyStateFrames || w->capture) return false;
+  }
+  return true;
+}
+
+Context::LoopAllocationCheck Context::beginLoopAllocationCheck() const {
+  LoopAllocationCheck check;
+  check.start = threadAllocationCount();
+  check.renderStart = renderWindowAllocations;
+  check.steady = windowsInSteadyState();
+  return check;
+}
+
+// Allocations of the iteration outside renderWindow, which already reported
+// its own; windows created or rebuilt meanwhile make it non-steady
+void Context::endLoopAllocationCheck(const LoopAllocationCheck& check) {
+  const uint64_t count = threadAllocationCount() - check.start - (renderWindowAllocations - check.renderStart);
+  if (!check.steady || count == 0 || !windowsInSteadyState()) return;
+  steadyStateLoopAllocations += count;
+  VKLITE_LOG_WARN("main loop: %llu heap allocation(s) outside renderWindow in a steady-state iteration", static_cast<unsigned long long>(count));
+  if (failOnFrameAllocations) {
+    flushLog();
+    std::abort();
+  }
+}
+
+bool Context::setPresentProfile(Window* window, PresentProfile profile) {
+  if (!window) return false;
+  if (window->presentProfile == profile && window->swapchain != VK_NULL_HANDLE) return true;
+  window->presentProfile = profile;
+  window->swapchainOutOfDate = true;
+  return recreateSwapchainForWindow(window);
+}
+
+PresentLatencyStats Context::getPresentLatency(const Window* window) const {
+  return window ? window->latency : PresentLatencyStats{};
+}
+
+void Context::waitForFrameSlot(Window* window) {
+  if (!window || window->frames.empty()) return;
+  VKLITE_TRACE_ZONE("waitForFrameSlot");
+  FrameResources& frame = window->frames[window->frameIndex];
+  vk.vkWaitForFences(device, 1, &frame.inFlight, VK_TRUE, UINT64_MAX);
+  // Keep at most one frame queued for display
+  if (presentWaitSupported && vk.vkWaitForPresentKHR && !window->pendingPresents.empty()) {
+    vk.vkWaitForPresentKHR(device, window->swapchain, window->pendingPresents.back().presentId, kPresentWaitTimeoutNs);
+  }
+  updatePresentLatency(window);
+}
+
+void Context::updatePresentLatency(Window* window) {
+  const double now = glfwGetTime();
+  if (presentWaitSupported && vk.vkWaitForPresentKHR) {
+    // Present ids complete in order; stop at the first one still queued
+    size_t done = 0;
+    for (; done < window->pendingPresents.size(); ++done) {
+      const auto& p = window->pendingPresents[done];
+      if (vk.vkWaitForPresentKHR(device, window->swapchain, p.presentId, 0) != VK_SUCCESS) break;
+      recordLatency(window->latency, now - p.inputTime, true);
+    }
+    window->pendingPresents.erase(window->pendingPresents.begin(), window->pendingPresents.begin() + done);
     return;
   }
+  for (auto& f : window->frames) {
+    if (f.pendingLatency && vk.vkGetFenceStatus(device, f.inFlight) == VK_SUCCESS) {
+      recordLatency(window->latency, now - f.inputTime, false);
+      f.pendingLatency = false;
+    }
+  }
+}
+
+// Build the frame's render graph and record it into `cmd`. `timed` brackets
+// it with the slot's GPU timestamps (dynamic resolution).
+void Context::recordFrameCommands(Window* window, VkCommandBuffer cmd, uint32_t imageIndex, uint32_t frameSlot, VkBuffer stagingBuffer,
+                                  int captureSlot, bool timed, VkCommandBufferUsageFlags usage) {
+  const VkExtent2D extent = window->swapchainExtent;
+  // Describe the frame as a graph; it derives every layout transition and
+  // dependency from the declared accesses and batches them per pass.
+  if (!window->graph) window->graph = std::make_unique<RenderGraph>(*this);
+  RenderGraph& graph = *window->graph;
+  graph.reset();
+  // The acquire semaphore is waited at COLOR_ATTACHMENT_OUTPUT, so the first
+  // barrier chains to that stage; old contents are cleared anyway.
+  RGResource color = graph.importImage("backbuffer", window->swapchainImages[imageIndex], window->swapchainImageViews[imageIndex],
+                                       VK_IMAGE_ASPECT_COLOR_BIT, 1, VK_IMAGE_LAYOUT_UNDEFINED,
+                                       VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT, 0);
+  RGResource depth = kInvalidRGResource;
+  if (window->depthView != VK_NULL_HANDLE) {
+    // Shared by all frames in flight: wait for last frame's depth writes and Hi-Z reads
+    depth = graph.importImage("depth", window->depthImage, window->depthView, VK_IMAGE_ASPECT_DEPTH_BIT, 1, VK_IMAGE_LAYOUT_UNDEFINED,
+                              VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+                              VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT);
+  }
+
+  // With dynamic resolution the main pass draws into part of an offscreen
+  // target that is upscaled into the backbuffer below
+  const bool scaled = dynamicResolutionActive(window);
+  RGResource target = color;
+  if (scaled) {
+    RGImageDesc sceneDesc;
+    sceneDesc.format = window->swapchainFormat;
+    sceneDesc.extent = window->swapchainExtent;
+    target = graph.createImage("scene", sceneDesc);
+  }
+
+  auto mainPass = graph.addPass("main", [this, window, &graph, target](VkCommandBuffer cb) {
+    VkRenderingAttachmentInfoKHR colorAtt{};
+    colorAtt.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO_KHR;
+    colorAtt.imageView = graph.view(target);
+    colorAtt.imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    VkClearValue clearColor{};
+    for (int i = 0; i < 4; ++i) clearColor.color.float32[i] = window->clearColor[i];
+    colorAtt.clearValue = clearColor;
+    // Use clear as the load operation and store results to the image
+    colorAtt.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+    colorAtt.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+
+    VkRenderingInfoKHR ri{};
+    ri.sType = VK_STRUCTURE_TYPE_RENDERING_INFO_KHR;
+    ri.flags = 0;
+    ri.renderArea.offset = {0,0};
+    // Render to the swapchain's extent (scaled by dynamic resolution); the
+    // framebuffer may already have a new size that will be picked up when
+    // the swapchain is recreated.
+    ri.renderArea.extent = window->renderExtent;
+    ri.layerCount = 1;
+    ri.colorAttachmentCount = 1;
+    ri.pColorAttachments = &colorAtt;
+
+    VkRenderingAttachmentInfoKHR depthAtt{};
+    if (window->depthView != VK_NULL_HANDLE) {
+      depthAtt.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO_KHR;
+      depthAtt.imageView = window->depthView;
+      depthAtt.imageLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+      depthAtt.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+      // Only keep depth around when the pyramid is built from it
+      depthAtt.storeOp = window->hizEnabled ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+      depthAtt.clearValue.depthStencil.depth = 1.0f;
+      depthAtt.clearValue.depthStencil.stencil = 0;
+      ri.pDepthAttachment = &depthAtt;
+    }
+
+    // Begin/End dynamic rendering via loaded function pointers
+    vk.vkCmdBeginRenderingKHR(cb, &ri);
+    // If the application attached a pipeline to this window, record its draw commands.
+    if (window->pipeline) {
+      Context::Pipeline* p = reinterpret_cast<Context::Pipeline*>(window->pipeline);
+      // Use the convenience helper to record bind + draw
+      this->recordPipelineDraw(p, window, cb);
+    }
+    vk.vkCmdEndRenderingKHR(cb);
+  });
+  mainPass.write(target, RGAccess::ColorAttachment);
+  if (depth != kInvalidRGResource) mainPass.write(depth, RGAccess::DepthAttachment);
+
+  if (scaled) {
+    const VkImage backbuffer = window->swapchainImages[imageIndex];
+    const VkExtent2D src = window->renderExtent;
+    const VkExtent2D dst = window->swapchainExtent;
+    const VkFilter filter = window->dynamicResolution.filter;
+    graph.addPass("upscale", [this, &graph, target, backbuffer, src, dst, filter](VkCommandBuffer cb) {
+      VkImageBlit blit{};
+      blit.srcSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+      blit.srcOffsets[1] = { static_cast<int32_t>(src.width), static_cast<int32_t>(src.height), 1 };
+      blit.dstSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+      blit.dstOffsets[1] = { static_cast<int32_t>(dst.width), static_cast<int32_t>(dst.height), 1 };
+      vk.vkCmdBlitImage(cb, graph.image(target), VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, backbuffer, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &blit, filter);
+    })
+        .read(target, RGAccess::TransferRead)
+        .write(color, RGAccess::TransferWrite);
+  }
+
+  // Build this frame's depth pyramid for next frame's occlusion tests
+  if (window->hizEnabled && depth != kInvalidRGResource && window->hizImage != VK_NULL_HANDLE) {
+    RGResource pyramid = graph.importImage("hiz", window->hizImage, window->hizView, VK_IMAGE_ASPECT_COLOR_BIT, window->hizLevels,
+                                           VK_IMAGE_LAYOUT_UNDEFINED, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_2_TRANSFER_BIT,
+                                           VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT);
+    graph.addPass("hiz", [this, window](VkCommandBuffer cb) { recordHiZBuild(window, cb); })
+        .read(depth, RGAccess::ComputeSampled)
+        .write(pyramid, RGAccess::ComputeStorageWrite)
+        .sideEffect(); // consumed by the CPU readback and the next frame
+  }
+
+  if (window->buildGraph) window->buildGraph(graph, color, depth);
+
+  // For debugging: copy the backbuffer to the staging buffer before presenting
+  if (stagingBuffer != VK_NULL_HANDLE) {
+    RGResource staging = graph.importBuffer("debug-staging", stagingBuffer, VK_PIPELINE_STAGE_2_NONE, 0);
+    graph.addPass("debug-readback", [this, window, imageIndex, stagingBuffer, extent](VkCommandBuffer cb) {
+      VkBufferImageCopy bic{};
+      bic.bufferOffset = 0;
+      bic.bufferRowLength = 0;
+      bic.bufferImageHeight = 0;
+      bic.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+      bic.imageSubresource.mipLevel = 0;
+      bic.imageSubresource.baseArrayLayer = 0;
+      bic.imageSubresource.layerCount = 1;
+      bic.imageOffset = {0,0,0};
+      bic.imageExtent = { extent.width, extent.height, 1 };
+      vk.vkCmdCopyImageToBuffer(cb, window->swapchainImages[imageIndex], VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, stagingBuffer, 1, &bic);
+    })
+        .read(color, RGAccess::TransferRead)
+        .write(staging, RGAccess::TransferWrite);
+    graph.markOutput(staging, RGAccess::HostRead);
+  }
+  // Frame capture: copy the finished backbuffer into a free readback slot
+  if (captureSlot >= 0) recordCaptureCopy(window, graph, color, imageIndex, captureSlot);
+  graph.markOutput(color, RGAccess::Present);
 
-  // Record command buffer: transition image layout and begin dynamic rendering
+  // Record command buffer
   VkCommandBufferBeginInfo bi{};
   bi.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-  vkResetCommandBuffer(window->commandBuffer, 0);
-  vkBeginCommandBuffer(window->commandBuffer, &bi);
-
-  VkImageMemoryBarrier barrier{};
-  barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-  barrier.srcAccessMask = 0;
-  barrier.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-  barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-  barrier.newLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-  barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-  barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-  barrier.image = window->swapchainImages[imageIndex];
-  barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-  barrier.subresourceRange.baseMipLevel = 0;
-  barrier.subresourceRange.levelCount = 1;
-  barrier.subresourceRange.baseArrayLayer = 0;
-  barrier.subresourceRange.layerCount = 1;
-
-  vkCmdPipelineBarrier(window->commandBuffer,
-                       VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
-                       VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
-                       0, 0, nullptr, 0, nullptr, 1, &barrier);
-
-  VkRenderingAttachmentInfoKHR colorAtt{};
-  colorAtt.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO_KHR;
-  colorAtt.imageView = window->swapchainImageViews[imageIndex];
-  colorAtt.imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-  // Always clear to opaque red for presentation test
-  VkClearValue clearColor{};
-  clearColor.color.float32[0] = 1.0f;
-  clearColor.color.float32[1] = 0.0f;
-  clearColor.color.float32[2] = 0.0f;
-  clearColor.color.float32[3] = 1.0f;
-  colorAtt.clearValue = clearColor;
-  // Use clear as the load operation and store results to the image
-  colorAtt.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-  colorAtt.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-
-  VkRenderingInfoKHR ri{};
-  ri.sType = VK_STRUCTURE_TYPE_RENDERING_INFO_KHR;
-  ri.flags = 0;
-  ri.renderArea.offset = {0,0};
-  int fbw=0, fbh=0;
-  if (window->handle) glfwGetFramebufferSize(static_cast<GLFWwindow*>(window->handle), &fbw, &fbh);
-  ri.renderArea.extent = { static_cast<uint32_t>(fbw>0?fbw:window->width), static_cast<uint32_t>(fbh>0?fbh:window->height) };
-  ri.layerCount = 1;
-  ri.colorAttachmentCount = 1;
-  ri.pColorAttachments = &colorAtt;
-
-  // Create a small host-visible staging buffer to copy the swapchain image into
-  // so we can inspect pixels for debugging.
-  VkBuffer stagingBuffer = VK_NULL_HANDLE;
-  VkDeviceMemory stagingMemory = VK_NULL_HANDLE;
-  VkDeviceSize imageSize = static_cast<VkDeviceSize>(ri.renderArea.extent.width) * ri.renderArea.extent.height * 4; // RGBA8
+  bi.flags = usage;
   {
+    VKLITE_TRACE_ZONE("recordCommands");
+    vk.vkResetCommandBuffer(cmd, 0);
+    vk.vkBeginCommandBuffer(cmd, &bi);
+    if (timed) {
+      vk.vkCmdResetQueryPool(cmd, window->timestampPool, 2 * frameSlot, 2);
+      vk.vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, window->timestampPool, 2 * frameSlot);
+    }
+    graph.execute(cmd);
+    if (timed) vk.vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, window->timestampPool, 2 * frameSlot + 1);
+    vk.vkEndCommandBuffer(cmd);
+  }
+}
+
+// A failed vkQueueSubmit leaves the frame's fence reset and its acquire
+// semaphore pending. Consume the semaphore with an empty submit that signals
+// the fence; if even that fails, replace the fence with a signaled one. Either
+// way the next wait on the slot returns and its last serial completes.
+void Context::recoverFailedSubmit(FrameResources& frame) {
+  VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+  VkSubmitInfo empty{};
+  empty.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+  empty.waitSemaphoreCount = 1;
+  empty.pWaitSemaphores = &frame.imageAvailable;
+  empty.pWaitDstStageMask = &waitStage;
+  if (vk.vkQueueSubmit(graphicsQueue, 1, &empty, frame.inFlight) == VK_SUCCESS) return;
+  VkFenceCreateInfo fenceInfo{};
+  fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+  fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+  VkFence fence = VK_NULL_HANDLE;
+  if (vk.vkCreateFence(device, &fenceInfo, nullptr, &fence) != VK_SUCCESS) {
+    VKLITE_LOG_ERROR("could not replace the fence of a failed submission");
+    return;
+  }
+  // Neither submit took the old fence, so nothing on the GPU references it
+  vk.vkDestroyFence(device, frame.inFlight, nullptr);
+  frame.inFlight = fence;
+}
+
+// Minimal per-window render: acquire, clear via dynamic rendering, present
+void Context::renderWindow(Window* window) {
+  if (!window || window->swapchain == VK_NULL_HANDLE || window->frames.empty()) return;
+
+  if (!vk.vkCmdBeginRenderingKHR || !vk.vkCmdEndRenderingKHR) return; // dynamic rendering required
+  VKLITE_TRACE_ZONE("renderWindow");
+  FrameAllocationCheck allocationCheck(*this, window, renderWindowAllocations);
+
+  updatePresentLatency(window);
+
+  // Wait until this frame slot's previous submission has finished
+  const uint32_t frameSlot = window->frameIndex;
+  FrameResources& frame = window->frames[frameSlot];
+  VkCommandBuffer cmd = frame.commandBuffer;
+  {
+    VKLITE_TRACE_ZONE("waitForFence");
+    // Alone, a window waits for its frame slot; next to other due windows
+    // it gives up after a short wait and is retried next iteration
+    const uint64_t timeout = manyWindowsDue ? kSharedFrameWaitNs : UINT64_MAX;
+    if (vk.vkWaitForFences(device, 1, &frame.inFlight, VK_TRUE, timeout) == VK_TIMEOUT) {
+      ++window->framesSkipped;
+      window->dirty = true;
+      return;
+    }
+  }
+  // That submission's pyramid readback is now complete
+  if (frame.hizSlot >= 0) {
+    window->hizReadableSlot = frame.hizSlot;
+    frame.hizSlot = -1;
+  }
+  // Likewise its frame capture copy
+  if (frame.captureSlot >= 0) completeCaptureFrame(window, frame);
+  // and its GPU time, which picks this frame's render resolution
+  updateDynamicResolution(window, frame, frameSlot);
+
+  uint32_t imageIndex = 0;
+  VkResult r = VK_SUCCESS;
+  {
+    VKLITE_TRACE_ZONE("acquireNextImage");
+    r = vk.vkAcquireNextImageKHR(device, window->swapchain, manyWindowsDue ? kSharedFrameWaitNs : kAcquireTimeoutNs, frame.imageAvailable,
+                                 VK_NULL_HANDLE, &imageIndex);
+  }
+  if (r == VK_ERROR_OUT_OF_DATE_KHR) {
+    // Nothing was submitted; the fence stays signaled for the retry
+    window->swapchainOutOfDate = true;
+    window->dirty = true;
+    return;
+  }
+  if (r == VK_TIMEOUT || r == VK_NOT_READY) {
+    // No image yet (e.g. occluded window); try again next iteration
+    ++window->framesSkipped;
+    window->dirty = true;
+    return;
+  }
+  if (r != VK_SUCCESS && r != VK_SUBOPTIMAL_KHR) {
+    VKLITE_LOG_ERROR("vkAcquireNextImageKHR failed result=%d", static_cast<int>(r));
+    return;
+  }
+  frame.inputTime = window->inputSampleTime > 0.0 ? window->inputSampleTime : glfwGetTime();
+
+  // Host-visible staging buffer the debug readback copies the backbuffer
+  // into; created on first use and kept with the swapchain
+  const VkExtent2D extent = window->swapchainExtent;
+  VkDeviceSize imageSize = static_cast<VkDeviceSize>(extent.width) * extent.height * 4; // RGBA8
+  if (this->debugReadback && window->debugStagingBuffer == VK_NULL_HANDLE) {
+    VkBuffer stagingBuffer = VK_NULL_HANDLE;
+    VkDeviceMemory stagingMemory = VK_NULL_HANDLE;
     VkBufferCreateInfo bci{};
     bci.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
     bci.size = imageSize;
     bci.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
     bci.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-    if (vkCreateBuffer(device, &bci, nullptr, &stagingBuffer) != VK_SUCCESS) {
-      stagingBuffer = VK_NULL_HANDLE;
-    }
-  }
-  if (stagingBuffer != VK_NULL_HANDLE) {
-    VkMemoryRequirements req{};
-    vkGetBufferMemoryRequirements(device, stagingBuffer, &req);
-    VkMemoryAllocateInfo mai{};
-    mai.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    mai.allocationSize = req.size;
-    // Find a host visible memory type
-    VkPhysicalDeviceMemoryProperties memProps{};
-    vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memProps);
-    uint32_t memTypeIndex = UINT32_MAX;
-    for (uint32_t i = 0; i < memProps.memoryTypeCount; ++i) {
-      if ((req.memoryTypeBits & (1u << i)) && (memProps.memoryTypes[i].propertyFlags & (VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT)) == (VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT)) {
-        memTypeIndex = i;
-        break;
-      }
-    }
-    if (memTypeIndex == UINT32_MAX) {
-      // try any host visible
-      for (uint32_t i = 0; i < memProps.memoryTypeCount; ++i) {
-        if ((req.memoryTypeBits & (1u << i)) && (memProps.memoryTypes[i].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)) {
-          memTypeIndex = i; break;
-        }
-      }
-    }
-    if (memTypeIndex != UINT32_MAX) {
-      mai.memoryTypeIndex = memTypeIndex;
-      if (vkAllocateMemory(device, &mai, nullptr, &stagingMemory) != VK_SUCCESS) {
-        vkDestroyBuffer(device, stagingBuffer, nullptr);
+    if (vk.vkCreateBuffer(device, &bci, nullptr, &stagingBuffer) == VK_SUCCESS) {
+      VkMemoryRequirements req{};
+      vk.vkGetBufferMemoryRequirements(device, stagingBuffer, &req);
+      VkMemoryAllocateInfo mai{};
+      mai.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+      mai.allocationSize = req.size;
+      mai.memoryTypeIndex = findMemoryType(req.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+      if (mai.memoryTypeIndex == UINT32_MAX || allocateMemory(mai, MemoryCategory::Staging, &stagingMemory) != VK_SUCCESS) {
+        vk.vkDestroyBuffer(device, stagingBuffer, nullptr);
         stagingBuffer = VK_NULL_HANDLE;
         stagingMemory = VK_NULL_HANDLE;
       } else {
-        vkBindBufferMemory(device, stagingBuffer, stagingMemory, 0);
+        vk.vkBindBufferMemory(device, stagingBuffer, stagingMemory, 0);
       }
-    } else {
-      // no suitable memory type found
-      vkDestroyBuffer(device, stagingBuffer, nullptr);
-      stagingBuffer = VK_NULL_HANDLE;
     }
+    window->debugStagingBuffer = stagingBuffer;
+    window->debugStagingMemory = stagingMemory;
   }
+  const VkBuffer stagingBuffer = this->debugReadback ? window->debugStagingBuffer : VK_NULL_HANDLE;
 
-  // Begin/End dynamic rendering via loaded function pointers
-  this->vkCmdBeginRenderingKHR(window->commandBuffer, &ri);
-  // If the application attached a pipeline to this window, record its draw commands.
-  if (window->pipeline) {
-    Context::Pipeline* p = reinterpret_cast<Context::Pipeline*>(window->pipeline);
-    // Use the convenience helper to record bind + draw
-    this->recordPipelineDraw(p, window, window->commandBuffer);
-  }
-  this->vkCmdEndRenderingKHR(window->commandBuffer);
-
-  // For debugging: copy image to staging buffer (if available) before presenting.
-  if (stagingBuffer != VK_NULL_HANDLE) {
-    // Transition image from COLOR_ATTACHMENT_OPTIMAL -> TRANSFER_SRC_OPTIMAL
-    VkImageMemoryBarrier copyBarrier = barrier;
-    copyBarrier.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-    copyBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
-    copyBarrier.oldLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-    copyBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
-    vkCmdPipelineBarrier(window->commandBuffer,
-                         VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
-                         VK_PIPELINE_STAGE_TRANSFER_BIT,
-                         0, 0, nullptr, 0, nullptr, 1, &copyBarrier);
-
-    VkBufferImageCopy bic{};
-    bic.bufferOffset = 0;
-    bic.bufferRowLength = 0;
-    bic.bufferImageHeight = 0;
-    bic.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-    bic.imageSubresource.mipLevel = 0;
-    bic.imageSubresource.baseArrayLayer = 0;
-    bic.imageSubresource.layerCount = 1;
-    bic.imageOffset = {0,0,0};
-    bic.imageExtent = { ri.renderArea.extent.width, ri.renderArea.extent.height, 1 };
-
-    vkCmdCopyImageToBuffer(window->commandBuffer, window->swapchainImages[imageIndex], VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, stagingBuffer, 1, &bic);
-
-    // Transition image from TRANSFER_SRC_OPTIMAL -> PRESENT_SRC_KHR
-    VkImageMemoryBarrier presBarrier = copyBarrier;
-    presBarrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
-    presBarrier.dstAccessMask = 0;
-    presBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
-    presBarrier.newLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
-    vkCmdPipelineBarrier(window->commandBuffer,
-                         VK_PIPELINE_STAGE_TRANSFER_BIT,
-                         VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
-                         0, 0, nullptr, 0, nullptr, 1, &presBarrier);
+  // Frame capture claims a readback slot before recording
+  const int captureSlot = window->capture ? beginCaptureFrame(window) : -1;
+  const bool timed = dynamicResolutionActive(window) && window->timestampPool != VK_NULL_HANDLE;
+  // Static windows resubmit a command buffer cached per swapchain image
+  // (Window::cacheCommandBuffers); the rest record the frame slot's buffer
+  VkCommandBuffer submitCmd = cmd;
+  if (commandCachingActive(window)) {
+    submitCmd = cachedFrameCommands(window, imageIndex, frameSlot);
   } else {
-    // No staging buffer available; transition directly to present
-    barrier.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-    barrier.dstAccessMask = 0;
-    barrier.oldLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-    barrier.newLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
-    vkCmdPipelineBarrier(window->commandBuffer,
-                         VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
-                         VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
-                         0, 0, nullptr, 0, nullptr, 1, &barrier);
+    recordFrameCommands(window, cmd, imageIndex, frameSlot, stagingBuffer, captureSlot, timed, 0);
   }
 
-  vkEndCommandBuffer(window->commandBuffer);
-
-  VkSemaphore waitSemaphores[] = { window->imageAvailableSemaphore };
+  VkSemaphore waitSemaphores[] = { frame.imageAvailable };
   VkPipelineStageFlags waitStages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
-  VkSemaphore signalSemaphores[] = { window->renderFinishedSemaphore };
+  VkSemaphore signalSemaphores[] = { window->renderFinishedSemaphores[imageIndex] };
 
   VkSubmitInfo submit{};
   submit.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
@@ -458,15 +1038,46 @@ void Context::renderWindow(Window* window) {
   submit.pWaitSemaphores = waitSemaphores;
   submit.pWaitDstStageMask = waitStages;
   submit.commandBufferCount = 1;
-  submit.pCommandBuffers = &window->commandBuffer;
+  submit.pCommandBuffers = &submitCmd;
   submit.signalSemaphoreCount = 1;
   submit.pSignalSemaphores = signalSemaphores;
 
-  VkResult submitRes = vkQueueSubmit(graphicsQueue, 1, &submit, window->inFlightFence);
+  // Also signal the context timeline with this submission's serial (the
+  // value is ignored for the binary render-finished semaphore)
+  const uint64_t serial = submitSerial + 1;
+  VkSemaphore timelineSignal[] = { signalSemaphores[0], submitTimeline };
+  const uint64_t signalValues[] = { 0, serial };
+  VkTimelineSemaphoreSubmitInfo timelineInfo{};
+  if (submitTimeline != VK_NULL_HANDLE) {
+    timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+    timelineInfo.signalSemaphoreValueCount = 2;
+    timelineInfo.pSignalSemaphoreValues = signalValues;
+    submit.pNext = &timelineInfo;
+    submit.signalSemaphoreCount = 2;
+    submit.pSignalSemaphores = timelineSignal;
+  }
+
+  VkResult submitRes = VK_SUCCESS;
+  {
+    VKLITE_TRACE_ZONE("queueSubmit");
+    // Reset only right before the submit, so every earlier return leaves the
+    // fence signaled for the next wait
+    vk.vkResetFences(device, 1, &frame.inFlight);
+    submitRes = vk.vkQueueSubmit(graphicsQueue, 1, &submit, frame.inFlight);
+  }
   if (submitRes != VK_SUCCESS) {
-    std::cerr << "vkQueueSubmit failed result=" << submitRes << "\n";
+    VKLITE_LOG_ERROR("vkQueueSubmit failed result=%d", static_cast<int>(submitRes));
+    cancelCaptureFrame(window, captureSlot);
+    recoverFailedSubmit(frame);
     return;
   }
+  frame.pendingLatency = !presentWaitSupported;
+  ++window->framesRendered;
+  submitSerial = serial;
+  frame.submitSerial = serial;
+  frame.captureSlot = captureSlot;
+  frame.timestampsWritten = timed;
+  window->frameIndex = (window->frameIndex + 1) % static_cast<uint32_t>(window->frames.size());
 
   VkPresentInfoKHR present{};
   present.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
@@ -476,19 +1087,42 @@ void Context::renderWindow(Window* window) {
   present.pSwapchains = &window->swapchain;
   present.pImageIndices = &imageIndex;
 
-  VkResult presRes = vkQueuePresentKHR(graphicsQueue, &present);
-  if (presRes != VK_SUCCESS) {
-    std::cerr << "vkQueuePresentKHR failed result=" << presRes << "\n";
+  // Tag the present so its completion can be observed with vkWaitForPresentKHR
+  VkPresentIdKHR presentIdInfo{};
+  uint64_t presentId = 0;
+  if (presentWaitSupported) {
+    presentId = ++window->presentIdCounter;
+    presentIdInfo.sType = VK_STRUCTURE_TYPE_PRESENT_ID_KHR;
+    presentIdInfo.swapchainCount = 1;
+    presentIdInfo.pPresentIds = &presentId;
+    present.pNext = &presentIdInfo;
+  }
+
+  VkResult presRes = VK_SUCCESS;
+  {
+    VKLITE_TRACE_ZONE("queuePresent");
+    presRes = vk.vkQueuePresentKHR(graphicsQueue, &present);
+  }
+  if (presentWaitSupported && (presRes == VK_SUCCESS || presRes == VK_SUBOPTIMAL_KHR)) {
+    if (window->pendingPresents.size() >= kMaxPendingPresents) window->pendingPresents.erase(window->pendingPresents.begin());
+    window->pendingPresents.push_back({ presentId, frame.inputTime });
+  }
+  if (presRes == VK_ERROR_OUT_OF_DATE_KHR || presRes == VK_SUBOPTIMAL_KHR) {
+    window->swapchainOutOfDate = true;
+    window->dirty = true;
+  } else if (presRes != VK_SUCCESS) {
+    VKLITE_LOG_ERROR("vkQueuePresentKHR failed result=%d", static_cast<int>(presRes));
   }
 
-  // For debugging: wait for device idle and inspect the staging buffer's center pixel
-  if (stagingBuffer != VK_NULL_HANDLE && stagingMemory != VK_NULL_HANDLE && this->debugReadback) {
-    vkDeviceWaitIdle(device);
+  // For debugging: wait for this frame and inspect the staging buffer's center pixel
+  if (stagingBuffer != VK_NULL_HANDLE) {
+    const VkDeviceMemory stagingMemory = window->debugStagingMemory;
+    vk.vkWaitForFences(device, 1, &frame.inFlight, VK_TRUE, UINT64_MAX);
     void* data = nullptr;
-    vkMapMemory(device, stagingMemory, 0, VK_WHOLE_SIZE, 0, &data);
+    vk.vkMapMemory(device, stagingMemory, 0, VK_WHOLE_SIZE, 0, &data);
     if (data) {
-      uint32_t w = ri.renderArea.extent.width;
-      uint32_t h = ri.renderArea.extent.height;
+      uint32_t w = extent.width;
+      uint32_t h = extent.height;
       uint32_t cx = w / 2;
       uint32_t cy = h / 2;
       uint8_t* bytes = reinterpret_cast<uint8_t*>(data);
@@ -516,16 +1150,12 @@ void Context::renderWindow(Window* window) {
             a = bytes[idx + 3];
             break;
         }
-  std::cerr << "Swapchain center pixel (interpreted RGBA) = (" << (int)r << "," << (int)g << "," << (int)b << "," << (int)a << ")\n";
+        VKLITE_LOG_INFO("Swapchain center pixel (interpreted RGBA) = (%d,%d,%d,%d)", r, g, b, a);
       } else {
-        std::cerr << "Staging buffer too small for center pixel readback\n";
+        VKLITE_LOG_WARN("Staging buffer too small for center pixel readback");
       }
-      vkUnmapMemory(device, stagingMemory);
+      vk.vkUnmapMemory(device, stagingMemory);
     }
-    vkDestroyBuffer(device, stagingBuffer, nullptr);
-    vkFreeMemory(device, stagingMemory, nullptr);
-    stagingBuffer = VK_NULL_HANDLE;
-    stagingMemory = VK_NULL_HANDLE;
   }
 }
 